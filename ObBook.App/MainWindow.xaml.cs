@@ -3,6 +3,7 @@ using System;
 using System.Collections.Generic;
 using System.IO;
 using System.Linq;
+using System.Threading.Tasks;
 using System.Windows;
 using System.Windows.Controls;
 using System.Windows.Input;
@@ -13,14 +14,33 @@ namespace ObBook.App
 {
     public partial class MainWindow : Window
     {
+        private const int MaxListedDiagnostics = 500;
+        private const int PreviewWidth = 1000;
+        private const int PreviewHeight = 700;
+        private const double TreeThumbnailSize = 32;
+
         private readonly ObBook.Engine _engine = new ObBook.Engine();
         private Point _treeDragStart;
         private bool _isUpdatingSource;
+        private ulong _latestCompileSequence;
+        private ObBook.AssetIndexView _assets;
+        private string _assetDataDirectory;
+        // Generations on screen; unique across the engine's compilers, so both compile paths compare against them.
+        private ulong _shownDiagnosticsGeneration = ulong.MaxValue;
+        private ulong _shownAssetGeneration = ulong.MaxValue;
+        private static readonly object LazyPlaceholder = new object();
 
         public MainWindow()
         {
             InitializeComponent();
 
+            _engine.GroupAdjacentDiagnostics = true;
+            _engine.MaxCompletedDiagnostics = MaxListedDiagnostics;
+            _engine.CompileCompleted += Engine_CompileCompleted;
+            _engine.ThumbnailCacheFile = Path.Combine(
+                Environment.GetFolderPath(Environment.SpecialFolder.LocalApplicationData), "ObBook", "thumbnails.obt");
+            Closed += (s, e) => _engine.Dispose();
+
             TxtOblivionPath.Text =
                 Environment.GetEnvironmentVariable("OBLIVION_PATH")
                 ?? TryDetectOblivionPathFromRegistry()
@@ -34,7 +54,7 @@ namespace ObBook.App
                 "<BR>\r\n" +
                 "Use straight quotes and forward slashes.\r\n";
 
-            CompileAndRefresh(updateSource: false);
+            QueueCompile(rescanAssets: false);
         }
 
         private void BtnCompile_Click(object sender, RoutedEventArgs e)
@@ -67,7 +87,7 @@ namespace ObBook.App
                 if (dlg.ShowDialog() == System.Windows.Forms.DialogResult.OK)
                 {
                     TxtOblivionPath.Text = dlg.SelectedPath;
-                    CompileAndRefresh(updateSource: false);
+                    QueueCompile(rescanAssets: false);
                 }
             }
         }
@@ -82,18 +102,59 @@ namespace ObBook.App
             }
 
             TxtOblivionPath.Text = detected;
-            CompileAndRefresh(updateSource: false);
+            QueueCompile(rescanAssets: false);
         }
 
         private void BtnScanAssets_Click(object sender, RoutedEventArgs e)
         {
-            CompileAndRefresh(updateSource: false);
+            QueueCompile(rescanAssets: true);
+        }
+
+        // Compile and preview run on the engine's worker; only the latest submission is ever shown.
+        private void QueueCompile(bool rescanAssets)
+        {
+            try
+            {
+                _engine.SetOblivionDirectory(TxtOblivionPath.Text ?? "");
+                _latestCompileSequence = _engine.SubmitCompile(TxtSource.Text ?? "", PreviewWidth, PreviewHeight, 96f, rescanAssets);
+            }
+            catch
+            {
+                // keep typing responsive; compile button surfaces full errors.
+            }
+        }
+
+        private void Engine_CompileCompleted(object sender, ObBook.CompileCompletedEventArgs e)
+        {
+            Dispatcher.BeginInvoke(new Action(() =>
+            {
+                if (e.Sequence != _latestCompileSequence)
+                {
+                    // Superseded: release its native asset snapshot now rather than when the finalizer gets to it.
+                    e.Assets.Dispose();
+                    return;
+                }
+
+                if (e.DiagnosticsGeneration != _shownDiagnosticsGeneration)
+                {
+                    ShowDiagnostics(e.Summary, e.Diagnostics);
+                    _shownDiagnosticsGeneration = e.DiagnosticsGeneration;
+                }
+                // Keep the tree (and its expansion state) while typing; rebuild only when a rescan changed it.
+                if (e.AssetGeneration == _shownAssetGeneration && e.ResolvedDataDirectory == _assetDataDirectory) e.Assets.Dispose();
+                else RefreshAssetTree(e.ResolvedDataDirectory, e.Assets, e.AssetGeneration);
+                if (e.Preview != null) ImgPreview.Source = e.Preview;
+            }));
         }
 
         private void CompileAndRefresh(bool updateSource)
         {
             try
             {
+                // The synchronous result wins over anything still queued in the background.
+                _engine.CancelCompile();
+                _latestCompileSequence = 0;
+
                 _engine.SetOblivionDirectory(TxtOblivionPath.Text ?? "");
                 _engine.SetSourceText(TxtSource.Text ?? "");
                 _engine.Compile();
@@ -105,16 +166,19 @@ namespace ObBook.App
                     _isUpdatingSource = false;
                 }
 
-                LstDiags.Items.Clear();
-                var diags = _engine.GetDiagnostics();
-                foreach (var d in diags)
+                // Unchanged generations skip marshalling as well as the UI rebuild.
+                var diagnosticsGeneration = _engine.DiagnosticsGeneration;
+                if (diagnosticsGeneration != _shownDiagnosticsGeneration)
                 {
-                    LstDiags.Items.Add($"{d.SeverityLevel,-7} off={d.Offset} len={d.Length} :: {d.Message}");
+                    ShowDiagnostics(_engine.GetDiagnosticSummary(), _engine.GetDiagnostics(MaxListedDiagnostics));
+                    _shownDiagnosticsGeneration = diagnosticsGeneration;
                 }
+                var assetGeneration = _engine.AssetGeneration;
+                var dataDirectory = _engine.ResolvedDataDirectory;
+                if (assetGeneration != _shownAssetGeneration || dataDirectory != _assetDataDirectory)
+                    RefreshAssetTree(dataDirectory, _engine.GetAssetIndex(), assetGeneration);
 
-                RefreshAssetTree();
-
-                ImgPreview.Source = _engine.RenderPreviewPage(1000, 700, 96f);
+                ImgPreview.Source = _engine.RenderPreviewPage(PreviewWidth, PreviewHeight, 96f);
             }
             catch (Exception ex)
             {
@@ -122,63 +186,157 @@ namespace ObBook.App
             }
         }
 
-        private void RefreshAssetTree()
+        private void ShowDiagnostics(ObBook.DiagnosticSummary summary, List<ObBook.Diagnostic> diags)
+        {
+            LstDiags.Items.Clear();
+            LstDiags.Items.Add($"{summary.Total} diagnostics: {summary.Errors} errors, {summary.Warnings} warnings, {summary.Infos} info");
+            foreach (var d in diags)
+            {
+                var count = d.Count > 1 ? $" (x{d.Count})" : "";
+                LstDiags.Items.Add($"{d.SeverityLevel,-7} off={d.Offset} len={d.Length} :: {d.Message}{count}");
+            }
+        }
+
+        private void RefreshAssetTree(string resolvedDataDirectory, ObBook.AssetIndexView assets, ulong generation)
         {
             TreeAssets.Items.Clear();
+            _assets?.Dispose();
+            _assets = assets;
+            _assetDataDirectory = resolvedDataDirectory;
+            _shownAssetGeneration = generation;
 
             var rootPath = new TreeViewItem
             {
-                Header = string.IsNullOrWhiteSpace(_engine.ResolvedDataDirectory)
+                Header = string.IsNullOrWhiteSpace(resolvedDataDirectory)
                     ? "Data directory: (not resolved)"
-                    : $"Data directory: {_engine.ResolvedDataDirectory}",
+                    : $"Data directory: {resolvedDataDirectory}",
                 IsExpanded = true,
                 IsEnabled = false
             };
             TreeAssets.Items.Add(rootPath);
 
-            var fonts = (_engine.GetBookFontAssets() ?? new System.Collections.Generic.List<string>())
-                .Select(ExtractAssetPath)
-                .Where(s => !string.IsNullOrWhiteSpace(s))
-                .Distinct(StringComparer.OrdinalIgnoreCase)
-                .OrderBy(s => s, StringComparer.OrdinalIgnoreCase)
-                .ToList();
+            if (assets == null) return;
 
-            var textures = (_engine.GetBookTextureAssets() ?? new System.Collections.Generic.List<string>())
-                .Select(ExtractAssetPath)
-                .Where(s => !string.IsNullOrWhiteSpace(s))
-                .Distinct(StringComparer.OrdinalIgnoreCase)
-                .OrderBy(s => s, StringComparer.OrdinalIgnoreCase)
+            // Fancy-font glyph textures count as both fonts and textures, as in the compiler's summary.
+            var fontRoots = new[] { assets.Find("fonts"), assets.Find("textures/menus/book/fancy_font") }
+                .Where(e => e != null)
                 .ToList();
+            var fonts = new TreeViewItem
+            {
+                Header = $"Fonts ({fontRoots.Sum(e => e.EntryCount)})",
+                IsExpanded = true
+            };
+            foreach (var folder in fontRoots)
+                fonts.Items.Add(BuildAssetNode(folder, folder.Path));
+            TreeAssets.Items.Add(fonts);
 
-            TreeAssets.Items.Add(BuildCategoryNode("Fonts", fonts));
-            TreeAssets.Items.Add(BuildCategoryNode("Textures", textures));
+            var bookTextures = assets.Find("textures/menus/book");
+            var textures = new TreeViewItem
+            {
+                Header = $"Textures ({bookTextures?.EntryCount ?? 0})",
+                IsExpanded = true
+            };
+            if (bookTextures != null)
+            {
+                foreach (var child in assets.GetChildren(bookTextures.Path))
+                    textures.Items.Add(BuildAssetNode(child, child.Name));
+                AttachThumbnails(textures);
+            }
+            TreeAssets.Items.Add(textures);
         }
 
-        private TreeViewItem BuildCategoryNode(string name, List<string> paths)
+        // Folders get a placeholder child and load their real children from the index when first expanded.
+        private TreeViewItem BuildAssetNode(ObBook.AssetEntry entry, string label)
         {
-            var root = new TreeViewItem
+            var item = new TreeViewItem
             {
-                Header = $"{name} ({paths.Count})",
-                IsExpanded = true
+                Header = entry.HasChildren ? $"{label} ({entry.EntryCount})" : label,
+                Tag = entry.IsFile ? entry.Path : null,
+                ToolTip = entry.IsFile ? $"{entry.Path} [{entry.Source}]" : entry.Path
             };
 
-            foreach (var path in paths)
+            if (entry.HasChildren)
             {
-                root.Items.Add(new TreeViewItem
+                item.Items.Add(LazyPlaceholder);
+                var assets = _assets;
+                item.Expanded += (s, e) =>
                 {
-                    Header = path,
-                    Tag = path
-                });
+                    if (e.OriginalSource != item || item.Items.Count != 1 || item.Items[0] != LazyPlaceholder) return;
+                    item.Items.Clear();
+                    foreach (var child in assets.GetChildren(entry.Path))
+                        item.Items.Add(BuildAssetNode(child, child.Name));
+                    AttachThumbnails(item);
+                };
             }
 
-            return root;
+            return item;
         }
 
-        private static string ExtractAssetPath(string raw)
+        // Puts a thumbnail in front of every DDS and TGA file directly under folder, in one batch so the engine decodes the
+        // missing ones in parallel; later expansions are served from its cache file. Reading and decoding run on the thread
+        // pool, so a large folder never stalls the editor; the pictures are applied on the UI thread afterwards.
+        private void AttachThumbnails(TreeViewItem folder)
         {
-            if (string.IsNullOrWhiteSpace(raw)) return "";
-            var idx = raw.IndexOf(" [", StringComparison.Ordinal);
-            return idx > 0 ? raw.Substring(0, idx) : raw;
+            if (string.IsNullOrWhiteSpace(_assetDataDirectory)) return;
+            var files = folder.Items.OfType<TreeViewItem>()
+                .Where(i => i.Tag is string path
+                    && (path.EndsWith(".dds", StringComparison.OrdinalIgnoreCase) || path.EndsWith(".tga", StringComparison.OrdinalIgnoreCase)))
+                .ToList();
+            if (files.Count == 0) return;
+
+            var dataDirectory = _assetDataDirectory;
+            var generation = _shownAssetGeneration;
+            var paths = files.Select(i => (string)i.Tag).ToList();
+            Task.Run(() =>
+            {
+                List<ObBook.TextureThumbnail> thumbnails;
+                try
+                {
+                    thumbnails = _engine.GetTextureThumbnails(dataDirectory, paths);
+                }
+                catch (Exception)
+                {
+                    return; // the tree still works without pictures (also once the engine is disposed)
+                }
+                Dispatcher.BeginInvoke(new Action(() => ApplyThumbnails(files, thumbnails, dataDirectory, generation)));
+            });
+        }
+
+        private void ApplyThumbnails(List<TreeViewItem> files, List<ObBook.TextureThumbnail> thumbnails, string dataDirectory, ulong generation)
+        {
+            // The tree may have been rebuilt for another scan while the batch was decoding.
+            if (generation != _shownAssetGeneration || dataDirectory != _assetDataDirectory) return;
+
+            for (int i = 0; i < files.Count && i < thumbnails.Count; ++i)
+            {
+                var image = thumbnails[i].Image;
+                var item = files[i];
+                if (image == null || !(item.Header is string label) || !IsInAssetTree(item)) continue;
+                var header = new StackPanel { Orientation = Orientation.Horizontal };
+                header.Children.Add(new Image
+                {
+                    Source = image,
+                    Width = TreeThumbnailSize,
+                    Height = TreeThumbnailSize,
+                    Stretch = System.Windows.Media.Stretch.Uniform,
+                    Margin = new Thickness(0, 1, 6, 1)
+                });
+                header.Children.Add(new TextBlock { Text = label, VerticalAlignment = VerticalAlignment.Center });
+                item.Header = header;
+
+                var tip = new StackPanel();
+                tip.Children.Add(new Image { Source = image, Stretch = System.Windows.Media.Stretch.None });
+                tip.Children.Add(new TextBlock { Text = item.ToolTip as string });
+                item.ToolTip = tip;
+            }
+        }
+
+        // Items are added directly, so their logical parents lead up to TreeAssets until the tree is cleared.
+        private bool IsInAssetTree(TreeViewItem item)
+        {
+            for (var node = item as FrameworkElement; node != null; node = node.Parent as FrameworkElement)
+                if (node == TreeAssets) return true;
+            return false;
         }
 
         private static string TryDetectOblivionPathFromRegistry()
@@ -253,18 +411,7 @@ namespace ObBook.App
         private void TxtSource_TextChanged(object sender, TextChangedEventArgs e)
         {
             if (_isUpdatingSource) return;
-
-            try
-            {
-                _engine.SetOblivionDirectory(TxtOblivionPath.Text ?? "");
-                _engine.SetSourceText(TxtSource.Text ?? "");
-                _engine.Compile();
-                ImgPreview.Source = _engine.RenderPreviewPage(1000, 700, 96f);
-            }
-            catch
-            {
-                // keep typing responsive; compile button surfaces full errors.
-            }
+            QueueCompile(rescanAssets: false);
         }
 
         private void TxtSource_Drop(object sender, System.Windows.DragEventArgs e)
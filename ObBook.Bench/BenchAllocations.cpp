@@ -0,0 +1,36 @@
+#include "BenchAllocations.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<bool> g_counting{ false };
+    std::atomic<uint64_t> g_allocations{ 0 };
+}
+
+// Own translation unit, so no caller sees malloc/free behind these when inlining.
+void* operator new(size_t size)
+{
+    if (g_counting.load(std::memory_order_relaxed)) g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace obbench
+{
+    void BeginCountingAllocations()
+    {
+        g_allocations.store(0, std::memory_order_relaxed);
+        g_counting.store(true, std::memory_order_relaxed);
+    }
+
+    uint64_t EndCountingAllocations()
+    {
+        g_counting.store(false, std::memory_order_relaxed);
+        return g_allocations.load(std::memory_order_relaxed);
+    }
+}
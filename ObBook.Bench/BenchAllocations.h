@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+
+namespace obbench
+{
+    // The bench replaces global operator new/delete so a code path's heap allocations can be counted. Counting
+    // is off outside these calls; otherwise an allocation costs one extra relaxed load.
+    void BeginCountingAllocations();
+    // Allocations since BeginCountingAllocations(), on any thread (callers keep other threads idle).
+    uint64_t EndCountingAllocations();
+
+    template <typename Fn>
+    uint64_t CountAllocations(Fn&& fn)
+    {
+        BeginCountingAllocations();
+        fn();
+        return EndCountingAllocations();
+    }
+}
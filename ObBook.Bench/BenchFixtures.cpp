@@ -0,0 +1,550 @@
+#include "BenchFixtures.h"
+#include "../ObBook.Core/ObBookAssets.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+
+namespace fs = std::filesystem;
+
+namespace obbench
+{
+    namespace
+    {
+        struct Rng
+        {
+            uint32_t state;
+            explicit Rng(uint32_t seed) : state(seed ? seed : 0x9E3779B9u) {}
+            uint32_t Next()
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                return state;
+            }
+            uint32_t Below(uint32_t n) { return n ? Next() % n : 0; }
+        };
+
+        const char* const kWords[] =
+        {
+            "the", "emperor", "of", "tamriel", "and", "his", "heirs", "were", "slain", "in", "one", "night",
+            "by", "assassins", "mythic", "dawn", "gates", "oblivion", "opened", "across", "cyrodiil", "while",
+            "the", "elder", "council", "argued", "over", "the", "amulet", "of", "kings", "daedric", "prince",
+            "mehrunes", "dagon", "sought", "to", "claim", "mundus", "as", "his", "own", "realm", "forever",
+        };
+
+        void AppendWords(std::string& out, Rng& rng, uint32_t count)
+        {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                if (i) out.push_back(' ');
+                out += kWords[rng.Below(static_cast<uint32_t>(sizeof(kWords) / sizeof(kWords[0])))];
+            }
+        }
+
+        void Put32(std::vector<uint8_t>& b, uint32_t v)
+        {
+            for (int i = 0; i < 4; ++i) b.push_back(static_cast<uint8_t>(v >> (8 * i)));
+        }
+
+        void Put64(std::vector<uint8_t>& b, uint64_t v)
+        {
+            for (int i = 0; i < 8; ++i) b.push_back(static_cast<uint8_t>(v >> (8 * i)));
+        }
+
+        void Set32(std::vector<uint8_t>& b, size_t at, uint32_t v)
+        {
+            for (int i = 0; i < 4; ++i) b[at + i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+
+        bool WriteFile(const fs::path& path, const void* data, size_t size)
+        {
+            std::error_code ec;
+            fs::create_directories(path.parent_path(), ec);
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            if (!out) return false;
+            out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            return static_cast<bool>(out);
+        }
+    }
+
+    std::string GenerateBookSource(CorpusKind kind, size_t targetBytes, uint32_t seed)
+    {
+        Rng rng(seed);
+        std::string out;
+        out.reserve(targetBytes + 256);
+        out += "<FONT face=1>\r\n<DIV align=\"center\">SYNTHETIC VOLUME</DIV>\r\n<BR>\r\n";
+
+        uint32_t paragraph = 0;
+        while (out.size() < targetBytes)
+        {
+            switch (kind)
+            {
+            case CorpusKind::Ascii:
+                out += "<DIV align=\"left\">";
+                AppendWords(out, rng, 40 + rng.Below(40));
+                out += ".</DIV>\r\n<BR>\r\n";
+                break;
+
+            case CorpusKind::Quotes:
+                // U+201C/U+201D around dialogue and U+2019 inside contractions, as pasted from a word processor.
+                out += "\xE2\x80\x9C";
+                AppendWords(out, rng, 6 + rng.Below(10));
+                out += ",\xE2\x80\x9D he said. \xE2\x80\x98";
+                AppendWords(out, rng, 2 + rng.Below(4));
+                out += "\xE2\x80\x99 isn\xE2\x80\x99t ";
+                AppendWords(out, rng, 4 + rng.Below(8));
+                out += ".<BR>\r\n";
+                break;
+
+            case CorpusKind::Images:
+            {
+                const uint32_t w = 32 + rng.Below(520);
+                const uint32_t h = 32 + rng.Below(256);
+                out += "<IMG src=\"Book\\Illuminated\\letter_";
+                out += std::to_string(paragraph % 26);
+                out += ".dds\" width=";
+                out += std::to_string(w);
+                out += " height=";
+                out += std::to_string(h);
+                out += ">";
+                AppendWords(out, rng, 8 + rng.Below(12));
+                out += "<BR>\r\n";
+                break;
+            }
+            }
+            ++paragraph;
+        }
+        return out;
+    }
+
+    const DdsLayout& GetDdsLayout(DdsKind kind)
+    {
+        enum : uint32_t { DDPF_ALPHAPIXELS = 0x1, DDPF_FOURCC = 0x4, DDPF_RGB = 0x40, DDPF_LUMINANCE = 0x20000 };
+        static const DdsLayout kLayouts[] =
+        {
+            { "dxt1", 0x31545844u, DDPF_FOURCC, 0, {}, 8 },
+            { "dxt5", 0x35545844u, DDPF_FOURCC, 0, {}, 16 },
+            { "argb32", 0, DDPF_RGB | DDPF_ALPHAPIXELS, 32, { 0x00FF0000u, 0x0000FF00u, 0x000000FFu, 0xFF000000u }, 0 },
+            { "dxt3", 0x33545844u, DDPF_FOURCC, 0, {}, 16 },
+            { "xrgb32", 0, DDPF_RGB, 32, { 0x00FF0000u, 0x0000FF00u, 0x000000FFu, 0 }, 0 },
+            { "abgr32", 0, DDPF_RGB | DDPF_ALPHAPIXELS, 32, { 0x000000FFu, 0x0000FF00u, 0x00FF0000u, 0xFF000000u }, 0 },
+            { "xbgr32", 0, DDPF_RGB, 32, { 0x000000FFu, 0x0000FF00u, 0x00FF0000u, 0 }, 0 },
+            { "rgb24", 0, DDPF_RGB, 24, { 0x00FF0000u, 0x0000FF00u, 0x000000FFu, 0 }, 0 },
+            { "r5g6b5", 0, DDPF_RGB, 16, { 0xF800u, 0x07E0u, 0x001Fu, 0 }, 0 },
+            { "a1r5g5b5", 0, DDPF_RGB | DDPF_ALPHAPIXELS, 16, { 0x7C00u, 0x03E0u, 0x001Fu, 0x8000u }, 0 },
+            { "x1r5g5b5", 0, DDPF_RGB, 16, { 0x7C00u, 0x03E0u, 0x001Fu, 0 }, 0 },
+            { "a4r4g4b4", 0, DDPF_RGB | DDPF_ALPHAPIXELS, 16, { 0x0F00u, 0x00F0u, 0x000Fu, 0xF000u }, 0 },
+            { "l8", 0, DDPF_LUMINANCE, 8, { 0xFFu, 0, 0, 0 }, 0 },
+            { "a8l8", 0, DDPF_LUMINANCE | DDPF_ALPHAPIXELS, 16, { 0x00FFu, 0, 0, 0xFF00u }, 0 },
+        };
+        static_assert(std::size(kLayouts) == static_cast<size_t>(DdsKind::Count));
+        return kLayouts[static_cast<size_t>(kind)];
+    }
+
+    std::vector<uint8_t> GenerateDds(DdsKind kind, uint32_t width, uint32_t height, uint32_t seed, uint32_t mipCount)
+    {
+        enum : uint32_t
+        {
+            DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PITCH = 0x8, DDSD_PIXELFORMAT = 0x1000,
+            DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000,
+            DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000,
+        };
+
+        const DdsLayout& layout = GetDdsLayout(kind);
+        const uint32_t fourCC = layout.fourCC;
+        auto levelBytes = [&layout](uint32_t w, uint32_t h)
+        {
+            if (layout.blockBytes) return static_cast<size_t>((w + 3) / 4) * ((h + 3) / 4) * layout.blockBytes;
+            return static_cast<size_t>(w) * h * (layout.bits / 8);
+        };
+        mipCount = std::max(1u, mipCount);
+        const size_t topBytes = levelBytes(width, height);
+        size_t payload = 0;
+        for (uint32_t level = 0, w = width, h = height; level < mipCount; ++level, w = std::max(1u, w >> 1), h = std::max(1u, h >> 1))
+            payload += levelBytes(w, h);
+
+        std::vector<uint8_t> b;
+        b.reserve(128 + payload);
+        b.insert(b.end(), { 'D', 'D', 'S', ' ' });
+        Put32(b, 124);
+        Put32(b, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | (fourCC ? DDSD_LINEARSIZE : DDSD_PITCH)
+            | (mipCount > 1 ? DDSD_MIPMAPCOUNT : 0u));
+        Put32(b, height);
+        Put32(b, width);
+        Put32(b, static_cast<uint32_t>(fourCC ? topBytes : static_cast<size_t>(width) * (layout.bits / 8)));
+        Put32(b, 0);                               // depth
+        Put32(b, mipCount);
+        for (int i = 0; i < 11; ++i) Put32(b, 0);  // reserved
+        Put32(b, 32);                              // pixel format size
+        Put32(b, layout.pfFlags);
+        Put32(b, fourCC);
+        Put32(b, layout.bits);
+        for (uint32_t mask : layout.masks) Put32(b, mask);
+        Put32(b, DDSCAPS_TEXTURE | (mipCount > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0u));
+        for (int i = 0; i < 4; ++i) Put32(b, 0);   // caps2..4, reserved2
+
+        Rng rng(seed);
+        for (size_t i = 0; i < payload; i += 4)
+        {
+            const uint32_t v = rng.Next();
+            for (size_t k = 0; k < 4 && i + k < payload; ++k) b.push_back(static_cast<uint8_t>(v >> (8 * k)));
+        }
+        return b;
+    }
+
+    std::vector<uint8_t> GenerateTgaImage(uint32_t width, uint32_t height, uint32_t seed)
+    {
+        Rng rng(seed);
+        std::vector<uint8_t> bgra(static_cast<size_t>(width) * height * 4);
+        uint32_t color = rng.Next();
+        for (size_t i = 0, left = 0; i < bgra.size(); i += 4)
+        {
+            // Stretches of one color (up to a few hundred pixels, so some exceed a packet) between noisy ones.
+            if (left == 0)
+            {
+                left = 1 + rng.Below(300);
+                color = rng.Below(3) == 0 ? 0 : rng.Next();
+            }
+            const uint32_t v = color ? color : rng.Next();
+            for (int k = 0; k < 4; ++k) bgra[i + k] = static_cast<uint8_t>(v >> (8 * k));
+            --left;
+        }
+        return bgra;
+    }
+
+    std::vector<uint8_t> EncodeTga(const std::vector<uint8_t>& bgra, uint32_t width, uint32_t height, const TgaLayout& layout)
+    {
+        const uint32_t bytes = layout.bits / 8;
+        std::vector<uint8_t> b;
+        b.reserve(18 + 4 + bgra.size() + bgra.size() / 64);
+        b.push_back(4); // image ID length
+        b.push_back(0);
+        b.push_back(static_cast<uint8_t>((layout.grayscale ? 3 : 2) + (layout.rle ? 8 : 0)));
+        for (int i = 0; i < 5; ++i) b.push_back(0); // color map spec
+        for (int i = 0; i < 4; ++i) b.push_back(0); // x, y origin
+        b.push_back(static_cast<uint8_t>(width)); b.push_back(static_cast<uint8_t>(width >> 8));
+        b.push_back(static_cast<uint8_t>(height)); b.push_back(static_cast<uint8_t>(height >> 8));
+        b.push_back(static_cast<uint8_t>(layout.bits));
+        const uint32_t alphaBits = layout.bits == 32 || layout.bits == 16 ? 8 : 0;
+        b.push_back(static_cast<uint8_t>(alphaBits | (layout.rightToLeft ? 0x10 : 0) | (layout.topDown ? 0x20 : 0)));
+        b.insert(b.end(), { 'o', 'b', 'b', 'k' });
+
+        // Pixels in file order, already in their stored form.
+        std::vector<uint8_t> pixels;
+        pixels.reserve(static_cast<size_t>(width) * height * bytes);
+        for (uint32_t fy = 0; fy < height; ++fy)
+            for (uint32_t fx = 0; fx < width; ++fx)
+            {
+                const uint32_t y = layout.topDown ? fy : height - 1 - fy;
+                const uint32_t x = layout.rightToLeft ? width - 1 - fx : fx;
+                const uint8_t* p = &bgra[(static_cast<size_t>(y) * width + x) * 4];
+                if (layout.grayscale)
+                {
+                    pixels.push_back(p[1]);
+                    if (bytes == 2) pixels.push_back(p[3]);
+                }
+                else
+                {
+                    pixels.insert(pixels.end(), p, p + bytes);
+                }
+            }
+        if (!layout.rle)
+        {
+            b.insert(b.end(), pixels.begin(), pixels.end());
+            return b;
+        }
+
+        // Runs of 3 or more equal pixels become run packets; packets run on across row ends.
+        const size_t count = pixels.size() / bytes;
+        auto same = [&](size_t i, size_t j) { return std::memcmp(&pixels[i * bytes], &pixels[j * bytes], bytes) == 0; };
+        for (size_t i = 0; i < count;)
+        {
+            size_t run = 1;
+            while (i + run < count && run < 128 && same(i, i + run)) ++run;
+            if (run >= 3)
+            {
+                b.push_back(static_cast<uint8_t>(0x80 | (run - 1)));
+                b.insert(b.end(), pixels.begin() + i * bytes, pixels.begin() + (i + 1) * bytes);
+                i += run;
+                continue;
+            }
+            size_t raw = 0;
+            while (i + raw < count && raw < 128 && !(i + raw + 2 < count && same(i + raw, i + raw + 1) && same(i + raw, i + raw + 2))) ++raw;
+            raw = std::max<size_t>(raw, 1);
+            b.push_back(static_cast<uint8_t>(raw - 1));
+            b.insert(b.end(), pixels.begin() + i * bytes, pixels.begin() + (i + raw) * bytes);
+            i += raw;
+        }
+        return b;
+    }
+
+    bool WriteSyntheticBsa(const fs::path& path, uint32_t version, const std::vector<SyntheticFile>& files)
+    {
+        // Folder records sorted by folder hash and file records by file hash within each folder, as the game
+        // expects; the name blocks follow the same order.
+        struct PendingFile { uint64_t hash; std::string name; const std::vector<uint8_t>* bytes; };
+        struct PendingFolder { uint64_t hash; std::string name; std::vector<PendingFile> files; };
+        std::map<std::string, std::vector<PendingFile>> byName;
+        for (const auto& f : files)
+        {
+            const auto slash = f.virtualPath.find_last_of('/');
+            std::string folder = slash == std::string::npos ? std::string() : f.virtualPath.substr(0, slash);
+            std::replace(folder.begin(), folder.end(), '/', '\\');
+            std::string name = f.virtualPath.substr(slash == std::string::npos ? 0 : slash + 1);
+            const uint64_t hash = obbook::HashBsaFileName(name);
+            byName[folder].push_back({ hash, std::move(name), &f.bytes });
+        }
+
+        std::vector<PendingFolder> folders;
+        folders.reserve(byName.size());
+        for (auto& [name, list] : byName)
+        {
+            std::sort(list.begin(), list.end(), [](const PendingFile& a, const PendingFile& b) { return a.hash < b.hash; });
+            folders.push_back({ obbook::HashBsaFolder(name), name, std::move(list) });
+        }
+        std::sort(folders.begin(), folders.end(), [](const PendingFolder& a, const PendingFolder& b) { return a.hash < b.hash; });
+
+        uint32_t totalFolderNameLength = 0;
+        uint32_t totalFileNameLength = 0;
+        for (const auto& folder : folders)
+        {
+            if (folder.name.size() + 1 > 255) return false;
+            totalFolderNameLength += static_cast<uint32_t>(folder.name.size() + 1);
+            for (const auto& f : folder.files) totalFileNameLength += static_cast<uint32_t>(f.name.size() + 1);
+        }
+
+        constexpr uint32_t kHeaderSize = 36;
+        constexpr uint32_t kRecordSize = 16;
+        const uint32_t folderCount = static_cast<uint32_t>(folders.size());
+        const uint32_t fileCount = static_cast<uint32_t>(files.size());
+
+        std::vector<uint8_t> b;
+        b.insert(b.end(), { 'B', 'S', 'A', '\0' });
+        Put32(b, version);
+        Put32(b, kHeaderSize);
+        Put32(b, 0x1u | 0x2u);   // folder names + file names
+        Put32(b, folderCount);
+        Put32(b, fileCount);
+        Put32(b, totalFolderNameLength);
+        Put32(b, totalFileNameLength);
+        Put32(b, 0x2u);          // content: textures
+
+        const size_t folderRecordsAt = b.size();
+        b.resize(b.size() + static_cast<size_t>(folderCount) * kRecordSize);
+
+        std::vector<size_t> fileRecordAt;
+        fileRecordAt.reserve(fileCount);
+        size_t folderIndex = 0;
+        for (const auto& folder : folders)
+        {
+            const size_t rec = folderRecordsAt + folderIndex * kRecordSize;
+            const uint32_t blockOffset = static_cast<uint32_t>(b.size()) + totalFileNameLength;
+            for (int i = 0; i < 8; ++i) b[rec + i] = static_cast<uint8_t>(folder.hash >> (8 * i));
+            Set32(b, rec + 8, static_cast<uint32_t>(folder.files.size()));
+            Set32(b, rec + 12, blockOffset);
+
+            b.push_back(static_cast<uint8_t>(folder.name.size() + 1));
+            b.insert(b.end(), folder.name.begin(), folder.name.end());
+            b.push_back(0);
+            for (const auto& f : folder.files)
+            {
+                fileRecordAt.push_back(b.size());
+                Put64(b, f.hash);
+                Put32(b, static_cast<uint32_t>(f.bytes->size()));
+                Put32(b, 0);   // data offset, patched below
+            }
+            ++folderIndex;
+        }
+
+        for (const auto& folder : folders)
+        {
+            for (const auto& f : folder.files)
+            {
+                b.insert(b.end(), f.name.begin(), f.name.end());
+                b.push_back(0);
+            }
+        }
+
+        size_t fileIndex = 0;
+        for (const auto& folder : folders)
+        {
+            for (const auto& f : folder.files)
+            {
+                Set32(b, fileRecordAt[fileIndex++] + 12, static_cast<uint32_t>(b.size()));
+                b.insert(b.end(), f.bytes->begin(), f.bytes->end());
+            }
+        }
+
+        return WriteFile(path, b.data(), b.size());
+    }
+
+    obbook::GlyphAtlas MakeBoxGlyphAtlas()
+    {
+        obbook::GlyphAtlas atlas;
+        atlas.cellWidth = 12;
+        atlas.cellHeight = 22;
+        atlas.originX = 1;
+        atlas.lineHeight = 26;
+        atlas.coverage.assign(static_cast<size_t>(atlas.cellWidth) * atlas.cellHeight * 256, 0);
+        for (uint32_t c = 0x20; c < 256; ++c)
+        {
+            atlas.advance[c] = c == ' ' ? 6 : 11;
+            if (c == ' ') continue;
+            uint8_t* cell = atlas.coverage.data() + static_cast<size_t>(c) * atlas.cellWidth * atlas.cellHeight;
+            for (uint32_t y = 6; y < 20; ++y)
+                for (uint32_t x = 2; x < 10; ++x) cell[y * atlas.cellWidth + x] = static_cast<uint8_t>(96 + (c * 7 + x * 13 + y) % 160);
+        }
+        return atlas;
+    }
+
+    std::vector<std::string> GenerateBookAssetPaths(uint32_t count, uint32_t seed)
+    {
+        Rng rng(seed);
+        std::vector<std::string> paths;
+        paths.reserve(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const uint32_t set = (i / 512) % 97;
+            if ((i & 15) == 0)
+                paths.push_back("textures/menus/book/fancy_font/set" + std::to_string(set) + "/glyph_" + std::to_string(i) + ".dds");
+            else
+                paths.push_back("textures/menus/book/set" + std::to_string(set) + "/chapter" + std::to_string(rng.Below(8))
+                    + "/page_" + std::to_string(i) + ".dds");
+        }
+        return paths;
+    }
+
+    fs::path GenerateDataFolder(const fs::path& root, const DataFolderSpec& spec)
+    {
+        const fs::path data = root / "Data";
+        std::error_code ec;
+        fs::remove_all(data, ec);
+        fs::create_directories(data, ec);
+
+        Rng rng(0xB00Cu);
+        const auto bookDds = GenerateDds(DdsKind::Dxt1, 64, 64, 7);
+        const std::vector<uint8_t> stub(16, 0xAB);
+
+        for (uint32_t i = 0; i < spec.looseBookTextures; ++i)
+        {
+            const auto p = data / "Textures" / "menus" / "book" / ("loose_" + std::to_string(i) + ".dds");
+            WriteFile(p, bookDds.data(), bookDds.size());
+        }
+        for (uint32_t i = 0; i < spec.looseOtherTextures; ++i)
+        {
+            const auto p = data / "Textures" / ("Armor" + std::to_string(i % 40)) / ("Piece_" + std::to_string(i) + ".dds");
+            WriteFile(p, stub.data(), stub.size());
+        }
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            const auto p = data / "Fonts" / ("Font_" + std::to_string(i) + ".fnt");
+            WriteFile(p, stub.data(), stub.size());
+        }
+
+        for (uint32_t a = 0; a < spec.bsaCount; ++a)
+        {
+            std::vector<SyntheticFile> files;
+            files.reserve(spec.bsaFileCount);
+            const uint32_t bookThreshold = static_cast<uint32_t>(spec.bookFraction * 1000000.0);
+            for (uint32_t i = 0; i < spec.bsaFileCount; ++i)
+            {
+                SyntheticFile f;
+                if (rng.Below(1000000) < bookThreshold)
+                {
+                    f.virtualPath = "textures/menus/book/set" + std::to_string(i % 16) + "/page_" + std::to_string(a) + "_" + std::to_string(i) + ".dds";
+                    f.bytes = bookDds;
+                }
+                else if ((i & 7) == 0)
+                {
+                    f.virtualPath = "meshes/clutter/set" + std::to_string(i % 64) + "/item_" + std::to_string(i) + ".nif";
+                    f.bytes = stub;
+                }
+                else
+                {
+                    f.virtualPath = "textures/architecture/set" + std::to_string(i % 128) + "/wall_" + std::to_string(i) + ".dds";
+                    f.bytes = stub;
+                }
+                files.push_back(std::move(f));
+            }
+            // The IMG corpus references book/illuminated/letter_0..25; the first archive carries them.
+            for (uint32_t i = 0; a == 0 && i < 26; ++i)
+                files.push_back({ "textures/menus/book/illuminated/letter_" + std::to_string(i) + ".dds", bookDds });
+            const uint32_t version = (a % 2 == 0) ? 103u : 104u;
+            WriteSyntheticBsa(data / ("Bench" + std::to_string(a) + ".bsa"), version, files);
+        }
+        return data;
+    }
+
+    std::vector<std::string> GenerateThumbnailFolder(const fs::path& root)
+    {
+        const fs::path data = root / "Data";
+        std::error_code ec;
+        fs::remove_all(data, ec);
+        fs::create_directories(data, ec);
+
+        std::vector<std::string> paths;
+        const std::vector<uint8_t> notDds(256, 0x5A);
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            paths.push_back("textures/menus/book/gallery/broken_" + std::to_string(i) + ".dds");
+            WriteFile(data / fs::path(paths.back()), notDds.data(), notDds.size());
+        }
+        for (uint32_t i = 0; i < 14; ++i)
+        {
+            const auto dds = GenerateDds(DdsKind::Argb32, 300, 200, 100 + i);
+            paths.push_back("textures/menus/book/gallery/plate_" + std::to_string(i) + ".dds");
+            WriteFile(data / fs::path(paths.back()), dds.data(), dds.size());
+        }
+        for (uint32_t i = 0; i < 192; ++i)
+        {
+            const auto dds = GenerateDds(DdsKind::Dxt1, 256, 256, 200 + i, 9);
+            paths.push_back("textures/menus/book/gallery/page_" + std::to_string(i) + ".dds");
+            WriteFile(data / fs::path(paths.back()), dds.data(), dds.size());
+        }
+
+        std::vector<SyntheticFile> files;
+        for (uint32_t i = 0; i < 112; ++i)
+        {
+            files.push_back({ "textures/menus/book/illuminated/plate_" + std::to_string(i) + ".dds",
+                GenerateDds(DdsKind::Dxt5, 128, 128, 400 + i, 8) });
+            paths.push_back(files.back().virtualPath);
+        }
+        WriteSyntheticBsa(data / "Thumbnails.bsa", 103, files);
+        return paths;
+    }
+
+    fs::path GenerateLooseTree(const fs::path& root, uint32_t fileCount)
+    {
+        const fs::path data = root / "Data";
+        const fs::path marker = root / "tree_files.txt";
+        {
+            std::ifstream in(marker);
+            uint32_t existing = 0;
+            if (in >> existing && existing == fileCount) return data;
+        }
+        std::error_code ec;
+        fs::remove(marker, ec);
+        fs::remove_all(data, ec);
+
+        static const char* const kCategories[] = { "Armor", "Clothes", "Weapons", "Landscape", "Architecture",
+            "Effects", "Characters", "Creatures", "Clutter", "Menus" };
+        auto addFiles = [&](const fs::path& top, const char* extension, uint32_t count)
+        {
+            for (uint32_t i = 0; i < count; i += 100)
+            {
+                const uint32_t leaf = i / 100;
+                const fs::path folder = top / ("Mod" + std::to_string(leaf / 100)) / kCategories[(leaf / 10) % 10] / ("Sub" + std::to_string(leaf % 10));
+                fs::create_directories(folder, ec);
+                for (uint32_t f = i; f < std::min(count, i + 100); ++f)
+                    std::ofstream(folder / ("File_" + std::to_string(f) + extension), std::ios::binary);
+            }
+        };
+        addFiles(data / "Textures", ".dds", fileCount);
+        addFiles(data / "Meshes", ".nif", fileCount / 10);
+
+        std::ofstream(marker) << fileCount;
+        return data;
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "../ObBook.Core/ObBookPages.h"
+
+namespace obbench
+{
+    enum class CorpusKind : uint8_t { Ascii=0, Quotes=1, Images=2 };
+
+    struct SyntheticFile
+    {
+        std::string virtualPath; // "textures/menus/book/a.dds"; folder and file name are split on the last '/'
+        std::vector<uint8_t> bytes;
+    };
+
+    enum class DdsKind : uint8_t
+    {
+        Dxt1=0, Dxt5=1, Argb32=2, Dxt3=3, Xrgb32=4, Abgr32=5, Xbgr32=6, Rgb24=7, R5G6B5=8, A1R5G5B5=9, X1R5G5B5=10,
+        A4R4G4B4=11, L8=12, A8L8=13, Count
+    };
+
+    // How a DdsKind is stored: a FourCC block format (blockBytes per 4x4 block) or a mask format (bits per pixel).
+    struct DdsLayout
+    {
+        const char* name;   // "dxt1", "r5g6b5"
+        uint32_t fourCC;
+        uint32_t pfFlags;
+        uint32_t bits;
+        uint32_t masks[4];  // r, g, b, a
+        uint32_t blockBytes;
+    };
+
+    const DdsLayout& GetDdsLayout(DdsKind kind);
+
+    // Deterministic book markup of roughly targetBytes, shaped like the named corpus.
+    std::string GenerateBookSource(CorpusKind kind, size_t targetBytes, uint32_t seed = 1);
+
+    // A DDS with pseudo-random block data, readable by obbook::DecodeDdsToBgra; mipCount levels, each half the
+    // size of the one before.
+    std::vector<uint8_t> GenerateDds(DdsKind kind, uint32_t width, uint32_t height, uint32_t seed = 1, uint32_t mipCount = 1);
+
+    struct TgaLayout
+    {
+        uint32_t bits = 32;      // 24/32 true-color, 8/16 grayscale
+        bool grayscale = false;
+        bool rle = false;
+        bool topDown = false;
+        bool rightToLeft = false;
+    };
+
+    // Top-down BGRA pixels alternating stretches of one color with noise, so RLE files mix run and raw packets.
+    std::vector<uint8_t> GenerateTgaImage(uint32_t width, uint32_t height, uint32_t seed = 1);
+
+    // The image as a TGA of the given layout. Grayscale stores the green channel; layouts without alpha drop it.
+    std::vector<uint8_t> EncodeTga(const std::vector<uint8_t>& bgra, uint32_t width, uint32_t height, const TgaLayout& layout);
+
+    // Writes an uncompressed BSA (version 103 or 104) with folder and file names embedded.
+    bool WriteSyntheticBsa(const std::filesystem::path& path, uint32_t version, const std::vector<SyntheticFile>& files);
+
+    struct DataFolderSpec
+    {
+        uint32_t bsaFileCount = 20000;   // entries per archive
+        uint32_t bsaCount = 2;           // alternates v103 / v104
+        uint32_t looseBookTextures = 200;
+        uint32_t looseOtherTextures = 2000;
+        double bookFraction = 0.05;      // share of archive entries under textures/menus/book/
+    };
+
+    // count normalized book-asset paths in archive-like (folder-grouped) order, as ReadBsaPaths would return
+    // them for one large archive. Paths are unique.
+    std::vector<std::string> GenerateBookAssetPaths(uint32_t count, uint32_t seed = 1);
+
+    // Filled-box glyphs with fixed advances, so pagination and page composition can be measured without a
+    // platform font rasterizer.
+    obbook::GlyphAtlas MakeBoxGlyphAtlas();
+
+    // Populates root/Data with loose textures and fonts plus synthetic archives. Returns the Data path.
+    std::filesystem::path GenerateDataFolder(const std::filesystem::path& root, const DataFolderSpec& spec);
+
+    // Populates root/Data with book textures for the thumbnail cache: mip-chained DXT1 loose files, mip-chained
+    // DXT5 in an archive, single-mip A8R8G8B8 plates that need downscaling and two files that are not DDS.
+    // Returns their virtual paths, the broken ones first.
+    std::vector<std::string> GenerateThumbnailFolder(const std::filesystem::path& root);
+
+    // Populates root/Data with fileCount empty loose files shaped like a heavily modded install: mixed-case
+    // Textures/ModNN/Category/Sub folders of 100 files each, plus a Meshes tree of a tenth the size. Kept when
+    // root already holds a tree of that size, since a large one takes a while to create. Returns the Data path.
+    std::filesystem::path GenerateLooseTree(const std::filesystem::path& root, uint32_t fileCount);
+}
@@ -0,0 +1,2699 @@
+// ObBook.Bench: offline benchmarks for the compiler, asset discovery, BSA reading, DDS and TGA decoding, page layout,
+// PNG export, golden-page diffing and preview rendering. Fixtures (book sources, BSA v103/v104 archives, DDS textures) are generated on
+// the fly, so the suite needs no game install. The native parts are portable; on Linux build it with e.g.
+//   g++ -std=c++20 -O2 -pthread -IObBook.Core ObBook.Core/*.cpp ObBook.Bench/*.cpp -o obbook-bench
+// Preview rendering uses GDI and is only measured on Windows.
+//
+// Usage: ObBook.Bench [--out results.json] [--fixtures dir] [--bsa-files N] [--source-kb N]
+//                     [--index-entries N] [--walk-files N] [--min-time-ms N] [--filter substring] [--trace trace.json]
+
+#include "BenchAllocations.h"
+#include "BenchFixtures.h"
+#include "../ObBook.Core/ObBookAssetIndex.h"
+#include "../ObBook.Core/ObBookAssets.h"
+#include "../ObBook.Core/ObBookCompileCache.h"
+#include "../ObBook.Core/ObBookCompileService.h"
+#include "../ObBook.Core/ObBookCore.h"
+#include "../ObBook.Core/ObBookGolden.h"
+#include "../ObBook.Core/ObBookImageDiff.h"
+#include "../ObBook.Core/ObBookLooseWalk.h"
+#include "../ObBook.Core/ObBookMemory.h"
+#include "../ObBook.Core/ObBookPages.h"
+#include "../ObBook.Core/ObBookPng.h"
+#include "../ObBook.Core/ObBookProject.h"
+#include "../ObBook.Core/ObBookSourceMap.h"
+#include "../ObBook.Core/ObBookStreaming.h"
+#include "../ObBook.Core/ObBookThumbnails.h"
+#include "../ObBook.Core/ObBookTrace.h"
+#include "../ObBook.Core/ObBookWorkers.h"
+#if defined(_WIN32)
+#include "../ObBook.RenderD2D/ObBookRenderD2D.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // Self-checks that fail the run (nonzero exit) rather than only printing.
+    int g_failedChecks = 0;
+
+    struct Options
+    {
+        std::string outPath = "bench_results.json";
+        fs::path fixtures = fs::temp_directory_path() / "obbook-bench";
+        uint32_t bsaFiles = 20000;
+        uint32_t sourceKb = 64;
+        uint32_t indexEntries = 500000;
+        uint32_t walkFiles = 500000;
+        uint32_t minTimeMs = 300;
+        std::string filter;
+        std::string tracePath;
+    };
+
+    struct BenchResult
+    {
+        std::string name;
+        uint64_t iterations{};
+        double minNs{};
+        double medianNs{};
+        double meanNs{};
+        uint64_t bytesPerIteration{};
+        uint64_t itemsPerIteration{};
+        std::vector<std::pair<std::string, double>> counters; // extra per-bench figures, e.g. memory
+    };
+
+    class BenchRunner
+    {
+    public:
+        explicit BenchRunner(const Options& o) : opts_(o) {}
+
+        // Runs fn repeatedly for at least minTimeMs (and at least 5 timed iterations) after one warm-up call.
+        void Run(const std::string& name, uint64_t bytes, uint64_t items, const std::function<void()>& fn)
+        {
+            if (!Selected(name)) return;
+
+            using clock = std::chrono::steady_clock;
+            fn();
+
+            std::vector<double> samples;
+            const auto budget = std::chrono::milliseconds(opts_.minTimeMs);
+            const auto start = clock::now();
+            while (samples.size() < 5 || (clock::now() - start < budget && samples.size() < 100000))
+            {
+                const auto t0 = clock::now();
+                fn();
+                const auto t1 = clock::now();
+                samples.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+            }
+
+            std::sort(samples.begin(), samples.end());
+            BenchResult r{};
+            r.name = name;
+            r.iterations = samples.size();
+            r.minNs = samples.front();
+            r.medianNs = samples[samples.size() / 2];
+            double sum = 0;
+            for (double s : samples) sum += s;
+            r.meanNs = sum / static_cast<double>(samples.size());
+            r.bytesPerIteration = bytes;
+            r.itemsPerIteration = items;
+
+            const double mbps = bytes ? (static_cast<double>(bytes) / (r.medianNs * 1e-9)) / (1024.0 * 1024.0) : 0.0;
+            std::printf("%-40s %10.3f ms median  %10.3f ms min  %8llu iters  %10.1f MB/s\n",
+                name.c_str(), r.medianNs * 1e-6, r.minNs * 1e-6,
+                static_cast<unsigned long long>(r.iterations), mbps);
+            results_.push_back(std::move(r));
+        }
+
+        bool Selected(const std::string& name) const
+        {
+            return opts_.filter.empty() || name.find(opts_.filter) != std::string::npos;
+        }
+
+        // Attaches a named figure to the named bench if it ran (filtered benches are skipped silently).
+        void AddCounter(const std::string& bench, const std::string& key, double value)
+        {
+            for (auto& r : results_)
+            {
+                if (r.name != bench) continue;
+                r.counters.emplace_back(key, value);
+                std::printf("  %-38s %s = %.0f\n", bench.c_str(), key.c_str(), value);
+                return;
+            }
+        }
+
+        const std::vector<BenchResult>& Results() const { return results_; }
+
+    private:
+        const Options& opts_;
+        std::vector<BenchResult> results_;
+    };
+
+    std::string JsonEscape(const std::string& s)
+    {
+        std::string out;
+        out.reserve(s.size() + 2);
+        for (char c : s)
+        {
+            switch (c)
+            {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+                    out += buf;
+                }
+                else out.push_back(c);
+            }
+        }
+        return out;
+    }
+
+    bool WriteJson(const Options& o, const std::vector<BenchResult>& results)
+    {
+        std::ofstream out(o.outPath, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+
+        char stamp[32]{};
+        const std::time_t now = std::time(nullptr);
+        std::tm tmUtc{};
+    #if defined(_WIN32)
+        gmtime_s(&tmUtc, &now);
+    #else
+        gmtime_r(&now, &tmUtc);
+    #endif
+        std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", &tmUtc);
+
+        out << "{\n";
+        out << "  \"schema\": 1,\n";
+        out << "  \"timestamp\": \"" << stamp << "\",\n";
+    #if defined(_WIN32)
+        out << "  \"platform\": \"windows\",\n";
+    #elif defined(__APPLE__)
+        out << "  \"platform\": \"macos\",\n";
+    #else
+        out << "  \"platform\": \"linux\",\n";
+    #endif
+        out << "  \"config\": { \"bsa_files\": " << o.bsaFiles << ", \"source_kb\": " << o.sourceKb
+            << ", \"index_entries\": " << o.indexEntries
+            << ", \"min_time_ms\": " << o.minTimeMs << " },\n";
+        out << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const auto& r = results[i];
+            char line[512];
+            std::snprintf(line, sizeof(line),
+                "    { \"name\": \"%s\", \"iterations\": %llu, \"min_ns\": %.0f, \"median_ns\": %.0f, \"mean_ns\": %.0f, "
+                "\"bytes_per_iteration\": %llu, \"items_per_iteration\": %llu",
+                JsonEscape(r.name).c_str(), static_cast<unsigned long long>(r.iterations), r.minNs, r.medianNs, r.meanNs,
+                static_cast<unsigned long long>(r.bytesPerIteration), static_cast<unsigned long long>(r.itemsPerIteration));
+            out << line;
+            if (!r.counters.empty())
+            {
+                out << ", \"counters\": {";
+                for (size_t c = 0; c < r.counters.size(); ++c)
+                {
+                    std::snprintf(line, sizeof(line), "%s\"%s\": %.0f", c ? ", " : " ",
+                        JsonEscape(r.counters[c].first).c_str(), r.counters[c].second);
+                    out << line;
+                }
+                out << " }";
+            }
+            out << " }" << ((i + 1 < results.size()) ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+        return static_cast<bool>(out);
+    }
+
+    bool ParseArgs(int argc, char** argv, Options& o)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string a = argv[i];
+            auto next = [&](const char* flag) -> const char*
+            {
+                if (i + 1 >= argc) { std::fprintf(stderr, "%s requires a value\n", flag); return nullptr; }
+                return argv[++i];
+            };
+
+            if (a == "--out") { auto v = next("--out"); if (!v) return false; o.outPath = v; }
+            else if (a == "--fixtures") { auto v = next("--fixtures"); if (!v) return false; o.fixtures = v; }
+            else if (a == "--bsa-files") { auto v = next("--bsa-files"); if (!v) return false; o.bsaFiles = static_cast<uint32_t>(std::strtoul(v, nullptr, 10)); }
+            else if (a == "--source-kb") { auto v = next("--source-kb"); if (!v) return false; o.sourceKb = static_cast<uint32_t>(std::strtoul(v, nullptr, 10)); }
+            else if (a == "--min-time-ms") { auto v = next("--min-time-ms"); if (!v) return false; o.minTimeMs = static_cast<uint32_t>(std::strtoul(v, nullptr, 10)); }
+            else if (a == "--index-entries") { auto v = next("--index-entries"); if (!v) return false; o.indexEntries = static_cast<uint32_t>(std::strtoul(v, nullptr, 10)); }
+            else if (a == "--walk-files") { auto v = next("--walk-files"); if (!v) return false; o.walkFiles = static_cast<uint32_t>(std::strtoul(v, nullptr, 10)); }
+            else if (a == "--filter") { auto v = next("--filter"); if (!v) return false; o.filter = v; }
+            else if (a == "--trace") { auto v = next("--trace"); if (!v) return false; o.tracePath = v; }
+            else
+            {
+                std::fprintf(stderr, "Unknown argument: %s\n", a.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // After the timed loop has warmed the compiler up, another compile of the same input must not allocate.
+    void CheckSteadyStateAllocations(BenchRunner& runner, const std::string& name, obbook::BookCompiler& compiler)
+    {
+        if (!runner.Selected(name)) return;
+        const uint64_t allocations = obbench::CountAllocations([&] { compiler.Compile(); });
+        runner.AddCounter(name, "allocations", static_cast<double>(allocations));
+        if (allocations != 0)
+        {
+            std::fprintf(stderr, "%s: steady-state Compile() made %llu heap allocations\n", name.c_str(), static_cast<unsigned long long>(allocations));
+            ++g_failedChecks;
+        }
+    }
+
+    // The normalization as two separate passes (quotes over the source, then slashes over that output): the
+    // reference the single-pass kernel in BookCompiler must match byte for byte, diagnostics and source map
+    // included.
+    struct ReferenceNormalization
+    {
+        std::string text;
+        std::vector<std::pair<uint32_t, uint32_t>> quotes; // source offset, length
+        std::vector<uint32_t> slashes;                      // normalized offset
+        std::vector<obbook::SourceMap::Edit> characters;    // every decoded character, when quotes are fixed
+    };
+
+    ReferenceNormalization NormalizeReference(const std::string& src, bool quotes, bool slashes)
+    {
+        ReferenceNormalization r;
+        if (quotes)
+        {
+            for (size_t i = 0; i < src.size();)
+            {
+                const size_t at = i;
+                const auto c = static_cast<unsigned char>(src[i]);
+                uint32_t cp = 0xFFFDu;
+                size_t n = 1;
+                if (c < 0x80u) cp = c;
+                else if ((c >> 5) == 0x6 && i + 1 < src.size()) { n = 2; cp = ((c & 0x1Fu) << 6) | (src[i + 1] & 0x3Fu); }
+                else if ((c >> 4) == 0xE && i + 2 < src.size()) { n = 3; cp = ((c & 0x0Fu) << 12) | ((src[i + 1] & 0x3Fu) << 6) | (src[i + 2] & 0x3Fu); }
+                else if ((c >> 3) == 0x1E && i + 3 < src.size())
+                {
+                    n = 4;
+                    cp = ((c & 0x07u) << 18) | ((src[i + 1] & 0x3Fu) << 12) | ((src[i + 2] & 0x3Fu) << 6) | (src[i + 3] & 0x3Fu);
+                }
+                i += n;
+                const size_t emitted = r.text.size();
+                if (cp == 0x2018u || cp == 0x2019u || cp == 0x201Cu || cp == 0x201Du)
+                {
+                    r.text.push_back('"');
+                    r.quotes.emplace_back(static_cast<uint32_t>(at), static_cast<uint32_t>(n));
+                }
+                else if (cp < 0x80u) r.text.push_back(static_cast<char>(cp));
+                else if (cp < 0x800u) { r.text.push_back(static_cast<char>(0xC0u | (cp >> 6))); r.text.push_back(static_cast<char>(0x80u | (cp & 0x3Fu))); }
+                else if (cp < 0x10000u)
+                {
+                    r.text.push_back(static_cast<char>(0xE0u | (cp >> 12)));
+                    r.text.push_back(static_cast<char>(0x80u | ((cp >> 6) & 0x3Fu)));
+                    r.text.push_back(static_cast<char>(0x80u | (cp & 0x3Fu)));
+                }
+                else
+                {
+                    r.text.push_back(static_cast<char>(0xF0u | (cp >> 18)));
+                    r.text.push_back(static_cast<char>(0x80u | ((cp >> 12) & 0x3Fu)));
+                    r.text.push_back(static_cast<char>(0x80u | ((cp >> 6) & 0x3Fu)));
+                    r.text.push_back(static_cast<char>(0x80u | (cp & 0x3Fu)));
+                }
+                r.characters.push_back({ static_cast<uint32_t>(at), static_cast<uint32_t>(emitted),
+                    static_cast<uint32_t>(n), static_cast<uint32_t>(r.text.size() - emitted) });
+            }
+        }
+        else
+        {
+            r.text = src;
+        }
+
+        if (slashes)
+        {
+            auto startsWithImg = [&](size_t at)
+            {
+                static const char lit[] = "<img";
+                for (size_t k = 0; k < 4; ++k)
+                {
+                    if (at + k >= r.text.size()) return false;
+                    char a = r.text[at + k];
+                    if (a >= 'A' && a <= 'Z') a = static_cast<char>(a - 'A' + 'a');
+                    if (a != lit[k]) return false;
+                }
+                return true;
+            };
+            bool inSrc = false;
+            bool inQuote = false;
+            for (size_t i = 0; i < r.text.size(); ++i)
+            {
+                if (!inSrc)
+                {
+                    inSrc = startsWithImg(i);
+                    continue;
+                }
+                const char c = r.text[i];
+                if (c == '>') { inSrc = false; inQuote = false; continue; }
+                if (c == '"') inQuote = !inQuote;
+                if (inQuote && c == '\\')
+                {
+                    r.text[i] = '/';
+                    r.slashes.push_back(static_cast<uint32_t>(i));
+                }
+            }
+        }
+        return r;
+    }
+
+    // Every corpus plus random markup-heavy bytes: malformed UTF-8, smart quotes, IMG tags, quotes, backslashes.
+    std::vector<std::string> MarkupCheckInputs()
+    {
+        std::vector<std::string> inputs;
+        for (uint32_t kind = 0; kind < 3; ++kind)
+            inputs.push_back(obbench::GenerateBookSource(static_cast<obbench::CorpusKind>(kind), 32 * 1024, kind + 7));
+        const char* pieces[] = { "<img src=\"", "<IMG ", "<iMg", "\\", "\"", ">", "g", "<", "a", " ", "\xE2\x80\x9C",
+            "\xE2\x80\x9D", "\xE2\x80\x98", "\xC3\xA9", " width=600", " WIDTH=\"12\"", " height=3", "\xC1\xA9", "\xC0\xBC", "\x80", "\xE2\x80", "\xF0\x9F\x98\x80", "\xFF" };
+        uint32_t state = 0x2545F491u;
+        for (int n = 0; n < 200; ++n)
+        {
+            std::string s;
+            const size_t count = 1 + n * 7;
+            for (size_t k = 0; k < count; ++k)
+            {
+                state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+                s += pieces[state % std::size(pieces)];
+            }
+            inputs.push_back(std::move(s));
+        }
+        return inputs;
+    }
+
+    // Every character must map to its counterpart both ways, as a start offset and as a range; without the quote
+    // fix (no characters) the texts are identical and the map must be empty.
+    bool SourceMapMatches(const obbook::SourceMap& map, const std::vector<obbook::SourceMap::Edit>& characters)
+    {
+        if (characters.empty()) return map.GetEditCount() == 0;
+        auto same = [](obbook::TextRange a, uint32_t offset, uint32_t length) { return a.offset == offset && a.length == length; };
+        for (const auto& c : characters)
+        {
+            if (map.ToNormalized(c.sourceOffset) != c.normalizedOffset || map.ToSource(c.normalizedOffset) != c.sourceOffset) return false;
+            if (!same(map.ToNormalized({ c.sourceOffset, c.sourceLength }), c.normalizedOffset, c.normalizedLength)) return false;
+            if (!same(map.ToSource({ c.normalizedOffset, c.normalizedLength }), c.sourceOffset, c.sourceLength)) return false;
+        }
+        const auto& last = characters.back();
+        return map.ToNormalized(last.sourceOffset + last.sourceLength) == last.normalizedOffset + last.normalizedLength;
+    }
+
+    // More distinct dynamic messages than 16-bit ids can name: every diagnostic must still show its own text or
+    // its kind's built-in one, never another diagnostic's.
+    void CheckMessageIds(const fs::path& emptyRoot)
+    {
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const std::string& what) { if (!ok) problems.push_back(what); };
+
+        constexpr uint32_t kRefs = 70000;
+        std::string source;
+        for (uint32_t i = 0; i < kRefs; ++i) source += "<IMG src=\"book/m" + std::to_string(i) + ".dds\"> ";
+        obbook::BookCompiler compiler;
+        compiler.SetOblivionDirectoryUtf8(emptyRoot.string());
+        compiler.SetSourceUtf8(source);
+        compiler.Compile();
+
+        const auto kind = obbook::DiagnosticKind::ImgTextureMissing;
+        const std::string& builtin = obbook::GetBuiltinDiagnosticMessage(kind);
+        uint32_t own = 0, generic = 0, wrong = 0;
+        for (const auto& d : compiler.GetDiagnostics())
+        {
+            if (d.kind != kind) continue;
+            const std::string& text = compiler.GetDiagnosticMessage(d);
+            const std::string_view src = std::string_view(source).substr(d.offset, d.length);
+            if (text == builtin) generic += d.count;
+            else if (d.count == 1 && text.size() >= src.size() && text.compare(text.size() - src.size(), src.size(), src) == 0) ++own;
+            else ++wrong;
+        }
+        expect(wrong == 0, std::to_string(wrong) + " missing-texture diagnostics show another reference's text");
+        expect(own == compiler.GetDiagnosticMessageCount() - static_cast<size_t>(obbook::DiagnosticKind::Count) && own > 65000,
+            std::to_string(own) + " diagnostics kept their own text");
+        expect(own + generic == kRefs, std::to_string(own + generic) + " of " + std::to_string(kRefs) + " missing textures reported");
+
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "message ids: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    // Grouping merges only diagnostics whose ranges touch: two smart quotes side by side become one record, one
+    // 40 KB further on stays its own. The streaming compiler must group the same way for any chunking.
+    void CheckGrouping(const fs::path& emptyRoot)
+    {
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const std::string& what) { if (!ok) problems.push_back(what); };
+
+        const std::string quote = "\xE2\x80\x9C";
+        const std::string source = quote + quote + std::string(40000, 'a') + quote + "<img src=\"a\\b\\c\">";
+        obbook::ProjectSettings settings{};
+        settings.groupAdjacentDiagnostics = true;
+        settings.lintImageReferences = false;
+        settings.oblivionDirectoryUtf8 = emptyRoot.string();
+        auto matches = [&](const std::vector<obbook::Diagnostic>& diags, const std::string& label)
+        {
+            std::vector<obbook::Diagnostic> quotes, slashes;
+            for (const auto& d : diags)
+            {
+                if (d.kind == obbook::DiagnosticKind::SmartQuoteNormalized) quotes.push_back(d);
+                else if (d.kind == obbook::DiagnosticKind::BackslashNormalized) slashes.push_back(d);
+            }
+            expect(quotes.size() == 2 && quotes[0].offset == 0 && quotes[0].length == 6 && quotes[0].count == 2
+                && quotes[0].normalizedOffset == 0 && quotes[0].normalizedLength == 2,
+                label + ": side-by-side quotes not grouped into one record");
+            expect(quotes.size() == 2 && quotes[1].offset == 40006 && quotes[1].length == 3 && quotes[1].count == 1
+                && quotes[1].normalizedOffset == 40002 && quotes[1].normalizedLength == 1,
+                label + ": a quote 40 KB further on was grouped with the first ones");
+            expect(slashes.size() == 2 && slashes[0].count == 1 && slashes[1].count == 1, label + ": backslashes one character apart were grouped");
+        };
+
+        obbook::BookCompiler compiler;
+        compiler.SetSettings(settings);
+        compiler.SetSourceUtf8(source);
+        compiler.Compile();
+        matches(compiler.GetDiagnostics(), "compile");
+
+        for (const size_t chunk : { size_t{ 1 }, size_t{ 7 }, size_t{ 4096 } })
+        {
+            std::vector<obbook::Diagnostic> diags;
+            obbook::StreamingCompiler stream(settings, [](std::string_view) {}, [&diags](const obbook::Diagnostic& d) { diags.push_back(d); });
+            for (size_t at = 0; at < source.size(); at += chunk)
+                stream.Feed(std::string_view(source).substr(at, chunk));
+            stream.Finish();
+            matches(diags, "stream in " + std::to_string(chunk) + "-byte chunks");
+        }
+
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "grouping: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    // The check inputs through all four quote/slash combinations. Timings for the corpora are the compile/* benches.
+    void CheckNormalization(const fs::path& emptyRoot)
+    {
+        const auto inputs = MarkupCheckInputs();
+        size_t failures = 0;
+        obbook::BookCompiler compiler;
+        for (int mode = 0; mode < 4; ++mode)
+        {
+            auto settings = compiler.GetSettings();
+            settings.autoNormalizeSmartQuotes = (mode & 2) != 0;
+            settings.autoNormalizeSlashes = (mode & 1) != 0;
+            settings.oblivionDirectoryUtf8 = emptyRoot.string();
+            compiler.SetSettings(settings);
+            for (const auto& input : inputs)
+            {
+                const auto expected = NormalizeReference(input, settings.autoNormalizeSmartQuotes, settings.autoNormalizeSlashes);
+                compiler.SetSourceUtf8(input);
+                compiler.Compile();
+                ReferenceNormalization actual;
+                actual.text = compiler.GetNormalizedSourceUtf8();
+                for (const auto& d : compiler.GetDiagnostics())
+                {
+                    if (d.kind == obbook::DiagnosticKind::SmartQuoteNormalized) actual.quotes.emplace_back(d.offset, d.length);
+                    else if (d.kind == obbook::DiagnosticKind::BackslashNormalized) actual.slashes.push_back(d.normalizedOffset);
+                }
+                if (actual.text != expected.text || actual.quotes != expected.quotes || actual.slashes != expected.slashes) ++failures;
+                else if (!SourceMapMatches(compiler.GetSourceMap(), expected.characters)) ++failures;
+            }
+        }
+        if (failures != 0)
+        {
+            std::fprintf(stderr, "normalize: %zu of %zu inputs differ from the two-pass reference\n", failures, inputs.size() * 4);
+            ++g_failedChecks;
+        }
+    }
+
+    // Streaming must reproduce a whole-source compile (lint off, no grouping) for any chunking: the same
+    // normalized bytes and the same diagnostics, compared as sorted sets since the order differs by design.
+    void CheckStreaming(const fs::path& emptyRoot)
+    {
+        auto key = [](const obbook::Diagnostic& d) { return std::make_tuple(d.kind, d.offset, d.length, d.count, d.normalizedOffset, d.normalizedLength); };
+        auto sorted = [&key](std::vector<obbook::Diagnostic> v)
+        {
+            std::sort(v.begin(), v.end(), [&key](const auto& a, const auto& b) { return key(a) < key(b); });
+            return v;
+        };
+
+        obbook::ProjectSettings settings{};
+        settings.lintImageReferences = false;
+        settings.oblivionDirectoryUtf8 = emptyRoot.string();
+        obbook::BookCompiler compiler;
+        compiler.SetSettings(settings);
+
+        const auto inputs = MarkupCheckInputs();
+        const size_t chunkSizes[] = { 1, 3, 7, 4096 };
+        size_t failures = 0;
+        for (const auto& input : inputs)
+        {
+            compiler.SetSourceUtf8(input);
+            compiler.Compile();
+            std::vector<obbook::Diagnostic> expected;
+            for (const auto& d : compiler.GetDiagnostics())
+                if (d.kind != obbook::DiagnosticKind::AssetScanSummary) expected.push_back(d);
+            expected = sorted(std::move(expected));
+
+            for (const size_t chunk : chunkSizes)
+            {
+                std::string text;
+                std::vector<obbook::Diagnostic> diags;
+                obbook::StreamingCompiler stream(settings,
+                    [&text](std::string_view part) { text.append(part); },
+                    [&diags](const obbook::Diagnostic& d) { diags.push_back(d); });
+                for (size_t at = 0; at < input.size(); at += chunk)
+                    stream.Feed(std::string_view(input).substr(at, chunk));
+                stream.Finish();
+                if (text != compiler.GetNormalizedSourceUtf8() || stream.GetSourceBytes() != input.size()) ++failures;
+                else if (diags.size() != expected.size()) ++failures;
+                else
+                {
+                    diags = sorted(std::move(diags));
+                    for (size_t d = 0; d < diags.size(); ++d)
+                        if (key(diags[d]) != key(expected[d]) || diags[d].severity != expected[d].severity) { ++failures; break; }
+                }
+            }
+        }
+        if (failures != 0)
+        {
+            std::fprintf(stderr, "stream: %zu of %zu chunked compiles differ from the whole-source compile\n", failures, inputs.size() * std::size(chunkSizes));
+            ++g_failedChecks;
+        }
+    }
+
+    // A large concatenated dump compiled in 64 KiB chunks; retained_bytes should track the chunk, not the input.
+    void BenchStreaming(BenchRunner& runner)
+    {
+        constexpr size_t kChunk = 64 * 1024;
+        std::string dump;
+        for (uint32_t part = 0; part < 48; ++part)
+            dump += obbench::GenerateBookSource(static_cast<obbench::CorpusKind>(part % 3), 256 * 1024, part + 1);
+
+        uint64_t normalizedBytes = 0;
+        uint64_t diagnostics = 0;
+        obbook::StreamingCompiler stream(obbook::ProjectSettings{},
+            [&normalizedBytes](std::string_view part) { normalizedBytes += part.size(); },
+            [&diagnostics](const obbook::Diagnostic&) { ++diagnostics; });
+        const std::string name = "stream/compile_" + std::to_string(dump.size() >> 20) + "mb/chunk_64k";
+        runner.Run(name, dump.size(), 1, [&]
+        {
+            stream.Reset();
+            for (size_t at = 0; at < dump.size(); at += kChunk)
+                stream.Feed(std::string_view(dump).substr(at, kChunk));
+            stream.Finish();
+        });
+        runner.AddCounter(name, "retained_bytes", static_cast<double>(stream.GetRetainedBytes()));
+        runner.AddCounter(name, "diagnostics", static_cast<double>(stream.GetDiagnosticSummary().total));
+    }
+
+    // Caret mapping on a quote-heavy book: one source -> normalized -> source round trip per item. A caret
+    // only moves when it was inside a replaced character.
+    void BenchSourceMap(BenchRunner& runner, const Options& o, const fs::path& emptyRoot)
+    {
+        const std::string name = "sourcemap/roundtrip";
+        if (!runner.Selected(name)) return;
+        const auto source = obbench::GenerateBookSource(obbench::CorpusKind::Quotes, static_cast<size_t>(o.sourceKb) * 1024);
+        obbook::BookCompiler compiler;
+        compiler.SetOblivionDirectoryUtf8(emptyRoot.string());
+        compiler.SetSourceUtf8(source);
+        compiler.Compile();
+        const auto& map = compiler.GetSourceMap();
+
+        constexpr size_t kCarets = 4096;
+        const uint32_t step = static_cast<uint32_t>(std::max<size_t>(1, source.size() / kCarets));
+        uint64_t moved = 0;
+        runner.Run(name, 0, kCarets, [&]
+        {
+            moved = 0;
+            for (uint32_t caret = 0, k = 0; k < kCarets; ++k, caret += step)
+                moved += map.ToSource(map.ToNormalized(caret)) != caret;
+        });
+        runner.AddCounter(name, "edits", static_cast<double>(map.GetEditCount()));
+        runner.AddCounter(name, "map_bytes", static_cast<double>(map.GetRetainedBytes()));
+        runner.AddCounter(name, "carets_moved", static_cast<double>(moved));
+    }
+
+    void BenchCompile(BenchRunner& runner, const Options& o, const fs::path& emptyRoot, const fs::path& dataDir)
+    {
+        struct Corpus { const char* name; obbench::CorpusKind kind; };
+        const Corpus corpora[] =
+        {
+            { "compile/ascii", obbench::CorpusKind::Ascii },
+            { "compile/quotes", obbench::CorpusKind::Quotes },
+            { "compile/images", obbench::CorpusKind::Images },
+        };
+
+        for (const auto& c : corpora)
+        {
+            const auto source = obbench::GenerateBookSource(c.kind, static_cast<size_t>(o.sourceKb) * 1024);
+            obbook::BookCompiler compiler;
+            // Point discovery at an empty Data folder so OBLIVION_PATH on the bench machine does not leak in.
+            compiler.SetOblivionDirectoryUtf8(emptyRoot.string());
+            compiler.SetSourceUtf8(source);
+            runner.Run(c.name, source.size(), 1, [&] { compiler.Compile(); });
+            CheckSteadyStateAllocations(runner, c.name, compiler);
+            runner.AddCounter(c.name, "retained_bytes", static_cast<double>(compiler.GetMemoryBytes(obbook::MemorySubsystem::CompileBuffers)));
+        }
+
+        // Same quote-heavy corpus with run-length grouping of adjacent diagnostics.
+        const auto quotes = obbench::GenerateBookSource(obbench::CorpusKind::Quotes, static_cast<size_t>(o.sourceKb) * 1024);
+        obbook::BookCompiler grouped;
+        auto settings = grouped.GetSettings();
+        settings.groupAdjacentDiagnostics = true;
+        grouped.SetSettings(settings);
+        grouped.SetOblivionDirectoryUtf8(emptyRoot.string());
+        grouped.SetSourceUtf8(quotes);
+        runner.Run("compile/quotes_grouped", quotes.size(), 1, [&] { grouped.Compile(); });
+        CheckSteadyStateAllocations(runner, "compile/quotes_grouped", grouped);
+
+        // IMG-heavy corpus against the synthetic install, so every IMG src is resolved and its aspect checked.
+        const auto images = obbench::GenerateBookSource(obbench::CorpusKind::Images, static_cast<size_t>(o.sourceKb) * 1024);
+        obbook::BookCompiler linted;
+        linted.SetOblivionDirectoryUtf8(dataDir.string());
+        linted.SetSourceUtf8(images);
+        linted.Compile(); // asset scan outside the timed loop
+        runner.Run("compile/images_lint", images.size(), 1, [&] { linted.Compile(); });
+        CheckSteadyStateAllocations(runner, "compile/images_lint", linted);
+        const auto& byKind = linted.GetDiagnosticSummary().byKind;
+        runner.AddCounter("compile/images_lint", "missing", byKind[static_cast<size_t>(obbook::DiagnosticKind::ImgTextureMissing)]);
+        runner.AddCounter("compile/images_lint", "aspect_mismatch", byKind[static_cast<size_t>(obbook::DiagnosticKind::ImgAspectMismatch)]);
+    }
+
+    // A mod-sized project: full build, a rebuild with nothing changed, and a rebuild after editing one book.
+    // Then the full build again with a warm persistent cache (what a fresh CI run sees); the cached outputs are
+    // checked against the compiled ones.
+    void BenchProject(BenchRunner& runner, const fs::path& emptyRoot, const fs::path& cacheDir)
+    {
+        constexpr uint32_t kBooks = 400;
+        obbook::BookProject project;
+        auto settings = project.GetSettings();
+        settings.oblivionDirectoryUtf8 = emptyRoot.string();
+        project.SetSettings(settings);
+        size_t totalBytes = 0;
+        for (uint32_t i = 0; i < kBooks; ++i)
+        {
+            auto source = obbench::GenerateBookSource(static_cast<obbench::CorpusKind>(i % 3), 8 * 1024, i + 1);
+            totalBytes += source.size();
+            project.SetBook("Book" + std::to_string(i), std::move(source));
+        }
+
+        const std::string suffix = "/" + std::to_string(kBooks);
+        runner.Run("project/rebuild_cold" + suffix, totalBytes, kBooks, [&]
+        {
+            project.InvalidateOutputs();
+            project.Rebuild();
+        });
+        runner.Run("project/rebuild_unchanged" + suffix, 0, kBooks, [&] { project.Rebuild(); });
+
+        const std::string edited = project.GetBookSourceUtf8(kBooks / 2);
+        uint32_t edit = 0;
+        obbook::BookProject::RebuildStats stats{};
+        runner.Run("project/rebuild_one_edit" + suffix, 0, kBooks, [&]
+        {
+            project.SetBook("Book" + std::to_string(kBooks / 2), edited + std::to_string(++edit));
+            stats = project.Rebuild();
+        });
+        runner.AddCounter("project/rebuild_one_edit" + suffix, "compiled", static_cast<double>(stats.compiled));
+        runner.AddCounter("project/rebuild_one_edit" + suffix, "reused", static_cast<double>(stats.reused));
+
+        std::error_code ec;
+        fs::remove_all(cacheDir, ec);
+        std::vector<obbook::BookOutput> compiled;
+        project.InvalidateOutputs();
+        project.Rebuild();
+        for (size_t i = 0; i < project.BookCount(); ++i) compiled.push_back(project.GetOutput(i));
+
+        obbook::CompileCache cache(cacheDir.string(), 256ull << 20);
+        project.SetCompileCache(&cache);
+        project.InvalidateOutputs();
+        project.Rebuild(); // fills the cache
+        cache.ResetStats();
+        runner.Run("project/rebuild_cold_cached" + suffix, totalBytes, kBooks, [&]
+        {
+            project.InvalidateOutputs();
+            project.Rebuild();
+        });
+        const auto cacheStats = cache.GetStats();
+        runner.AddCounter("project/rebuild_cold_cached" + suffix, "hit_rate", cacheStats.HitRate());
+        runner.AddCounter("project/rebuild_cold_cached" + suffix, "bytes_read_per_book",
+            cacheStats.lookups ? static_cast<double>(cacheStats.bytesRead) / static_cast<double>(cacheStats.lookups) : 0.0);
+        runner.AddCounter("project/rebuild_cold_cached" + suffix, "cache_bytes", static_cast<double>(cache.TotalBytes()));
+
+        for (size_t i = 0; i < project.BookCount(); ++i)
+        {
+            const auto& a = compiled[i];
+            const auto& b = project.GetOutput(i);
+            bool same = a.normalizedUtf8 == b.normalizedUtf8 && a.messages == b.messages
+                && a.diagnostics.size() == b.diagnostics.size()
+                && std::memcmp(&a.summary, &b.summary, sizeof(a.summary)) == 0;
+            for (size_t d = 0; same && d < a.diagnostics.size(); ++d)
+                same = std::memcmp(&a.diagnostics[d], &b.diagnostics[d], sizeof(obbook::Diagnostic)) == 0;
+            if (!same)
+            {
+                std::fprintf(stderr, "project: cached output of %s differs from the compiled one\n", project.GetBookId(i).c_str());
+                ++g_failedChecks;
+            }
+        }
+
+        // Half the size the project needs: every store past the bound evicts the least recently used entry.
+        const uint64_t bound = cache.TotalBytes() / 2;
+        fs::remove_all(cacheDir, ec);
+        obbook::CompileCache bounded(cacheDir.string(), bound);
+        project.SetCompileCache(&bounded);
+        project.InvalidateOutputs();
+        project.Rebuild();
+        project.SetCompileCache(nullptr);
+        runner.AddCounter("project/rebuild_cold_cached" + suffix, "bounded_evictions", static_cast<double>(bounded.GetStats().evictions));
+        runner.AddCounter("project/rebuild_cold_cached" + suffix, "bounded_entries", static_cast<double>(bounded.EntryCount()));
+    }
+
+    // Simulates typing: a burst of growing snapshots submitted back-to-back, timed until the last one completes.
+    // Superseded snapshots are cancelled, so the cost should stay close to a single compile.
+    void BenchCompileService(BenchRunner& runner, const Options& o, const fs::path& emptyRoot)
+    {
+        constexpr size_t kBurst = 16;
+        const auto source = obbench::GenerateBookSource(obbench::CorpusKind::Quotes, static_cast<size_t>(o.sourceKb) * 1024);
+
+        std::mutex mutex;
+        std::condition_variable done;
+        uint64_t completedSequence = 0;
+        uint64_t completions = 0;
+        obbook::CompileService service([&](std::shared_ptr<const obbook::CompileResult> r)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            completedSequence = r->sequence;
+            ++completions;
+            done.notify_all();
+        });
+
+        obbook::CompileRequest request{};
+        request.settings.oblivionDirectoryUtf8 = emptyRoot.string();
+        uint64_t bursts = 0;
+        runner.Run("service/keystroke_burst", source.size(), kBurst, [&]
+        {
+            uint64_t last = 0;
+            for (size_t i = 1; i <= kBurst; ++i)
+            {
+                request.sourceUtf8.assign(source, 0, source.size() * i / kBurst);
+                last = service.Submit(request);
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [&] { return completedSequence == last; });
+            ++bursts;
+        });
+        if (bursts != 0)
+            std::printf("  service/keystroke_burst: %.2f completions per %zu-snapshot burst\n",
+                static_cast<double>(completions) / static_cast<double>(bursts), kBurst);
+    }
+
+    // The shared fan-out: every index goes to exactly one worker, and an exception on the calling thread only
+    // leaves RunOnWorkers once the other workers are joined (destroying a joinable thread would terminate).
+    void CheckWorkers()
+    {
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const std::string& what) { if (!ok) problems.push_back(what); };
+
+        constexpr size_t kItems = 10000;
+        std::vector<std::atomic<uint32_t>> claimed(kItems);
+        obbook::WorkCursor cursor(kItems);
+        obbook::RunOnWorkers(obbook::WorkerCount(8, kItems), [&](uint32_t)
+        {
+            for (size_t i = 0; cursor.Next(i);) claimed[i].fetch_add(1, std::memory_order_relaxed);
+        });
+        size_t once = 0;
+        for (const auto& c : claimed) once += c.load() == 1;
+        expect(once == kItems, std::to_string(kItems - once) + " indexes not handed out exactly once");
+        expect(obbook::WorkerCount(8, 3) == 3 && obbook::WorkerCount(8, 0) == 1 && obbook::WorkerCount(0, 100) >= 1,
+            "worker counts not clamped to the items");
+
+        std::atomic<uint32_t> finished{ 0 };
+        bool caught = false;
+        try
+        {
+            obbook::RunOnWorkers(4, [&](uint32_t worker)
+            {
+                if (worker == 0) throw std::runtime_error("worker 0");
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                finished.fetch_add(1);
+            });
+        }
+        catch (const std::runtime_error&)
+        {
+            caught = true;
+        }
+        expect(caught && finished.load() == 3, "an exception left RunOnWorkers before the other workers finished");
+
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "workers: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    // Threads that come and go must reuse trace rings rather than add one each, and an export running while a
+    // thread wraps its ring must only contain whole spans (the span's detail holds its begin time).
+    void CheckTrace()
+    {
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const std::string& what) { if (!ok) problems.push_back(what); };
+        const bool wasEnabled = obbook::trace::IsEnabled();
+        obbook::trace::SetEnabled(true);
+
+        auto spansOf = [](const std::string& json, const std::string& name, auto&& onSpan)
+        {
+            const std::string key = "{\"name\":\"" + name + "\"";
+            for (size_t at = json.find(key); at != std::string::npos; at = json.find(key, at + 1))
+            {
+                const size_t end = json.find('}', json.find("\"args\"", at));
+                onSpan(json.substr(at, end - at));
+            }
+        };
+        auto field = [](const std::string& span, const char* key)
+        {
+            const size_t at = span.find(key);
+            return at == std::string::npos ? std::string() : span.substr(at + std::strlen(key));
+        };
+
+        for (uint32_t t = 0; t < 64; ++t)
+            std::thread([] { obbook::trace::RecordSpan("Check.TraceThread", "x", 1, 2); }).join();
+        size_t threadSpans = 0;
+        std::vector<unsigned long> tids;
+        spansOf(obbook::trace::ExportChromeTraceJson(), "Check.TraceThread", [&](const std::string& span)
+        {
+            ++threadSpans;
+            const unsigned long tid = std::strtoul(field(span, "\"tid\":").c_str(), nullptr, 10);
+            if (std::find(tids.begin(), tids.end(), tid) == tids.end()) tids.push_back(tid);
+        });
+        expect(threadSpans == 64, std::to_string(threadSpans) + " of 64 short-lived threads' spans exported");
+        expect(tids.size() <= 2, "64 short-lived threads used " + std::to_string(tids.size()) + " trace rings");
+
+        // Details are cut to 47 bytes; a multi-byte character across the cut must go as a whole.
+        const std::pair<std::string, std::string> cuts[] = {
+            { std::string(47, 'a'), std::string(47, 'a') },
+            { std::string(46, 'a') + "\xC3\xA9" + "b", std::string(46, 'a') },
+            { std::string(45, 'a') + "\xE2\x82\xAC", std::string(45, 'a') },
+            { std::string(44, 'a') + "\xF0\x9F\x93\x96", std::string(44, 'a') },
+            { std::string(45, 'a') + "\xC3\xA9", std::string(45, 'a') + "\xC3\xA9" } };
+        for (const auto& [detail, kept] : cuts) obbook::trace::RecordSpan("Check.TraceUtf8", detail.c_str(), 1, 2);
+        std::vector<std::string> details;
+        spansOf(obbook::trace::ExportChromeTraceJson(), "Check.TraceUtf8", [&](const std::string& span)
+        {
+            const std::string rest = field(span, "\"detail\":\"");
+            details.push_back(rest.substr(0, rest.find('"')));
+        });
+        bool cutOk = details.size() == std::size(cuts);
+        for (size_t i = 0; cutOk && i < details.size(); ++i) cutOk = details[i] == cuts[i].second;
+        expect(cutOk, "long span details not cut at a UTF-8 character boundary");
+
+        std::atomic<bool> done{ false };
+        std::thread writer([&]
+        {
+            char detail[24];
+            for (uint64_t k = 1000; !done.load(std::memory_order_relaxed) || k < 60000; ++k)
+            {
+                std::snprintf(detail, sizeof(detail), "%llu", static_cast<unsigned long long>(k));
+                obbook::trace::RecordSpan("Check.TraceWrap", detail, k * 1000, k * 1000 + 1000);
+            }
+        });
+        size_t wrapSpans = 0, torn = 0;
+        for (int round = 0; round < 8; ++round)
+        {
+            spansOf(obbook::trace::ExportChromeTraceJson(), "Check.TraceWrap", [&](const std::string& span)
+            {
+                ++wrapSpans;
+                const double ts = std::strtod(field(span, "\"ts\":").c_str(), nullptr);
+                const unsigned long long k = std::strtoull(field(span, "\"detail\":\"").c_str(), nullptr, 10);
+                torn += static_cast<unsigned long long>(ts + 0.5) == k ? 0 : 1;
+            });
+        }
+        done.store(true, std::memory_order_relaxed);
+        writer.join();
+        expect(torn == 0, std::to_string(torn) + " of " + std::to_string(wrapSpans) + " spans exported while being overwritten");
+
+        obbook::trace::SetEnabled(wasEnabled);
+        if (!wasEnabled) obbook::trace::Clear();
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "trace: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    // The loose walk must find book textures and fonts whatever the folder case and skip every other folder.
+    // Loose textures outside the book folder stay out of the index but still resolve IMG references, so a
+    // result with a missing reference can be cached like any other.
+    void CheckLooseDiscovery(const fs::path& root)
+    {
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const std::string& what) { if (!ok) problems.push_back(what); };
+
+        const fs::path data = root / "loose_check" / "Data";
+        std::error_code ec;
+        fs::remove_all(data, ec);
+        const uint8_t stub[16]{};
+        for (const fs::path& file : {
+            data / "TEXTURES" / "Menus" / "Book" / "Plate.dds",
+            data / "textures" / "menus" / "book" / "sub" / "b.tga",
+            data / "Textures" / "menus" / "BOOK" / "Fancy_Font" / "g.dds",
+            data / "Textures" / "menus" / "BOOK" / "Fancy_Font" / "g.fnt",
+            data / "Fonts" / "f.fnt",
+            data / "Textures" / "Armor" / "X.dds",
+            data / "textures" / "menus" / "map.dds",
+            data / "Meshes" / "menus" / "book" / "m.nif" })
+        {
+            fs::create_directories(file.parent_path(), ec);
+            std::ofstream(file, std::ios::binary).write(reinterpret_cast<const char*>(stub), sizeof(stub));
+        }
+
+        const fs::path cacheDir = root / "loose_check" / "cache";
+        fs::remove_all(cacheDir, ec);
+        obbook::CompileCache cache(cacheDir.string(), 1ull << 20);
+        obbook::BookCompiler compiler;
+        compiler.SetOblivionDirectoryUtf8(data.parent_path().string());
+        compiler.SetCompileCache(&cache);
+        compiler.SetSourceUtf8("<IMG src=\"armor/x.dds\"> <IMG src=\"armor/missing.dds\"> <IMG src=\"book/plate.dds\"> "
+            "<IMG src=\"../../Data/Textures/Armor/X.dds\">");
+        compiler.Compile();
+        const auto& index = *compiler.GetAssetIndex();
+        obbook::AssetSourceId source{};
+        expect(index.EntryCount() == 5, "loose walk indexed " + std::to_string(index.EntryCount()) + " entries instead of 5");
+        for (const char* path : { "textures/menus/book/plate.dds", "textures/menus/book/sub/b.tga",
+            "textures/menus/book/fancy_font/g.dds", "textures/menus/book/fancy_font/g.fnt", "fonts/f.fnt" })
+        {
+            expect(index.FindEntry(path, source) && source == 0, std::string(path) + " not found as a loose entry");
+        }
+        expect(compiler.GetTexturePaths().Contains("textures/armor/x.dds") && compiler.GetTexturePaths().Contains("textures/menus/map.dds"),
+            "loose textures outside the book folder were not collected");
+        const uint32_t missing = compiler.GetDiagnosticSummary().byKind[static_cast<size_t>(obbook::DiagnosticKind::ImgTextureMissing)];
+        expect(missing == 2, std::to_string(missing) + " IMG references reported missing instead of 2");
+        expect(cache.GetStats().stores == 1, "a result with a missing IMG reference was not cached");
+        // Fancy font files count as fonts; of them only the .dds also counts as a texture.
+        bool summarized = false;
+        for (const auto& d : compiler.GetDiagnostics())
+        {
+            if (d.kind == obbook::DiagnosticKind::AssetScanSummary)
+                summarized = compiler.GetDiagnosticMessage(d).find("Fonts=3, Textures=3,") != std::string::npos;
+        }
+        expect(summarized, "scan summary does not count 3 fonts and 3 textures");
+
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "loose discovery: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    // A compile or rescan that finds what the last one did keeps its generation (and the asset snapshot itself);
+    // a change gets a new one and a delta from the one before it; an unknown generation gives a reset.
+    void CheckGenerations(const fs::path& root)
+    {
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const std::string& what) { if (!ok) problems.push_back(what); };
+
+        const fs::path data = root / "generation_check" / "Data";
+        const fs::path book = data / "textures" / "menus" / "book";
+        std::error_code ec;
+        fs::remove_all(data, ec);
+        fs::create_directories(book, ec);
+        const uint8_t stub[16]{};
+        std::ofstream(book / "a.dds", std::ios::binary).write(reinterpret_cast<const char*>(stub), sizeof(stub));
+
+        obbook::BookCompiler compiler;
+        expect(compiler.GetDiagnosticsGeneration() == 0 && compiler.GetAssetGeneration() == 0, "a new compiler has generations");
+        compiler.SetOblivionDirectoryUtf8(data.parent_path().string());
+        compiler.SetSourceUtf8("<IMG src=\"book/missing.dds\"> text");
+        compiler.Compile();
+        const uint64_t diagnostics = compiler.GetDiagnosticsGeneration();
+        const size_t firstCount = compiler.GetDiagnostics().size();
+        const uint64_t assets = compiler.GetAssetGeneration();
+        const auto snapshot = compiler.GetAssetIndex();
+        expect(diagnostics != 0 && firstCount != 0 && assets != 0, "first compile did not publish");
+
+        obbook::DiagnosticsDelta diagnosticsDelta;
+        compiler.Compile();
+        expect(compiler.GetDiagnosticsGeneration() == diagnostics, "recompiling the same source bumped the diagnostics generation");
+        expect(!compiler.GetDiagnosticsDelta(diagnostics, diagnosticsDelta) && diagnosticsDelta.added.empty() && diagnosticsDelta.removed.empty(),
+            "delta from the current generation not empty");
+
+        // One more finding at the end: nothing before it moves, so the delta only adds.
+        compiler.SetSourceUtf8("<IMG src=\"book/missing.dds\"> text <IMG src=\"book/other.dds\">");
+        compiler.Compile();
+        const uint64_t edited = compiler.GetDiagnosticsGeneration();
+        const size_t editedCount = compiler.GetDiagnostics().size();
+        expect(edited != diagnostics, "an edit that changed the diagnostics kept the generation");
+        expect(compiler.GetDiagnosticsDelta(diagnostics, diagnosticsDelta) && !diagnosticsDelta.reset
+            && diagnosticsDelta.fromGeneration == diagnostics && diagnosticsDelta.toGeneration == edited,
+            "no delta from the previous diagnostics generation");
+        expect(editedCount > firstCount && diagnosticsDelta.removed.empty() && diagnosticsDelta.added.size() == editedCount - firstCount,
+            "diagnostics delta does not list just the new findings");
+        for (const uint32_t i : diagnosticsDelta.added) expect(i < editedCount, "added diagnostic index out of range");
+        expect(compiler.GetDiagnosticsDelta(diagnostics + 1000000, diagnosticsDelta) && diagnosticsDelta.reset
+            && diagnosticsDelta.added.size() == editedCount, "unknown diagnostics generation did not reset");
+
+        obbook::AssetDelta assetDelta;
+        compiler.DiscoverBookAssets();
+        expect(compiler.GetAssetGeneration() == assets && compiler.GetAssetIndex() == snapshot,
+            "rescanning an unchanged Data folder replaced the asset snapshot");
+        expect(!compiler.GetAssetDelta(assets, assetDelta), "delta from the current asset generation not empty");
+
+        std::ofstream(book / "b.dds", std::ios::binary).write(reinterpret_cast<const char*>(stub), sizeof(stub));
+        compiler.DiscoverBookAssets();
+        const uint64_t rescanned = compiler.GetAssetGeneration();
+        expect(rescanned != assets && compiler.GetAssetIndex() != snapshot, "a new texture kept the asset generation");
+        expect(compiler.GetAssetDelta(assets, assetDelta) && !assetDelta.reset && assetDelta.entries.removed.empty()
+            && assetDelta.entries.changed.empty() && assetDelta.entries.added == std::vector<std::string>{ "textures/menus/book/b.dds" },
+            "asset delta does not list just the new texture");
+        expect(obbook::DiffAssetIndexes(*snapshot, *compiler.GetAssetIndex(), nullptr)
+            && !obbook::DiffAssetIndexes(*compiler.GetAssetIndex(), *compiler.GetAssetIndex(), nullptr), "index diff wrong");
+        expect(compiler.GetAssetDelta(0, assetDelta) && assetDelta.reset && assetDelta.entries.added.size() == compiler.GetAssetIndex()->EntryCount(),
+            "unknown asset generation did not reset");
+
+        fs::remove(book / "a.dds", ec);
+        compiler.DiscoverBookAssets();
+        expect(compiler.GetAssetDelta(rescanned, assetDelta) && assetDelta.entries.added.empty()
+            && assetDelta.entries.removed == std::vector<std::string>{ "textures/menus/book/a.dds" }, "asset delta misses a removed texture");
+
+        // Generations come from one counter, so another compiler's are unknown here.
+        obbook::BookCompiler other;
+        other.SetOblivionDirectoryUtf8(data.parent_path().string());
+        other.Compile();
+        expect(other.GetAssetGeneration() != compiler.GetAssetGeneration(), "two compilers share an asset generation");
+
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "generations: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    // Readers on other threads must always get a whole snapshot from GetAssetIndex() while the owner rescans and
+    // publishes new ones, and a snapshot a reader keeps must stay as it was. Run the bench under ThreadSanitizer
+    // (-fsanitize=thread) to have the publication itself checked as well.
+    void CheckAssetPublication(const fs::path& root)
+    {
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const std::string& what) { if (!ok) problems.push_back(what); };
+
+        const fs::path data = root / "publication_check" / "Data";
+        const fs::path book = data / "textures" / "menus" / "book";
+        std::error_code ec;
+        fs::remove_all(data, ec);
+        fs::create_directories(book, ec);
+        fs::create_directories(data / "fonts", ec);
+        const uint8_t stub[16]{};
+        for (const fs::path& file : { book / "a.dds", data / "fonts" / "f.fnt" })
+            std::ofstream(file, std::ios::binary).write(reinterpret_cast<const char*>(stub), sizeof(stub));
+
+        obbook::BookCompiler compiler;
+        compiler.SetOblivionDirectoryUtf8(data.parent_path().string());
+        compiler.DiscoverBookAssets();
+        const auto kept = compiler.GetAssetIndex();
+
+        constexpr uint32_t kRescans = 40;
+        constexpr uint32_t kReaders = 3;
+        std::atomic<bool> done{ false };
+        std::atomic<uint64_t> reads{ 0 }, torn{ 0 };
+        auto read = [&]
+        {
+            uint64_t myReads = 0, myTorn = 0;
+            // At least one read even if the rescans are over before this thread gets to run.
+            do
+            {
+                const auto index = compiler.GetAssetIndex();
+                size_t listed = 0;
+                index->ForEachEntry(obbook::AssetIndex::kRoot, [&](obbook::AssetNodeId) { ++listed; });
+                obbook::AssetSourceId source{};
+                const size_t entries = index->EntryCount();
+                const bool whole = listed == entries && (entries == 2 || entries == 3)
+                    && index->FindEntry("textures/menus/book/a.dds", source)
+                    && index->FindEntry("textures/menus/book/b.dds", source) == (entries == 3);
+                myTorn += whole ? 0 : 1;
+                ++myReads;
+                std::this_thread::yield();
+            } while (!done.load(std::memory_order_acquire));
+            reads.fetch_add(myReads, std::memory_order_relaxed);
+            torn.fetch_add(myTorn, std::memory_order_relaxed);
+        };
+        std::vector<std::thread> readers;
+        for (uint32_t t = 0; t < kReaders; ++t) readers.emplace_back(read);
+
+        // Every rescan adds or removes b.dds, so each one publishes a new snapshot.
+        uint64_t published = 0;
+        for (uint32_t r = 0; r < kRescans; ++r)
+        {
+            const uint64_t generation = compiler.GetAssetGeneration();
+            if (r % 2 == 0) std::ofstream(book / "b.dds", std::ios::binary).write(reinterpret_cast<const char*>(stub), sizeof(stub));
+            else fs::remove(book / "b.dds", ec);
+            compiler.DiscoverBookAssets();
+            published += compiler.GetAssetGeneration() != generation ? 1 : 0;
+            std::this_thread::yield();
+        }
+        done.store(true, std::memory_order_release);
+        for (auto& t : readers) t.join();
+
+        expect(published == kRescans, std::to_string(published) + " of " + std::to_string(kRescans) + " rescans published a snapshot");
+        expect(reads.load() >= kReaders, "readers did not run");
+        expect(torn.load() == 0, std::to_string(torn.load()) + " reads saw an incomplete snapshot");
+        obbook::AssetSourceId source{};
+        expect(kept->EntryCount() == 2 && kept->FindEntry("textures/menus/book/a.dds", source)
+            && !kept->FindEntry("textures/menus/book/b.dds", source) && kept.use_count() == 1,
+            "a snapshot held across rescans changed or is still referenced by the compiler");
+
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "asset publication: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    // What a full loose inventory cost before WalkLooseFiles: one recursive_directory_iterator, fs::relative and
+    // NormalizeVirtualPath per file, in listing order.
+    std::vector<std::string> WalkWithRecursiveIterator(const fs::path& dataDir)
+    {
+        std::vector<std::string> paths;
+        for (auto it = fs::recursive_directory_iterator(dataDir); it != fs::recursive_directory_iterator(); ++it)
+        {
+            if (it->is_regular_file()) paths.push_back(obbook::NormalizeVirtualPath(fs::relative(it->path(), dataDir).string()));
+        }
+        return paths;
+    }
+
+    // Segment by segment, i.e. '/' before any other byte.
+    bool SegmentLess(const std::string& a, const std::string& b)
+    {
+        return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y)
+        {
+            return (x == '/' ? 0 : static_cast<unsigned char>(x)) < (y == '/' ? 0 : static_cast<unsigned char>(y));
+        });
+    }
+
+    // WalkLooseFiles must list exactly what the recursive iterator finds, in sorted order, for every worker
+    // count; a prefix must keep only that subtree; cancellation must be reported.
+    void CheckLooseWalk(const fs::path& root)
+    {
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const std::string& what) { if (!ok) problems.push_back(what); };
+
+        const fs::path dataDir = obbench::GenerateLooseTree(root / "walk_check", 2345);
+        std::vector<std::string> reference = WalkWithRecursiveIterator(dataDir);
+        std::sort(reference.begin(), reference.end(), SegmentLess);
+        obbook::LooseInventory inventory;
+        for (const uint32_t workers : { 1u, 3u, 8u })
+        {
+            const bool ok = obbook::WalkLooseFiles(dataDir.string(), "", workers, inventory);
+            expect(ok && inventory.paths == reference, std::to_string(workers) + " workers listed " + std::to_string(inventory.paths.size())
+                + " files instead of the " + std::to_string(reference.size()) + " the iterator found, or in another order");
+        }
+
+        const std::string prefix = "textures/mod0/armor/";
+        std::vector<std::string> subtree;
+        for (const auto& p : reference)
+            if (p.compare(0, prefix.size(), prefix) == 0) subtree.push_back(p);
+        expect(obbook::WalkLooseFiles(dataDir.string(), prefix, 4, inventory) && !subtree.empty() && inventory.paths == subtree
+            && inventory.directories == 1 + 1 + 1 + 1 + 10, "prefix walk listed the wrong files or read unrelated folders");
+
+        obbook::CancellationToken cancel;
+        cancel.Cancel();
+        expect(!obbook::WalkLooseFiles(dataDir.string(), "", 2, inventory, &cancel), "cancelled walk reported success");
+        expect(!obbook::WalkLooseFiles((root / "walk_check" / "missing").string(), "", 2, inventory), "walk of a missing folder reported success");
+
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "loose walk: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    // Full loose inventory of a large generated tree: the recursive iterator versus WalkLooseFiles on one
+    // worker and on every core.
+    void BenchLooseWalk(BenchRunner& runner, const Options& o)
+    {
+        const uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::string> names = { "walk/recursive_iterator", "walk/parallel/workers_1" };
+        if (cores > 1) names.push_back("walk/parallel/workers_" + std::to_string(cores));
+        if (std::none_of(names.begin(), names.end(), [&](const std::string& n) { return runner.Selected(n); })) return;
+
+        std::printf("Generating a %u-file loose tree...\n", o.walkFiles);
+        const fs::path dataDir = obbench::GenerateLooseTree(o.fixtures / "loose_tree", o.walkFiles);
+        const uint64_t files = o.walkFiles + o.walkFiles / 10;
+        std::vector<std::string> paths;
+        runner.Run(names[0], 0, files, [&] { paths = WalkWithRecursiveIterator(dataDir); });
+
+        obbook::LooseInventory inventory;
+        for (size_t i = 1; i < names.size(); ++i)
+        {
+            const uint32_t workers = i == 1 ? 1 : cores;
+            runner.Run(names[i], 0, files, [&] { obbook::WalkLooseFiles(dataDir.string(), "", workers, inventory); });
+            runner.AddCounter(names[i], "directories", inventory.directories);
+            runner.AddCounter(names[i], "files", static_cast<double>(inventory.paths.size()));
+        }
+    }
+
+    void BenchAssets(BenchRunner& runner, const fs::path& dataDir, uint32_t bsaFiles)
+    {
+        obbook::BookCompiler compiler;
+        compiler.SetOblivionDirectoryUtf8(dataDir.string());
+        runner.Run("assets/discover", 0, 0, [&] { compiler.DiscoverBookAssets(); });
+
+        for (const char* name : { "Bench0.bsa", "Bench1.bsa" })
+        {
+            const fs::path bsa = dataDir / name;
+            if (!fs::exists(bsa)) continue;
+            const auto bytes = static_cast<uint64_t>(fs::file_size(bsa));
+            std::vector<std::string> paths;
+            runner.Run(std::string("assets/read_bsa_paths/") + name, bytes, bsaFiles, [&]
+            {
+                paths.clear();
+                obbook::ReadBsaPaths(bsa, paths);
+            });
+        }
+
+        // Pick a book texture that only exists inside the last archive, so every archive before it is searched.
+        std::string bsaOnly;
+        {
+            std::vector<std::string> paths;
+            const fs::path last = dataDir / "Bench1.bsa";
+            if (obbook::ReadBsaPaths(fs::exists(last) ? last : dataDir / "Bench0.bsa", paths))
+            {
+                for (const auto& p : paths)
+                    if (obbook::IsBookTexturePath(p)) { bsaOnly = p; break; }
+            }
+        }
+
+        std::vector<uint8_t> bytes;
+        if (!bsaOnly.empty())
+        {
+            runner.Run("assets/read_asset_bytes/bsa", 0, 1, [&]
+            {
+                obbook::ReadAssetBytes(dataDir.string(), bsaOnly, bytes);
+            });
+        }
+
+        // Single-file lookup in one archive: hashed record search versus reading every folder and file name.
+        const fs::path lookupBsa = dataDir / "Bench0.bsa";
+        std::vector<obbook::BsaFileEntry> entries;
+        if (fs::exists(lookupBsa) && obbook::ReadBsaEntries(lookupBsa, entries) && !entries.empty())
+        {
+            // The hashed lookup must land on the same record as the name scan; sampled so the check stays cheap.
+            size_t checked = 0;
+            size_t mismatches = 0;
+            obbook::BsaFileEntry found;
+            for (size_t i = 0; i < entries.size(); i += 37, ++checked)
+            {
+                if (!obbook::FindBsaFile(lookupBsa, entries[i].path, found)
+                    || found.offset != entries[i].offset || found.packedSize != entries[i].packedSize) ++mismatches;
+            }
+            if (obbook::FindBsaFile(lookupBsa, entries.back().path + ".missing", found)) ++mismatches;
+            if (mismatches != 0)
+            {
+                std::fprintf(stderr, "assets/find_bsa_file: %zu of %zu sampled lookups disagree with ReadBsaEntries\n", mismatches, checked + 1);
+                ++g_failedChecks;
+            }
+
+            const std::string target = entries[entries.size() / 2].path;
+            runner.Run("assets/find_bsa_file", 0, 1, [&]
+            {
+                obbook::FindBsaFile(lookupBsa, target, found);
+            });
+            runner.Run("assets/find_bsa_file/name_scan", 0, 1, [&]
+            {
+                std::vector<obbook::BsaFileEntry> scanned;
+                obbook::ReadBsaEntries(lookupBsa, scanned);
+                for (const auto& e : scanned)
+                    if (e.path == target) { found = e; break; }
+            });
+        }
+        // Loose files keep their on-disk casing for the Textures root so the lookup also hits on case-sensitive filesystems.
+        runner.Run("assets/read_asset_bytes/loose", 0, 1, [&]
+        {
+            obbook::ReadAssetBytes(dataDir.string(), "Textures/menus/book/loose_0.dds", bytes);
+        });
+    }
+
+    // Building the browsable asset list for one huge archive: the structured index versus the previous
+    // "path [source]" string list that was sorted and deduplicated.
+    void BenchAssetIndex(BenchRunner& runner, const Options& o)
+    {
+        const auto paths = obbench::GenerateBookAssetPaths(o.indexEntries);
+        size_t pathBytes = 0;
+        for (const auto& p : paths) pathBytes += p.size();
+        const std::string indexName = "assets/index_build/" + std::to_string(o.indexEntries);
+        const std::string legacyName = "assets/string_list_build/" + std::to_string(o.indexEntries);
+
+        size_t indexBytes = 0;
+        size_t indexNodes = 0;
+        runner.Run(indexName, pathBytes, paths.size(), [&]
+        {
+            obbook::AssetIndexBuilder builder;
+            builder.Reserve(paths.size(), pathBytes);
+            const auto source = builder.AddSource("bsa:Big.bsa");
+            for (const auto& p : paths) builder.Add(p, source);
+            const obbook::AssetIndex index = builder.Build();
+            indexBytes = index.MemoryBytes();
+            indexNodes = index.NodeCount();
+        });
+        runner.AddCounter(indexName, "memory_bytes", static_cast<double>(indexBytes));
+        runner.AddCounter(indexName, "nodes", static_cast<double>(indexNodes));
+
+        size_t legacyBytes = 0;
+        runner.Run(legacyName, pathBytes, paths.size(), [&]
+        {
+            std::vector<std::string> list;
+            for (const auto& p : paths) list.push_back(p + " [bsa:Big.bsa]");
+            std::sort(list.begin(), list.end());
+            list.erase(std::unique(list.begin(), list.end()), list.end());
+            legacyBytes = list.capacity() * sizeof(std::string);
+            for (const auto& s : list)
+                if (s.capacity() >= sizeof(std::string)) legacyBytes += s.capacity() + 1; // heap, past SSO
+        });
+        runner.AddCounter(legacyName, "memory_bytes", static_cast<double>(legacyBytes));
+
+        obbook::AssetIndexBuilder builder;
+        const auto source = builder.AddSource("bsa:Big.bsa");
+        for (const auto& p : paths) builder.Add(p, source);
+        const obbook::AssetIndex index = builder.Build();
+        size_t next = 0;
+        obbook::AssetSourceId found{};
+        runner.Run("assets/index_find", 0, 1024, [&]
+        {
+            for (int i = 0; i < 1024; ++i)
+            {
+                index.FindEntry(paths[next], found);
+                next = (next + 7919) % paths.size();
+            }
+        });
+
+        // What a reader pays per GetAssetIndex(): an atomic load and a reference count round trip.
+        const obbook::AssetIndexPublisher publisher(std::make_shared<const obbook::AssetIndex>(index));
+        size_t loadedEntries = 0;
+        runner.Run("assets/snapshot_load", 0, 1024, [&]
+        {
+            for (int i = 0; i < 1024; ++i) loadedEntries += publisher.Load()->EntryCount();
+        });
+    }
+
+    // Straightforward per-pixel decode of one level from the layout description alone, to hold the table-driven
+    // kernels to: every pixel finds its block (or its bytes) and reads its channels through runtime masks.
+    void ReferenceDecodeDds(obbench::DdsKind kind, const uint8_t* level, uint32_t w, uint32_t h, std::vector<uint8_t>& out)
+    {
+        const obbench::DdsLayout& layout = obbench::GetDdsLayout(kind);
+        out.assign(static_cast<size_t>(w) * h * 4, 0);
+        auto rd16 = [](const uint8_t* p) { return static_cast<uint32_t>(p[0] | (p[1] << 8)); };
+        auto widen = [](uint32_t v, uint32_t mask, uint8_t none) -> uint8_t
+        {
+            if (mask == 0) return none;
+            uint32_t shift = 0;
+            while (((mask >> shift) & 1) == 0) ++shift;
+            return static_cast<uint8_t>(((v & mask) >> shift) * 255 / (mask >> shift));
+        };
+        for (uint32_t y = 0; y < h; ++y)
+            for (uint32_t x = 0; x < w; ++x)
+            {
+                uint8_t* p = &out[(static_cast<size_t>(y) * w + x) * 4];
+                if (layout.blockBytes == 0)
+                {
+                    const uint32_t bytes = layout.bits / 8;
+                    const uint8_t* s = level + (static_cast<size_t>(y) * w + x) * bytes;
+                    uint32_t v = 0;
+                    for (uint32_t k = 0; k < bytes; ++k) v |= static_cast<uint32_t>(s[k]) << (8 * k);
+                    const bool luminance = (layout.pfFlags & 0x20000u) != 0;
+                    p[2] = widen(v, layout.masks[0], 0);
+                    p[1] = luminance ? p[2] : widen(v, layout.masks[1], 0);
+                    p[0] = luminance ? p[2] : widen(v, layout.masks[2], 0);
+                    p[3] = widen(v, layout.masks[3], 255);
+                    continue;
+                }
+                const uint8_t* block = level + (static_cast<size_t>(y / 4) * ((w + 3) / 4) + x / 4) * layout.blockBytes;
+                const uint32_t i = (y % 4) * 4 + x % 4;
+                const uint8_t* color = layout.blockBytes == 16 ? block + 8 : block;
+                const uint32_t c[2] = { rd16(color), rd16(color + 2) };
+                uint32_t ch[2][3]; // b, g, r per endpoint
+                for (int e = 0; e < 2; ++e)
+                {
+                    ch[e][2] = ((c[e] >> 11) & 31) * 255 / 31;
+                    ch[e][1] = ((c[e] >> 5) & 63) * 255 / 63;
+                    ch[e][0] = (c[e] & 31) * 255 / 31;
+                }
+                const uint32_t ci = ((rd16(color + 4) | (rd16(color + 6) << 16)) >> (2 * i)) & 3;
+                const bool threeColor = kind == obbench::DdsKind::Dxt1 && c[0] <= c[1];
+                uint8_t alpha = 255;
+                for (int k = 0; k < 3; ++k)
+                {
+                    uint32_t v = ch[ci & 1][k];
+                    if (ci == 2) v = threeColor ? (ch[0][k] + ch[1][k]) / 2 : (2 * ch[0][k] + ch[1][k]) / 3;
+                    if (ci == 3) v = threeColor ? 0 : (ch[0][k] + 2 * ch[1][k]) / 3;
+                    p[k] = static_cast<uint8_t>(v);
+                }
+                if (threeColor && ci == 3) alpha = 0;
+                if (kind == obbench::DdsKind::Dxt3)
+                {
+                    alpha = static_cast<uint8_t>(((block[i / 2] >> (4 * (i % 2))) & 15) * 17);
+                }
+                else if (kind == obbench::DdsKind::Dxt5)
+                {
+                    const uint32_t a0 = block[0], a1 = block[1];
+                    const uint32_t bit = 3 * i;
+                    uint32_t ai = 0;
+                    for (uint32_t k = 0; k < 3; ++k) ai |= ((block[2 + (bit + k) / 8] >> ((bit + k) % 8)) & 1u) << k;
+                    if (ai < 2) alpha = static_cast<uint8_t>(ai == 0 ? a0 : a1);
+                    else if (a0 > a1) alpha = static_cast<uint8_t>(((8 - ai) * a0 + (ai - 1) * a1) / 7);
+                    else if (ai < 6) alpha = static_cast<uint8_t>(((6 - ai) * a0 + (ai - 1) * a1) / 5);
+                    else alpha = ai == 6 ? 0 : 255;
+                }
+                p[3] = alpha;
+            }
+    }
+
+    // Every format must match the reference bit for bit on sizes with partial edge blocks and on a skipped-to mip;
+    // a file one byte short of its level, an unknown layout and a DX10 header must fail.
+    void CheckDds()
+    {
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const std::string& what) { if (!ok) problems.push_back(what); };
+        struct Size { uint32_t w, h; };
+        const Size sizes[] = { { 64, 32 }, { 37, 23 }, { 3, 5 }, { 1, 1 } };
+        std::vector<uint8_t> out, ref;
+        for (size_t k = 0; k < static_cast<size_t>(obbench::DdsKind::Count); ++k)
+        {
+            const auto kind = static_cast<obbench::DdsKind>(k);
+            const std::string name = obbench::GetDdsLayout(kind).name;
+            for (const Size& s : sizes)
+            {
+                const std::string label = name + " " + std::to_string(s.w) + "x" + std::to_string(s.h);
+                auto dds = obbench::GenerateDds(kind, s.w, s.h, 31 + static_cast<uint32_t>(k), 3);
+                uint32_t w = 0, h = 0;
+                const bool ok = obbook::DecodeDdsToBgra(dds, out, w, h);
+                expect(ok && w == s.w && h == s.h, label + ": top level not decoded");
+                ReferenceDecodeDds(kind, dds.data() + 128, s.w, s.h, ref);
+                expect(!ok || out == ref, label + ": top level differs from the reference");
+
+                // The third level, after skipping two.
+                const uint32_t w1 = std::max(1u, s.w >> 1), h1 = std::max(1u, s.h >> 1);
+                const uint32_t w2 = std::max(1u, w1 >> 1), h2 = std::max(1u, h1 >> 1);
+                const size_t end = dds.size();
+                size_t levelStart = 0;
+                {
+                    const obbench::DdsLayout& layout = obbench::GetDdsLayout(kind);
+                    auto bytes = [&](uint32_t lw, uint32_t lh)
+                    {
+                        return layout.blockBytes ? static_cast<size_t>((lw + 3) / 4) * ((lh + 3) / 4) * layout.blockBytes
+                            : static_cast<size_t>(lw) * lh * (layout.bits / 8);
+                    };
+                    levelStart = 128 + bytes(s.w, s.h) + bytes(w1, h1);
+                    expect(end == levelStart + bytes(w2, h2), label + ": fixture size");
+                }
+                const uint32_t maxEdge = std::max(w2, h2);
+                if (std::max(w1, h1) > maxEdge)
+                {
+                    const bool mipOk = obbook::DecodeDdsToBgra(dds, maxEdge, out, w, h);
+                    expect(mipOk && w == w2 && h == h2, label + ": third level not chosen");
+                    ReferenceDecodeDds(kind, dds.data() + levelStart, w2, h2, ref);
+                    expect(!mipOk || out == ref, label + ": third level differs from the reference");
+                }
+
+                dds = obbench::GenerateDds(kind, s.w, s.h, 31 + static_cast<uint32_t>(k));
+                dds.pop_back();
+                expect(!obbook::DecodeDdsToBgra(dds, out, w, h), label + ": truncated file decoded");
+            }
+        }
+
+        uint32_t w = 0, h = 0;
+        auto dds = obbench::GenerateDds(obbench::DdsKind::R5G6B5, 8, 8);
+        dds[4 + 93] = 0x0F; // green mask 0x0FE0: overlaps red
+        expect(!obbook::DecodeDdsToBgra(dds, out, w, h), "unknown mask layout decoded");
+        dds = obbench::GenerateDds(obbench::DdsKind::Dxt1, 8, 8);
+        std::memcpy(dds.data() + 4 + 80, "DX10", 4);
+        expect(!obbook::DecodeDdsToBgra(dds, out, w, h), "DX10 header decoded");
+
+        // Sides whose block counts wrap in 32 bits, and a well-formed file just over the size cap: all rejected
+        // before anything is allocated for them.
+        auto rejects = [&out](std::vector<uint8_t> file, uint32_t fileW, uint32_t fileH)
+        {
+            std::memcpy(file.data() + 4 + 8, &fileH, 4);
+            std::memcpy(file.data() + 4 + 12, &fileW, 4);
+            uint32_t w = 0, h = 0;
+            try
+            {
+                return !obbook::DecodeDdsToBgra(file, out, w, h) && !obbook::DecodeDdsToBgra(file, 64, out, w, h);
+            }
+            catch (const std::exception&)
+            {
+                return false;
+            }
+        };
+        const auto small = obbench::GenerateDds(obbench::DdsKind::Dxt1, 8, 8);
+        expect(rejects(small, 0xFFFFFFFDu, 0xFFFFFFFFu), "DXT1 0xFFFFFFFD x 0xFFFFFFFF not rejected");
+        expect(rejects(small, 8, 0xFFFFFFFEu), "DXT1 8 x 0xFFFFFFFE not rejected");
+        expect(rejects(obbench::GenerateDds(obbench::DdsKind::Argb32, 8, 8), 0x40000000u, 4), "A8R8G8B8 2^30 x 4 not rejected");
+        expect(rejects(obbench::GenerateDds(obbench::DdsKind::Dxt1, 16388, 4), 16388, 4), "DXT1 16388 x 4 not rejected");
+
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "dds: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    void BenchDds(BenchRunner& runner)
+    {
+        for (size_t k = 0; k < static_cast<size_t>(obbench::DdsKind::Count); ++k)
+        {
+            const auto kind = static_cast<obbench::DdsKind>(k);
+            const std::string name = std::string("dds/") + obbench::GetDdsLayout(kind).name + "_512";
+            if (!runner.Selected(name)) continue;
+            const auto dds = obbench::GenerateDds(kind, 512, 512);
+            std::vector<uint8_t> out;
+            uint32_t w = 0, h = 0;
+            runner.Run(name, 512ull * 512ull * 4ull, 512ull * 512ull, [&]
+            {
+                obbook::DecodeDdsToBgra(dds, out, w, h);
+            });
+        }
+    }
+
+    // What a TGA of the layout decodes back to: grayscale repeats green, layouts without alpha read opaque.
+    std::vector<uint8_t> ExpectedTgaPixels(const std::vector<uint8_t>& bgra, const obbench::TgaLayout& layout)
+    {
+        std::vector<uint8_t> out = bgra;
+        for (size_t i = 0; i < out.size(); i += 4)
+        {
+            if (layout.grayscale) out[i] = out[i + 2] = out[i + 1];
+            if (layout.bits == 24 || layout.bits == 8) out[i + 3] = 255;
+        }
+        return out;
+    }
+
+    // Every layout, raw and RLE, of all four origins must decode back to the pixels it was written from, also
+    // through DecodeTextureToBgra and LoadBookImages; truncated, color-mapped and oversized files must fail.
+    void CheckTga(const fs::path& root)
+    {
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const std::string& what) { if (!ok) problems.push_back(what); };
+        struct Size { uint32_t w, h; };
+        const Size sizes[] = { { 64, 48 }, { 37, 23 }, { 300, 3 }, { 1, 1 } };
+        const std::pair<uint32_t, bool> formats[] = { { 24, false }, { 32, false }, { 8, true }, { 16, true } };
+        std::vector<uint8_t> out;
+        for (const Size& s : sizes)
+        {
+            const auto image = obbench::GenerateTgaImage(s.w, s.h, s.w * 131 + s.h);
+            for (const auto& [bits, gray] : formats)
+                for (uint32_t variant = 0; variant < 8; ++variant)
+                {
+                    obbench::TgaLayout layout{ bits, gray, (variant & 1) != 0, (variant & 2) != 0, (variant & 4) != 0 };
+                    const std::string label = std::to_string(bits) + (gray ? "-bit gray" : "-bit") + (layout.rle ? " rle" : " raw")
+                        + (layout.topDown ? " top" : " bottom") + (layout.rightToLeft ? " right " : " left ")
+                        + std::to_string(s.w) + "x" + std::to_string(s.h);
+                    auto tga = obbench::EncodeTga(image, s.w, s.h, layout);
+                    uint32_t w = 0, h = 0;
+                    const bool ok = obbook::DecodeTgaToBgra(tga, out, w, h);
+                    expect(ok && w == s.w && h == s.h, label + ": not decoded");
+                    expect(!ok || out == ExpectedTgaPixels(image, layout), label + ": pixels differ");
+                    if (variant == 1)
+                    {
+                        std::vector<uint8_t> viaTexture;
+                        expect(obbook::DecodeTextureToBgra(tga, 16, viaTexture, w, h) && viaTexture == out, label + ": texture entry point differs");
+                    }
+                    tga.pop_back();
+                    expect(!obbook::DecodeTgaToBgra(tga, out, w, h), label + ": truncated file decoded");
+                }
+        }
+
+        uint32_t w = 0, h = 0;
+        const auto small = obbench::GenerateTgaImage(4, 4, 5);
+        auto tga = obbench::EncodeTga(small, 4, 4, obbench::TgaLayout{ 24, false, true, false, false });
+        tga[12] = tga[13] = tga[14] = tga[15] = 0xFF; // 65535 x 65535 from a few dozen RLE bytes
+        expect(!obbook::DecodeTgaToBgra(tga, out, w, h), "oversized RLE header decoded");
+        tga = obbench::EncodeTga(small, 4, 4, obbench::TgaLayout{ 32, false, false, false, false });
+        tga[2] = 1;
+        expect(!obbook::DecodeTgaToBgra(tga, out, w, h), "color-mapped file decoded");
+
+        // Through the preview path.
+        const fs::path data = root / "tga_check" / "Data";
+        std::error_code ec;
+        fs::remove_all(data.parent_path(), ec);
+        fs::create_directories(data / "textures/menus/book", ec);
+        const auto plate = obbench::GenerateTgaImage(40, 30, 9);
+        const obbench::TgaLayout plateLayout{ 32, false, true, false, false };
+        {
+            const auto bytes = obbench::EncodeTga(plate, 40, 30, plateLayout);
+            std::ofstream(data / "textures/menus/book/plate.tga", std::ios::binary).write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        }
+        obbook::BookLayout bookLayout;
+        obbook::ParseBookMarkup("<IMG src=\"Book\\plate.tga\" width=40 height=30>text", bookLayout);
+        std::vector<obbook::DecodedImage> images;
+        obbook::LoadBookImages(bookLayout, data.string(), images);
+        expect(images.size() == 1 && images[0].width == 40 && images[0].height == 30 && images[0].bgra == ExpectedTgaPixels(plate, plateLayout),
+            "book image from a loose TGA not decoded");
+
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "tga: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    void BenchTga(BenchRunner& runner)
+    {
+        struct Case { const char* name; obbench::TgaLayout layout; };
+        const Case cases[] =
+        {
+            { "tga/rgb24_raw_512", { 24, false, false, false, false } },
+            { "tga/rgba32_raw_512", { 32, false, false, false, false } },
+            { "tga/rgba32_raw_topdown_512", { 32, false, false, true, false } },
+            { "tga/gray8_raw_512", { 8, true, false, false, false } },
+            { "tga/rgb24_rle_512", { 24, false, true, false, false } },
+            { "tga/rgba32_rle_512", { 32, false, true, false, false } },
+            { "tga/gray8_rle_512", { 8, true, true, false, false } },
+        };
+        const auto image = obbench::GenerateTgaImage(512, 512, 3);
+        for (const auto& c : cases)
+        {
+            if (!runner.Selected(c.name)) continue;
+            const auto tga = obbench::EncodeTga(image, 512, 512, c.layout);
+            std::vector<uint8_t> out;
+            uint32_t w = 0, h = 0;
+            runner.Run(c.name, 512ull * 512ull * 4ull, 512ull * 512ull, [&]
+            {
+                obbook::DecodeTgaToBgra(tga, out, w, h);
+            });
+            runner.AddCounter(c.name, "file_bytes", static_cast<double>(tga.size()));
+        }
+    }
+
+    // A cold build must decode every texture once, a reopened cache must serve the same bytes without decoding,
+    // and a cache file torn mid-append must lose only its last record.
+    void CheckThumbnails(const fs::path& root, const std::vector<std::string>& paths)
+    {
+        const std::string dataDir = (root / "Data").string();
+        const fs::path file = root / "check.obt";
+        std::error_code ec;
+        fs::remove(file, ec);
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const char* what) { if (!ok) problems.push_back(what); };
+
+        std::vector<obbook::ThumbnailView> cold;
+        obbook::ThumbnailStats coldStats{};
+        std::vector<std::vector<uint8_t>> coldPixels;
+        uint32_t maxEdge = 0;
+        {
+            obbook::ThumbnailCache cache(file.string());
+            maxEdge = cache.GetMaxEdge();
+            expect(cache.IsOpen(), "cache file did not open");
+            cache.GetThumbnails(dataDir, paths, 4, cold, &coldStats);
+            expect(coldStats.cached == 0 && coldStats.decoded == paths.size() - 2 && coldStats.failed == 2, "cold build stats");
+            for (const auto& t : cold)
+            {
+                coldPixels.emplace_back(t.bgra, t.bgra + static_cast<size_t>(t.width) * t.height * 4);
+                expect(t.width <= maxEdge && t.height <= maxEdge, "thumbnail larger than the max edge");
+            }
+            expect(!cold[0].IsValid() && !cold[1].IsValid(), "non-DDS file produced a thumbnail");
+            expect(cold[2].width == 96 && cold[2].height == 64, "300x200 plate not box-filtered to 96x64");
+            expect(cold[16].width == 64 && cold[16].height == 64, "256x256 mip chain did not use its 64x64 level");
+            expect(cold.back().width == 64 && cold.back().height == 64, "archived 128x128 mip chain did not use its 64x64 level");
+
+            std::vector<obbook::ThumbnailView> warm;
+            obbook::ThumbnailStats warmStats{};
+            cache.GetThumbnails(dataDir, paths, 4, warm, &warmStats);
+            expect(warmStats.cached == paths.size() && warmStats.decoded == 0, "second request decoded again");
+        }
+
+        // cold's views outlive their cache; the mapping they hold must still read the same bytes.
+        for (size_t i = 0; i < cold.size(); ++i)
+            expect(std::equal(coldPixels[i].begin(), coldPixels[i].end(), cold[i].bgra), "view changed after its cache was destroyed");
+
+        {
+            obbook::ThumbnailCache reopened(file.string());
+            std::vector<obbook::ThumbnailView> again;
+            obbook::ThumbnailStats stats{};
+            reopened.GetThumbnails(dataDir, paths, 4, again, &stats);
+            expect(stats.cached == paths.size() && stats.decoded == 0, "reopened cache decoded again");
+            bool same = again.size() == cold.size();
+            for (size_t i = 0; same && i < again.size(); ++i)
+                same = again[i].width == cold[i].width && again[i].height == cold[i].height
+                    && std::equal(coldPixels[i].begin(), coldPixels[i].end(), again[i].bgra);
+            expect(same, "reopened cache served different pixels");
+        }
+
+        // Windows cannot shrink a file that is still mapped.
+        cold.clear();
+        const uint64_t bytes = fs::file_size(file, ec);
+        fs::resize_file(file, bytes - 100, ec);
+        {
+            obbook::ThumbnailCache torn(file.string());
+            std::vector<obbook::ThumbnailView> again;
+            obbook::ThumbnailStats stats{};
+            torn.GetThumbnails(dataDir, paths, 4, again, &stats);
+            expect(stats.cached == paths.size() - 1 && stats.decoded == 1, "torn cache file not cut back to its last whole record");
+            expect(fs::file_size(file, ec) == bytes, "torn record not rewritten");
+        }
+
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "thumbnails: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    // Gallery of a few hundred book textures: decoding all of them into a fresh cache file on every core, and
+    // reopening that file, which maps it and decodes nothing.
+    void BenchThumbnails(BenchRunner& runner, const fs::path& root, const std::vector<std::string>& paths)
+    {
+        const std::string dataDir = (root / "Data").string();
+        const fs::path file = root / "bench.obt";
+        const std::string suffix = "/" + std::to_string(paths.size());
+        std::error_code ec;
+
+        obbook::ThumbnailStats stats{};
+        std::vector<obbook::ThumbnailView> views;
+        const std::string cold = "thumbnails/cold" + suffix;
+        runner.Run(cold, 0, paths.size(), [&]
+        {
+            views.clear();
+            fs::remove(file, ec);
+            obbook::ThumbnailCache cache(file.string());
+            cache.GetThumbnails(dataDir, paths, 0, views, &stats);
+        });
+        runner.AddCounter(cold, "workers", stats.workers);
+        runner.AddCounter(cold, "file_bytes", static_cast<double>(fs::file_size(file, ec)));
+
+        const std::string coldSerial = "thumbnails/cold_serial" + suffix;
+        runner.Run(coldSerial, 0, paths.size(), [&]
+        {
+            views.clear();
+            fs::remove(file.string() + ".serial", ec);
+            obbook::ThumbnailCache cache(file.string() + ".serial");
+            cache.GetThumbnails(dataDir, paths, 1, views, &stats);
+        });
+
+        const std::string reopen = "thumbnails/reopen" + suffix;
+        runner.Run(reopen, 0, paths.size(), [&]
+        {
+            views.clear();
+            obbook::ThumbnailCache cache(file.string());
+            cache.GetThumbnails(dataDir, paths, 0, views, &stats);
+        });
+        runner.AddCounter(reopen, "cached", stats.cached);
+    }
+
+    // Whole-book pagination and page composition with a synthetic glyph atlas, serial versus one worker per core.
+    void BenchPages(BenchRunner& runner, const Options& o, const fs::path& dataDir)
+    {
+        const auto source = obbench::GenerateBookSource(obbench::CorpusKind::Images, static_cast<size_t>(o.sourceKb) * 1024);
+        const obbook::GlyphAtlas atlas = obbench::MakeBoxGlyphAtlas();
+        obbook::BookPagesRequest request{};
+        request.dataDirUtf8 = dataDir.string();
+
+        obbook::BookLayout layout;
+        std::vector<obbook::DecodedImage> images;
+        runner.Run("pages/layout", source.size(), 1, [&]
+        {
+            obbook::ParseBookMarkup(source, layout);
+            obbook::LoadBookImages(layout, request.dataDirUtf8, images);
+            obbook::LayoutBookPages(layout, atlas, request.geometry, images);
+        });
+        const uint32_t pageCount = layout.PageCount();
+        const uint64_t pageBytes = static_cast<uint64_t>(request.geometry.width) * request.geometry.height * 4;
+
+        const uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+        for (const uint32_t workers : { 1u, cores })
+        {
+            const std::string name = "pages/render_all/workers_" + std::to_string(workers);
+            request.workerCount = workers;
+            obbook::BookPagesResult result;
+            runner.Run(name, pageBytes * pageCount, pageCount, [&]
+            {
+                obbook::RenderBookPages(source, atlas, request, result);
+            });
+
+            std::vector<double> pageMs;
+            for (const auto& page : result.pages) pageMs.push_back(page.milliseconds);
+            std::sort(pageMs.begin(), pageMs.end());
+            runner.AddCounter(name, "pages", static_cast<double>(result.totalPages));
+            runner.AddCounter(name, "workers", static_cast<double>(result.workers));
+            runner.AddCounter(name, "layout_ms", result.layoutMilliseconds);
+            runner.AddCounter(name, "wall_ms", result.wallMilliseconds);
+            if (!pageMs.empty()) runner.AddCounter(name, "page_median_ms", pageMs[pageMs.size() / 2]);
+            if (cores == 1) break;
+        }
+    }
+
+    const char* PngFilterName(obbook::PngFilter filter)
+    {
+        static const char* const kNames[] = { "none", "sub", "up", "average", "paeth", "adaptive" };
+        return kNames[static_cast<size_t>(filter)];
+    }
+
+    // Every filter, level and channel layout must read back (with the in-tree decoder, which checks CRCs and
+    // Adler-32) as the pixels that went in; an exported book must match RenderBookPages page for page; and a
+    // warm encoder must not allocate.
+    void CheckPng(const fs::path& root, const fs::path& dataDir)
+    {
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const std::string& what) { if (!ok) problems.push_back(what); };
+
+        const uint32_t width = 157, height = 61;
+        const size_t stride = width * 4 + 12;
+        std::vector<std::vector<uint8_t>> images(3, std::vector<uint8_t>(stride * height));
+        uint32_t seed = 7;
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                for (int c = 0; c < 4; ++c) images[0][y * stride + x * 4 + c] = static_cast<uint8_t>(seed >> (8 * c));
+                const uint8_t gradient[4] = { static_cast<uint8_t>(x), static_cast<uint8_t>(y * 4), static_cast<uint8_t>(x + y), static_cast<uint8_t>(255 - x) };
+                std::memcpy(&images[1][y * stride + x * 4], gradient, 4);
+                const bool ink = (x / 3 + y / 5) % 7 == 0;
+                const uint8_t page[4] = { ink ? uint8_t{ 36 } : uint8_t{ 0xF5 }, ink ? uint8_t{ 36 } : uint8_t{ 0xF0 }, ink ? uint8_t{ 36 } : uint8_t{ 0xE7 }, 255 };
+                std::memcpy(&images[2][y * stride + x * 4], page, 4);
+            }
+        }
+
+        obbook::PngEncoder encoder;
+        std::vector<uint8_t> png, decoded;
+        for (size_t i = 0; i < images.size(); ++i)
+        {
+            for (uint32_t f = 0; f <= static_cast<uint32_t>(obbook::PngFilter::Adaptive); ++f)
+            {
+                for (const uint32_t level : { 0u, 1u, 2u, 9u })
+                {
+                    for (const bool alpha : { false, true })
+                    {
+                        obbook::PngOptions options{};
+                        options.filter = static_cast<obbook::PngFilter>(f);
+                        options.level = level;
+                        options.keepAlpha = alpha;
+                        const std::string what = "image " + std::to_string(i) + ", " + PngFilterName(options.filter) + ", level "
+                            + std::to_string(level) + (alpha ? ", rgba" : ", rgb");
+                        uint32_t w = 0, h = 0;
+                        if (!encoder.Encode(images[i].data(), width, height, stride, options, png)
+                            || !obbook::DecodePng(png.data(), png.size(), w, h, decoded) || w != width || h != height)
+                        {
+                            expect(false, what + " did not round-trip");
+                            continue;
+                        }
+                        bool same = true;
+                        for (uint32_t y = 0; same && y < height; ++y)
+                        {
+                            for (uint32_t x = 0; same && x < width; ++x)
+                            {
+                                const uint8_t* a = &images[i][y * stride + x * 4];
+                                const uint8_t* b = &decoded[(static_cast<size_t>(y) * width + x) * 4];
+                                same = a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && (alpha ? a[3] : 255) == b[3];
+                            }
+                        }
+                        expect(same, what + " decoded to different pixels");
+                    }
+                }
+            }
+        }
+        png[png.size() / 2] ^= 0x40;
+        uint32_t w = 0, h = 0;
+        expect(!obbook::DecodePng(png.data(), png.size(), w, h, decoded), "corrupted PNG was accepted");
+
+        const auto source = obbench::GenerateBookSource(obbench::CorpusKind::Images, 6 * 1024, 3);
+        const obbook::GlyphAtlas atlas = obbench::MakeBoxGlyphAtlas();
+        obbook::BookPagesRequest request{};
+        request.dataDirUtf8 = dataDir.string();
+        request.workerCount = 3;
+        obbook::BookPagesResult rendered;
+        obbook::RenderBookPages(source, atlas, request, rendered);
+
+        const fs::path directory = root / "png_check";
+        std::error_code ec;
+        fs::remove_all(directory, ec);
+        obbook::BookPagesExport output{};
+        output.directoryUtf8 = directory.string();
+        obbook::BookPagesExportResult exported;
+        obbook::ExportBookPages(source, atlas, request, output, exported);
+        expect(rendered.pages.size() > 1 && exported.filesUtf8.size() == rendered.pages.size() && exported.failed == 0,
+            "export did not write every page");
+        for (size_t i = 0; i < exported.filesUtf8.size() && i < rendered.pages.size(); ++i)
+        {
+            const std::string& file = exported.filesUtf8[i];
+            char name[32];
+            std::snprintf(name, sizeof(name), "page_%04u.png", rendered.pages[i].page + 1);
+            expect(fs::path(file).filename() == name, "exported page " + std::to_string(i) + " misnamed");
+            std::vector<uint8_t> bgra;
+            const bool read = obbook::ReadPngFile(file, w, h, bgra);
+            expect(read && w == request.geometry.width && h == request.geometry.height && bgra == rendered.pages[i].bgra,
+                "exported page " + std::to_string(i) + " differs from the rendered one");
+        }
+
+        // The exported pages are opaque, so the rendered frame is what comes back; reuse it for the allocation check.
+        if (!rendered.pages.empty())
+        {
+            const auto& page = rendered.pages[0].bgra;
+            obbook::PngOptions options{};
+            encoder.Encode(page.data(), request.geometry.width, request.geometry.height, request.geometry.width * 4, options, png);
+            const uint64_t allocations = obbench::CountAllocations([&]
+            {
+                encoder.Encode(page.data(), request.geometry.width, request.geometry.height, request.geometry.width * 4, options, png);
+            });
+            expect(allocations == 0, "warm PngEncoder allocated " + std::to_string(allocations) + " times");
+        }
+
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "png: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    // An inflater that shares nothing with ObBookPng, after zlib's puff.c: one bit at a time, slow but small
+    // enough to trust.
+    class ReferenceInflater
+    {
+    public:
+        // False on any malformed or truncated stream; consumed is the bytes read, up to the last block's end.
+        bool Inflate(const uint8_t* in, size_t size, std::vector<uint8_t>& out, size_t& consumed)
+        {
+            in_ = in;
+            size_ = size;
+            pos_ = 0;
+            bitBuffer_ = 0;
+            bitCount_ = 0;
+            overrun_ = false;
+            out_ = &out;
+            out.clear();
+            for (bool last = false; !last;)
+            {
+                last = Bits(1) != 0;
+                const uint32_t type = Bits(2);
+                const bool ok = type == 0 ? Stored() : type == 1 ? Fixed() : type == 2 ? Dynamic() : false;
+                if (!ok || overrun_) return false;
+            }
+            consumed = pos_;
+            return true;
+        }
+
+    private:
+        struct Huffman
+        {
+            uint16_t count[16];
+            uint16_t symbol[288];
+        };
+
+        const uint8_t* in_ = nullptr;
+        size_t size_ = 0, pos_ = 0;
+        uint64_t bitBuffer_ = 0;
+        uint32_t bitCount_ = 0;
+        bool overrun_ = false;
+        std::vector<uint8_t>* out_ = nullptr;
+
+        uint32_t Bits(uint32_t need)
+        {
+            uint64_t value = bitBuffer_;
+            while (bitCount_ < need)
+            {
+                if (pos_ == size_)
+                {
+                    overrun_ = true;
+                    return 0;
+                }
+                value |= static_cast<uint64_t>(in_[pos_++]) << bitCount_;
+                bitCount_ += 8;
+            }
+            bitBuffer_ = value >> need;
+            bitCount_ -= need;
+            return static_cast<uint32_t>(value & ((uint64_t{ 1 } << need) - 1));
+        }
+
+        // False if over-subscribed; incomplete codes are allowed (a single distance code is).
+        static bool Build(Huffman& h, const uint8_t* lengths, uint32_t n)
+        {
+            std::memset(h.count, 0, sizeof(h.count));
+            for (uint32_t s = 0; s < n; ++s) ++h.count[lengths[s]];
+            int left = 1;
+            for (uint32_t len = 1; len < 16; ++len)
+            {
+                left = left * 2 - h.count[len];
+                if (left < 0) return false;
+            }
+            uint16_t offsets[16] = {};
+            for (uint32_t len = 1; len < 15; ++len) offsets[len + 1] = static_cast<uint16_t>(offsets[len] + h.count[len]);
+            for (uint32_t s = 0; s < n; ++s)
+                if (lengths[s] != 0) h.symbol[offsets[lengths[s]]++] = static_cast<uint16_t>(s);
+            return true;
+        }
+
+        int Decode(const Huffman& h)
+        {
+            int code = 0, first = 0, index = 0;
+            for (uint32_t len = 1; len < 16; ++len)
+            {
+                code |= static_cast<int>(Bits(1));
+                const int count = h.count[len];
+                if (code - count < first) return h.symbol[index + (code - first)];
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+            }
+            return -1;
+        }
+
+        bool Stored()
+        {
+            bitBuffer_ = 0;
+            bitCount_ = 0;
+            if (size_ - pos_ < 4) return false;
+            const uint32_t len = in_[pos_] | in_[pos_ + 1] << 8;
+            const uint32_t nlen = in_[pos_ + 2] | in_[pos_ + 3] << 8;
+            pos_ += 4;
+            if (len != (~nlen & 0xFFFF) || size_ - pos_ < len) return false;
+            out_->insert(out_->end(), in_ + pos_, in_ + pos_ + len);
+            pos_ += len;
+            return true;
+        }
+
+        bool Codes(const Huffman& lengthCodes, const Huffman& distanceCodes)
+        {
+            static const uint16_t kLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                67, 83, 99, 115, 131, 163, 195, 227, 258 };
+            static const uint8_t kLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+            static const uint16_t kDistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+                1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+            static const uint8_t kDistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+                12, 12, 13, 13 };
+            std::vector<uint8_t>& out = *out_;
+            for (;;)
+            {
+                int symbol = Decode(lengthCodes);
+                if (symbol < 0 || overrun_) return false;
+                if (symbol < 256)
+                {
+                    out.push_back(static_cast<uint8_t>(symbol));
+                    continue;
+                }
+                if (symbol == 256) return true;
+                symbol -= 257;
+                if (symbol >= 29) return false;
+                const uint32_t length = kLengthBase[symbol] + Bits(kLengthExtra[symbol]);
+                symbol = Decode(distanceCodes);
+                if (symbol < 0 || symbol >= 30) return false;
+                const size_t distance = kDistanceBase[symbol] + Bits(kDistanceExtra[symbol]);
+                if (distance > out.size()) return false;
+                for (uint32_t i = 0; i < length; ++i) out.push_back(out[out.size() - distance]);
+            }
+        }
+
+        bool Fixed()
+        {
+            uint8_t lengths[288];
+            std::memset(lengths, 8, 144);
+            std::memset(lengths + 144, 9, 112);
+            std::memset(lengths + 256, 7, 24);
+            std::memset(lengths + 280, 8, 8);
+            Huffman lengthCodes, distanceCodes;
+            Build(lengthCodes, lengths, 288);
+            std::memset(lengths, 5, 30);
+            Build(distanceCodes, lengths, 30);
+            return Codes(lengthCodes, distanceCodes);
+        }
+
+        bool Dynamic()
+        {
+            static const uint8_t kOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            const uint32_t nlen = Bits(5) + 257, ndist = Bits(5) + 1, ncode = Bits(4) + 4;
+            if (nlen > 286 || ndist > 30) return false;
+            uint8_t lengths[320] = {};
+            for (uint32_t i = 0; i < ncode; ++i) lengths[kOrder[i]] = static_cast<uint8_t>(Bits(3));
+            Huffman lengthCodes, distanceCodes;
+            if (!Build(lengthCodes, lengths, 19)) return false;
+            for (uint32_t i = 0; i < nlen + ndist;)
+            {
+                const int symbol = Decode(lengthCodes);
+                if (symbol < 0 || overrun_) return false;
+                if (symbol < 16)
+                {
+                    lengths[i++] = static_cast<uint8_t>(symbol);
+                    continue;
+                }
+                uint8_t value = 0;
+                uint32_t repeat = 0;
+                if (symbol == 16)
+                {
+                    if (i == 0) return false;
+                    value = lengths[i - 1];
+                    repeat = 3 + Bits(2);
+                }
+                else
+                {
+                    repeat = symbol == 17 ? 3 + Bits(3) : 11 + Bits(7);
+                }
+                if (i + repeat > nlen + ndist) return false;
+                while (repeat-- > 0) lengths[i++] = value;
+            }
+            if (lengths[256] == 0) return false;
+            return Build(lengthCodes, lengths, nlen) && Build(distanceCodes, lengths + nlen, ndist) && Codes(lengthCodes, distanceCodes);
+        }
+    };
+
+    uint32_t ReferenceCrc32(const uint8_t* data, size_t size)
+    {
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; ++i)
+        {
+            crc ^= data[i];
+            for (int k = 0; k < 8; ++k) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+        return ~crc;
+    }
+
+    // Reads an 8-bit RGB or RGBA PNG with nothing from ObBookPng: every chunk's CRC, IEND exactly at the end, the
+    // zlib header and Adler-32, then the row filters. Pixels come back in the file's channel order.
+    bool ReferenceDecodePng(const std::vector<uint8_t>& png, uint32_t& width, uint32_t& height, uint32_t& channels,
+        std::vector<uint8_t>& pixels, std::string& error)
+    {
+        auto be32 = [&png](size_t at) { return uint32_t{ png[at] } << 24 | uint32_t{ png[at + 1] } << 16 | uint32_t{ png[at + 2] } << 8 | png[at + 3]; };
+        static const uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        if (png.size() < 8 || std::memcmp(png.data(), kSignature, 8) != 0) { error = "bad signature"; return false; }
+        std::vector<uint8_t> zlib;
+        bool header = false, ended = false;
+        for (size_t at = 8; !ended;)
+        {
+            if (png.size() - at < 12) { error = "truncated chunk"; return false; }
+            const uint32_t length = be32(at);
+            if (png.size() - at - 12 < length) { error = "chunk runs past the end"; return false; }
+            const uint8_t* type = &png[at + 4];
+            if (ReferenceCrc32(type, 4 + length) != be32(at + 8 + length))
+            {
+                error = "bad CRC on chunk " + std::string(reinterpret_cast<const char*>(type), 4) + " at " + std::to_string(at);
+                return false;
+            }
+            if (std::memcmp(type, "IHDR", 4) == 0 && length == 13)
+            {
+                width = be32(at + 8);
+                height = be32(at + 12);
+                channels = png[at + 17] == 6 ? 4 : png[at + 17] == 2 ? 3 : 0;
+                header = png[at + 16] == 8 && channels != 0 && png[at + 18] == 0 && png[at + 19] == 0 && png[at + 20] == 0;
+            }
+            else if (std::memcmp(type, "IDAT", 4) == 0)
+            {
+                zlib.insert(zlib.end(), type + 4, type + 4 + length);
+            }
+            ended = std::memcmp(type, "IEND", 4) == 0;
+            at += 12 + length;
+            if (ended && at != png.size()) { error = "bytes after IEND"; return false; }
+        }
+        if (!header) { error = "missing or unsupported IHDR"; return false; }
+
+        if (zlib.size() < 6 || (zlib[0] & 0x0F) != 8 || (zlib[0] << 8 | zlib[1]) % 31 != 0 || (zlib[1] & 0x20) != 0) { error = "bad zlib header"; return false; }
+        std::vector<uint8_t> raw;
+        size_t consumed = 0;
+        ReferenceInflater inflater;
+        if (!inflater.Inflate(zlib.data() + 2, zlib.size() - 2, raw, consumed)) { error = "inflate failed"; return false; }
+        uint32_t a = 1, b = 0;
+        for (const uint8_t v : raw) { a = (a + v) % 65521; b = (b + a) % 65521; }
+        const size_t trailer = 2 + consumed;
+        if (zlib.size() - trailer != 4 || (b << 16 | a) != (uint32_t{ zlib[trailer] } << 24 | uint32_t{ zlib[trailer + 1] } << 16
+            | uint32_t{ zlib[trailer + 2] } << 8 | zlib[trailer + 3])) { error = "bad Adler-32 or trailing bytes"; return false; }
+
+        const size_t rowBytes = static_cast<size_t>(width) * channels;
+        if (raw.size() != (rowBytes + 1) * height) { error = "inflated to " + std::to_string(raw.size()) + " bytes"; return false; }
+        pixels.assign(rowBytes * height, 0);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const uint8_t filter = raw[y * (rowBytes + 1)];
+            const uint8_t* in = &raw[y * (rowBytes + 1) + 1];
+            uint8_t* row = &pixels[y * rowBytes];
+            const uint8_t* up = y > 0 ? row - rowBytes : nullptr;
+            for (size_t i = 0; i < rowBytes; ++i)
+            {
+                const int left = i >= channels ? row[i - channels] : 0, above = up ? up[i] : 0, corner = up && i >= channels ? up[i - channels] : 0;
+                const int p = left + above - corner, pa = std::abs(p - left), pb = std::abs(p - above), pc = std::abs(p - corner);
+                const int predictor = filter == 0 ? 0 : filter == 1 ? left : filter == 2 ? above : filter == 3 ? (left + above) / 2
+                    : pa <= pb && pa <= pc ? left : pb <= pc ? above : corner;
+                if (filter > 4) { error = "bad filter type"; return false; }
+                row[i] = static_cast<uint8_t>(in[i] + predictor);
+            }
+        }
+        return true;
+    }
+
+    // Noise does not compress, so every block falls back to stored ones: the worst case for the encoder's output
+    // bound. Each file is read back by ReferenceDecodePng, not the in-tree decoder.
+    void CheckPngNoise()
+    {
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const std::string& what) { if (!ok) problems.push_back(what); };
+
+        obbook::PngEncoder encoder;
+        std::vector<uint8_t> image, png, pixels;
+        uint32_t seed = 12345;
+        for (const auto& [width, height] : { std::pair<uint32_t, uint32_t>{ 1024, 1024 }, { 1000, 70 }, { 333, 97 } })
+        {
+            image.resize(static_cast<size_t>(width) * height * 4);
+            for (auto& v : image)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                v = static_cast<uint8_t>(seed >> 24);
+            }
+            for (const uint32_t level : { 0u, 1u, 3u, 6u, 9u })
+            {
+                for (const bool alpha : { false, true })
+                {
+                    for (const obbook::PngFilter filter : { obbook::PngFilter::None, obbook::PngFilter::Adaptive })
+                    {
+                        // The large image once per level is enough to cross many 64 KiB blocks.
+                        if (width == 1024 && (!alpha || filter != obbook::PngFilter::None)) continue;
+                        obbook::PngOptions options{};
+                        options.filter = filter;
+                        options.level = level;
+                        options.keepAlpha = alpha;
+                        const std::string what = std::to_string(width) + "x" + std::to_string(height) + " noise, "
+                            + PngFilterName(filter) + ", level " + std::to_string(level) + (alpha ? ", rgba" : ", rgb");
+                        if (!encoder.Encode(image.data(), width, height, static_cast<size_t>(width) * 4, options, png))
+                        {
+                            expect(false, what + " was not encoded");
+                            continue;
+                        }
+                        uint32_t w = 0, h = 0, channels = 0;
+                        std::string error;
+                        if (!ReferenceDecodePng(png, w, h, channels, pixels, error))
+                        {
+                            expect(false, what + ": " + error);
+                            continue;
+                        }
+                        bool same = w == width && h == height && channels == (alpha ? 4u : 3u);
+                        for (size_t i = 0; same && i < static_cast<size_t>(width) * height; ++i)
+                        {
+                            const uint8_t* in = &image[i * 4];
+                            const uint8_t* out = &pixels[i * channels];
+                            same = out[0] == in[2] && out[1] == in[1] && out[2] == in[0] && (!alpha || out[3] == in[3]);
+                        }
+                        expect(same, what + " decoded to different pixels");
+                    }
+                }
+            }
+        }
+
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "png noise: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    // PNG encoding of one rendered 1000x700 page per filter and per level, then whole-book export (compose,
+    // encode and write every page) serial versus one worker per core.
+    void BenchPng(BenchRunner& runner, const Options& o, const fs::path& dataDir)
+    {
+        const auto source = obbench::GenerateBookSource(obbench::CorpusKind::Images, static_cast<size_t>(o.sourceKb) * 1024);
+        const obbook::GlyphAtlas atlas = obbench::MakeBoxGlyphAtlas();
+        obbook::BookPagesRequest request{};
+        request.dataDirUtf8 = dataDir.string();
+        const uint32_t width = request.geometry.width, height = request.geometry.height;
+        const uint64_t frameBytes = static_cast<uint64_t>(width) * height * 4;
+
+        obbook::BookPagesRequest first = request;
+        first.pageCount = 1;
+        obbook::BookPagesResult rendered;
+        obbook::RenderBookPages(source, atlas, first, rendered);
+        if (rendered.pages.empty()) return;
+        const auto& page = rendered.pages[0].bgra;
+
+        obbook::PngEncoder encoder;
+        std::vector<uint8_t> png;
+        auto encode = [&](const std::string& name, const obbook::PngOptions& options)
+        {
+            runner.Run(name, frameBytes, 1, [&]
+            {
+                encoder.Encode(page.data(), width, height, static_cast<size_t>(width) * 4, options, png);
+            });
+            runner.AddCounter(name, "png_bytes", static_cast<double>(png.size()));
+        };
+        for (uint32_t f = 0; f <= static_cast<uint32_t>(obbook::PngFilter::Adaptive); ++f)
+        {
+            obbook::PngOptions options{};
+            options.filter = static_cast<obbook::PngFilter>(f);
+            encode(std::string("png/encode_1000x700/") + PngFilterName(options.filter), options);
+        }
+        for (const uint32_t level : { 0u, 3u, 6u, 9u })
+        {
+            obbook::PngOptions options{};
+            options.level = level;
+            encode("png/encode_1000x700/sub_level_" + std::to_string(level), options);
+        }
+
+        obbook::BookPagesExport output{};
+        output.directoryUtf8 = (o.fixtures / "png_export").string();
+        const uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+        for (const uint32_t workers : { 1u, cores })
+        {
+            const std::string name = "png/export_book/workers_" + std::to_string(workers);
+            request.workerCount = workers;
+            obbook::BookPagesExportResult result;
+            uint64_t pages = 0;
+            if (runner.Selected(name))
+            {
+                obbook::ExportBookPages(source, atlas, request, output, result);
+                pages = result.filesUtf8.size();
+            }
+            runner.Run(name, frameBytes * pages, pages, [&]
+            {
+                obbook::ExportBookPages(source, atlas, request, output, result);
+            });
+            runner.AddCounter(name, "pages", static_cast<double>(pages));
+            runner.AddCounter(name, "workers", static_cast<double>(result.workers));
+            runner.AddCounter(name, "png_bytes", static_cast<double>(result.pngBytes));
+            runner.AddCounter(name, "compose_ms", result.composeMilliseconds);
+            runner.AddCounter(name, "encode_ms", result.encodeMilliseconds);
+            if (cores == 1) break;
+        }
+    }
+
+    // Reference for DiffBgra: one pixel at a time, no SIMD.
+    obbook::ImageDiffStats DiffReference(const std::vector<uint8_t>& e, const std::vector<uint8_t>& a, size_t stride,
+        uint32_t width, uint32_t height, uint8_t tolerance)
+    {
+        obbook::ImageDiffStats stats{};
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                uint32_t worst = 0;
+                for (int c = 0; c < 4; ++c)
+                {
+                    const int d = static_cast<int>(e[y * stride + x * 4 + c]) - a[y * stride + x * 4 + c];
+                    worst = std::max<uint32_t>(worst, static_cast<uint32_t>(d < 0 ? -d : d));
+                }
+                stats.maxChannelDelta = std::max(stats.maxChannelDelta, worst);
+                stats.differingPixels += worst > tolerance ? 1 : 0;
+            }
+        }
+        return stats;
+    }
+
+    // DiffBgra must count exactly like the scalar reference for any width (SIMD body plus tail) and tolerance.
+    // The golden run must pass against goldens it just recorded, fail with a heatmap when a golden page is
+    // changed or missing, and fail on a recorded time far below the current one.
+    void CheckGolden(const fs::path& root, const fs::path& dataDir)
+    {
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const std::string& what) { if (!ok) problems.push_back(what); };
+
+        uint32_t seed = 11;
+        for (const uint32_t width : { 1u, 3u, 4u, 5u, 17u, 64u })
+        {
+            const uint32_t height = 9;
+            const size_t stride = width * 4 + 8;
+            std::vector<uint8_t> e(stride * height), a(stride * height);
+            for (size_t i = 0; i < e.size(); ++i)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                e[i] = static_cast<uint8_t>(seed >> 24);
+                // Mostly small deltas either way, so every tolerance splits the pixels.
+                const int delta = static_cast<int>((seed >> 8) % 9) - 4 + ((seed & 0x3F) == 0 ? 120 : 0);
+                a[i] = static_cast<uint8_t>(std::clamp(e[i] + delta, 0, 255));
+            }
+            for (const uint8_t tolerance : { uint8_t{ 0 }, uint8_t{ 2 }, uint8_t{ 4 }, uint8_t{ 200 }, uint8_t{ 255 } })
+            {
+                obbook::ImageDiffStats stats{};
+                obbook::DiffBgra(e.data(), stride, a.data(), stride, width, height, tolerance, stats);
+                const obbook::ImageDiffStats expected = DiffReference(e, a, stride, width, height, tolerance);
+                expect(stats.differingPixels == expected.differingPixels && stats.maxChannelDelta == expected.maxChannelDelta,
+                    "diff of width " + std::to_string(width) + " at tolerance " + std::to_string(tolerance) + " counted "
+                    + std::to_string(stats.differingPixels) + " instead of " + std::to_string(expected.differingPixels));
+            }
+        }
+
+        const obbook::GlyphAtlas atlas = obbench::MakeBoxGlyphAtlas();
+        std::vector<obbook::GoldenCase> cases;
+        for (uint32_t i = 0; i < 3; ++i)
+            cases.push_back(obbook::GoldenCase{ "book" + std::to_string(i), obbench::GenerateBookSource(obbench::CorpusKind::Images, (2 + i) * 1024, i + 1) });
+
+        const fs::path directory = root / "golden_check";
+        std::error_code ec;
+        fs::remove_all(directory, ec);
+        obbook::GoldenOptions options{};
+        options.goldenDirUtf8 = (directory / "golden").string();
+        options.outputDirUtf8 = (directory / "out").string();
+        options.request.geometry.width = 300;
+        options.request.geometry.height = 200;
+        options.request.dataDirUtf8 = dataDir.string();
+        options.renderRepeats = 1;
+        options.workerCount = 2;
+        options.update = true;
+        obbook::GoldenReport report;
+        obbook::RunGoldenPages(cases, atlas, options, report);
+        expect(report.Passed() && report.cases.size() == cases.size(), "recording the goldens failed");
+
+        options.update = false;
+        options.maxSlowdown = 1000; // timing is checked on its own below
+        obbook::RunGoldenPages(cases, atlas, options, report);
+        expect(report.Passed(), "fresh goldens did not match");
+        for (const auto& c : report.cases) expect(c.pages > 0 && c.pages == c.goldenPages, c.name + " lost pages");
+
+        // Paint a block into one golden page; only that case may fail, on that page, with a heatmap.
+        const fs::path changed = directory / "golden" / "book1" / "page_0002.png";
+        uint32_t w = 0, h = 0;
+        std::vector<uint8_t> bgra;
+        if (obbook::ReadPngFile(changed.string(), w, h, bgra))
+        {
+            for (uint32_t y = 10; y < 20; ++y) std::memset(&bgra[(static_cast<size_t>(y) * w + 10) * 4], 0x30, 10 * 4);
+            obbook::WritePngFile(changed.string(), bgra.data(), w, h, static_cast<size_t>(w) * 4, obbook::PngOptions{});
+        }
+        fs::remove(directory / "golden" / "book2" / "page_0001.png", ec);
+        obbook::RunGoldenPages(cases, atlas, options, report);
+        expect(report.failedCases == 2 && report.cases[0].passed, "changed goldens: " + std::to_string(report.failedCases) + " cases failed");
+        const auto& book1 = report.cases[1].failures;
+        expect(book1.size() == 1 && book1[0].page == 1 && !book1[0].missing && book1[0].diff.differingPixels > 0
+            && book1[0].diff.differingPixels <= 100 && fs::is_regular_file(book1[0].heatmapUtf8, ec)
+            && fs::is_regular_file(book1[0].actualUtf8, ec), "changed golden page not reported with a heatmap");
+        const auto& book2 = report.cases[2].failures;
+        expect(!book2.empty() && book2[0].page == 0 && book2[0].missing, "missing golden page not reported");
+        options.maxDifferingPixels = 100;
+        options.tolerance = 0;
+        obbook::RunGoldenPages({ cases[1] }, atlas, options, report);
+        expect(report.Passed(), "change within maxDifferingPixels failed");
+
+        // A recorded time far below the real one is a regression; case 0 still has its real time.
+        {
+            std::ofstream timings(directory / "golden" / "timings.tsv", std::ios::trunc);
+            timings << "book0\t0.001\n";
+        }
+        options.maxSlowdown = 0.25;
+        options.minSlowdownMs = 0;
+        obbook::RunGoldenPages({ cases[0] }, atlas, options, report);
+        expect(!report.Passed() && report.cases[0].slower && report.cases[0].failures.empty(), "time regression not reported");
+
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "golden: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    // Accounts must follow their owners: a compiler reports what it retains and gives it all back when destroyed,
+    // copies report their own share, laying out a book shows its decoded textures in the peak only, a thumbnail
+    // cache reports while open, and budgets flag without enforcing.
+    void CheckMemory(const fs::path& emptyRoot, const fs::path& dataDir, const fs::path& thumbnailRoot,
+        const std::vector<std::string>& thumbnailPaths)
+    {
+        std::vector<std::string> problems;
+        auto expect = [&problems](bool ok, const std::string& what) { if (!ok) problems.push_back(what); };
+        using obbook::MemorySubsystem;
+        auto bytesOf = [](MemorySubsystem s) { return obbook::GetMemoryStats()[s].bytes; };
+
+        const obbook::MemoryStats before = obbook::GetMemoryStats();
+        const auto source = obbench::GenerateBookSource(obbench::CorpusKind::Quotes, 64 * 1024);
+        {
+            obbook::BookCompiler compiler;
+            compiler.SetOblivionDirectoryUtf8(emptyRoot.string());
+            compiler.SetSourceUtf8(source);
+            compiler.Compile();
+            const uint64_t compileBytes = compiler.GetMemoryBytes(MemorySubsystem::CompileBuffers);
+            const obbook::MemoryStats during = obbook::GetMemoryStats();
+            expect(compileBytes >= 2 * source.size(), "compile buffers reported " + std::to_string(compileBytes) + " bytes");
+            expect(during[MemorySubsystem::CompileBuffers].bytes == before[MemorySubsystem::CompileBuffers].bytes + compileBytes,
+                "process-wide compile buffers do not include the compiler's");
+            expect(during[MemorySubsystem::CompileBuffers].accounts == before[MemorySubsystem::CompileBuffers].accounts + 1
+                && during[MemorySubsystem::AssetIndex].accounts == before[MemorySubsystem::AssetIndex].accounts + 1,
+                "compiler accounts not counted");
+            expect(during[MemorySubsystem::CompileBuffers].peakBytes >= during[MemorySubsystem::CompileBuffers].bytes, "peak below current");
+
+            const uint64_t steady = bytesOf(MemorySubsystem::CompileBuffers);
+            const uint64_t allocations = obbench::CountAllocations([&] { compiler.Compile(); });
+            expect(bytesOf(MemorySubsystem::CompileBuffers) == steady && allocations == 0, "steady-state compile changed its accounts or allocated");
+
+            {
+                obbook::BookCompiler copy = compiler;
+                expect(bytesOf(MemorySubsystem::CompileBuffers) == steady + compileBytes, "copied compiler not reported");
+            }
+            expect(bytesOf(MemorySubsystem::CompileBuffers) == steady, "copied compiler's bytes not returned");
+
+            obbook::SetMemoryBudget(MemorySubsystem::CompileBuffers, compileBytes / 2);
+            expect(obbook::GetMemoryStats()[MemorySubsystem::CompileBuffers].IsOverBudget(), "budget not flagged");
+            obbook::SetMemoryBudget(MemorySubsystem::CompileBuffers, 0);
+            expect(!obbook::GetMemoryStats()[MemorySubsystem::CompileBuffers].IsOverBudget(), "cleared budget still flagged");
+        }
+        const obbook::MemoryStats after = obbook::GetMemoryStats();
+        for (const MemorySubsystem s : { MemorySubsystem::AssetIndex, MemorySubsystem::CompileBuffers })
+        {
+            expect(after[s].bytes == before[s].bytes && after[s].accounts == before[s].accounts,
+                std::string(obbook::GetMemorySubsystemName(s)) + " not returned by a destroyed compiler");
+        }
+
+        obbook::ResetMemoryPeaks();
+        const uint64_t textureBefore = bytesOf(MemorySubsystem::TextureCache);
+        const obbook::GlyphAtlas atlas = obbench::MakeBoxGlyphAtlas();
+        obbook::BookPagesRequest request{};
+        request.dataDirUtf8 = dataDir.string();
+        request.pageCount = 1;
+        obbook::BookPagesResult rendered;
+        obbook::RenderBookPages(obbench::GenerateBookSource(obbench::CorpusKind::Images, 8 * 1024, 5), atlas, request, rendered);
+        const obbook::MemoryUsage texture = obbook::GetMemoryStats()[MemorySubsystem::TextureCache];
+        expect(texture.bytes == textureBefore && texture.peakBytes > textureBefore, "decoded book textures not reported while laid out");
+
+        {
+            const fs::path file = thumbnailRoot / "memory_check.obt";
+            std::error_code ec;
+            fs::remove(file, ec);
+            obbook::ThumbnailCache cache(file.string());
+            std::vector<obbook::ThumbnailView> thumbnails;
+            cache.GetThumbnails((thumbnailRoot / "Data").string(), thumbnailPaths, 2, thumbnails);
+            expect(bytesOf(MemorySubsystem::TextureCache) >= textureBefore + cache.FileBytes(), "thumbnail cache not reported");
+        }
+        expect(bytesOf(MemorySubsystem::TextureCache) == textureBefore, "closed thumbnail cache still reported");
+
+        if (!problems.empty())
+        {
+            for (const auto& p : problems) std::fprintf(stderr, "memory: %s\n", p.c_str());
+            ++g_failedChecks;
+        }
+    }
+
+    // Diffing two 1000x700 pages: identical, and with every eighth pixel off by more than the tolerance.
+    void BenchImageDiff(BenchRunner& runner)
+    {
+        const uint32_t width = 1000, height = 700;
+        const size_t bytes = static_cast<size_t>(width) * height * 4;
+        std::vector<uint8_t> expected(bytes), actual(bytes);
+        for (size_t i = 0; i < bytes; ++i) expected[i] = static_cast<uint8_t>(0xE0 + (i * 7 >> 5) % 16);
+        obbook::ImageDiffStats stats{};
+        actual = expected;
+        runner.Run("imagediff/1000x700/identical", bytes, 1, [&]
+        {
+            obbook::DiffBgra(expected.data(), width * 4, actual.data(), width * 4, width, height, 2, stats);
+        });
+        for (size_t i = 0; i < bytes; i += 32) actual[i] ^= 0x10;
+        runner.Run("imagediff/1000x700/eighth_differ", bytes, 1, [&]
+        {
+            obbook::DiffBgra(expected.data(), width * 4, actual.data(), width * 4, width, height, 2, stats);
+        });
+        runner.AddCounter("imagediff/1000x700/eighth_differ", "differing_pixels", static_cast<double>(stats.differingPixels));
+        std::vector<uint8_t> heatmap;
+        runner.Run("imagediff/1000x700/heatmap", bytes, 1, [&]
+        {
+            obbook::DiffHeatmapBgra(expected.data(), width * 4, actual.data(), width * 4, width, height, 2, heatmap);
+        });
+    }
+
+#if defined(_WIN32)
+    void BenchRender(BenchRunner& runner, const Options& o)
+    {
+        const auto source = obbench::GenerateBookSource(obbench::CorpusKind::Ascii, static_cast<size_t>(o.sourceKb) * 1024);
+        obbook::RenderParams p{};
+        p.width = 1000;
+        p.height = 700;
+        std::vector<uint8_t> bgra;
+        std::string err;
+        runner.Run("render/preview_1000x700", static_cast<uint64_t>(p.width) * p.height * 4, 1, [&]
+        {
+            obbook::RenderPreviewBgra(p, source, bgra, err);
+        });
+
+        // Caller-owned target with padded rows, as with a locked WriteableBitmap back buffer.
+        const size_t stride = (static_cast<size_t>(p.width) * 4 + 63) & ~static_cast<size_t>(63);
+        std::vector<uint8_t> target(stride * p.height);
+        runner.Run("render/preview_into_1000x700", static_cast<uint64_t>(p.width) * p.height * 4, 1, [&]
+        {
+            obbook::RenderPreviewBgra(p, source, target.data(), stride, err);
+        });
+    }
+#endif
+}
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    if (!ParseArgs(argc, argv, opts)) return 2;
+
+    std::error_code ec;
+    fs::create_directories(opts.fixtures, ec);
+    const fs::path emptyRoot = opts.fixtures / "empty";
+    fs::create_directories(emptyRoot / "Data", ec);
+
+    obbench::DataFolderSpec spec{};
+    spec.bsaFileCount = opts.bsaFiles;
+    std::printf("Generating fixtures in %s (%u entries per BSA)...\n", opts.fixtures.string().c_str(), opts.bsaFiles);
+    const fs::path dataDir = obbench::GenerateDataFolder(opts.fixtures / "install", spec);
+    const fs::path thumbnailRoot = opts.fixtures / "thumbnails";
+    const auto thumbnailPaths = obbench::GenerateThumbnailFolder(thumbnailRoot);
+
+    // Tracing perturbs timings slightly; it is meant for attributing time, not for tracked numbers.
+    if (!opts.tracePath.empty()) obbook::trace::SetEnabled(true);
+
+    BenchRunner runner(opts);
+    CheckWorkers();
+    CheckTrace();
+    CheckNormalization(emptyRoot);
+    CheckMessageIds(emptyRoot);
+    CheckStreaming(emptyRoot);
+    CheckGrouping(emptyRoot);
+    CheckDds();
+    CheckTga(opts.fixtures);
+    CheckThumbnails(thumbnailRoot, thumbnailPaths);
+    CheckLooseDiscovery(opts.fixtures);
+    CheckGenerations(opts.fixtures);
+    CheckAssetPublication(opts.fixtures);
+    CheckLooseWalk(opts.fixtures);
+    CheckPng(opts.fixtures, dataDir);
+    CheckPngNoise();
+    CheckGolden(opts.fixtures, dataDir);
+    CheckMemory(emptyRoot, dataDir, thumbnailRoot, thumbnailPaths);
+    BenchCompile(runner, opts, emptyRoot, dataDir);
+    BenchCompileService(runner, opts, emptyRoot);
+    BenchStreaming(runner);
+    BenchSourceMap(runner, opts, emptyRoot);
+    BenchProject(runner, emptyRoot, opts.fixtures / "compile_cache");
+    BenchAssets(runner, dataDir, opts.bsaFiles);
+    BenchLooseWalk(runner, opts);
+    BenchAssetIndex(runner, opts);
+    BenchDds(runner);
+    BenchTga(runner);
+    BenchThumbnails(runner, thumbnailRoot, thumbnailPaths);
+    BenchPages(runner, opts, dataDir);
+    BenchPng(runner, opts, dataDir);
+    BenchImageDiff(runner);
+#if defined(_WIN32)
+    BenchRender(runner, opts);
+#endif
+
+    if (!opts.tracePath.empty() && !obbook::trace::WriteChromeTraceJson(opts.tracePath))
+        std::fprintf(stderr, "Failed to write trace %s\n", opts.tracePath.c_str());
+
+    if (!WriteJson(opts, runner.Results()))
+    {
+        std::fprintf(stderr, "Failed to write %s\n", opts.outPath.c_str());
+        return 1;
+    }
+    std::printf("Wrote %zu results to %s\n", runner.Results().size(), opts.outPath.c_str());
+    if (g_failedChecks != 0)
+    {
+        std::fprintf(stderr, "%d self-check(s) failed\n", g_failedChecks);
+        return 1;
+    }
+    return 0;
+}
@@ -1,14 +1,17 @@
+#include <msclr/lock.h>
 #include <msclr/marshal_cppstd.h>
+#include <vcclr.h>
+#include <memory>
 #include <vector>
 #include <string>
-#include <array>
 #include <algorithm>
-#include <filesystem>
-#include <fstream>
 #include <cstdint>
-#include <cstring>
 
 #include "../ObBook.Core/ObBookCore.h"
+#include "../ObBook.Core/ObBookAssets.h"
+#include "../ObBook.Core/ObBookCompileService.h"
+#include "../ObBook.Core/ObBookThumbnails.h"
+#include "../ObBook.Core/ObBookTrace.h"
 #include "../ObBook.RenderD2D/ObBookRenderD2D.h"
 #include "Bridge.h"
 
@@ -17,369 +20,266 @@ using namespace msclr::interop;
 
 namespace
 {
-    namespace fs = std::filesystem;
-
-    static std::string ToLowerAscii(std::string s)
-    {
-        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c)
-        {
-            if (c >= 'A' && c <= 'Z') return static_cast<char>(c - 'A' + 'a');
-            return static_cast<char>(c);
-        });
-        return s;
-    }
-
-    static std::string NormalizeVirtualPath(std::string s)
-    {
-        for (auto& c : s) if (c == '\\') c = '/';
-        s = ToLowerAscii(s);
-        while (!s.empty() && s.front() == '/') s.erase(s.begin());
-        return s;
-    }
+    static uint8_t ClampU8(int v) { return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v)); }
 
-    static bool StartsWithNoCase(const std::string& s, size_t at, const char* lit)
+    static void BlitBgra(uint8_t* dst, uint32_t dw, uint32_t dh, size_t dstStride, const std::vector<uint8_t>& src, uint32_t sw, uint32_t sh)
     {
-        size_t i = 0;
-        for (; lit[i] != '\0'; ++i)
-        {
-            if (at + i >= s.size()) return false;
-            char a = s[at + i];
-            char b = lit[i];
-            if (a >= 'A' && a <= 'Z') a = static_cast<char>(a - 'A' + 'a');
-            if (b >= 'A' && b <= 'Z') b = static_cast<char>(b - 'A' + 'a');
-            if (a != b) return false;
-        }
-        return true;
-    }
+        if (!dst || src.empty() || dw==0 || dh==0 || sw==0 || sh==0) return;
+        const uint32_t maxW = dw / 2;
+        const uint32_t maxH = dh / 2;
+        const float scaleW = maxW / static_cast<float>(sw);
+        const float scaleH = maxH / static_cast<float>(sh);
+        float scale = (scaleW < scaleH) ? scaleW : scaleH;
+        if (scale > 1.0f) scale = 1.0f;
+        uint32_t tw = static_cast<uint32_t>(sw * scale);
+        uint32_t th = static_cast<uint32_t>(sh * scale);
+        if (tw == 0) tw = 1;
+        if (th == 0) th = 1;
+        uint32_t ox = (dw > tw) ? (dw - tw)/2 : 0;
+        uint32_t oy = 120;
+        if (oy + th > dh) oy = (dh > th) ? dh - th : 0;
 
-    static std::string ExtractFirstImgSrc(std::string src)
-    {
-        for (size_t i = 0; i + 4 < src.size(); ++i)
+        for (uint32_t y=0; y<th; ++y)
         {
-            if (!StartsWithNoCase(src, i, "<img")) continue;
-            size_t j = i;
-            while (j < src.size() && src[j] != '>') ++j;
-            if (j >= src.size()) return {};
-
-            for (size_t k = i; k + 4 < j; ++k)
+            uint32_t sy = static_cast<uint32_t>((static_cast<uint64_t>(y) * sh) / th);
+            uint8_t* dstRow = dst + static_cast<size_t>(oy + y) * dstStride;
+            for (uint32_t x=0; x<tw; ++x)
             {
-                if (!StartsWithNoCase(src, k, "src=")) continue;
-                k += 4;
-                if (k >= j) return {};
-                if (src[k] == '"')
-                {
-                    ++k;
-                    size_t e = k;
-                    while (e < j && src[e] != '"') ++e;
-                    return src.substr(k, e - k);
-                }
-                size_t e = k;
-                while (e < j && src[e] != ' ' && src[e] != '	') ++e;
-                return src.substr(k, e - k);
+                uint32_t sx = static_cast<uint32_t>((static_cast<uint64_t>(x) * sw) / tw);
+                const uint8_t* sp = &src[(static_cast<size_t>(sy) * sw + sx) * 4];
+                uint8_t* dp = dstRow + static_cast<size_t>(ox + x) * 4;
+                const float a = sp[3] / 255.0f;
+                dp[0] = ClampU8(static_cast<int>(sp[0] * a + dp[0] * (1 - a)));
+                dp[1] = ClampU8(static_cast<int>(sp[1] * a + dp[1] * (1 - a)));
+                dp[2] = ClampU8(static_cast<int>(sp[2] * a + dp[2] * (1 - a)));
+                dp[3] = 255;
             }
-            return {};
         }
-        return {};
     }
 
-    static std::string ToTextureVirtualPath(const std::string& imgSrc)
+    // Reused between previews so the texture read and decode keep their capacity.
+    struct OverlayScratch
     {
-        auto p = NormalizeVirtualPath(imgSrc);
-        if (p.rfind("textures/", 0) == 0) return p;
-        if (p.rfind("book/", 0) == 0) return std::string("textures/menus/") + p;
-        return std::string("textures/") + p;
-    }
-
-    struct BsaFileEntry
-    {
-        std::string path;
-        uint32_t packedSize{};
-        uint32_t offset{};
+        std::vector<uint8_t> bytes;
+        std::vector<uint8_t> tex;
     };
 
-    static bool ReadExact(std::ifstream& in, void* dst, size_t size)
+    static void TryOverlayFirstImg(uint8_t* page, uint32_t width, uint32_t height, size_t stride, const std::string& srcUtf8, const std::string& dataDirUtf8, OverlayScratch& scratch)
     {
-        in.read(reinterpret_cast<char*>(dst), static_cast<std::streamsize>(size));
-        return static_cast<size_t>(in.gcount()) == size;
-    }
-
-    static bool ReadBsaEntries(const fs::path& bsaPath, std::vector<BsaFileEntry>& entries)
-    {
-        std::ifstream in(bsaPath, std::ios::binary);
-        if (!in) return false;
-
-        std::array<char,4> magic{};
-        if (!ReadExact(in, magic.data(), magic.size()) || std::memcmp(magic.data(), "BSA\0", 4) != 0) return false;
+        if (dataDirUtf8.empty()) return;
+        const auto src = obbook::ExtractFirstImgSrc(srcUtf8);
+        if (src.empty()) return;
+        const auto path = obbook::ToTextureVirtualPath(src);
 
-        struct Header { uint32_t ver, dirOff, flags, folders, files, folderNamesLen, fileNamesLen, fileFlags; } h{};
-        if (!ReadExact(in, &h, sizeof(h))) return false;
-        if (h.ver != 103 && h.ver != 104) return false;
+        if (!obbook::ReadAssetBytes(dataDirUtf8, path, scratch.bytes)) return;
 
-        struct Folder { uint64_t hash; uint32_t fileCount; uint32_t offset; };
-        struct FileRec { uint64_t hash; uint32_t size; uint32_t offset; };
+        uint32_t tw = 0, th = 0;
+        if (!obbook::DecodeTextureToBgra(scratch.bytes, 0, scratch.tex, tw, th)) return;
 
-        in.seekg(static_cast<std::streamoff>(h.dirOff), std::ios::beg);
-        std::vector<Folder> folders(h.folders);
-        for (auto& f : folders) if (!ReadExact(in, &f, sizeof(f))) return false;
+        BlitBgra(page, width, height, stride, scratch.tex, tw, th);
+    }
 
-        std::vector<BsaFileEntry> raw;
-        raw.reserve(h.files);
-        for (const auto& f : folders)
+    // Messages are interned, so each distinct text is marshalled once per call.
+    template <typename MessageFn>
+    static System::Collections::Generic::List<ObBook::Diagnostic^>^ ToManagedDiagnostics(
+        const std::vector<obbook::Diagnostic>& diags, System::Int32 maxCount, MessageFn messageOf)
+    {
+        const size_t n = maxCount <= 0 ? 0 : std::min(diags.size(), static_cast<size_t>(maxCount));
+        auto list = gcnew System::Collections::Generic::List<ObBook::Diagnostic^>(static_cast<int>(n));
+        auto messages = gcnew System::Collections::Generic::Dictionary<System::UInt16, System::String^>();
+        for (size_t i = 0; i < n; ++i)
         {
-            uint8_t folderNameLen = 0;
-            if (!ReadExact(in, &folderNameLen, sizeof(folderNameLen))) return false;
-
-            std::string folderName;
-            if (folderNameLen > 0)
+            const auto& d = diags[i];
+            System::String^ text = nullptr;
+            if (!messages->TryGetValue(d.messageId, text))
             {
-                folderName.resize(folderNameLen);
-                if (!ReadExact(in, folderName.data(), folderName.size())) return false;
-                if (!folderName.empty() && folderName.back() == '\0') folderName.pop_back();
+                text = marshal_as<System::String^>(messageOf(d.messageId));
+                messages->Add(d.messageId, text);
             }
-            folderName = NormalizeVirtualPath(folderName);
 
-            for (uint32_t i = 0; i < f.fileCount; ++i)
-            {
-                FileRec r{};
-                if (!ReadExact(in, &r, sizeof(r))) return false;
-                raw.push_back({folderName, r.size, r.offset});
-            }
+            auto m = gcnew ObBook::Diagnostic();
+            m->SeverityLevel = static_cast<ObBook::Severity>(static_cast<System::Byte>(d.severity));
+            m->Kind = static_cast<ObBook::DiagnosticKind>(static_cast<System::Byte>(d.kind));
+            m->Offset = static_cast<System::Int32>(d.offset);
+            m->Length = static_cast<System::Int32>(d.length);
+            m->Count = static_cast<System::Int32>(d.count);
+            m->NormalizedOffset = static_cast<System::Int32>(d.normalizedOffset);
+            m->NormalizedLength = static_cast<System::Int32>(d.normalizedLength);
+            m->Message = text;
+            list->Add(m);
         }
-
-        const uint64_t namesOffset = static_cast<uint64_t>(h.dirOff) + static_cast<uint64_t>(h.folders) * sizeof(Folder)
-            + static_cast<uint64_t>(h.folderNamesLen) + static_cast<uint64_t>(h.files) * sizeof(FileRec);
-        in.seekg(static_cast<std::streamoff>(namesOffset), std::ios::beg);
-        if (!in) return false;
-
-        entries.clear();
-        entries.reserve(raw.size());
-        for (auto& r : raw)
-        {
-            std::string fileName;
-            for (;;)
-            {
-                char c=0; if (!in.get(c)) return false; if (c=='\0') break; fileName.push_back(c);
-            }
-            auto fn = NormalizeVirtualPath(fileName);
-            BsaFileEntry e{};
-            e.path = r.path.empty() ? fn : (r.path + "/" + fn);
-            e.packedSize = r.packedSize;
-            e.offset = r.offset;
-            entries.push_back(std::move(e));
-        }
-        return true;
+        return list;
     }
 
-    static bool ReadAssetBytes(const std::string& dataDirUtf8, const std::string& virtualPath, std::vector<uint8_t>& bytes)
+    static ObBook::DiagnosticSummary^ ToManagedSummary(const obbook::DiagnosticSummary& s)
     {
-        const fs::path dataDir(dataDirUtf8);
-        auto loose = dataDir / fs::path(virtualPath);
-        if (fs::exists(loose) && fs::is_regular_file(loose))
-        {
-            std::ifstream in(loose, std::ios::binary);
-            if (!in) return false;
-            in.seekg(0, std::ios::end);
-            auto size = static_cast<size_t>(in.tellg());
-            in.seekg(0, std::ios::beg);
-            bytes.resize(size);
-            in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(size));
-            return in.good() || in.eof();
-        }
-
-        for (const auto& entry : fs::directory_iterator(dataDir))
-        {
-            if (!entry.is_regular_file()) continue;
-            if (ToLowerAscii(entry.path().extension().string()) != ".bsa") continue;
-
-            std::vector<BsaFileEntry> entries;
-            if (!ReadBsaEntries(entry.path(), entries)) continue;
-
-            auto it = std::find_if(entries.begin(), entries.end(), [&](const BsaFileEntry& e)
-            {
-                return e.path == virtualPath;
-            });
-            if (it == entries.end()) continue;
-
-            constexpr uint32_t kSizeMask = 0x3FFFFFFFu;
-            constexpr uint32_t kCompressedBit = 0x40000000u;
-            if ((it->packedSize & kCompressedBit) != 0u) return false;
-            const uint32_t sz = (it->packedSize & kSizeMask);
-            if (sz == 0) return false;
-
-            std::ifstream in(entry.path(), std::ios::binary);
-            if (!in) return false;
-            in.seekg(static_cast<std::streamoff>(it->offset), std::ios::beg);
-            if (!in) return false;
-            bytes.resize(sz);
-            in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(sz));
-            return in.good() || in.eof();
-        }
-        return false;
+        auto m = gcnew ObBook::DiagnosticSummary();
+        m->Total = static_cast<System::Int32>(s.total);
+        m->Infos = static_cast<System::Int32>(s.bySeverity[0]);
+        m->Warnings = static_cast<System::Int32>(s.bySeverity[1]);
+        m->Errors = static_cast<System::Int32>(s.bySeverity[2]);
+        const int kinds = static_cast<int>(obbook::DiagnosticKind::Count);
+        m->CountsByKind = gcnew array<System::Int32>(kinds);
+        for (int i = 0; i < kinds; ++i)
+            m->CountsByKind[i] = static_cast<System::Int32>(s.byKind[i]);
+        return m;
     }
 
-    static uint8_t ClampU8(int v) { return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v)); }
-
-    static void Decode565(uint16_t c, uint8_t& r, uint8_t& g, uint8_t& b)
+    static System::Collections::Generic::List<System::String^>^ ToManagedStrings(const std::vector<std::string>& strings)
     {
-        r = static_cast<uint8_t>(((c >> 11) & 31) * 255 / 31);
-        g = static_cast<uint8_t>(((c >> 5) & 63) * 255 / 63);
-        b = static_cast<uint8_t>((c & 31) * 255 / 31);
+        auto list = gcnew System::Collections::Generic::List<System::String^>(static_cast<int>(strings.size()));
+        for (const auto& s : strings) list->Add(marshal_as<System::String^>(s));
+        return list;
     }
 
-    static bool DecodeDxt1(const uint8_t* data, size_t size, uint32_t w, uint32_t h, std::vector<uint8_t>& out)
+    static ObBook::AssetEntry^ ToManagedAssetEntry(const obbook::AssetIndex& index, obbook::AssetNodeId node)
     {
-        const uint32_t bw = (w + 3) / 4, bh = (h + 3) / 4;
-        if (size < static_cast<size_t>(bw) * bh * 8) return false;
-        out.assign(static_cast<size_t>(w) * h * 4, 0);
-        size_t off = 0;
-        for (uint32_t by=0; by<bh; ++by) for (uint32_t bx=0; bx<bw; ++bx)
-        {
-            uint16_t c0 = data[off] | (data[off+1]<<8);
-            uint16_t c1 = data[off+2] | (data[off+3]<<8);
-            uint32_t idx = data[off+4] | (data[off+5]<<8) | (data[off+6]<<16) | (data[off+7]<<24);
-            off += 8;
-            uint8_t r[4],g[4],b[4],a[4]{255,255,255,255};
-            Decode565(c0,r[0],g[0],b[0]); Decode565(c1,r[1],g[1],b[1]);
-            if (c0 > c1) {
-                r[2]=(2*r[0]+r[1])/3; g[2]=(2*g[0]+g[1])/3; b[2]=(2*b[0]+b[1])/3;
-                r[3]=(r[0]+2*r[1])/3; g[3]=(g[0]+2*g[1])/3; b[3]=(b[0]+2*b[1])/3;
-            } else {
-                r[2]=(r[0]+r[1])/2; g[2]=(g[0]+g[1])/2; b[2]=(b[0]+b[1])/2;
-                r[3]=g[3]=b[3]=0; a[3]=0;
-            }
-            for (uint32_t py=0; py<4; ++py) for (uint32_t px=0; px<4; ++px)
-            {
-                uint32_t x=bx*4+px, y=by*4+py; if (x>=w||y>=h) continue;
-                uint32_t ci=(idx >> (2*(py*4+px))) & 3;
-                uint8_t* p=&out[(static_cast<size_t>(y)*w+x)*4];
-                p[0]=b[ci]; p[1]=g[ci]; p[2]=r[ci]; p[3]=a[ci];
-            }
-        }
-        return true;
+        auto m = gcnew ObBook::AssetEntry();
+        const auto segment = index.Segment(node);
+        m->Name = marshal_as<System::String^>(std::string(segment));
+        m->Path = marshal_as<System::String^>(index.Path(node));
+        m->IsFile = index.IsEntry(node);
+        m->Source = m->IsFile ? marshal_as<System::String^>(index.SourceName(index.Source(node))) : nullptr;
+        m->HasChildren = index.ChildCount(node) > 0;
+        m->EntryCount = static_cast<System::Int32>(index.EntryCountUnder(node));
+        return m;
     }
 
-    static bool DecodeDxt5(const uint8_t* data, size_t size, uint32_t w, uint32_t h, std::vector<uint8_t>& out)
+    // WPF copies the native buffer straight into the bitmap; no managed staging array.
+    static System::Windows::Media::Imaging::BitmapSource^ ToBitmapSource(const std::vector<uint8_t>& bgra,
+        System::Int32 width, System::Int32 height, float dpi)
     {
-        const uint32_t bw=(w+3)/4,bh=(h+3)/4;
-        if (size < static_cast<size_t>(bw)*bh*16) return false;
-        out.assign(static_cast<size_t>(w)*h*4,0);
-        size_t off=0;
-        for(uint32_t by=0;by<bh;++by) for(uint32_t bx=0;bx<bw;++bx)
-        {
-            uint8_t a0=data[off],a1=data[off+1];
-            uint64_t abits=0; for(int i=0;i<6;++i) abits |= static_cast<uint64_t>(data[off+2+i])<<(8*i);
-            uint16_t c0=data[off+8]|(data[off+9]<<8), c1=data[off+10]|(data[off+11]<<8);
-            uint32_t cbits=data[off+12]|(data[off+13]<<8)|(data[off+14]<<16)|(data[off+15]<<24);
-            off+=16;
-            uint8_t aval[8]; aval[0]=a0; aval[1]=a1;
-            if(a0>a1){ for(int i=1;i<=6;++i) aval[i+1]=static_cast<uint8_t>(((7-i)*a0+i*a1)/7); }
-            else { for(int i=1;i<=4;++i) aval[i+1]=static_cast<uint8_t>(((5-i)*a0+i*a1)/5); aval[6]=0; aval[7]=255; }
-            uint8_t r[4],g[4],b[4]; Decode565(c0,r[0],g[0],b[0]); Decode565(c1,r[1],g[1],b[1]);
-            r[2]=(2*r[0]+r[1])/3; g[2]=(2*g[0]+g[1])/3; b[2]=(2*b[0]+b[1])/3;
-            r[3]=(r[0]+2*r[1])/3; g[3]=(g[0]+2*g[1])/3; b[3]=(b[0]+2*b[1])/3;
-            for(uint32_t py=0;py<4;++py) for(uint32_t px=0;px<4;++px)
-            {
-                uint32_t x=bx*4+px,y=by*4+py; if(x>=w||y>=h) continue;
-                uint32_t ci=(cbits>>(2*(py*4+px)))&3;
-                uint32_t ai=(abits>>(3*(py*4+px)))&7;
-                uint8_t* p=&out[(static_cast<size_t>(y)*w+x)*4];
-                p[0]=b[ci]; p[1]=g[ci]; p[2]=r[ci]; p[3]=aval[ai];
-            }
-        }
-        return true;
+        const int stride = width * 4;
+        return System::Windows::Media::Imaging::BitmapSource::Create(
+            width, height, dpi, dpi,
+            System::Windows::Media::PixelFormats::Bgra32,
+            nullptr,
+            static_cast<System::IntPtr>(const_cast<void*>(static_cast<const void*>(bgra.data()))),
+            static_cast<int>(bgra.size()),
+            stride);
     }
 
-    static bool DecodeDdsToBgra(const std::vector<uint8_t>& dds, std::vector<uint8_t>& out, uint32_t& w, uint32_t& h)
+    // Runs on the compile worker; everything it touches is native.
+    static bool RenderCompiledPreview(const obbook::BookCompiler& compiler, const obbook::CompileRequest& request,
+        obbook::CompileResult& result, const obbook::CancellationToken& cancel)
     {
-        if (dds.size() < 128 || std::memcmp(dds.data(), "DDS ", 4) != 0) return false;
-        const uint8_t* hdr = dds.data() + 4;
-        auto rd32 = [&](size_t o)->uint32_t { return *reinterpret_cast<const uint32_t*>(hdr + o); };
-        if (rd32(0) != 124) return false;
-        h = rd32(8); w = rd32(12);
-        const uint32_t pfFlags = rd32(76);
-        const uint32_t fourCC = rd32(80);
-        const uint32_t rgbBits = rd32(84);
-        const uint32_t rMask = rd32(88), gMask = rd32(92), bMask = rd32(96);
-        const uint8_t* data = dds.data() + 128;
-        const size_t size = dds.size() - 128;
-
-        auto FCC=[&](char a,char b,char c,char d){ return static_cast<uint32_t>(a)| (static_cast<uint32_t>(b)<<8) | (static_cast<uint32_t>(c)<<16) | (static_cast<uint32_t>(d)<<24); };
-        if ((pfFlags & 0x4u) && fourCC == FCC('D','X','T','1')) return DecodeDxt1(data,size,w,h,out);
-        if ((pfFlags & 0x4u) && fourCC == FCC('D','X','T','5')) return DecodeDxt5(data,size,w,h,out);
-        if ((pfFlags & 0x40u) && rgbBits == 32 && rMask == 0x00FF0000u && gMask == 0x0000FF00u && bMask == 0x000000FFu)
-        {
-            if (size < static_cast<size_t>(w) * h * 4) return false;
-            out.assign(data, data + static_cast<size_t>(w) * h * 4);
-            return true;
-        }
-        return false;
+        obbook::RenderParams p{};
+        p.width = request.previewWidth;
+        p.height = request.previewHeight;
+        p.dpi = request.previewDpi;
+
+        const auto& source = compiler.GetNormalizedSourceUtf8().empty()
+            ? compiler.GetSourceUtf8()
+            : compiler.GetNormalizedSourceUtf8();
+        if (!obbook::RenderPreviewBgra(p, source, result.previewBgra, result.previewError)) return false;
+        if (cancel.IsCancelled()) return false;
+
+        OverlayScratch scratch;
+        TryOverlayFirstImg(result.previewBgra.data(), p.width, p.height, static_cast<size_t>(p.width) * 4,
+            source, compiler.GetResolvedDataDirectoryUtf8(), scratch);
+        return true;
     }
 
-    static void BlitBgra(std::vector<uint8_t>& dst, uint32_t dw, uint32_t dh, const std::vector<uint8_t>& src, uint32_t sw, uint32_t sh)
+    // Holds the engine weakly so a pending compile never keeps it from being finalized.
+    struct CompileCompletedForwarder
     {
-        if (dst.empty() || src.empty() || dw==0 || dh==0 || sw==0 || sh==0) return;
-        const uint32_t maxW = dw / 2;
-        const uint32_t maxH = dh / 2;
-        const float scaleW = maxW / static_cast<float>(sw);
-        const float scaleH = maxH / static_cast<float>(sh);
-        float scale = (scaleW < scaleH) ? scaleW : scaleH;
-        if (scale > 1.0f) scale = 1.0f;
-        uint32_t tw = static_cast<uint32_t>(sw * scale);
-        uint32_t th = static_cast<uint32_t>(sh * scale);
-        if (tw == 0) tw = 1;
-        if (th == 0) th = 1;
-        uint32_t ox = (dw > tw) ? (dw - tw)/2 : 0;
-        uint32_t oy = 120;
-        if (oy + th > dh) oy = (dh > th) ? dh - th : 0;
+        gcroot<System::WeakReference^> engine;
 
-        for (uint32_t y=0; y<th; ++y)
+        void operator()(std::shared_ptr<const obbook::CompileResult> result) const
         {
-            uint32_t sy = static_cast<uint32_t>((static_cast<uint64_t>(y) * sh) / th);
-            for (uint32_t x=0; x<tw; ++x)
-            {
-                uint32_t sx = static_cast<uint32_t>((static_cast<uint64_t>(x) * sw) / tw);
-                const uint8_t* sp = &src[(static_cast<size_t>(sy) * sw + sx) * 4];
-                uint8_t* dp = &dst[(static_cast<size_t>(oy + y) * dw + (ox + x)) * 4];
-                const float a = sp[3] / 255.0f;
-                dp[0] = ClampU8(static_cast<int>(sp[0] * a + dp[0] * (1 - a)));
-                dp[1] = ClampU8(static_cast<int>(sp[1] * a + dp[1] * (1 - a)));
-                dp[2] = ClampU8(static_cast<int>(sp[2] * a + dp[2] * (1 - a)));
-                dp[3] = 255;
-            }
+            auto target = dynamic_cast<ObBook::Engine^>(engine->Target);
+            if (target && result) target->RaiseCompileCompleted(*result);
         }
-    }
+    };
+}
 
-    static void TryOverlayFirstImg(std::vector<uint8_t>& page, uint32_t width, uint32_t height, const std::string& srcUtf8, const std::string& dataDirUtf8)
-    {
-        if (dataDirUtf8.empty()) return;
-        const auto src = ExtractFirstImgSrc(srcUtf8);
-        if (src.empty()) return;
-        const auto path = ToTextureVirtualPath(src);
+class ObBook::AssetIndexHolder
+{
+public:
+    explicit AssetIndexHolder(std::shared_ptr<const obbook::AssetIndex> i) : index(std::move(i)) {}
+    std::shared_ptr<const obbook::AssetIndex> index;
+};
+
+ObBook::AssetIndexView::AssetIndexView(AssetIndexHolder* holder)
+    : holder_(holder)
+{
+}
 
-        std::vector<uint8_t> dds;
-        if (!ReadAssetBytes(dataDirUtf8, path, dds)) return;
+ObBook::AssetIndexView::~AssetIndexView()
+{
+    this->!AssetIndexView();
+}
 
-        std::vector<uint8_t> tex;
-        uint32_t tw = 0, th = 0;
-        if (!DecodeDdsToBgra(dds, tex, tw, th)) return;
+ObBook::AssetIndexView::!AssetIndexView()
+{
+    delete holder_;
+    holder_ = nullptr;
+}
 
-        BlitBgra(page, width, height, tex, tw, th);
-    }
+System::Int32 ObBook::AssetIndexView::EntryCount::get()
+{
+    return holder_ ? static_cast<System::Int32>(holder_->index->EntryCount()) : 0;
+}
+
+System::Boolean ObBook::AssetIndexView::IsSameSnapshot(AssetIndexView^ other)
+{
+    return other && holder_ && other->holder_ && holder_->index == other->holder_->index;
+}
+
+ObBook::AssetEntry^ ObBook::AssetIndexView::Find(System::String^ path)
+{
+    if (!holder_ || !path) return nullptr;
+    const auto& index = *holder_->index;
+    const auto node = index.Find(obbook::NormalizeVirtualPath(marshal_as<std::string>(path)));
+    if (node == obbook::kInvalidAssetNode || node == obbook::AssetIndex::kRoot) return nullptr;
+    return ToManagedAssetEntry(index, node);
+}
+
+System::Collections::Generic::List<ObBook::AssetEntry^>^ ObBook::AssetIndexView::GetChildren(System::String^ path)
+{
+    auto list = gcnew System::Collections::Generic::List<AssetEntry^>();
+    if (!holder_) return list;
+    if (!path) path = "";
+    const auto& index = *holder_->index;
+    const auto node = index.Find(obbook::NormalizeVirtualPath(marshal_as<std::string>(path)));
+    if (node == obbook::kInvalidAssetNode) return list;
+
+    const uint32_t count = index.ChildCount(node);
+    list->Capacity = static_cast<int>(count);
+    for (uint32_t i = 0; i < count; ++i)
+        list->Add(ToManagedAssetEntry(index, index.FirstChild(node) + i));
+    return list;
 }
 
 class ObBook::EngineImpl
 {
 public:
+    explicit EngineImpl(ObBook::Engine^ owner)
+        : compileService(CompileCompletedForwarder{ gcnew System::WeakReference(owner) }, &RenderCompiledPreview)
+    {
+    }
+
     obbook::BookCompiler compiler{};
+    OverlayScratch overlayScratch{}; // UI-thread previews only
+    obbook::MemoryAccount previewMemory{ obbook::MemorySubsystem::RenderBuffers }; // overlayScratch and the preview bitmap
+    std::string thumbnailFileUtf8;
+    std::unique_ptr<obbook::ThumbnailCache> thumbnails; // opened on first use
+    std::atomic<int32_t> maxCompletedDiagnostics{ INT32_MAX };
+
+    // Declared last so its worker is joined before the members above are destroyed.
+    obbook::CompileService compileService;
 };
 
 ObBook::Engine::Engine()
-    : impl_(new EngineImpl())
+    : impl_(nullptr), thumbnailLock_(gcnew System::Object())
 {
+    impl_ = new EngineImpl(this);
 }
 
 ObBook::Engine::~Engine()
 {
+    // Waits for a thumbnail batch running on another thread.
+    msclr::lock lock(thumbnailLock_);
     this->!Engine();
 }
 
@@ -422,38 +322,151 @@ System::String^ ObBook::Engine::ResolvedDataDirectory::get()
     return marshal_as<System::String^>(impl_->compiler.GetResolvedDataDirectoryUtf8());
 }
 
-System::Collections::Generic::List<ObBook::Diagnostic^>^ ObBook::Engine::GetDiagnostics()
+bool ObBook::Engine::TracingEnabled::get()
+{
+    return obbook::trace::IsEnabled();
+}
+
+void ObBook::Engine::TracingEnabled::set(bool value)
+{
+    obbook::trace::SetEnabled(value);
+}
+
+void ObBook::Engine::WriteTrace(System::String^ path)
+{
+    if (!path) throw gcnew System::ArgumentNullException("path");
+    if (!obbook::trace::WriteChromeTraceJson(marshal_as<std::string>(path)))
+        throw gcnew System::IO::IOException("Failed to write trace file.");
+}
+
+System::Collections::Generic::List<ObBook::MemoryUsage^>^ ObBook::Engine::GetMemoryUsage()
 {
-    auto list = gcnew System::Collections::Generic::List<Diagnostic^>();
-    const auto& diags = impl_->compiler.GetDiagnostics();
-    for (const auto& d : diags)
+    const obbook::MemoryStats stats = obbook::GetMemoryStats();
+    constexpr size_t kCount = static_cast<size_t>(obbook::MemorySubsystem::Count);
+    auto list = gcnew System::Collections::Generic::List<MemoryUsage^>(static_cast<int>(kCount));
+    for (size_t i = 0; i < kCount; ++i)
     {
-        auto m = gcnew Diagnostic();
-        m->SeverityLevel = static_cast<Severity>(static_cast<System::Byte>(d.severity));
-        m->Offset = static_cast<System::Int32>(d.offset);
-        m->Length = static_cast<System::Int32>(d.length);
-        m->Message = marshal_as<System::String^>(d.message);
+        const auto subsystem = static_cast<obbook::MemorySubsystem>(i);
+        const obbook::MemoryUsage& u = stats[subsystem];
+        auto m = gcnew MemoryUsage();
+        m->Subsystem = static_cast<MemorySubsystem>(i);
+        m->Name = marshal_as<System::String^>(obbook::GetMemorySubsystemName(subsystem));
+        m->Bytes = static_cast<System::Int64>(u.bytes);
+        m->PeakBytes = static_cast<System::Int64>(u.peakBytes);
+        m->Accounts = static_cast<System::Int32>(u.accounts);
+        m->BudgetBytes = static_cast<System::Int64>(u.budgetBytes);
+        m->IsOverBudget = u.IsOverBudget();
         list->Add(m);
     }
     return list;
 }
 
-System::Collections::Generic::List<System::String^>^ ObBook::Engine::GetBookFontAssets()
+void ObBook::Engine::SetMemoryBudget(MemorySubsystem subsystem, System::Int64 bytes)
 {
-    auto list = gcnew System::Collections::Generic::List<System::String^>();
-    const auto& assets = impl_->compiler.GetBookFontAssetsUtf8();
-    for (const auto& a : assets)
-        list->Add(marshal_as<System::String^>(a));
-    return list;
+    const size_t i = static_cast<size_t>(subsystem);
+    if (i >= static_cast<size_t>(obbook::MemorySubsystem::Count)) throw gcnew System::ArgumentOutOfRangeException("subsystem");
+    obbook::SetMemoryBudget(static_cast<obbook::MemorySubsystem>(i), bytes > 0 ? static_cast<uint64_t>(bytes) : 0);
 }
 
-System::Collections::Generic::List<System::String^>^ ObBook::Engine::GetBookTextureAssets()
+void ObBook::Engine::ResetMemoryPeaks()
 {
-    auto list = gcnew System::Collections::Generic::List<System::String^>();
-    const auto& assets = impl_->compiler.GetBookTextureAssetsUtf8();
-    for (const auto& a : assets)
-        list->Add(marshal_as<System::String^>(a));
-    return list;
+    obbook::ResetMemoryPeaks();
+}
+
+bool ObBook::Engine::GroupAdjacentDiagnostics::get()
+{
+    return impl_->compiler.GetSettings().groupAdjacentDiagnostics;
+}
+
+void ObBook::Engine::GroupAdjacentDiagnostics::set(bool value)
+{
+    auto settings = impl_->compiler.GetSettings();
+    settings.groupAdjacentDiagnostics = value;
+    impl_->compiler.SetSettings(settings);
+}
+
+System::Int32 ObBook::Engine::SourceToNormalizedOffset(System::Int32 sourceOffset)
+{
+    if (sourceOffset < 0) return 0;
+    return static_cast<System::Int32>(impl_->compiler.GetSourceMap().ToNormalized(static_cast<uint32_t>(sourceOffset)));
+}
+
+System::Int32 ObBook::Engine::NormalizedToSourceOffset(System::Int32 normalizedOffset)
+{
+    if (normalizedOffset < 0) return 0;
+    return static_cast<System::Int32>(impl_->compiler.GetSourceMap().ToSource(static_cast<uint32_t>(normalizedOffset)));
+}
+
+System::Collections::Generic::List<ObBook::Diagnostic^>^ ObBook::Engine::GetDiagnostics()
+{
+    return GetDiagnostics(System::Int32::MaxValue);
+}
+
+System::Collections::Generic::List<ObBook::Diagnostic^>^ ObBook::Engine::GetDiagnostics(System::Int32 maxCount)
+{
+    const auto& compiler = impl_->compiler;
+    return ToManagedDiagnostics(compiler.GetDiagnostics(), maxCount,
+        [&compiler](uint16_t id) -> const std::string& { return compiler.GetDiagnosticMessage(id); });
+}
+
+ObBook::DiagnosticSummary^ ObBook::Engine::GetDiagnosticSummary()
+{
+    return ToManagedSummary(impl_->compiler.GetDiagnosticSummary());
+}
+
+ObBook::AssetIndexView^ ObBook::Engine::GetAssetIndex()
+{
+    return gcnew AssetIndexView(new AssetIndexHolder(impl_->compiler.GetAssetIndex()));
+}
+
+System::UInt64 ObBook::Engine::DiagnosticsGeneration::get()
+{
+    return impl_->compiler.GetDiagnosticsGeneration();
+}
+
+System::UInt64 ObBook::Engine::AssetGeneration::get()
+{
+    return impl_->compiler.GetAssetGeneration();
+}
+
+ObBook::DiagnosticsDelta^ ObBook::Engine::GetDiagnosticsDelta(System::UInt64 sinceGeneration)
+{
+    const auto& compiler = impl_->compiler;
+    obbook::DiagnosticsDelta delta;
+    compiler.GetDiagnosticsDelta(sinceGeneration, delta);
+
+    auto m = gcnew DiagnosticsDelta();
+    m->FromGeneration = delta.fromGeneration;
+    m->ToGeneration = delta.toGeneration;
+    m->Reset = delta.reset;
+    m->Removed = gcnew System::Collections::Generic::List<System::Int32>(static_cast<int>(delta.removed.size()));
+    for (const uint32_t i : delta.removed) m->Removed->Add(static_cast<System::Int32>(i));
+    m->AddedIndexes = gcnew System::Collections::Generic::List<System::Int32>(static_cast<int>(delta.added.size()));
+    std::vector<obbook::Diagnostic> added;
+    added.reserve(delta.added.size());
+    for (const uint32_t i : delta.added)
+    {
+        m->AddedIndexes->Add(static_cast<System::Int32>(i));
+        added.push_back(compiler.GetDiagnostics()[i]);
+    }
+    m->Added = ToManagedDiagnostics(added, System::Int32::MaxValue,
+        [&compiler](uint16_t id) -> const std::string& { return compiler.GetDiagnosticMessage(id); });
+    return m;
+}
+
+ObBook::AssetDelta^ ObBook::Engine::GetAssetDelta(System::UInt64 sinceGeneration)
+{
+    obbook::AssetDelta delta;
+    impl_->compiler.GetAssetDelta(sinceGeneration, delta);
+
+    auto m = gcnew AssetDelta();
+    m->FromGeneration = delta.fromGeneration;
+    m->ToGeneration = delta.toGeneration;
+    m->Reset = delta.reset;
+    m->Added = ToManagedStrings(delta.entries.added);
+    m->Removed = ToManagedStrings(delta.entries.removed);
+    m->Changed = ToManagedStrings(delta.entries.changed);
+    return m;
 }
 
 System::Windows::Media::Imaging::BitmapSource^ ObBook::Engine::RenderPreviewPage(System::Int32 width, System::Int32 height, float dpi)
@@ -467,29 +480,243 @@ System::Windows::Media::Imaging::BitmapSource^ ObBook::Engine::RenderPreviewPage
     p.height = static_cast<uint32_t>(height);
     p.dpi = dpi;
 
-    std::vector<uint8_t> bgra;
+    const auto& source = impl_->compiler.GetNormalizedSourceUtf8().empty()
+        ? impl_->compiler.GetSourceUtf8()
+        : impl_->compiler.GetNormalizedSourceUtf8();
+
+    auto bitmap = previewBitmap_;
+    if (!bitmap || bitmap->PixelWidth != width || bitmap->PixelHeight != height || bitmap->DpiX != dpi)
+    {
+        bitmap = gcnew System::Windows::Media::Imaging::WriteableBitmap(
+            width, height, dpi, dpi, System::Windows::Media::PixelFormats::Bgra32, nullptr);
+    }
+
+    // Render, then overlay, directly into the bitmap's back buffer.
+    bitmap->Lock();
     std::string err;
-    const auto source = impl_->compiler.GetNormalizedSourceUtf8().empty()
+    bool ok = false;
+    try
+    {
+        auto* pixels = static_cast<uint8_t*>(bitmap->BackBuffer.ToPointer());
+        const size_t stride = static_cast<size_t>(bitmap->BackBufferStride);
+        ok = obbook::RenderPreviewBgra(p, source, pixels, stride, err);
+        if (ok)
+        {
+            TryOverlayFirstImg(pixels, p.width, p.height, stride, source, impl_->compiler.GetResolvedDataDirectoryUtf8(),
+                impl_->overlayScratch);
+            bitmap->AddDirtyRect(System::Windows::Int32Rect(0, 0, width, height));
+        }
+    }
+    finally
+    {
+        bitmap->Unlock();
+    }
+
+    if (!ok)
+        throw gcnew System::InvalidOperationException(marshal_as<System::String^>(err));
+
+    previewBitmap_ = bitmap;
+    impl_->previewMemory.Report(static_cast<size_t>(bitmap->BackBufferStride) * static_cast<size_t>(height)
+        + obbook::HeapBytes(impl_->overlayScratch.bytes) + obbook::HeapBytes(impl_->overlayScratch.tex));
+    return bitmap;
+}
+
+System::String^ ObBook::Engine::ThumbnailCacheFile::get()
+{
+    msclr::lock lock(thumbnailLock_);
+    return marshal_as<System::String^>(impl_->thumbnailFileUtf8);
+}
+
+void ObBook::Engine::ThumbnailCacheFile::set(System::String^ value)
+{
+    if (!value) value = "";
+    const std::string file = marshal_as<std::string>(value);
+    msclr::lock lock(thumbnailLock_);
+    if (file == impl_->thumbnailFileUtf8) return;
+    impl_->thumbnailFileUtf8 = file;
+    impl_->thumbnails.reset(); // views already handed out keep their own mapping
+}
+
+System::Collections::Generic::List<ObBook::TextureThumbnail^>^ ObBook::Engine::GetTextureThumbnails(System::String^ dataDirectory,
+    System::Collections::Generic::IList<System::String^>^ virtualPaths)
+{
+    auto list = gcnew System::Collections::Generic::List<TextureThumbnail^>();
+    if (!virtualPaths || virtualPaths->Count == 0) return list;
+    if (!dataDirectory) dataDirectory = "";
+
+    std::vector<std::string> paths;
+    paths.reserve(static_cast<size_t>(virtualPaths->Count));
+    for each (System::String^ path in virtualPaths)
+        paths.push_back(obbook::NormalizeVirtualPath(path ? marshal_as<std::string>(path) : std::string()));
+
+    msclr::lock lock(thumbnailLock_);
+    if (!impl_) throw gcnew System::ObjectDisposedException("Engine");
+    if (!impl_->thumbnails) impl_->thumbnails = std::make_unique<obbook::ThumbnailCache>(impl_->thumbnailFileUtf8);
+    std::vector<obbook::ThumbnailView> views;
+    impl_->thumbnails->GetThumbnails(marshal_as<std::string>(dataDirectory), paths, 0, views);
+
+    list->Capacity = static_cast<int>(views.size());
+    for (size_t i = 0; i < views.size(); ++i)
+    {
+        auto m = gcnew TextureThumbnail();
+        m->Path = marshal_as<System::String^>(paths[i]);
+        const auto& v = views[i];
+        if (v.IsValid())
+        {
+            const int stride = static_cast<int>(v.width) * 4;
+            m->Image = System::Windows::Media::Imaging::BitmapSource::Create(
+                static_cast<int>(v.width), static_cast<int>(v.height), 96.0, 96.0,
+                System::Windows::Media::PixelFormats::Bgra32, nullptr,
+                static_cast<System::IntPtr>(const_cast<void*>(static_cast<const void*>(v.bgra))), stride * static_cast<int>(v.height), stride);
+            m->Image->Freeze();
+        }
+        list->Add(m);
+    }
+    return list;
+}
+
+ObBook::PreviewPagesResult^ ObBook::Engine::RenderPreviewPages(System::Int32 width, System::Int32 height, float dpi,
+    System::Int32 firstPage, System::Int32 pageCount, System::Int32 workerCount)
+{
+    if (width <= 0) width = 1024;
+    if (height <= 0) height = 768;
+    if (dpi <= 0.0f) dpi = 96.0f;
+
+    obbook::BookPagesRequest request{};
+    request.geometry.width = static_cast<uint32_t>(width);
+    request.geometry.height = static_cast<uint32_t>(height);
+    request.firstPage = firstPage > 0 ? static_cast<uint32_t>(firstPage) : 0;
+    request.pageCount = pageCount > 0 ? static_cast<uint32_t>(pageCount) : obbook::kAllPages;
+    request.workerCount = workerCount > 0 ? static_cast<uint32_t>(workerCount) : 0;
+    request.dataDirUtf8 = impl_->compiler.GetResolvedDataDirectoryUtf8();
+
+    const auto& source = impl_->compiler.GetNormalizedSourceUtf8().empty()
         ? impl_->compiler.GetSourceUtf8()
         : impl_->compiler.GetNormalizedSourceUtf8();
 
-    if (!obbook::RenderPreviewBgra(p, source, bgra, err))
+    obbook::BookPagesResult rendered;
+    std::string err;
+    if (!obbook::RenderBookPagesBgra(source, request, rendered, err))
         throw gcnew System::InvalidOperationException(marshal_as<System::String^>(err));
 
-    TryOverlayFirstImg(bgra, p.width, p.height, source, impl_->compiler.GetResolvedDataDirectoryUtf8());
-
-    const int stride = width * 4;
-    auto pixels = gcnew array<System::Byte>(static_cast<int>(bgra.size()));
-    System::Runtime::InteropServices::Marshal::Copy(
-        static_cast<System::IntPtr>(static_cast<void*>(bgra.data())),
-        pixels,
-        0,
-        pixels->Length);
-
-    return System::Windows::Media::Imaging::BitmapSource::Create(
-        width, height, dpi, dpi,
-        System::Windows::Media::PixelFormats::Bgra32,
-        nullptr,
-        pixels,
-        stride);
+    auto result = gcnew PreviewPagesResult();
+    result->TotalPages = static_cast<System::Int32>(rendered.totalPages);
+    result->Workers = static_cast<System::Int32>(rendered.workers);
+    result->LayoutMilliseconds = rendered.layoutMilliseconds;
+    result->WallMilliseconds = rendered.wallMilliseconds;
+    result->Pages = gcnew System::Collections::Generic::List<PreviewPage^>(static_cast<int>(rendered.pages.size()));
+    for (const auto& page : rendered.pages)
+    {
+        auto m = gcnew PreviewPage();
+        m->PageIndex = static_cast<System::Int32>(page.page);
+        m->Milliseconds = page.milliseconds;
+        m->Image = ToBitmapSource(page.bgra, width, height, dpi);
+        m->Image->Freeze();
+        result->Pages->Add(m);
+    }
+    return result;
+}
+
+ObBook::PreviewExportResult^ ObBook::Engine::ExportPreviewPages(System::String^ directory, System::String^ fileStem,
+    System::Int32 width, System::Int32 height, System::Int32 firstPage, System::Int32 pageCount, System::Int32 workerCount)
+{
+    if (!directory) throw gcnew System::ArgumentNullException("directory");
+    if (width <= 0) width = 1024;
+    if (height <= 0) height = 768;
+
+    obbook::BookPagesRequest request{};
+    request.geometry.width = static_cast<uint32_t>(width);
+    request.geometry.height = static_cast<uint32_t>(height);
+    request.firstPage = firstPage > 0 ? static_cast<uint32_t>(firstPage) : 0;
+    request.pageCount = pageCount > 0 ? static_cast<uint32_t>(pageCount) : obbook::kAllPages;
+    request.workerCount = workerCount > 0 ? static_cast<uint32_t>(workerCount) : 0;
+    request.dataDirUtf8 = impl_->compiler.GetResolvedDataDirectoryUtf8();
+
+    obbook::BookPagesExport output{};
+    output.directoryUtf8 = marshal_as<std::string>(directory);
+    if (!System::String::IsNullOrEmpty(fileStem)) output.fileStem = marshal_as<std::string>(fileStem);
+
+    const auto& source = impl_->compiler.GetNormalizedSourceUtf8().empty()
+        ? impl_->compiler.GetSourceUtf8()
+        : impl_->compiler.GetNormalizedSourceUtf8();
+
+    obbook::BookPagesExportResult exported;
+    std::string err;
+    if (!obbook::ExportBookPagesPng(source, request, output, exported, err))
+        throw gcnew System::IO::IOException(marshal_as<System::String^>(err));
+
+    auto result = gcnew PreviewExportResult();
+    result->TotalPages = static_cast<System::Int32>(exported.totalPages);
+    result->Workers = static_cast<System::Int32>(exported.workers);
+    result->PngBytes = static_cast<System::Int64>(exported.pngBytes);
+    result->WallMilliseconds = exported.wallMilliseconds;
+    result->Files = gcnew System::Collections::Generic::List<System::String^>(static_cast<int>(exported.filesUtf8.size()));
+    for (const auto& file : exported.filesUtf8)
+        result->Files->Add(marshal_as<System::String^>(file));
+    return result;
+}
+
+System::UInt64 ObBook::Engine::SubmitCompile(System::String^ text, System::Int32 previewWidth, System::Int32 previewHeight,
+    float dpi, bool rescanAssets)
+{
+    if (!text) text = "";
+    if (dpi <= 0.0f) dpi = 96.0f;
+
+    obbook::CompileRequest request{};
+    request.sourceUtf8 = marshal_as<std::string>(text);
+    request.settings = impl_->compiler.GetSettings();
+    request.rescanAssets = rescanAssets;
+    request.previewWidth = previewWidth > 0 ? static_cast<uint32_t>(previewWidth) : 0;
+    request.previewHeight = previewHeight > 0 ? static_cast<uint32_t>(previewHeight) : 0;
+    request.previewDpi = dpi;
+    return impl_->compileService.Submit(std::move(request));
+}
+
+void ObBook::Engine::CancelCompile()
+{
+    impl_->compileService.CancelPending();
+}
+
+System::UInt64 ObBook::Engine::LatestCompileSequence::get()
+{
+    return impl_->compileService.GetLatestSequence();
+}
+
+System::Int32 ObBook::Engine::MaxCompletedDiagnostics::get()
+{
+    return impl_->maxCompletedDiagnostics.load();
+}
+
+void ObBook::Engine::MaxCompletedDiagnostics::set(System::Int32 value)
+{
+    impl_->maxCompletedDiagnostics.store(value);
+}
+
+void ObBook::Engine::RaiseCompileCompleted(const obbook::CompileResult& result)
+{
+    if (!impl_) return;
+
+    const auto& messages = result.messages;
+    static const std::string noMessage;
+    auto args = gcnew CompileCompletedEventArgs();
+    args->Sequence = result.sequence;
+    args->SourceText = marshal_as<System::String^>(result.sourceUtf8);
+    args->NormalizedText = marshal_as<System::String^>(result.normalizedUtf8);
+    args->ResolvedDataDirectory = marshal_as<System::String^>(result.resolvedDataDirUtf8);
+    args->Summary = ToManagedSummary(result.summary);
+    args->Diagnostics = ToManagedDiagnostics(result.diagnostics, impl_->maxCompletedDiagnostics.load(),
+        [&messages](uint16_t id) -> const std::string& { return id < messages.size() ? messages[id] : noMessage; });
+    args->DiagnosticsGeneration = result.diagnosticsGeneration;
+    args->Assets = gcnew AssetIndexView(new AssetIndexHolder(result.assetIndex));
+    args->AssetGeneration = result.assetGeneration;
+
+    if (!result.previewBgra.empty())
+    {
+        auto preview = ToBitmapSource(result.previewBgra, static_cast<System::Int32>(result.previewWidth),
+            static_cast<System::Int32>(result.previewHeight), result.previewDpi);
+        preview->Freeze(); // consumers are on the UI thread
+        args->Preview = preview;
+    }
+
+    CompileCompleted(this, args);
 }
@@ -1,18 +1,177 @@
 #pragma once
 
+namespace obbook { struct CompileResult; }
+
 namespace ObBook
 {
     public enum class Severity : System::Byte { Info=0, Warning=1, Error=2 };
 
+    // Mirrors obbook::DiagnosticKind.
+    public enum class DiagnosticKind : System::Byte
+    {
+        SmartQuoteNormalized = 0,
+        BackslashNormalized = 1,
+        ImgWidthExceeded = 2,
+        AssetScanSummary = 3,
+        ImgTextureMissing = 4,
+        ImgAspectMismatch = 5,
+    };
+
     public ref class Diagnostic sealed
     {
     public:
         property Severity SeverityLevel;
-        property System::Int32 Offset;
+        property DiagnosticKind Kind;
+        property System::Int32 Offset; // UTF-8 byte offset into the source text
         property System::Int32 Length;
+        property System::Int32 Count; // >1 when adjacent same-kind diagnostics were grouped
+        property System::Int32 NormalizedOffset; // the same range in NormalizedText
+        property System::Int32 NormalizedLength;
         property System::String^ Message;
     };
 
+    public ref class DiagnosticSummary sealed
+    {
+    public:
+        property System::Int32 Total;
+        property System::Int32 Infos;
+        property System::Int32 Warnings;
+        property System::Int32 Errors;
+        property array<System::Int32>^ CountsByKind; // indexed by DiagnosticKind
+    };
+
+    // Diagnostics that changed between two generations; see Engine::GetDiagnosticsDelta.
+    public ref class DiagnosticsDelta sealed
+    {
+    public:
+        property System::UInt64 FromGeneration;
+        property System::UInt64 ToGeneration;
+        property System::Boolean Reset; // FromGeneration was not known: clear the list, Added holds every diagnostic
+        property System::Collections::Generic::List<System::Int32>^ Removed;      // indexes into the FromGeneration list, ascending
+        property System::Collections::Generic::List<System::Int32>^ AddedIndexes; // indexes into GetDiagnostics(), ascending
+        property System::Collections::Generic::List<Diagnostic^>^ Added;          // the records at AddedIndexes
+    };
+
+    // Asset index entries that changed between two generations; see Engine::GetAssetDelta.
+    public ref class AssetDelta sealed
+    {
+    public:
+        property System::UInt64 FromGeneration;
+        property System::UInt64 ToGeneration;
+        property System::Boolean Reset; // FromGeneration was not known: Added lists every entry
+        property System::Collections::Generic::List<System::String^>^ Added;   // normalized paths, in path order
+        property System::Collections::Generic::List<System::String^>^ Removed;
+        property System::Collections::Generic::List<System::String^>^ Changed; // now resolving from another source
+    };
+
+    // One node of the asset index: a folder, a file entry, or both.
+    public ref class AssetEntry sealed
+    {
+    public:
+        property System::String^ Name;   // last path segment
+        property System::String^ Path;   // normalized virtual path
+        property System::Boolean IsFile;
+        property System::String^ Source; // "loose" or "bsa:<file>"; null for folders
+        property System::Boolean HasChildren;
+        property System::Int32 EntryCount; // file entries at or below this node
+    };
+
+    public ref class TextureThumbnail sealed
+    {
+    public:
+        property System::String^ Path;   // normalized virtual path
+        property System::Windows::Media::Imaging::BitmapSource^ Image; // frozen; null when the texture could not be decoded
+    };
+
+    class AssetIndexHolder;
+
+    // Immutable snapshot of a scan's asset index; safe to query from any thread. Children are materialized on
+    // demand, so a tree view can expand folders lazily.
+    public ref class AssetIndexView sealed
+    {
+    public:
+        ~AssetIndexView();
+        !AssetIndexView();
+
+        property System::Int32 EntryCount { System::Int32 get(); }
+        // True when both views wrap the same scan (no rescan happened in between).
+        System::Boolean IsSameSnapshot(AssetIndexView^ other);
+        // null when the path is not in the index.
+        AssetEntry^ Find(System::String^ path);
+        // Children of a folder in name order; "" lists the top level. Empty when the path is unknown.
+        System::Collections::Generic::List<AssetEntry^>^ GetChildren(System::String^ path);
+
+    internal:
+        AssetIndexView(AssetIndexHolder* holder);
+
+    private:
+        AssetIndexHolder* holder_;
+    };
+
+    public ref class CompileCompletedEventArgs sealed : System::EventArgs
+    {
+    public:
+        property System::UInt64 Sequence;
+        property System::String^ SourceText; // the snapshot that was compiled
+        property System::String^ NormalizedText;
+        property System::String^ ResolvedDataDirectory;
+        property DiagnosticSummary^ Summary;
+        property System::Collections::Generic::List<Diagnostic^>^ Diagnostics; // capped by MaxCompletedDiagnostics
+        property System::UInt64 DiagnosticsGeneration; // equal to the one shown: the list did not change
+        property AssetIndexView^ Assets;
+        property System::UInt64 AssetGeneration;
+        property System::Windows::Media::Imaging::BitmapSource^ Preview; // frozen; null if rendering failed
+    };
+
+    public ref class PreviewPage sealed
+    {
+    public:
+        property System::Int32 PageIndex;
+        property System::Double Milliseconds; // compose time on its worker
+        property System::Windows::Media::Imaging::BitmapSource^ Image; // frozen
+    };
+
+    public ref class PreviewPagesResult sealed
+    {
+    public:
+        property System::Int32 TotalPages; // pages in the whole book
+        property System::Int32 Workers;
+        property System::Double LayoutMilliseconds;
+        property System::Double WallMilliseconds;
+        property System::Collections::Generic::List<PreviewPage^>^ Pages;
+    };
+
+    public ref class PreviewExportResult sealed
+    {
+    public:
+        property System::Int32 TotalPages; // pages in the whole book
+        property System::Int32 Workers;
+        property System::Int64 PngBytes;
+        property System::Double WallMilliseconds;
+        property System::Collections::Generic::List<System::String^>^ Files; // one per exported page, in page order
+    };
+
+    // Mirrors obbook::MemorySubsystem.
+    public enum class MemorySubsystem : System::Byte
+    {
+        AssetIndex = 0,
+        CompileBuffers = 1,
+        TextureCache = 2,
+        RenderBuffers = 3,
+    };
+
+    public ref class MemoryUsage sealed
+    {
+    public:
+        property MemorySubsystem Subsystem;
+        property System::String^ Name;
+        property System::Int64 Bytes;       // retained now, process-wide
+        property System::Int64 PeakBytes;   // since start or ResetMemoryPeaks
+        property System::Int32 Accounts;    // live owners reporting into it
+        property System::Int64 BudgetBytes; // 0 = none
+        property System::Boolean IsOverBudget;
+    };
+
     class EngineImpl;
 
     public ref class Engine sealed
@@ -29,15 +188,81 @@ namespace ObBook
         property System::String^ NormalizedText { System::String^ get(); }
         property System::String^ ExportDescText { System::String^ get(); }
         property System::String^ ResolvedDataDirectory { System::String^ get(); }
+        property bool GroupAdjacentDiagnostics { bool get(); void set(bool value); }
+
+        // UTF-8 byte offsets between the last compiled source and NormalizedText, e.g. to keep the caret in
+        // place when switching views. No recompile; an offset inside a rewritten character maps to its start.
+        System::Int32 SourceToNormalizedOffset(System::Int32 sourceOffset);
+        System::Int32 NormalizedToSourceOffset(System::Int32 normalizedOffset);
+
+        // Hot-path trace spans (compile passes, asset reads, texture decode, rendering), process-wide.
+        property bool TracingEnabled { bool get(); void set(bool value); }
+        // Writes the recorded spans as Chrome trace-event JSON (load in chrome://tracing or Perfetto).
+        void WriteTrace(System::String^ path);
+
+        // Memory the engine retains, one entry per MemorySubsystem, process-wide (every engine and background
+        // compile). Budgets are only reported through IsOverBudget; bytes <= 0 clears one.
+        System::Collections::Generic::List<MemoryUsage^>^ GetMemoryUsage();
+        void SetMemoryBudget(MemorySubsystem subsystem, System::Int64 bytes);
+        void ResetMemoryPeaks();
 
         System::Collections::Generic::List<Diagnostic^>^ GetDiagnostics();
-        System::Collections::Generic::List<System::String^>^ GetBookFontAssets();
-        System::Collections::Generic::List<System::String^>^ GetBookTextureAssets();
+        // Materializes at most maxCount records; use GetDiagnosticSummary for totals.
+        System::Collections::Generic::List<Diagnostic^>^ GetDiagnostics(System::Int32 maxCount);
+        DiagnosticSummary^ GetDiagnosticSummary();
+        // Book fonts and textures from the last scan of the synchronous compiler.
+        AssetIndexView^ GetAssetIndex();
 
-        // v1 preview plumbing: returns a BitmapSource for a stub page.
+        // Generations of the synchronous compiler's diagnostics and asset index. They only move when the
+        // content changes and are unique across engines and background compiles, so a host that remembers the
+        // generation it shows can skip GetDiagnostics, GetAssetIndex and its own UI rebuild when they match.
+        property System::UInt64 DiagnosticsGeneration { System::UInt64 get(); }
+        property System::UInt64 AssetGeneration { System::UInt64 get(); }
+        // What changed since sinceGeneration. Only the previous generation gives a real delta; any other
+        // generation gives a Reset listing everything. ToGeneration == sinceGeneration means nothing changed.
+        DiagnosticsDelta^ GetDiagnosticsDelta(System::UInt64 sinceGeneration);
+        AssetDelta^ GetAssetDelta(System::UInt64 sinceGeneration);
+
+        // v1 preview plumbing: renders a stub page straight into a WriteableBitmap. The bitmap is reused (and
+        // updated in place) by later calls with the same size and DPI; call from the thread that owns it.
         System::Windows::Media::Imaging::BitmapSource^ RenderPreviewPage(System::Int32 width, System::Int32 height, float dpi);
 
+        // Paginates the compiled book and renders pages [firstPage, firstPage + pageCount) concurrently, one frozen
+        // bitmap each (pageCount <= 0 renders to the end; workerCount <= 0 uses every core). Blocks until done.
+        PreviewPagesResult^ RenderPreviewPages(System::Int32 width, System::Int32 height, float dpi,
+            System::Int32 firstPage, System::Int32 pageCount, System::Int32 workerCount);
+
+        // Headless counterpart for saving previews: renders the same pages and writes each to
+        // directory/<fileStem>_0001.png and so on (the directory is created if needed), composing and encoding on
+        // the workers without creating bitmaps. Throws if any page could not be written.
+        PreviewExportResult^ ExportPreviewPages(System::String^ directory, System::String^ fileStem, System::Int32 width,
+            System::Int32 height, System::Int32 firstPage, System::Int32 pageCount, System::Int32 workerCount);
+
+        // Book texture thumbnails (fitted into 96 x 96) for virtual paths under dataDirectory, one per path. Missing
+        // ones are decoded in parallel and appended to ThumbnailCacheFile; cached ones are read from a mapping of
+        // that file, so a reopened browser does not decode again. Without a cache file nothing is kept. May be called
+        // from any thread (calls are serialized); throws ObjectDisposedException once the engine is disposed.
+        property System::String^ ThumbnailCacheFile { System::String^ get(); void set(System::String^ value); }
+        System::Collections::Generic::List<TextureThumbnail^>^ GetTextureThumbnails(System::String^ dataDirectory,
+            System::Collections::Generic::IList<System::String^>^ virtualPaths);
+
+        // Background compile + preview render of a source snapshot, using the current Oblivion directory and
+        // settings. Returns immediately; a newer submission supersedes and cancels older ones, so only the
+        // latest completes. CompileCompleted is raised on a worker thread (marshal with Dispatcher.BeginInvoke;
+        // a blocking Invoke can deadlock against Dispose). Returns the request's sequence number.
+        System::UInt64 SubmitCompile(System::String^ text, System::Int32 previewWidth, System::Int32 previewHeight,
+            float dpi, bool rescanAssets);
+        void CancelCompile();
+        property System::UInt64 LatestCompileSequence { System::UInt64 get(); }
+        property System::Int32 MaxCompletedDiagnostics { System::Int32 get(); void set(System::Int32 value); }
+        event System::EventHandler<CompileCompletedEventArgs^>^ CompileCompleted;
+
+    internal:
+        void RaiseCompileCompleted(const obbook::CompileResult& result);
+
     private:
         EngineImpl* impl_;
+        System::Windows::Media::Imaging::WriteableBitmap^ previewBitmap_;
+        System::Object^ thumbnailLock_; // guards impl_->thumbnails and impl_ itself against thumbnail calls from the pool
     };
 }
@@ -0,0 +1,497 @@
+#include "ObBookAssetIndex.h"
+#include "ObBookTrace.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+
+namespace obbook
+{
+    const std::string& AssetIndex::SourceName(AssetSourceId id) const
+    {
+        static const std::string unknown;
+        return id < sources_.size() ? sources_[id] : unknown;
+    }
+
+    std::string_view AssetIndex::Segment(AssetNodeId node) const
+    {
+        const uint32_t s = nodes_[node].segment;
+        return std::string_view(segmentChars_).substr(segmentOffsets_[s], segmentOffsets_[s + 1] - segmentOffsets_[s]);
+    }
+
+    std::string AssetIndex::Path(AssetNodeId node) const
+    {
+        if (node >= nodes_.size() || node == kRoot) return std::string();
+
+        size_t length = 0;
+        for (AssetNodeId n = node; n != kRoot; n = nodes_[n].parent)
+            length += Segment(n).size() + 1;
+
+        std::string out(length - 1, '/');
+        size_t end = out.size();
+        for (AssetNodeId n = node; n != kRoot; n = nodes_[n].parent)
+        {
+            const auto seg = Segment(n);
+            end -= seg.size();
+            std::copy(seg.begin(), seg.end(), out.begin() + static_cast<std::ptrdiff_t>(end));
+            if (end > 0) --end; // skip the separator
+        }
+        return out;
+    }
+
+    AssetNodeId AssetIndex::FindChild(AssetNodeId parent, std::string_view segment) const
+    {
+        const Node& p = nodes_[parent];
+        uint32_t lo = 0;
+        uint32_t hi = p.childCount;
+        while (lo < hi)
+        {
+            const uint32_t mid = lo + (hi - lo) / 2;
+            const int c = Segment(p.firstChild + mid).compare(segment);
+            if (c == 0) return p.firstChild + mid;
+            if (c < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return kInvalidAssetNode;
+    }
+
+    AssetNodeId AssetIndex::Find(std::string_view normalizedPath) const
+    {
+        if (nodes_.empty()) return kInvalidAssetNode;
+        AssetNodeId node = kRoot;
+        size_t start = 0;
+        while (start <= normalizedPath.size() && node != kInvalidAssetNode)
+        {
+            size_t slash = normalizedPath.find('/', start);
+            if (slash == std::string_view::npos) slash = normalizedPath.size();
+            if (slash > start) node = FindChild(node, normalizedPath.substr(start, slash - start));
+            start = slash + 1;
+        }
+        return node;
+    }
+
+    bool AssetIndex::FindEntry(std::string_view normalizedPath, AssetSourceId& outSource) const
+    {
+        const AssetNodeId node = Find(normalizedPath);
+        if (node == kInvalidAssetNode || !IsEntry(node)) return false;
+        outSource = nodes_[node].source;
+        return true;
+    }
+
+    size_t AssetIndex::MemoryBytes() const
+    {
+        size_t bytes = nodes_.capacity() * sizeof(Node)
+            + segmentChars_.capacity()
+            + segmentOffsets_.capacity() * sizeof(uint32_t)
+            + sources_.capacity() * sizeof(std::string);
+        for (const auto& s : sources_) bytes += s.capacity();
+        return bytes;
+    }
+
+    AssetSourceId AssetIndexBuilder::AddSource(const std::string& name)
+    {
+        sources_.push_back(name);
+        return static_cast<AssetSourceId>(sources_.size() - 1);
+    }
+
+    void AssetIndexBuilder::Reserve(size_t entries, size_t pathBytes)
+    {
+        entries_.reserve(entries);
+        chars_.reserve(pathBytes);
+    }
+
+    void AssetIndexBuilder::Add(std::string_view normalizedPath, AssetSourceId source)
+    {
+        // Stored without leading, trailing or repeated slashes, so every '/' separates two non-empty segments.
+        Entry e{};
+        e.offset = static_cast<uint32_t>(chars_.size());
+        e.source = source;
+        const bool clean = !normalizedPath.empty() && normalizedPath.front() != '/' && normalizedPath.back() != '/'
+            && normalizedPath.find("//") == std::string_view::npos;
+        if (clean)
+        {
+            chars_.append(normalizedPath.data(), normalizedPath.size());
+        }
+        else
+        {
+            for (const char c : normalizedPath)
+            {
+                if (c == '/' && (chars_.size() == e.offset || chars_.back() == '/')) continue;
+                chars_.push_back(c);
+            }
+            if (chars_.size() > e.offset && chars_.back() == '/') chars_.pop_back();
+        }
+        e.length = static_cast<uint32_t>(chars_.size() - e.offset);
+        if (e.length != 0) entries_.push_back(e);
+    }
+
+    AssetIndex AssetIndexBuilder::Build()
+    {
+        OBBOOK_TRACE_SCOPE("AssetIndex.Build");
+        const std::string_view chars(chars_);
+
+        struct BuildNode
+        {
+            std::string_view name; // view into chars_, stable until the builder is cleared below
+            uint32_t parent;
+            AssetSourceId source;
+            bool folder;
+        };
+        std::vector<BuildNode> nodes;
+        nodes.reserve(entries_.size() + 64);
+        nodes.push_back({ std::string_view(), kInvalidAssetNode, AssetIndex::kNoSource, true });
+
+        // Pass 1: one node per entry plus one per distinct folder, keyed by the folder's full path. Archives
+        // list files folder by folder, so the previous entry's folder is checked before the hash table.
+        std::unordered_map<std::string_view, uint32_t> folders;
+        auto resolveFolder = [&](std::string_view path) -> uint32_t
+        {
+            if (path.empty()) return 0u;
+            if (auto it = folders.find(path); it != folders.end()) return it->second;
+
+            // Deepest existing ancestor, then create the missing folders top-down.
+            size_t known = 0;
+            uint32_t parent = 0;
+            for (size_t cut = path.rfind('/'); cut != std::string_view::npos; cut = cut ? path.rfind('/', cut - 1) : std::string_view::npos)
+            {
+                if (auto it = folders.find(path.substr(0, cut)); it != folders.end())
+                {
+                    known = cut + 1;
+                    parent = it->second;
+                    break;
+                }
+            }
+            while (known < path.size())
+            {
+                size_t slash = path.find('/', known);
+                if (slash == std::string_view::npos) slash = path.size();
+                const uint32_t id = static_cast<uint32_t>(nodes.size());
+                nodes.push_back({ path.substr(known, slash - known), parent, AssetIndex::kNoSource, true });
+                folders.emplace(path.substr(0, slash), id);
+                parent = id;
+                known = slash + 1;
+            }
+            return parent;
+        };
+
+        {
+            OBBOOK_TRACE_SCOPE("AssetIndex.Build.Insert");
+            std::string_view lastFolder;
+            uint32_t lastFolderNode = 0;
+            for (const Entry& e : entries_)
+            {
+                const std::string_view path = chars.substr(e.offset, e.length);
+                const size_t slash = path.rfind('/');
+                const std::string_view folder = slash == std::string_view::npos ? std::string_view() : path.substr(0, slash);
+                const std::string_view leaf = slash == std::string_view::npos ? path : path.substr(slash + 1);
+                if (folder.size() != lastFolder.size() || folder != lastFolder)
+                {
+                    lastFolderNode = resolveFolder(folder);
+                    lastFolder = folder;
+                }
+                nodes.push_back({ leaf, lastFolderNode, e.source, false });
+            }
+        }
+
+        // Pass 2: children as CSR over creation ids, each group sorted by name. Equal names are merged: a
+        // folder absorbs a same-named file entry, and among duplicate entries the lowest source id wins.
+        const size_t nodeCount = nodes.size();
+        std::vector<uint32_t> childStart(nodeCount + 1, 0);
+        std::vector<uint32_t> childCount(nodeCount, 0);
+        for (size_t i = 1; i < nodeCount; ++i) ++childStart[nodes[i].parent + 1];
+        for (size_t i = 0; i < nodeCount; ++i) childStart[i + 1] += childStart[i];
+        std::vector<uint32_t> children(nodeCount - 1);
+        {
+            std::vector<uint32_t> fill(childStart.begin(), childStart.end() - 1);
+            for (size_t i = 1; i < nodeCount; ++i) children[fill[nodes[i].parent]++] = static_cast<uint32_t>(i);
+        }
+        {
+            OBBOOK_TRACE_SCOPE("AssetIndex.Build.SortChildren");
+            for (size_t p = 0; p < nodeCount; ++p)
+            {
+                const auto first = children.begin() + childStart[p];
+                const auto last = children.begin() + childStart[p + 1];
+                if (last - first > 1)
+                {
+                    std::sort(first, last, [&](uint32_t a, uint32_t b)
+                    {
+                        const BuildNode& na = nodes[a];
+                        const BuildNode& nb = nodes[b];
+                        if (const int c = na.name.compare(nb.name); c != 0) return c < 0;
+                        if (na.folder != nb.folder) return na.folder;
+                        return na.source < nb.source;
+                    });
+                }
+
+                uint32_t kept = 0;
+                for (auto it = first; it != last; ++it)
+                {
+                    BuildNode& n = nodes[*it];
+                    if (kept > 0)
+                    {
+                        BuildNode& prev = nodes[*(first + (kept - 1))];
+                        if (prev.name == n.name)
+                        {
+                            if (prev.source == AssetIndex::kNoSource) prev.source = n.source;
+                            continue;
+                        }
+                    }
+                    *(first + kept++) = *it;
+                }
+                childCount[p] = kept;
+            }
+        }
+
+        // Pass 3: breadth-first relayout so siblings are contiguous in the final node array.
+        std::vector<uint32_t> bfs;
+        std::vector<uint32_t> newId(nodeCount, kInvalidAssetNode);
+        bfs.reserve(nodeCount);
+        bfs.push_back(0);
+        newId[0] = 0;
+        for (size_t i = 0; i < bfs.size(); ++i)
+        {
+            const uint32_t old = bfs[i];
+            for (uint32_t c = 0; c < childCount[old]; ++c)
+            {
+                const uint32_t child = children[childStart[old] + c];
+                newId[child] = static_cast<uint32_t>(bfs.size());
+                bfs.push_back(child);
+            }
+        }
+
+        // Folder names repeat across parents ("set3", "chapter1") and are interned; file names are unique per
+        // folder and are appended as-is.
+        AssetIndex index;
+        const size_t finalCount = bfs.size();
+        size_t nameBytes = 0;
+        for (const uint32_t old : bfs) nameBytes += nodes[old].name.size();
+        index.segmentChars_.reserve(nameBytes);
+        index.segmentOffsets_.reserve(finalCount + 1);
+        std::unordered_map<std::string_view, uint32_t> folderSegments;
+        auto addSegment = [&](std::string_view name)
+        {
+            index.segmentOffsets_.push_back(static_cast<uint32_t>(index.segmentChars_.size()));
+            index.segmentChars_.append(name.data(), name.size());
+            return static_cast<uint32_t>(index.segmentOffsets_.size() - 1);
+        };
+
+        index.nodes_.resize(finalCount);
+        for (size_t j = 0; j < finalCount; ++j)
+        {
+            const uint32_t old = bfs[j];
+            const BuildNode& b = nodes[old];
+            AssetIndex::Node& n = index.nodes_[j];
+            if (b.folder)
+            {
+                auto [it, inserted] = folderSegments.emplace(b.name, 0u);
+                if (inserted) it->second = addSegment(b.name);
+                n.segment = it->second;
+            }
+            else
+            {
+                n.segment = addSegment(b.name);
+            }
+            n.parent = old == 0 ? kInvalidAssetNode : newId[b.parent];
+            n.childCount = childCount[old];
+            n.firstChild = n.childCount ? newId[children[childStart[old]]] : 0;
+            n.source = b.source;
+            n.entryCount = b.source != AssetIndex::kNoSource ? 1u : 0u;
+        }
+        index.segmentOffsets_.push_back(static_cast<uint32_t>(index.segmentChars_.size()));
+        index.segmentOffsets_.shrink_to_fit();
+        for (size_t j = finalCount; j-- > 1;)
+            index.nodes_[index.nodes_[j].parent].entryCount += index.nodes_[j].entryCount;
+        index.sources_ = sources_;
+
+        entries_.clear();
+        chars_.clear();
+        return index;
+    }
+
+    namespace
+    {
+        // Both trees keep children sorted by segment, so each folder present in both is a merge of two sorted
+        // lists; a subtree on one side only is listed whole.
+        struct IndexDiffWalk
+        {
+            const AssetIndex& before;
+            const AssetIndex& after;
+            AssetIndexDiff* diff;
+
+            static void Subtree(const AssetIndex& index, AssetNodeId node, std::vector<std::string>* out)
+            {
+                if (out) index.ForEachEntry(node, [&](AssetNodeId n) { out->push_back(index.Path(n)); });
+            }
+
+            bool Nodes(AssetNodeId a, AssetNodeId b) const
+            {
+                bool differs = false;
+                if (before.IsEntry(a) != after.IsEntry(b))
+                {
+                    differs = true;
+                    if (!diff) return true;
+                    if (before.IsEntry(a)) diff->removed.push_back(before.Path(a));
+                    else diff->added.push_back(after.Path(b));
+                }
+                else if (before.IsEntry(a) && before.SourceName(before.Source(a)) != after.SourceName(after.Source(b)))
+                {
+                    differs = true;
+                    if (!diff) return true;
+                    diff->changed.push_back(after.Path(b));
+                }
+
+                const AssetNodeId aEnd = before.FirstChild(a) + before.ChildCount(a);
+                const AssetNodeId bEnd = after.FirstChild(b) + after.ChildCount(b);
+                AssetNodeId i = before.FirstChild(a), j = after.FirstChild(b);
+                while (i < aEnd || j < bEnd)
+                {
+                    const int c = i == aEnd ? 1 : j == bEnd ? -1 : before.Segment(i).compare(after.Segment(j));
+                    if (c == 0)
+                    {
+                        differs = Nodes(i++, j++) || differs;
+                    }
+                    else
+                    {
+                        if (c < 0) Subtree(before, i++, diff ? &diff->removed : nullptr);
+                        else Subtree(after, j++, diff ? &diff->added : nullptr);
+                        differs = true;
+                    }
+                    if (differs && !diff) return true;
+                }
+                return differs;
+            }
+        };
+    }
+
+    bool DiffAssetIndexes(const AssetIndex& before, const AssetIndex& after, AssetIndexDiff* diff)
+    {
+        OBBOOK_TRACE_SCOPE("AssetIndex.Diff");
+        if (diff) *diff = AssetIndexDiff{};
+        if (before.NodeCount() == 0 || after.NodeCount() == 0)
+        {
+            if (before.EntryCount() == 0 && after.EntryCount() == 0) return false;
+            if (before.NodeCount() != 0) IndexDiffWalk::Subtree(before, AssetIndex::kRoot, diff ? &diff->removed : nullptr);
+            if (after.NodeCount() != 0) IndexDiffWalk::Subtree(after, AssetIndex::kRoot, diff ? &diff->added : nullptr);
+            return true;
+        }
+        return IndexDiffWalk{ before, after, diff }.Nodes(AssetIndex::kRoot, AssetIndex::kRoot);
+    }
+
+    AssetIndexPublisher::AssetIndexPublisher() = default;
+
+    AssetIndexPublisher::AssetIndexPublisher(std::shared_ptr<const AssetIndex> index)
+        : current_(std::move(index))
+    {
+    }
+
+    AssetIndexPublisher::~AssetIndexPublisher() = default;
+
+    AssetIndexPublisher::AssetIndexPublisher(const AssetIndexPublisher& other)
+        : current_(other.Load())
+    {
+    }
+
+    AssetIndexPublisher& AssetIndexPublisher::operator=(const AssetIndexPublisher& other)
+    {
+        if (this != &other) Publish(other.Load());
+        return *this;
+    }
+
+    // Acquire and release on the flag order the copy after the Publish() that stored it, so a reader sees the
+    // snapshot fully built.
+    std::shared_ptr<const AssetIndex> AssetIndexPublisher::Load() const
+    {
+        while (busy_.test_and_set(std::memory_order_acquire)) std::this_thread::yield();
+        std::shared_ptr<const AssetIndex> index = current_;
+        busy_.clear(std::memory_order_release);
+        return index;
+    }
+
+    void AssetIndexPublisher::Publish(std::shared_ptr<const AssetIndex> index)
+    {
+        while (busy_.test_and_set(std::memory_order_acquire)) std::this_thread::yield();
+        current_.swap(index);
+        busy_.clear(std::memory_order_release);
+        // index now holds the previous snapshot; it is freed here unless readers still hold it.
+    }
+
+    uint64_t AssetPathSet::Hash(std::string_view path)
+    {
+        // FNV-1a with a murmur-style finalizer so the low bits used for the slot index are well mixed.
+        uint64_t h = 0xCBF29CE484222325ull;
+        for (const char c : path)
+        {
+            h ^= static_cast<uint8_t>(c);
+            h *= 0x100000001B3ull;
+        }
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        return h ? h : 1;
+    }
+
+    void AssetPathSet::Rehash(size_t slotCount)
+    {
+        std::vector<uint64_t> old;
+        old.swap(slots_);
+        slots_.assign(slotCount, 0);
+        size_ = 0;
+        for (const uint64_t h : old)
+            if (h != 0) InsertHash(h);
+    }
+
+    void AssetPathSet::InsertHash(uint64_t hash)
+    {
+        const size_t mask = slots_.size() - 1;
+        for (size_t i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask)
+        {
+            if (slots_[i] == hash) return;
+            if (slots_[i] == 0)
+            {
+                slots_[i] = hash;
+                ++size_;
+                return;
+            }
+        }
+    }
+
+    void AssetPathSet::Reserve(size_t count)
+    {
+        size_t slots = 16;
+        while (slots < count * 2) slots *= 2;
+        if (slots > slots_.size()) Rehash(slots);
+    }
+
+    void AssetPathSet::Insert(std::string_view normalizedPath)
+    {
+        if ((size_ + 1) * 2 > slots_.size()) Rehash(slots_.empty() ? 16 : slots_.size() * 2);
+        InsertHash(Hash(normalizedPath));
+    }
+
+    bool AssetPathSet::Contains(std::string_view normalizedPath) const
+    {
+        if (slots_.empty()) return false;
+        const uint64_t hash = Hash(normalizedPath);
+        const size_t mask = slots_.size() - 1;
+        for (size_t i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask)
+        {
+            if (slots_[i] == hash) return true;
+            if (slots_[i] == 0) return false;
+        }
+    }
+
+    uint64_t AssetPathSet::Fingerprint() const
+    {
+        // The slots already hold well-mixed hashes, so their sum is a fair digest; the size guards against
+        // sums that happen to cancel.
+        uint64_t sum = 0;
+        for (const uint64_t h : slots_) sum += h;
+        return sum ^ (static_cast<uint64_t>(size_) * 0x9E3779B97F4A7C15ull);
+    }
+
+    void AssetPathSet::Clear()
+    {
+        slots_.clear();
+        size_ = 0;
+    }
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace obbook
+{
+    using AssetSourceId = uint16_t;
+    using AssetNodeId = uint32_t;
+    constexpr AssetNodeId kInvalidAssetNode = 0xFFFFFFFFu;
+
+    // Immutable prefix tree over normalized virtual paths ("textures/menus/book/a.dds").
+    // Path segments are interned into one character pool; nodes are laid out breadth-first so every node's
+    // children are contiguous and sorted by segment, which gives lazy child enumeration and O(depth * log fanout)
+    // exact lookup. Each entry records the source (loose files or one archive) it resolves from.
+    class AssetIndex
+    {
+    public:
+        static constexpr AssetNodeId kRoot = 0;
+
+        size_t NodeCount() const { return nodes_.size(); }
+        size_t EntryCount() const { return nodes_.empty() ? 0 : nodes_[kRoot].entryCount; }
+        size_t SourceCount() const { return sources_.size(); }
+        const std::string& SourceName(AssetSourceId id) const;
+
+        // Folder or entry node for a normalized path ("" is the root); kInvalidAssetNode if absent.
+        AssetNodeId Find(std::string_view normalizedPath) const;
+        // True only for entries (files); outSource receives the winning source.
+        bool FindEntry(std::string_view normalizedPath, AssetSourceId& outSource) const;
+
+        std::string_view Segment(AssetNodeId node) const;
+        std::string Path(AssetNodeId node) const;
+        AssetNodeId Parent(AssetNodeId node) const { return nodes_[node].parent; }
+        bool IsEntry(AssetNodeId node) const { return nodes_[node].source != kNoSource; }
+        AssetSourceId Source(AssetNodeId node) const { return nodes_[node].source; }
+
+        // Children are the ids [FirstChild, FirstChild + ChildCount), in segment order.
+        AssetNodeId FirstChild(AssetNodeId node) const { return nodes_[node].firstChild; }
+        uint32_t ChildCount(AssetNodeId node) const { return nodes_[node].childCount; }
+        // Entries at or below node.
+        uint32_t EntryCountUnder(AssetNodeId node) const { return nodes_[node].entryCount; }
+
+        // Calls fn(AssetNodeId) for every entry at or below node, depth-first in path order.
+        template <typename Fn>
+        void ForEachEntry(AssetNodeId node, Fn&& fn) const
+        {
+            if (node >= nodes_.size()) return;
+            if (IsEntry(node)) fn(node);
+            const Node& n = nodes_[node];
+            for (uint32_t i = 0; i < n.childCount; ++i)
+                ForEachEntry(n.firstChild + i, fn);
+        }
+
+        // Heap bytes owned by the index (capacity, not size).
+        size_t MemoryBytes() const;
+
+    private:
+        friend class AssetIndexBuilder;
+        static constexpr AssetSourceId kNoSource = 0xFFFF;
+
+        struct Node
+        {
+            uint32_t segment;    // index into segmentOffsets_
+            AssetNodeId parent;
+            AssetNodeId firstChild;
+            uint32_t childCount;
+            uint32_t entryCount;
+            AssetSourceId source; // kNoSource for pure folders
+        };
+
+        std::vector<Node> nodes_;
+        std::string segmentChars_;
+        std::vector<uint32_t> segmentOffsets_; // segment i is [offsets[i], offsets[i+1])
+        std::vector<std::string> sources_;
+
+        AssetNodeId FindChild(AssetNodeId parent, std::string_view segment) const;
+    };
+
+    // Entries that differ between two snapshots, as normalized paths in path order.
+    struct AssetIndexDiff
+    {
+        std::vector<std::string> added;
+        std::vector<std::string> removed;
+        std::vector<std::string> changed; // in both, but resolving from a differently named source
+
+        bool Empty() const { return added.empty() && removed.empty() && changed.empty(); }
+    };
+
+    // Walks both trees side by side, so only entries that differ get their paths built. True when the snapshots
+    // differ; with diff null it stops at the first difference.
+    bool DiffAssetIndexes(const AssetIndex& before, const AssetIndex& after, AssetIndexDiff* diff);
+
+    // The current AssetIndex snapshot of one owner, readable from any thread while the owner builds and publishes
+    // the next (RCU style). Load() takes a reference to whatever snapshot is current; a reader keeps that one
+    // alive and unchanged for as long as it holds it, however many are published meanwhile, and the last holder
+    // frees it. Readers never wait for a scan: the slot is only locked for the pointer copy and reference count
+    // increment, and a replaced snapshot is released after the lock. Copies load the other's current snapshot.
+    class AssetIndexPublisher
+    {
+    public:
+        AssetIndexPublisher();
+        explicit AssetIndexPublisher(std::shared_ptr<const AssetIndex> index);
+        ~AssetIndexPublisher();
+        AssetIndexPublisher(const AssetIndexPublisher& other);
+        AssetIndexPublisher& operator=(const AssetIndexPublisher& other);
+
+        std::shared_ptr<const AssetIndex> Load() const;
+        void Publish(std::shared_ptr<const AssetIndex> index);
+
+    private:
+        // A spin lock rather than std::atomic<std::shared_ptr>, which locks internally in both standard libraries
+        // as well, and whose libstdc++ 12 load releases that lock without ordering the pointer read before it.
+        mutable std::atomic_flag busy_;
+        std::shared_ptr<const AssetIndex> current_;
+    };
+
+    // Collects (path, source) pairs and freezes them into an AssetIndex.
+    // When a path comes from several sources the lowest source id wins, so register sources in priority order.
+    class AssetIndexBuilder
+    {
+    public:
+        AssetSourceId AddSource(const std::string& name);
+        // normalizedPath must already be lower-case with forward slashes (see NormalizeVirtualPath).
+        void Add(std::string_view normalizedPath, AssetSourceId source);
+        void Reserve(size_t entries, size_t pathBytes);
+        size_t PendingCount() const { return entries_.size(); }
+
+        // Consumes the pending entries; the builder is empty afterwards but keeps its sources.
+        AssetIndex Build();
+
+    private:
+        struct Entry
+        {
+            uint32_t offset;
+            uint32_t length;
+            AssetSourceId source;
+        };
+
+        std::string chars_;
+        std::vector<Entry> entries_;
+        std::vector<std::string> sources_;
+    };
+
+    // Open-addressed set of 64-bit hashes of normalized paths, for O(1) membership tests over every asset of a
+    // kind (e.g. all textures, not just the browsable book subset). Stores 8 bytes per slot and never the
+    // strings, so two distinct paths with equal hashes (odds 2^-64 per pair) read as present.
+    class AssetPathSet
+    {
+    public:
+        void Reserve(size_t count);
+        void Insert(std::string_view normalizedPath);
+        bool Contains(std::string_view normalizedPath) const;
+        void Clear();
+
+        size_t Size() const { return size_; }
+        size_t MemoryBytes() const { return slots_.capacity() * sizeof(uint64_t); }
+        // Order-independent digest of the contents: equal sets give equal values whatever the insertion order.
+        uint64_t Fingerprint() const;
+
+    private:
+        std::vector<uint64_t> slots_; // 0 marks an empty slot; power-of-two size, kept at most half full
+        size_t size_ = 0;
+
+        static uint64_t Hash(std::string_view normalizedPath);
+        void InsertHash(uint64_t hash);
+        void Rehash(size_t slotCount);
+    };
+}
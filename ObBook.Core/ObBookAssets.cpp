@@ -0,0 +1,1068 @@
+#include "ObBookAssets.h"
+#include "ObBookTrace.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace obbook
+{
+    static std::string ToLowerAscii(std::string s)
+    {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c)
+        {
+            if (c >= 'A' && c <= 'Z') return static_cast<char>(c - 'A' + 'a');
+            return static_cast<char>(c);
+        });
+        return s;
+    }
+
+    static bool StartsWithNoCase(const std::string& s, size_t at, const char* lit)
+    {
+        size_t i = 0;
+        for (; lit[i] != '\0'; ++i)
+        {
+            if (at + i >= s.size()) return false;
+            char a = s[at + i];
+            char b = lit[i];
+            if (a >= 'A' && a <= 'Z') a = static_cast<char>(a - 'A' + 'a');
+            if (b >= 'A' && b <= 'Z') b = static_cast<char>(b - 'A' + 'a');
+            if (a != b) return false;
+        }
+        return true;
+    }
+
+    std::string NormalizeVirtualPath(std::string path)
+    {
+        for (auto& c : path) if (c == '\\') c = '/';
+        path = ToLowerAscii(path);
+        while (!path.empty() && path.front() == '/') path.erase(path.begin());
+        return path;
+    }
+
+    bool IsBookTexturePath(const std::string& normalizedPath)
+    {
+        if (normalizedPath.rfind("textures/menus/book/", 0) != 0) return false;
+        const auto dot = normalizedPath.find_last_of('.');
+        if (dot == std::string::npos) return false;
+        const auto ext = normalizedPath.substr(dot);
+        return ext == ".dds" || ext == ".tga";
+    }
+
+    bool IsBookFontPath(const std::string& normalizedPath)
+    {
+        if (normalizedPath.rfind("fonts/", 0) == 0) return true;
+        return normalizedPath.rfind("textures/menus/book/fancy_font/", 0) == 0;
+    }
+
+    std::string ExtractFirstImgSrc(const std::string& src)
+    {
+        for (size_t i = 0; i + 4 < src.size(); ++i)
+        {
+            if (!StartsWithNoCase(src, i, "<img")) continue;
+            size_t j = i;
+            while (j < src.size() && src[j] != '>') ++j;
+            if (j >= src.size()) return {};
+
+            for (size_t k = i; k + 4 < j; ++k)
+            {
+                if (!StartsWithNoCase(src, k, "src=")) continue;
+                k += 4;
+                if (k >= j) return {};
+                if (src[k] == '"')
+                {
+                    ++k;
+                    size_t e = k;
+                    while (e < j && src[e] != '"') ++e;
+                    return src.substr(k, e - k);
+                }
+                size_t e = k;
+                while (e < j && src[e] != ' ' && src[e] != '\t') ++e;
+                return src.substr(k, e - k);
+            }
+            return {};
+        }
+        return {};
+    }
+
+    std::string ToTextureVirtualPath(const std::string& imgSrc)
+    {
+        std::string p;
+        ToTextureVirtualPath(imgSrc, p);
+        return p;
+    }
+
+    void ToTextureVirtualPath(std::string_view imgSrc, std::string& out)
+    {
+        // NormalizeVirtualPath applied while copying, then the game's prefix rules.
+        out.clear();
+        for (char c : imgSrc)
+        {
+            if (c == '\\') c = '/';
+            else if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+            if (c == '/' && out.empty()) continue;
+            out.push_back(c);
+        }
+        if (out.rfind("textures/", 0) == 0) return;
+        out.insert(0, out.rfind("book/", 0) == 0 ? "textures/menus/" : "textures/");
+    }
+
+    static std::string ReadBsaZString(std::ifstream& in)
+    {
+        std::string out;
+        for (;;)
+        {
+            char c = 0;
+            if (!in.get(c)) break;
+            if (c == '\0') break;
+            out.push_back(c);
+        }
+        return out;
+    }
+
+    struct BsaFolderRecord
+    {
+        uint64_t hash{};
+        uint32_t fileCount{};
+        uint32_t offset{};
+    };
+
+    struct BsaFileRecord
+    {
+        uint64_t hash{};
+        uint32_t size{};
+        uint32_t offset{};
+    };
+
+    struct BsaHeader
+    {
+        uint32_t version{};
+        uint32_t dirOffset{};
+        uint32_t archiveFlags{};
+        uint32_t folderCount{};
+        uint32_t fileCount{};
+        uint32_t totalFolderNameLength{};
+        uint32_t totalFileNameLength{};
+        uint32_t fileFlags{};
+    };
+
+    enum : uint32_t
+    {
+        kArchiveFlagIncludeDirectoryNames = 0x1,
+        kArchiveFlagIncludeFileNames = 0x2,
+    };
+
+    static bool ReadExact(std::ifstream& in, void* dst, size_t size)
+    {
+        in.read(reinterpret_cast<char*>(dst), static_cast<std::streamsize>(size));
+        return static_cast<size_t>(in.gcount()) == size;
+    }
+
+    bool ReadBsaPaths(const fs::path& bsaPath, std::vector<std::string>& outPaths)
+    {
+        std::ifstream in(bsaPath, std::ios::binary);
+        if (!in) return false;
+
+        std::array<char, 4> magic{};
+        if (!ReadExact(in, magic.data(), magic.size())) return false;
+        if (std::memcmp(magic.data(), "BSA\0", 4) != 0) return false;
+
+        BsaHeader header{};
+        if (!ReadExact(in, &header, sizeof(header))) return false;
+        if (header.version != 103 && header.version != 104) return false;
+        if (header.folderCount == 0 || header.fileCount == 0) return true;
+        if (header.folderCount > 100000 || header.fileCount > 2000000) return false;
+
+        std::vector<BsaFolderRecord> folders(header.folderCount);
+        in.seekg(static_cast<std::streamoff>(header.dirOffset), std::ios::beg);
+        for (auto& f : folders)
+        {
+            if (!ReadExact(in, &f, sizeof(f))) return false;
+            if (f.fileCount > header.fileCount) return false;
+        }
+
+        std::vector<std::string> folderPrefixes;
+        folderPrefixes.reserve(header.fileCount);
+        uint64_t countedFiles = 0;
+
+        if ((header.archiveFlags & kArchiveFlagIncludeDirectoryNames) == 0)
+            return false;
+
+        for (const auto& folder : folders)
+        {
+            uint8_t folderNameLen = 0;
+            if (!ReadExact(in, &folderNameLen, sizeof(folderNameLen))) return false;
+
+            std::string folderName;
+            if (folderNameLen > 0)
+            {
+                folderName.resize(static_cast<size_t>(folderNameLen));
+                if (!ReadExact(in, folderName.data(), folderName.size())) return false;
+
+                if (!folderName.empty() && folderName.back() == '\0')
+                    folderName.pop_back();
+            }
+
+            const auto safeFolder = NormalizeVirtualPath(folderName);
+            for (uint32_t i = 0; i < folder.fileCount; ++i)
+            {
+                BsaFileRecord fr{};
+                if (!ReadExact(in, &fr, sizeof(fr))) return false;
+                folderPrefixes.push_back(safeFolder);
+            }
+
+            countedFiles += folder.fileCount;
+            if (countedFiles > header.fileCount) return false;
+        }
+
+        if (countedFiles != header.fileCount) return false;
+
+        if ((header.archiveFlags & kArchiveFlagIncludeFileNames) == 0)
+            return false;
+
+        // The file-name block directly follows the last folder's file records. totalFolderNameLength
+        // excludes the per-folder length bytes, so the stream position is used rather than a computed offset.
+        outPaths.reserve(outPaths.size() + folderPrefixes.size());
+        for (const auto& prefix : folderPrefixes)
+        {
+            std::string fileName = ReadBsaZString(in);
+            if (!in) return false;
+
+            auto fileNorm = NormalizeVirtualPath(fileName);
+            if (prefix.empty())
+                outPaths.push_back(std::move(fileNorm));
+            else
+                outPaths.push_back(prefix + "/" + fileNorm);
+        }
+
+        return true;
+    }
+
+    bool ReadBsaEntries(const fs::path& bsaPath, std::vector<BsaFileEntry>& entries)
+    {
+        std::ifstream in(bsaPath, std::ios::binary);
+        if (!in) return false;
+
+        std::array<char,4> magic{};
+        if (!ReadExact(in, magic.data(), magic.size()) || std::memcmp(magic.data(), "BSA\0", 4) != 0) return false;
+
+        BsaHeader h{};
+        if (!ReadExact(in, &h, sizeof(h))) return false;
+        if (h.version != 103 && h.version != 104) return false;
+        if ((h.archiveFlags & kArchiveFlagIncludeDirectoryNames) == 0 || (h.archiveFlags & kArchiveFlagIncludeFileNames) == 0) return false;
+
+        in.seekg(static_cast<std::streamoff>(h.dirOffset), std::ios::beg);
+        std::vector<BsaFolderRecord> folders(h.folderCount);
+        for (auto& f : folders) if (!ReadExact(in, &f, sizeof(f))) return false;
+
+        std::vector<BsaFileEntry> raw;
+        raw.reserve(h.fileCount);
+        for (const auto& f : folders)
+        {
+            uint8_t folderNameLen = 0;
+            if (!ReadExact(in, &folderNameLen, sizeof(folderNameLen))) return false;
+
+            std::string folderName;
+            if (folderNameLen > 0)
+            {
+                folderName.resize(folderNameLen);
+                if (!ReadExact(in, folderName.data(), folderName.size())) return false;
+                if (!folderName.empty() && folderName.back() == '\0') folderName.pop_back();
+            }
+            folderName = NormalizeVirtualPath(folderName);
+
+            for (uint32_t i = 0; i < f.fileCount; ++i)
+            {
+                BsaFileRecord r{};
+                if (!ReadExact(in, &r, sizeof(r))) return false;
+                raw.push_back({folderName, r.size, r.offset});
+            }
+        }
+
+        entries.clear();
+        entries.reserve(raw.size());
+        for (auto& r : raw)
+        {
+            std::string fileName;
+            for (;;)
+            {
+                char c=0; if (!in.get(c)) return false; if (c=='\0') break; fileName.push_back(c);
+            }
+            auto fn = NormalizeVirtualPath(fileName);
+            BsaFileEntry e{};
+            e.path = r.path.empty() ? fn : (r.path + "/" + fn);
+            e.packedSize = r.packedSize;
+            e.offset = r.offset;
+            entries.push_back(std::move(e));
+        }
+        return true;
+    }
+
+    static uint32_t HashBsaString(std::string_view s)
+    {
+        uint32_t h = 0;
+        for (const char c : s) h = h * 0x1003Fu + static_cast<uint8_t>(c);
+        return h;
+    }
+
+    static char ToBsaHashChar(char c)
+    {
+        if (c >= 'A' && c <= 'Z') return static_cast<char>(c - 'A' + 'a');
+        return c == '/' ? '\\' : c;
+    }
+
+    // stem and ext (which keeps its leading '.') are already lower-case with backslashes.
+    static uint64_t HashBsaName(std::string_view stem, std::string_view ext)
+    {
+        const size_t len = stem.size();
+        if (len == 0) return 0;
+
+        uint32_t low = static_cast<uint8_t>(stem[len - 1])
+            + (len > 2 ? static_cast<uint32_t>(static_cast<uint8_t>(stem[len - 2])) << 8 : 0u)
+            + (static_cast<uint32_t>(len) << 16)
+            + (static_cast<uint32_t>(static_cast<uint8_t>(stem[0])) << 24);
+        uint32_t high = len > 3 ? HashBsaString(stem.substr(1, len - 3)) : 0u;
+
+        if (!ext.empty())
+        {
+            if (ext == ".kf") low |= 0x80u;
+            else if (ext == ".nif") low |= 0x8000u;
+            else if (ext == ".dds") low |= 0x8080u;
+            else if (ext == ".wav") low |= 0x80000000u;
+            high += HashBsaString(ext);
+        }
+        return (static_cast<uint64_t>(high) << 32) + low;
+    }
+
+    uint64_t HashBsaFolder(std::string_view folderPath)
+    {
+        char buf[256];
+        if (folderPath.size() >= sizeof(buf)) return 0; // folder names are length-prefixed by one byte
+        for (size_t i = 0; i < folderPath.size(); ++i) buf[i] = ToBsaHashChar(folderPath[i]);
+        return HashBsaName(std::string_view(buf, folderPath.size()), {});
+    }
+
+    uint64_t HashBsaFileName(std::string_view fileName)
+    {
+        char buf[256];
+        if (fileName.size() >= sizeof(buf)) return 0;
+        for (size_t i = 0; i < fileName.size(); ++i) buf[i] = ToBsaHashChar(fileName[i]);
+        const std::string_view name(buf, fileName.size());
+        const size_t dot = name.rfind('.');
+        if (dot == std::string_view::npos) return HashBsaName(name, {});
+        return HashBsaName(name.substr(0, dot), name.substr(dot));
+    }
+
+    // First index in [0, count) whose record hash is not below hash; records are read one at a time.
+    template <typename Record>
+    static bool LowerBoundRecord(std::ifstream& in, std::streamoff base, uint32_t count, uint64_t hash, uint32_t& index, Record& record)
+    {
+        uint32_t lo = 0;
+        uint32_t hi = count;
+        while (lo < hi)
+        {
+            const uint32_t mid = lo + (hi - lo) / 2;
+            in.seekg(base + static_cast<std::streamoff>(mid) * static_cast<std::streamoff>(sizeof(Record)), std::ios::beg);
+            Record r{};
+            if (!ReadExact(in, &r, sizeof(r))) return false;
+            if (r.hash < hash) lo = mid + 1;
+            else hi = mid;
+        }
+        index = lo;
+        if (lo == count) return true;
+        in.seekg(base + static_cast<std::streamoff>(lo) * static_cast<std::streamoff>(sizeof(Record)), std::ios::beg);
+        return ReadExact(in, &record, sizeof(record));
+    }
+
+    // The game binary-searches both record tables, so archives it can load keep them sorted by hash.
+    static bool FindBsaRecord(std::ifstream& in, const std::string& virtualPath, BsaFileRecord& out)
+    {
+        std::array<char, 4> magic{};
+        if (!ReadExact(in, magic.data(), magic.size()) || std::memcmp(magic.data(), "BSA\0", 4) != 0) return false;
+
+        BsaHeader h{};
+        if (!ReadExact(in, &h, sizeof(h))) return false;
+        if (h.version != 103 && h.version != 104) return false;
+        if (h.folderCount == 0 || h.fileCount == 0) return false;
+
+        const size_t slash = virtualPath.rfind('/');
+        const std::string_view path(virtualPath);
+        const std::string_view folder = slash == std::string::npos ? std::string_view() : path.substr(0, slash);
+        const std::string_view file = slash == std::string::npos ? path : path.substr(slash + 1);
+        const uint64_t folderHash = HashBsaFolder(folder);
+        const uint64_t fileHash = HashBsaFileName(file);
+        const bool hasFolderNames = (h.archiveFlags & kArchiveFlagIncludeDirectoryNames) != 0;
+
+        uint32_t index = 0;
+        BsaFolderRecord f{};
+        if (!LowerBoundRecord(in, static_cast<std::streamoff>(h.dirOffset), h.folderCount, folderHash, index, f)) return false;
+
+        // Distinct folders can share a hash; the folder name settles it when the archive carries names.
+        for (; index < h.folderCount && f.hash == folderHash; ++index)
+        {
+            if (f.offset < h.totalFileNameLength || f.fileCount > h.fileCount) return false;
+            std::streamoff records = static_cast<std::streamoff>(f.offset - h.totalFileNameLength);
+            in.seekg(records, std::ios::beg);
+
+            bool folderMatches = true;
+            if (hasFolderNames)
+            {
+                uint8_t nameLen = 0;
+                if (!ReadExact(in, &nameLen, sizeof(nameLen))) return false;
+                char name[256];
+                if (!ReadExact(in, name, nameLen)) return false;
+                const size_t len = nameLen > 0 && name[nameLen - 1] == '\0' ? nameLen - 1u : nameLen;
+                folderMatches = len == folder.size();
+                for (size_t i = 0; folderMatches && i < len; ++i)
+                    folderMatches = ToBsaHashChar(name[i]) == ToBsaHashChar(folder[i]);
+                records += 1 + static_cast<std::streamoff>(nameLen);
+            }
+
+            if (folderMatches)
+            {
+                uint32_t fileIndex = 0;
+                if (!LowerBoundRecord(in, records, f.fileCount, fileHash, fileIndex, out)) return false;
+                return fileIndex < f.fileCount && out.hash == fileHash;
+            }
+
+            if (index + 1 < h.folderCount)
+            {
+                in.seekg(static_cast<std::streamoff>(h.dirOffset) + static_cast<std::streamoff>(index + 1) * static_cast<std::streamoff>(sizeof(f)), std::ios::beg);
+                if (!ReadExact(in, &f, sizeof(f))) return false;
+            }
+        }
+        return false;
+    }
+
+    bool FindBsaFile(const fs::path& bsaPath, const std::string& virtualPath, BsaFileEntry& entry)
+    {
+        std::ifstream in(bsaPath, std::ios::binary);
+        if (!in) return false;
+
+        BsaFileRecord r{};
+        if (!FindBsaRecord(in, virtualPath, r)) return false;
+        entry.path = virtualPath;
+        entry.packedSize = r.size;
+        entry.offset = r.offset;
+        return true;
+    }
+
+    // Same archive order as asset discovery, so reads get the copy the asset index reports.
+    static std::vector<fs::path> ListArchives(const fs::path& dataDir)
+    {
+        std::vector<fs::path> archives;
+        std::error_code ec;
+        for (fs::directory_iterator it(dataDir, ec), end; !ec && it != end; it.increment(ec))
+        {
+            if (!it->is_regular_file(ec)) continue;
+            if (ToLowerAscii(it->path().extension().string()) == ".bsa") archives.push_back(it->path());
+        }
+        std::sort(archives.begin(), archives.end());
+        return archives;
+    }
+
+    static constexpr uint32_t kBsaSizeMask = 0x3FFFFFFFu;
+    static constexpr uint32_t kBsaCompressedBit = 0x40000000u;
+
+    // Opens the winning copy of a virtual path (loose first, then archives in file-name order) and leaves the
+    // stream at its first byte. False for missing and compressed entries.
+    static bool OpenAsset(const fs::path& dataDir, const std::string& virtualPath, std::ifstream& in, size_t& size)
+    {
+        auto loose = dataDir / fs::path(virtualPath);
+        std::error_code ec;
+        if (fs::is_regular_file(loose, ec))
+        {
+            in.open(loose, std::ios::binary);
+            if (!in) return false;
+            in.seekg(0, std::ios::end);
+            size = static_cast<size_t>(in.tellg());
+            in.seekg(0, std::ios::beg);
+            return static_cast<bool>(in);
+        }
+
+        for (const auto& archive : ListArchives(dataDir))
+        {
+            in.close();
+            in.clear();
+            in.open(archive, std::ios::binary);
+            if (!in) continue;
+            BsaFileRecord r{};
+            if (!FindBsaRecord(in, virtualPath, r)) continue;
+
+            if ((r.size & kBsaCompressedBit) != 0u) return false;
+            size = r.size & kBsaSizeMask;
+
+            in.clear();
+            in.seekg(static_cast<std::streamoff>(r.offset), std::ios::beg);
+            return static_cast<bool>(in);
+        }
+        return false;
+    }
+
+    bool ReadAssetBytes(const std::string& dataDirUtf8, const std::string& virtualPath, std::vector<uint8_t>& bytes)
+    {
+        OBBOOK_TRACE_SCOPE_DETAIL("ReadAssetBytes", virtualPath.c_str());
+        std::ifstream in;
+        size_t size = 0;
+        if (!OpenAsset(fs::path(dataDirUtf8), virtualPath, in, size) || size == 0) return false;
+        bytes.resize(size);
+        in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(size));
+        return in.good() || in.eof();
+    }
+
+    static bool DescribeContainer(const fs::path& path, AssetLocation& location)
+    {
+        std::error_code ec;
+        location.containerSize = fs::file_size(path, ec);
+        if (ec) return false;
+        location.containerWriteTime = static_cast<int64_t>(fs::last_write_time(path, ec).time_since_epoch().count());
+        if (ec) return false;
+        location.containerUtf8 = path.string();
+        return true;
+    }
+
+    void LocateAssets(const std::string& dataDirUtf8, const std::vector<std::string>& virtualPaths, std::vector<AssetLocation>& locations)
+    {
+        OBBOOK_TRACE_SCOPE("LocateAssets");
+        const fs::path dataDir(dataDirUtf8);
+        locations.assign(virtualPaths.size(), AssetLocation{});
+
+        std::vector<size_t> pending; // not loose; looked up in the archives
+        for (size_t i = 0; i < virtualPaths.size(); ++i)
+        {
+            const auto loose = dataDir / fs::path(virtualPaths[i]);
+            std::error_code ec;
+            AssetLocation& l = locations[i];
+            if (fs::is_regular_file(loose, ec) && DescribeContainer(loose, l)) l.size = l.containerSize;
+            else pending.push_back(i);
+        }
+        if (pending.empty()) return;
+
+        for (const auto& archive : ListArchives(dataDir))
+        {
+            std::ifstream in(archive, std::ios::binary);
+            if (!in) continue;
+            AssetLocation container{};
+            if (!DescribeContainer(archive, container)) continue;
+
+            size_t kept = 0;
+            for (const size_t i : pending)
+            {
+                in.clear();
+                in.seekg(0, std::ios::beg);
+                BsaFileRecord r{};
+                if (!FindBsaRecord(in, virtualPaths[i], r))
+                {
+                    pending[kept++] = i;
+                    continue;
+                }
+                // The first archive with the path wins even when its copy is compressed.
+                if ((r.size & kBsaCompressedBit) != 0u) continue;
+                AssetLocation& l = locations[i];
+                l = container;
+                l.inArchive = true;
+                l.offset = r.offset;
+                l.size = r.size & kBsaSizeMask;
+            }
+            pending.resize(kept);
+            if (pending.empty()) return;
+        }
+    }
+
+    bool ReadAssetBytes(const AssetLocation& location, std::vector<uint8_t>& bytes)
+    {
+        OBBOOK_TRACE_SCOPE_DETAIL("ReadAssetBytes", location.containerUtf8.c_str());
+        if (!location.IsFound() || location.size == 0) return false;
+        std::ifstream in(fs::path(location.containerUtf8), std::ios::binary);
+        if (!in) return false;
+        in.seekg(static_cast<std::streamoff>(location.offset), std::ios::beg);
+        bytes.resize(static_cast<size_t>(location.size));
+        return ReadExact(in, bytes.data(), bytes.size());
+    }
+
+    bool ReadTextureSize(const std::string& dataDirUtf8, const std::string& virtualPath, uint32_t& w, uint32_t& h)
+    {
+        OBBOOK_TRACE_SCOPE_DETAIL("ReadTextureSize", virtualPath.c_str());
+        std::ifstream in;
+        size_t size = 0;
+        if (!OpenAsset(fs::path(dataDirUtf8), virtualPath, in, size)) return false;
+
+        uint8_t hdr[20]{};
+        const size_t want = std::min(size, sizeof(hdr));
+        if (!ReadExact(in, hdr, want)) return false;
+        auto rd16 = [&](size_t o) { return static_cast<uint32_t>(hdr[o] | (hdr[o + 1] << 8)); };
+        auto rd32 = [&](size_t o) { return rd16(o) | (rd16(o + 2) << 16); };
+
+        if (want >= 20 && std::memcmp(hdr, "DDS ", 4) == 0)
+        {
+            h = rd32(12);
+            w = rd32(16);
+            return w != 0 && h != 0;
+        }
+        const auto dot = virtualPath.find_last_of('.');
+        if (want >= 18 && dot != std::string::npos && virtualPath.compare(dot, std::string::npos, ".tga") == 0)
+        {
+            w = rd16(12);
+            h = rd16(14);
+            return w != 0 && h != 0;
+        }
+        return false;
+    }
+
+    static void Decode565(uint16_t c, uint8_t& r, uint8_t& g, uint8_t& b)
+    {
+        r = static_cast<uint8_t>(((c >> 11) & 31) * 255 / 31);
+        g = static_cast<uint8_t>(((c >> 5) & 63) * 255 / 63);
+        b = static_cast<uint8_t>((c & 31) * 255 / 31);
+    }
+
+    // DDS decoding: one kernel per pixel format, chosen once per file from kDdsFormats. The level size is checked
+    // against the payload before a kernel runs, so the kernels read and write through raw pointers without
+    // per-pixel checks; block kernels decode whole 4x4 blocks and only the blocks on the right and bottom edge
+    // go through a scratch block to be clipped.
+
+    // BGRA palette of a DXT color block. DXT1 switches to three colors plus transparent black when c0 <= c1;
+    // the color half of DXT3/DXT5 always interpolates four.
+    template <bool PunchThrough>
+    static void DecodeColorPalette(const uint8_t* src, uint8_t (&palette)[4][4])
+    {
+        const uint16_t c0 = static_cast<uint16_t>(src[0] | (src[1] << 8));
+        const uint16_t c1 = static_cast<uint16_t>(src[2] | (src[3] << 8));
+        uint8_t r[4], g[4], b[4], a[4]{ 255, 255, 255, 255 };
+        Decode565(c0, r[0], g[0], b[0]);
+        Decode565(c1, r[1], g[1], b[1]);
+        if (!PunchThrough || c0 > c1)
+        {
+            r[2] = static_cast<uint8_t>((2 * r[0] + r[1]) / 3); g[2] = static_cast<uint8_t>((2 * g[0] + g[1]) / 3); b[2] = static_cast<uint8_t>((2 * b[0] + b[1]) / 3);
+            r[3] = static_cast<uint8_t>((r[0] + 2 * r[1]) / 3); g[3] = static_cast<uint8_t>((g[0] + 2 * g[1]) / 3); b[3] = static_cast<uint8_t>((b[0] + 2 * b[1]) / 3);
+        }
+        else
+        {
+            r[2] = static_cast<uint8_t>((r[0] + r[1]) / 2); g[2] = static_cast<uint8_t>((g[0] + g[1]) / 2); b[2] = static_cast<uint8_t>((b[0] + b[1]) / 2);
+            r[3] = g[3] = b[3] = 0; a[3] = 0;
+        }
+        for (int i = 0; i < 4; ++i)
+        {
+            palette[i][0] = b[i]; palette[i][1] = g[i]; palette[i][2] = r[i]; palette[i][3] = a[i];
+        }
+    }
+
+    static uint32_t Read32(const uint8_t* p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    // Block kernels: Decode writes one 4x4 block of BGRA rows stride bytes apart.
+    struct Dxt1Block
+    {
+        static constexpr uint32_t kBytes = 8;
+        static void Decode(const uint8_t* src, uint8_t* dst, size_t stride)
+        {
+            uint8_t palette[4][4];
+            DecodeColorPalette<true>(src, palette);
+            const uint32_t idx = Read32(src + 4);
+            for (uint32_t py = 0; py < 4; ++py, dst += stride)
+                for (uint32_t px = 0; px < 4; ++px)
+                    std::memcpy(dst + px * 4, palette[(idx >> (2 * (py * 4 + px))) & 3], 4);
+        }
+    };
+
+    // Explicit alpha: 4 bits per pixel in row order, low nibble first.
+    struct Dxt3Block
+    {
+        static constexpr uint32_t kBytes = 16;
+        static void Decode(const uint8_t* src, uint8_t* dst, size_t stride)
+        {
+            uint8_t palette[4][4];
+            DecodeColorPalette<false>(src + 8, palette);
+            const uint32_t idx = Read32(src + 12);
+            for (uint32_t py = 0; py < 4; ++py, dst += stride)
+            {
+                const uint32_t alphaRow = src[py * 2] | (src[py * 2 + 1] << 8);
+                for (uint32_t px = 0; px < 4; ++px)
+                {
+                    uint8_t* p = dst + px * 4;
+                    std::memcpy(p, palette[(idx >> (2 * (py * 4 + px))) & 3], 4);
+                    p[3] = static_cast<uint8_t>(((alphaRow >> (4 * px)) & 15) * 17);
+                }
+            }
+        }
+    };
+
+    struct Dxt5Block
+    {
+        static constexpr uint32_t kBytes = 16;
+        static void Decode(const uint8_t* src, uint8_t* dst, size_t stride)
+        {
+            const uint8_t a0 = src[0], a1 = src[1];
+            uint64_t abits = 0;
+            for (int i = 0; i < 6; ++i) abits |= static_cast<uint64_t>(src[2 + i]) << (8 * i);
+            uint8_t aval[8];
+            aval[0] = a0; aval[1] = a1;
+            if (a0 > a1) { for (int i = 1; i <= 6; ++i) aval[i + 1] = static_cast<uint8_t>(((7 - i) * a0 + i * a1) / 7); }
+            else { for (int i = 1; i <= 4; ++i) aval[i + 1] = static_cast<uint8_t>(((5 - i) * a0 + i * a1) / 5); aval[6] = 0; aval[7] = 255; }
+            uint8_t palette[4][4];
+            DecodeColorPalette<false>(src + 8, palette);
+            const uint32_t idx = Read32(src + 12);
+            for (uint32_t py = 0; py < 4; ++py, dst += stride)
+                for (uint32_t px = 0; px < 4; ++px)
+                {
+                    uint8_t* p = dst + px * 4;
+                    std::memcpy(p, palette[(idx >> (2 * (py * 4 + px))) & 3], 4);
+                    p[3] = aval[static_cast<uint32_t>(abits >> (3 * (py * 4 + px))) & 7];
+                }
+        }
+    };
+
+    template <typename Block>
+    static void DecodeBlocks(const uint8_t* src, uint32_t w, uint32_t h, uint8_t* out)
+    {
+        const uint64_t bw = (uint64_t{ w } + 3) / 4, bh = (uint64_t{ h } + 3) / 4;
+        const size_t stride = static_cast<size_t>(w) * 4;
+        uint8_t edge[4 * 16];
+        for (uint64_t by = 0; by < bh; ++by)
+        {
+            const uint32_t rows = static_cast<uint32_t>(std::min<uint64_t>(4, h - by * 4));
+            uint8_t* row = out + static_cast<size_t>(by) * 4 * stride;
+            for (uint64_t bx = 0; bx < bw; ++bx, src += Block::kBytes)
+            {
+                const uint32_t cols = static_cast<uint32_t>(std::min<uint64_t>(4, w - bx * 4));
+                uint8_t* dst = row + static_cast<size_t>(bx) * 16;
+                if (rows == 4 && cols == 4)
+                {
+                    Block::Decode(src, dst, stride);
+                    continue;
+                }
+                Block::Decode(src, edge, 16);
+                for (uint32_t py = 0; py < rows; ++py) std::memcpy(dst + py * stride, edge + py * 16, cols * 4);
+            }
+        }
+    }
+
+    // Uncompressed layouts, described by their DDS bit masks. A channel with no mask reads as 0, or 255 for
+    // alpha; narrower channels are widened as x * 255 / max, like DXT endpoints. Luminance formats put their
+    // mask in R and copy it to G and B.
+    template <uint32_t Bytes, uint32_t RMask, uint32_t GMask, uint32_t BMask, uint32_t AMask, bool Luminance = false>
+    struct MaskedPixels
+    {
+        static constexpr uint32_t kBytes = Bytes;
+        static constexpr uint32_t kMasks[4] = { RMask, GMask, BMask, AMask };
+
+        template <uint32_t Mask>
+        static uint8_t Channel(uint32_t v, uint8_t none)
+        {
+            if constexpr (Mask == 0)
+            {
+                return none;
+            }
+            else
+            {
+                constexpr int shift = std::countr_zero(Mask);
+                constexpr uint32_t max = Mask >> shift;
+                if constexpr (max == 255) return static_cast<uint8_t>(v >> shift);
+                else return static_cast<uint8_t>(((v & Mask) >> shift) * 255 / max);
+            }
+        }
+
+        static void Decode(const uint8_t* src, uint32_t w, uint32_t h, uint8_t* out)
+        {
+            const size_t n = static_cast<size_t>(w) * h;
+            for (size_t i = 0; i < n; ++i, src += Bytes, out += 4)
+            {
+                uint32_t v = src[0];
+                if constexpr (Bytes >= 2) v |= src[1] << 8;
+                if constexpr (Bytes >= 3) v |= src[2] << 16;
+                if constexpr (Bytes >= 4) v |= static_cast<uint32_t>(src[3]) << 24;
+                const uint8_t r = Channel<RMask>(v, 0);
+                out[0] = Luminance ? r : Channel<BMask>(v, 0);
+                out[1] = Luminance ? r : Channel<GMask>(v, 0);
+                out[2] = r;
+                out[3] = Channel<AMask>(v, 255);
+            }
+        }
+    };
+
+    // A8R8G8B8 is already BGRA in memory.
+    template <>
+    void MaskedPixels<4, 0x00FF0000u, 0x0000FF00u, 0x000000FFu, 0xFF000000u>::Decode(const uint8_t* src, uint32_t w, uint32_t h, uint8_t* out)
+    {
+        std::memcpy(out, src, static_cast<size_t>(w) * h * 4);
+    }
+
+    namespace
+    {
+        constexpr uint32_t kDdpfAlphaPixels = 0x1, kDdpfFourCC = 0x4, kDdpfRgb = 0x40, kDdpfLuminance = 0x20000;
+        // Larger than any texture the game loads; keeps a hostile header from sizing a multi-gigabyte buffer.
+        constexpr uint32_t kMaxDdsEdge = 16384;
+
+        constexpr uint32_t FourCC(const char (&s)[5])
+        {
+            return static_cast<uint32_t>(s[0]) | (static_cast<uint32_t>(s[1]) << 8) | (static_cast<uint32_t>(s[2]) << 16) | (static_cast<uint32_t>(s[3]) << 24);
+        }
+
+        struct DdsFormat
+        {
+            uint32_t fourCC;   // block formats; 0 for mask formats
+            uint32_t pfFlag;   // kDdpfRgb or kDdpfLuminance for mask formats
+            uint32_t rgbBits;
+            uint32_t masks[4]; // r, g, b, a; a only counts when the file sets DDPF_ALPHAPIXELS
+            uint32_t edge;     // 4 for block formats, 1 for pixels
+            uint32_t unitBytes;
+            void (*decode)(const uint8_t* src, uint32_t w, uint32_t h, uint8_t* out);
+
+            uint64_t LevelBytes(uint32_t w, uint32_t h) const
+            {
+                return (uint64_t{ w } + edge - 1) / edge * ((uint64_t{ h } + edge - 1) / edge) * unitBytes;
+            }
+        };
+
+        template <typename Block>
+        constexpr DdsFormat BlockFormat(const char (&fourCC)[5])
+        {
+            return DdsFormat{ FourCC(fourCC), 0, 0, {}, 4, Block::kBytes, &DecodeBlocks<Block> };
+        }
+
+        template <typename Pixels>
+        constexpr DdsFormat PixelFormat(uint32_t pfFlag)
+        {
+            return DdsFormat{ 0, pfFlag, Pixels::kBytes * 8, { Pixels::kMasks[0], Pixels::kMasks[1], Pixels::kMasks[2], Pixels::kMasks[3] },
+                1, Pixels::kBytes, &Pixels::Decode };
+        }
+
+        const DdsFormat kDdsFormats[] =
+        {
+            BlockFormat<Dxt1Block>("DXT1"),
+            BlockFormat<Dxt3Block>("DXT3"),
+            BlockFormat<Dxt5Block>("DXT5"),
+            PixelFormat<MaskedPixels<4, 0x00FF0000u, 0x0000FF00u, 0x000000FFu, 0xFF000000u>>(kDdpfRgb), // A8R8G8B8
+            PixelFormat<MaskedPixels<4, 0x00FF0000u, 0x0000FF00u, 0x000000FFu, 0>>(kDdpfRgb),           // X8R8G8B8
+            PixelFormat<MaskedPixels<4, 0x000000FFu, 0x0000FF00u, 0x00FF0000u, 0xFF000000u>>(kDdpfRgb), // A8B8G8R8
+            PixelFormat<MaskedPixels<4, 0x000000FFu, 0x0000FF00u, 0x00FF0000u, 0>>(kDdpfRgb),           // X8B8G8R8
+            PixelFormat<MaskedPixels<3, 0x00FF0000u, 0x0000FF00u, 0x000000FFu, 0>>(kDdpfRgb),           // R8G8B8
+            PixelFormat<MaskedPixels<2, 0xF800u, 0x07E0u, 0x001Fu, 0>>(kDdpfRgb),                       // R5G6B5
+            PixelFormat<MaskedPixels<2, 0x7C00u, 0x03E0u, 0x001Fu, 0x8000u>>(kDdpfRgb),                 // A1R5G5B5
+            PixelFormat<MaskedPixels<2, 0x7C00u, 0x03E0u, 0x001Fu, 0>>(kDdpfRgb),                       // X1R5G5B5
+            PixelFormat<MaskedPixels<2, 0x0F00u, 0x00F0u, 0x000Fu, 0xF000u>>(kDdpfRgb),                 // A4R4G4B4
+            PixelFormat<MaskedPixels<1, 0xFFu, 0, 0, 0, true>>(kDdpfLuminance),                         // L8
+            PixelFormat<MaskedPixels<2, 0x00FFu, 0, 0, 0xFF00u, true>>(kDdpfLuminance),                 // A8L8
+        };
+
+        const DdsFormat* FindDdsFormat(uint32_t pfFlags, uint32_t fourCC, uint32_t rgbBits, const uint32_t (&masks)[4])
+        {
+            for (const DdsFormat& f : kDdsFormats)
+            {
+                if (f.fourCC != 0)
+                {
+                    if ((pfFlags & kDdpfFourCC) && fourCC == f.fourCC) return &f;
+                    continue;
+                }
+                if ((pfFlags & kDdpfFourCC) || !(pfFlags & f.pfFlag) || rgbBits != f.rgbBits) continue;
+                const uint32_t a = (pfFlags & kDdpfAlphaPixels) ? masks[3] : 0;
+                if (masks[0] == f.masks[0] && masks[1] == f.masks[1] && masks[2] == f.masks[2] && a == f.masks[3]) return &f;
+            }
+            return nullptr;
+        }
+    }
+
+    bool DecodeDdsToBgra(AssetView dds, std::vector<uint8_t>& out, uint32_t& w, uint32_t& h)
+    {
+        return DecodeDdsToBgra(dds, 0, out, w, h);
+    }
+
+    // maxEdge 0 decodes the top mip.
+    bool DecodeDdsToBgra(AssetView dds, uint32_t maxEdge, std::vector<uint8_t>& out, uint32_t& w, uint32_t& h)
+    {
+        OBBOOK_TRACE_SCOPE("DecodeDdsToBgra");
+        if (dds.size < 128 || std::memcmp(dds.data, "DDS ", 4) != 0) return false;
+        const uint8_t* hdr = dds.data + 4;
+        auto rd32 = [&](size_t o)->uint32_t { uint32_t v; std::memcpy(&v, hdr + o, sizeof(v)); return v; };
+        if (rd32(0) != 124) return false;
+        h = rd32(8); w = rd32(12);
+        if (w == 0 || h == 0 || w > kMaxDdsEdge || h > kMaxDdsEdge) return false;
+        const uint32_t flags = rd32(4);
+        const uint32_t masks[4] = { rd32(88), rd32(92), rd32(96), rd32(100) };
+        const DdsFormat* format = FindDdsFormat(rd32(76), rd32(80), rd32(84), masks);
+        if (!format) return false;
+        const uint8_t* data = dds.data + 128;
+        size_t size = dds.size - 128;
+
+        // Skip whole levels until one fits; DDSD_MIPMAPCOUNT says how many follow the top one.
+        const uint32_t levels = (flags & 0x20000u) && rd32(24) > 1 ? rd32(24) : 1;
+        for (uint32_t level = 1; maxEdge != 0 && level < levels && (w > maxEdge || h > maxEdge); ++level)
+        {
+            const uint64_t skip = format->LevelBytes(w, h);
+            if (skip > size) return false;
+            data += static_cast<size_t>(skip);
+            size -= static_cast<size_t>(skip);
+            w = std::max(1u, w >> 1);
+            h = std::max(1u, h >> 1);
+        }
+
+        if (size < format->LevelBytes(w, h)) return false;
+        out.resize(static_cast<size_t>(w) * h * 4);
+        format->decode(data, w, h, out.data());
+        return true;
+    }
+
+    // TGA decoding: true-color (24/32-bit) and grayscale (8-bit, or 16-bit with alpha), raw or RLE, written
+    // straight into the BGRA rows they belong to. Bottom-up files fill the destination from its last row, so no
+    // flip pass is needed. Raw input is size-checked once for the whole image and RLE input once per packet.
+    template <uint32_t Bytes>
+    static void TgaPixel(const uint8_t* s, uint8_t* d)
+    {
+        if constexpr (Bytes == 1) { d[0] = d[1] = d[2] = s[0]; d[3] = 255; }
+        else if constexpr (Bytes == 2) { d[0] = d[1] = d[2] = s[0]; d[3] = s[1]; }
+        else if constexpr (Bytes == 3) { d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = 255; }
+        else std::memcpy(d, s, 4);
+    }
+
+    template <uint32_t Bytes>
+    static void TgaCopy(const uint8_t* s, uint8_t* d, size_t n)
+    {
+        if constexpr (Bytes == 4)
+        {
+            std::memcpy(d, s, n * 4);
+        }
+        else
+        {
+            for (size_t i = 0; i < n; ++i, s += Bytes, d += 4) TgaPixel<Bytes>(s, d);
+        }
+    }
+
+    // A run converts its pixel once, then doubles the filled span with memcpy.
+    static void TgaFill(const uint8_t (&pixel)[4], uint8_t* d, size_t n)
+    {
+        std::memcpy(d, pixel, 4);
+        for (size_t done = 1; done < n;)
+        {
+            const size_t take = std::min(done, n - done);
+            std::memcpy(d + done * 4, d, take * 4);
+            done += take;
+        }
+    }
+
+    template <uint32_t Bytes>
+    static bool DecodeTgaPixels(const uint8_t* src, const uint8_t* end, bool rle, bool topDown, uint32_t w, uint32_t h, uint8_t* out)
+    {
+        const size_t stride = static_cast<size_t>(w) * 4;
+        auto rowOf = [&](uint32_t fileRow) { return out + static_cast<size_t>(topDown ? fileRow : h - 1 - fileRow) * stride; };
+        if (!rle)
+        {
+            if (static_cast<size_t>(end - src) / Bytes / w < h) return false;
+            for (uint32_t y = 0; y < h; ++y, src += static_cast<size_t>(w) * Bytes) TgaCopy<Bytes>(src, rowOf(y), w);
+            return true;
+        }
+
+        // Packets may cross row ends; each one is split at them.
+        uint32_t y = 0, x = 0;
+        uint8_t* row = rowOf(0);
+        while (y < h)
+        {
+            if (src == end) return false;
+            const uint8_t header = *src++;
+            uint32_t count = (header & 0x7Fu) + 1;
+            const bool run = (header & 0x80u) != 0;
+            uint8_t pixel[4];
+            if (run)
+            {
+                if (static_cast<size_t>(end - src) < Bytes) return false;
+                TgaPixel<Bytes>(src, pixel);
+                src += Bytes;
+            }
+            else if (static_cast<size_t>(end - src) < static_cast<size_t>(count) * Bytes)
+            {
+                return false;
+            }
+            while (count != 0 && y < h)
+            {
+                const uint32_t n = std::min(count, w - x);
+                if (run)
+                {
+                    TgaFill(pixel, row + static_cast<size_t>(x) * 4, n);
+                }
+                else
+                {
+                    TgaCopy<Bytes>(src, row + static_cast<size_t>(x) * 4, n);
+                    src += static_cast<size_t>(n) * Bytes;
+                }
+                count -= n;
+                x += n;
+                if (x == w)
+                {
+                    x = 0;
+                    if (++y < h) row = rowOf(y);
+                }
+            }
+        }
+        return true;
+    }
+
+    bool DecodeTgaToBgra(AssetView tga, std::vector<uint8_t>& out, uint32_t& w, uint32_t& h)
+    {
+        OBBOOK_TRACE_SCOPE("DecodeTgaToBgra");
+        if (tga.size < 18) return false;
+        const uint8_t* hdr = tga.data;
+        auto rd16 = [&](size_t o) { return static_cast<uint32_t>(hdr[o] | (hdr[o + 1] << 8)); };
+        const uint32_t idLength = hdr[0], colorMapType = hdr[1], imageType = hdr[2];
+        const uint32_t colorMapLength = rd16(5), colorMapEntryBits = hdr[7];
+        const uint32_t depth = hdr[16], descriptor = hdr[17];
+        w = rd16(12);
+        h = rd16(14);
+        if (colorMapType > 1 || w == 0 || h == 0) return false;
+
+        const bool rle = imageType == 10 || imageType == 11;
+        const bool gray = imageType == 3 || imageType == 11;
+        if (!rle && imageType != 2 && imageType != 3) return false;
+        if (gray ? depth != 8 && depth != 16 : depth != 24 && depth != 32) return false;
+        const uint32_t bytes = depth / 8;
+
+        // True-color images may still carry a palette; it is skipped.
+        const size_t skip = 18 + idLength + (colorMapType ? static_cast<size_t>(colorMapLength) * ((colorMapEntryBits + 7) / 8) : 0);
+        if (skip > tga.size) return false;
+        const uint8_t* src = tga.data + skip;
+        const uint8_t* end = tga.data + tga.size;
+        // A packet of 1 + bytes input bytes yields at most 128 pixels; more pixels than the input can hold are
+        // rejected before the buffer is sized for them.
+        const size_t pixels = static_cast<size_t>(w) * h;
+        if (rle ? pixels / 128 > static_cast<size_t>(end - src) / (1 + bytes) : pixels > static_cast<size_t>(end - src) / bytes) return false;
+
+        out.resize(pixels * 4);
+        const bool topDown = (descriptor & 0x20u) != 0;
+        bool ok = false;
+        switch (bytes)
+        {
+        case 1: ok = DecodeTgaPixels<1>(src, end, rle, topDown, w, h, out.data()); break;
+        case 2: ok = DecodeTgaPixels<2>(src, end, rle, topDown, w, h, out.data()); break;
+        case 3: ok = DecodeTgaPixels<3>(src, end, rle, topDown, w, h, out.data()); break;
+        default: ok = DecodeTgaPixels<4>(src, end, rle, topDown, w, h, out.data()); break;
+        }
+        if (!ok) return false;
+
+        // Right-to-left files are rare enough to mirror afterwards.
+        if (descriptor & 0x10u)
+        {
+            for (uint32_t y = 0; y < h; ++y)
+            {
+                uint8_t* row = out.data() + static_cast<size_t>(y) * w * 4;
+                for (uint32_t a = 0, b = w - 1; a < b; ++a, --b)
+                {
+                    uint8_t t[4];
+                    std::memcpy(t, row + a * 4, 4);
+                    std::memcpy(row + a * 4, row + b * 4, 4);
+                    std::memcpy(row + b * 4, t, 4);
+                }
+            }
+        }
+        return true;
+    }
+
+    bool DecodeTextureToBgra(AssetView bytes, uint32_t maxEdge, std::vector<uint8_t>& out, uint32_t& w, uint32_t& h)
+    {
+        // TGA has no signature; anything that is not a DDS is tried as one.
+        if (bytes.size >= 4 && std::memcmp(bytes.data, "DDS ", 4) == 0) return DecodeDdsToBgra(bytes, maxEdge, out, w, h);
+        return DecodeTgaToBgra(bytes, out, w, h);
+    }
+}
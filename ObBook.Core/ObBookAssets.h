@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace obbook
+{
+    // Virtual paths are Data-relative, lower-case and use forward slashes ("textures/menus/book/a.dds").
+    std::string NormalizeVirtualPath(std::string path);
+    bool IsBookTexturePath(const std::string& normalizedPath);
+    bool IsBookFontPath(const std::string& normalizedPath);
+
+    // IMG src handling mirrors the game: "book/..." resolves under textures/menus/, anything else under textures/.
+    std::string ExtractFirstImgSrc(const std::string& markupUtf8);
+    std::string ToTextureVirtualPath(const std::string& imgSrc);
+    // Same, into a caller-owned buffer so a retained one can be reused without allocating.
+    void ToTextureVirtualPath(std::string_view imgSrc, std::string& out);
+
+    struct BsaFileEntry
+    {
+        std::string path;
+        uint32_t packedSize{};
+        uint32_t offset{};
+    };
+
+    // BSA v103 (Oblivion) / v104 readers. Both require the archive to carry folder and file names.
+    bool ReadBsaPaths(const std::filesystem::path& bsaPath, std::vector<std::string>& outPaths);
+    bool ReadBsaEntries(const std::filesystem::path& bsaPath, std::vector<BsaFileEntry>& entries);
+
+    // Oblivion / Fallout 3 BSA name hashes. Input is lower-cased and '/' is hashed as '\\'. Folder records hash the
+    // whole folder path; file records hash the file name split at its last '.'.
+    uint64_t HashBsaFolder(std::string_view folderPath);
+    uint64_t HashBsaFileName(std::string_view fileName);
+
+    // Locates one file by hashing its normalized virtual path and binary-searching the archive's sorted folder
+    // records, then that folder's file records: O(log n) small reads. The folder name is compared on a hash
+    // match; the file-name block is never read, so file names are trusted to the 64-bit hash, as the game does.
+    bool FindBsaFile(const std::filesystem::path& bsaPath, const std::string& virtualPath, BsaFileEntry& entry);
+
+    // Resolves a virtual path against loose files first, then every BSA in the Data folder (in file-name order).
+    bool ReadAssetBytes(const std::string& dataDirUtf8, const std::string& virtualPath, std::vector<uint8_t>& bytes);
+
+    // Where the copy ReadAssetBytes would read lives: a loose file, or a byte range of an archive. With the
+    // container's size and write time it identifies the bytes without reading them.
+    struct AssetLocation
+    {
+        std::string containerUtf8;      // the loose file or the .bsa; empty when the path was not found
+        bool inArchive = false;
+        uint64_t offset{};              // of the entry in the archive; 0 for loose files
+        uint64_t size{};
+        uint64_t containerSize{};
+        int64_t containerWriteTime{};   // file clock ticks; only meaningful compared with another read of the same file
+
+        bool IsFound() const { return !containerUtf8.empty(); }
+    };
+
+    // Batch lookup: lists and opens the archives once for all paths. Compressed archive entries are not found,
+    // as ReadAssetBytes cannot read them either.
+    void LocateAssets(const std::string& dataDirUtf8, const std::vector<std::string>& virtualPaths, std::vector<AssetLocation>& locations);
+    bool ReadAssetBytes(const AssetLocation& location, std::vector<uint8_t>& bytes);
+
+    // Pixel size of a DDS or TGA texture, resolved like ReadAssetBytes but reading only the file header.
+    bool ReadTextureSize(const std::string& dataDirUtf8, const std::string& virtualPath, uint32_t& w, uint32_t& h);
+
+    // Bytes of an asset owned elsewhere (a ReadAssetBytes buffer, a mapped file); decoders read them in place.
+    struct AssetView
+    {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+
+        AssetView() = default;
+        AssetView(const uint8_t* d, size_t n) : data(d), size(n) {}
+        AssetView(const std::vector<uint8_t>& bytes) : data(bytes.data()), size(bytes.size()) {}
+    };
+
+    // Decodes the top mip of a DDS into a tightly packed BGRA8 buffer. Reads DXT1, DXT3 and DXT5, the 32-bit
+    // ARGB/XRGB/ABGR/XBGR layouts, R8G8B8, R5G6B5, A1R5G5B5, X1R5G5B5, A4R4G4B4, L8 and A8L8; false for anything
+    // else (DX10 headers included), for sides over 16384, or when the file is shorter than the level it decodes.
+    bool DecodeDdsToBgra(AssetView dds, std::vector<uint8_t>& out, uint32_t& w, uint32_t& h);
+    // Same, for the largest mip that fits in maxEdge x maxEdge, or the smallest one the file has if none does.
+    bool DecodeDdsToBgra(AssetView dds, uint32_t maxEdge, std::vector<uint8_t>& out, uint32_t& w, uint32_t& h);
+
+    // Decodes a raw or RLE TGA, true-color (24/32-bit) or grayscale (8-bit, 16-bit with alpha), of either origin,
+    // into a tightly packed top-down BGRA8 buffer. Color-mapped images are not read.
+    bool DecodeTgaToBgra(AssetView tga, std::vector<uint8_t>& out, uint32_t& w, uint32_t& h);
+
+    // A book texture of either kind, told apart by the DDS signature. TGA has no mips, so maxEdge only applies
+    // to DDS files; callers that need a bound scale the result themselves.
+    bool DecodeTextureToBgra(AssetView bytes, uint32_t maxEdge, std::vector<uint8_t>& out, uint32_t& w, uint32_t& h);
+}
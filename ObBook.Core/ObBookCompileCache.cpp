@@ -0,0 +1,435 @@
+#include "ObBookCompileCache.h"
+#include "ObBookTrace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace obbook
+{
+    // Entry file layout; integers are little-endian (x64 only, so written as-is):
+    //   header   "OBCC", u32 format, key[32], u64 payload bytes, u64 payload checksum
+    //   payload  u32 n, normalized bytes[n]
+    //            u32 n, n x { u8 severity, u8 kind, u16 messageId, u32 offset, u32 length, u32 count,
+    //                         u32 normalizedOffset, u32 normalizedLength }
+    //            u32 n, n x { u32 sourceOffset, u32 normalizedOffset, u32 sourceLength, u32 normalizedLength }
+    //            u32 total, u32 bySeverity[3], u32 kindCount, u32 byKind[kindCount]
+    //            u32 n, n x { u32 length, bytes[length] }   dynamic messages
+    static constexpr char kMagic[4] = { 'O', 'B', 'C', 'C' };
+    static constexpr uint32_t kFormatVersion = 2;
+    static constexpr size_t kHeaderBytes = 4 + 4 + 32 + 8 + 8;
+    static constexpr size_t kDiagnosticBytes = 24;
+    static constexpr size_t kSourceMapEditBytes = 16;
+    static constexpr const char* kEntryExtension = ".obc";
+
+    // Catches torn or bit-rotted files; the key in the header already ties the entry to its input.
+    static uint64_t Checksum(const char* data, size_t size)
+    {
+        uint64_t h = 0xCBF29CE484222325ull ^ size;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t v;
+            std::memcpy(&v, data + i, sizeof(v));
+            h = (h ^ v) * 0x100000001B3ull;
+            h ^= h >> 29;
+        }
+        for (; i < size; ++i) h = (h ^ static_cast<uint8_t>(data[i])) * 0x100000001B3ull;
+        return h;
+    }
+
+    template <typename T>
+    static void Put(std::string& out, T value)
+    {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        out.append(bytes, sizeof(T));
+    }
+
+    static void PutString(std::string& out, const std::string& s)
+    {
+        Put(out, static_cast<uint32_t>(s.size()));
+        out.append(s);
+    }
+
+    // Bounds-checked cursor over an entry payload; every read fails once one has.
+    struct PayloadReader
+    {
+        const char* p;
+        const char* end;
+        bool ok = true;
+
+        template <typename T>
+        T Get()
+        {
+            T value{};
+            if (!ok || static_cast<size_t>(end - p) < sizeof(T))
+            {
+                ok = false;
+                return value;
+            }
+            std::memcpy(&value, p, sizeof(T));
+            p += sizeof(T);
+            return value;
+        }
+
+        void GetString(std::string& s)
+        {
+            const uint32_t n = Get<uint32_t>();
+            if (!ok || static_cast<size_t>(end - p) < n)
+            {
+                ok = false;
+                return;
+            }
+            s.assign(p, n);
+            p += n;
+        }
+    };
+
+    static void EncodePayload(const CompileCacheEntry& entry, std::string& out)
+    {
+        PutString(out, entry.normalizedUtf8);
+
+        Put(out, static_cast<uint32_t>(entry.diagnostics.size()));
+        for (const auto& d : entry.diagnostics)
+        {
+            Put(out, static_cast<uint8_t>(d.severity));
+            Put(out, static_cast<uint8_t>(d.kind));
+            Put(out, d.messageId);
+            Put(out, d.offset);
+            Put(out, d.length);
+            Put(out, d.count);
+            Put(out, d.normalizedOffset);
+            Put(out, d.normalizedLength);
+        }
+
+        Put(out, static_cast<uint32_t>(entry.sourceMapEdits.size()));
+        for (const auto& e : entry.sourceMapEdits)
+        {
+            Put(out, e.sourceOffset);
+            Put(out, e.normalizedOffset);
+            Put(out, e.sourceLength);
+            Put(out, e.normalizedLength);
+        }
+
+        Put(out, entry.summary.total);
+        for (const uint32_t n : entry.summary.bySeverity) Put(out, n);
+        Put(out, static_cast<uint32_t>(DiagnosticKind::Count));
+        for (const uint32_t n : entry.summary.byKind) Put(out, n);
+
+        Put(out, static_cast<uint32_t>(entry.dynamicMessages.size()));
+        for (const auto& m : entry.dynamicMessages) PutString(out, m);
+    }
+
+    static bool DecodePayload(const char* data, size_t size, CompileCacheEntry& entry)
+    {
+        PayloadReader r{ data, data + size };
+        r.GetString(entry.normalizedUtf8);
+
+        const uint32_t diagCount = r.Get<uint32_t>();
+        if (!r.ok || static_cast<size_t>(r.end - r.p) / kDiagnosticBytes < diagCount) return false;
+        entry.diagnostics.resize(diagCount);
+        for (auto& d : entry.diagnostics)
+        {
+            const uint8_t severity = r.Get<uint8_t>();
+            const uint8_t kind = r.Get<uint8_t>();
+            if (severity > static_cast<uint8_t>(Diagnostic::Severity::Error)) return false;
+            if (kind >= static_cast<uint8_t>(DiagnosticKind::Count)) return false;
+            d.severity = static_cast<Diagnostic::Severity>(severity);
+            d.kind = static_cast<DiagnosticKind>(kind);
+            d.messageId = r.Get<uint16_t>();
+            d.offset = r.Get<uint32_t>();
+            d.length = r.Get<uint32_t>();
+            d.count = r.Get<uint32_t>();
+            d.normalizedOffset = r.Get<uint32_t>();
+            d.normalizedLength = r.Get<uint32_t>();
+        }
+
+        // Edits must be in order and inside the normalized text, as SourceMap expects.
+        const uint32_t editCount = r.Get<uint32_t>();
+        if (!r.ok || static_cast<size_t>(r.end - r.p) / kSourceMapEditBytes < editCount) return false;
+        entry.sourceMapEdits.resize(editCount);
+        uint64_t sourceEnd = 0;
+        uint64_t normalizedEnd = 0;
+        for (auto& e : entry.sourceMapEdits)
+        {
+            e.sourceOffset = r.Get<uint32_t>();
+            e.normalizedOffset = r.Get<uint32_t>();
+            e.sourceLength = r.Get<uint32_t>();
+            e.normalizedLength = r.Get<uint32_t>();
+            if (e.sourceOffset < sourceEnd || e.normalizedOffset < normalizedEnd) return false;
+            sourceEnd = uint64_t{ e.sourceOffset } + e.sourceLength;
+            normalizedEnd = uint64_t{ e.normalizedOffset } + e.normalizedLength;
+        }
+        if (normalizedEnd > entry.normalizedUtf8.size()) return false;
+
+        entry.summary.total = r.Get<uint32_t>();
+        for (uint32_t& n : entry.summary.bySeverity) n = r.Get<uint32_t>();
+        if (r.Get<uint32_t>() != static_cast<uint32_t>(DiagnosticKind::Count)) return false;
+        for (uint32_t& n : entry.summary.byKind) n = r.Get<uint32_t>();
+
+        const uint32_t messageCount = r.Get<uint32_t>();
+        if (!r.ok || static_cast<size_t>(r.end - r.p) / sizeof(uint32_t) < messageCount) return false;
+        entry.dynamicMessages.resize(messageCount);
+        for (auto& m : entry.dynamicMessages) r.GetString(m);
+        if (!r.ok || r.p != r.end) return false;
+
+        const size_t messageLimit = static_cast<size_t>(DiagnosticKind::Count) + messageCount;
+        for (const auto& d : entry.diagnostics)
+            if (d.messageId >= messageLimit) return false;
+        return true;
+    }
+
+    static bool IsEntryFileName(const std::string& name)
+    {
+        const size_t hexChars = 64;
+        if (name.size() != hexChars + std::strlen(kEntryExtension)) return false;
+        if (name.compare(hexChars, std::string::npos, kEntryExtension) != 0) return false;
+        return std::all_of(name.begin(), name.begin() + hexChars, [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+    }
+
+    struct CompileCache::Impl
+    {
+        struct EntryInfo
+        {
+            uint64_t bytes{};
+            uint64_t lastUse{}; // logical clock; larger is more recent
+        };
+
+        mutable std::mutex mutex;
+        fs::path directory;
+        uint64_t maxBytes{};
+        bool open = false;
+        std::unordered_map<std::string, EntryInfo> entries; // by file name
+        uint64_t totalBytes{};
+        uint64_t clock{};
+        uint64_t tempCounter{};
+        CompileCacheStats stats{};
+
+        // Callers hold the mutex.
+        void Track(const std::string& name, uint64_t bytes)
+        {
+            auto [it, inserted] = entries.try_emplace(name);
+            if (!inserted) totalBytes -= it->second.bytes;
+            it->second.bytes = bytes;
+            it->second.lastUse = ++clock;
+            totalBytes += bytes;
+        }
+
+        void Forget(const std::string& name)
+        {
+            auto it = entries.find(name);
+            if (it == entries.end()) return;
+            totalBytes -= it->second.bytes;
+            entries.erase(it);
+        }
+
+        // Drops least-recently-used entries until the total fits, never the one just stored. A linear scan per
+        // victim: stores are rare next to compiles and the directory holds at most a few thousand entries.
+        void Evict(const std::string& keep)
+        {
+            while (totalBytes > maxBytes && entries.size() > 1)
+            {
+                auto victim = entries.end();
+                for (auto it = entries.begin(); it != entries.end(); ++it)
+                {
+                    if (it->first == keep) continue;
+                    if (victim == entries.end() || it->second.lastUse < victim->second.lastUse) victim = it;
+                }
+                std::error_code ec;
+                fs::remove(directory / victim->first, ec);
+                totalBytes -= victim->second.bytes;
+                entries.erase(victim);
+                ++stats.evictions;
+            }
+        }
+    };
+
+    CompileCache::CompileCache(const std::string& directoryUtf8, uint64_t maxBytes)
+        : impl_(std::make_unique<Impl>())
+    {
+        OBBOOK_TRACE_SCOPE("CompileCache.Open");
+        impl_->directory = fs::path(directoryUtf8);
+        impl_->maxBytes = maxBytes;
+
+        std::error_code ec;
+        fs::create_directories(impl_->directory, ec);
+        if (ec || !fs::is_directory(impl_->directory, ec)) return;
+        impl_->open = true;
+
+        // Seed the recency order from the modification times left by earlier runs.
+        struct Existing { std::string name; uint64_t bytes; fs::file_time_type modified; };
+        std::vector<Existing> existing;
+        for (fs::directory_iterator it(impl_->directory, ec), end; !ec && it != end; it.increment(ec))
+        {
+            std::string name = it->path().filename().string();
+            if (!IsEntryFileName(name)) continue;
+            std::error_code fileEc;
+            const uint64_t bytes = it->file_size(fileEc);
+            const auto modified = it->last_write_time(fileEc);
+            if (fileEc) continue;
+            existing.push_back({ std::move(name), bytes, modified });
+        }
+        std::sort(existing.begin(), existing.end(), [](const Existing& a, const Existing& b) { return a.modified < b.modified; });
+        for (const auto& e : existing) impl_->Track(e.name, e.bytes);
+        impl_->Evict(std::string());
+    }
+
+    CompileCache::~CompileCache() = default;
+
+    bool CompileCache::IsOpen() const
+    {
+        return impl_->open;
+    }
+
+    Sha256::Digest CompileCache::MakeKey(const std::string& sourceUtf8, const ProjectSettings& settings, uint64_t assetFingerprint)
+    {
+        Sha256 h;
+        const uint32_t numbers[] = { kCompilerVersion, settings.codepage, settings.maxImageWidth };
+        const uint8_t flags[] = { settings.autoNormalizeSmartQuotes, settings.autoNormalizeSlashes,
+            settings.groupAdjacentDiagnostics, settings.lintImageReferences };
+        const uint64_t sourceBytes = sourceUtf8.size();
+        h.Update(numbers, sizeof(numbers));
+        h.Update(flags, sizeof(flags));
+        h.Update(&assetFingerprint, sizeof(assetFingerprint));
+        h.Update(&sourceBytes, sizeof(sourceBytes));
+        h.Update(sourceUtf8);
+        return h.Finish();
+    }
+
+    bool CompileCache::Load(const Sha256::Digest& key, CompileCacheEntry& entry)
+    {
+        OBBOOK_TRACE_SCOPE("CompileCache.Load");
+        Impl& impl = *impl_;
+        const std::string name = Sha256::ToHex(key) + kEntryExtension;
+        {
+            std::lock_guard<std::mutex> lock(impl.mutex);
+            ++impl.stats.lookups;
+        }
+        if (!impl.open) return false;
+
+        const fs::path path = impl.directory / name;
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) return false;
+        const std::streamoff fileBytes = in.tellg();
+        if (fileBytes < static_cast<std::streamoff>(kHeaderBytes)) return false;
+
+        std::string data(static_cast<size_t>(fileBytes), '\0');
+        in.seekg(0);
+        const bool read = static_cast<bool>(in.read(data.data(), fileBytes));
+        in.close();
+
+        bool valid = read && std::memcmp(data.data(), kMagic, sizeof(kMagic)) == 0;
+        if (valid)
+        {
+            uint32_t format;
+            uint64_t payloadBytes, checksum;
+            std::memcpy(&format, data.data() + 4, sizeof(format));
+            std::memcpy(&payloadBytes, data.data() + 40, sizeof(payloadBytes));
+            std::memcpy(&checksum, data.data() + 48, sizeof(checksum));
+            const char* payload = data.data() + kHeaderBytes;
+            valid = format == kFormatVersion
+                && std::memcmp(data.data() + 8, key.data(), key.size()) == 0
+                && payloadBytes == data.size() - kHeaderBytes
+                && Checksum(payload, payloadBytes) == checksum
+                && DecodePayload(payload, payloadBytes, entry);
+        }
+
+        std::lock_guard<std::mutex> lock(impl.mutex);
+        impl.stats.bytesRead += static_cast<uint64_t>(fileBytes);
+        std::error_code ec;
+        if (!valid)
+        {
+            ++impl.stats.corrupt;
+            fs::remove(path, ec);
+            impl.Forget(name);
+            return false;
+        }
+        ++impl.stats.hits;
+        impl.Track(name, static_cast<uint64_t>(fileBytes));
+        fs::last_write_time(path, fs::file_time_type::clock::now(), ec); // recency for the next run
+        return true;
+    }
+
+    bool CompileCache::Store(const Sha256::Digest& key, const CompileCacheEntry& entry)
+    {
+        OBBOOK_TRACE_SCOPE("CompileCache.Store");
+        Impl& impl = *impl_;
+        if (!impl.open) return false;
+
+        std::string data;
+        data.append(kMagic, sizeof(kMagic));
+        Put(data, kFormatVersion);
+        data.append(reinterpret_cast<const char*>(key.data()), key.size());
+        data.resize(kHeaderBytes);
+        EncodePayload(entry, data);
+        const uint64_t payloadBytes = data.size() - kHeaderBytes;
+        const uint64_t checksum = Checksum(data.data() + kHeaderBytes, payloadBytes);
+        std::memcpy(data.data() + 40, &payloadBytes, sizeof(payloadBytes));
+        std::memcpy(data.data() + 48, &checksum, sizeof(checksum));
+
+        const std::string name = Sha256::ToHex(key) + kEntryExtension;
+        uint64_t tempId;
+        {
+            std::lock_guard<std::mutex> lock(impl.mutex);
+            tempId = ++impl.tempCounter;
+        }
+        // Unique per process and call, so concurrent writers never share a temporary; the rename publishes the
+        // entry whole.
+        const auto stamp = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        const fs::path temp = impl.directory / (name + "." + std::to_string(stamp) + "." + std::to_string(tempId) + ".tmp");
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            if (!out || !out.write(data.data(), static_cast<std::streamsize>(data.size())))
+            {
+                out.close();
+                std::error_code ec;
+                fs::remove(temp, ec);
+                return false;
+            }
+        }
+        std::error_code ec;
+        fs::rename(temp, impl.directory / name, ec);
+        if (ec)
+        {
+            fs::remove(temp, ec);
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(impl.mutex);
+        ++impl.stats.stores;
+        impl.stats.bytesWritten += data.size();
+        impl.Track(name, data.size());
+        impl.Evict(name);
+        return true;
+    }
+
+    CompileCacheStats CompileCache::GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        return impl_->stats;
+    }
+
+    void CompileCache::ResetStats()
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        impl_->stats = {};
+    }
+
+    uint64_t CompileCache::TotalBytes() const
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        return impl_->totalBytes;
+    }
+
+    size_t CompileCache::EntryCount() const
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        return impl_->entries.size();
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ObBookCore.h"
+#include "ObBookSha256.h"
+
+namespace obbook
+{
+    // Part of every cache key. Bump it whenever Compile() output for the same input changes.
+    constexpr uint32_t kCompilerVersion = 2;
+
+    // What Compile() produces, minus the built-in message texts (those come from the compiler itself).
+    struct CompileCacheEntry
+    {
+        std::string normalizedUtf8;
+        std::vector<Diagnostic> diagnostics;
+        std::vector<SourceMap::Edit> sourceMapEdits;
+        DiagnosticSummary summary{};
+        std::vector<std::string> dynamicMessages;
+    };
+
+    struct CompileCacheStats
+    {
+        uint64_t lookups{};
+        uint64_t hits{};
+        uint64_t stores{};
+        uint64_t evictions{};
+        uint64_t corrupt{};      // entries that failed validation and were deleted
+        uint64_t bytesRead{};    // entry files read, hits and corrupt entries alike
+        uint64_t bytesWritten{};
+
+        double HitRate() const { return lookups ? static_cast<double>(hits) / static_cast<double>(lookups) : 0.0; }
+    };
+
+    // On-disk, content-addressed cache of compile results. Each entry is one "<sha256>.obc" file in a compact
+    // binary format, written to a temporary name and renamed into place, so several processes (e.g. parallel CI
+    // jobs) can share a directory. Total size is bounded: storing past maxBytes evicts least-recently-used entries,
+    // with use times kept in the file modification times so the order survives restarts.
+    // Thread-safe; one instance can serve several compilers.
+    class CompileCache
+    {
+    public:
+        CompileCache(const std::string& directoryUtf8, uint64_t maxBytes);
+        ~CompileCache();
+
+        CompileCache(const CompileCache&) = delete;
+        CompileCache& operator=(const CompileCache&) = delete;
+
+        // False if the directory could not be created; Load() then always misses and Store() does nothing.
+        bool IsOpen() const;
+
+        // SHA-256 over the compiler version, the settings that affect output, the asset-scan fingerprint and the
+        // source. The Oblivion directory setting is left out: the fingerprint covers what it resolved to.
+        static Sha256::Digest MakeKey(const std::string& sourceUtf8, const ProjectSettings& settings, uint64_t assetFingerprint);
+
+        bool Load(const Sha256::Digest& key, CompileCacheEntry& entry);
+        bool Store(const Sha256::Digest& key, const CompileCacheEntry& entry);
+
+        CompileCacheStats GetStats() const;
+        void ResetStats();
+        uint64_t TotalBytes() const;
+        size_t EntryCount() const;
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl_;
+    };
+}
@@ -0,0 +1,151 @@
+#include "ObBookCompileService.h"
+#include "ObBookTrace.h"
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace obbook
+{
+    struct CompileService::Impl
+    {
+        CompletedFn onCompleted;
+        RenderFn render;
+
+        mutable std::mutex mutex;
+        std::condition_variable wake;
+        std::optional<CompileRequest> pending;
+        uint64_t latestSequence = 0; // last sequence handed out by Submit()
+        bool stopping = false;
+        std::shared_ptr<const CompileResult> latestResult;
+
+        // Cancels the job the worker is running; reset under the mutex when the worker takes the next request.
+        CancellationToken cancel;
+
+        // Only touched by the worker thread. Kept across jobs so asset discovery is reused.
+        BookCompiler compiler;
+        std::thread worker;
+
+        std::shared_ptr<CompileResult> Run(const CompileRequest& req, uint64_t sequence)
+        {
+            OBBOOK_TRACE_SCOPE("CompileService.Run");
+            compiler.SetSettings(req.settings);
+            compiler.SetSourceUtf8(req.sourceUtf8);
+            if (req.rescanAssets) compiler.InvalidateAssetScan();
+            if (!compiler.Compile(cancel)) return nullptr;
+
+            auto result = std::make_shared<CompileResult>();
+            result->sequence = sequence;
+            result->sourceUtf8 = req.sourceUtf8;
+            result->normalizedUtf8 = compiler.GetNormalizedSourceUtf8();
+            result->sourceMap = compiler.GetSourceMap();
+            result->diagnostics = compiler.GetDiagnostics();
+            result->summary = compiler.GetDiagnosticSummary();
+            const size_t messageCount = compiler.GetDiagnosticMessageCount();
+            result->messages.reserve(messageCount);
+            for (size_t i = 0; i < messageCount; ++i)
+                result->messages.push_back(compiler.GetDiagnosticMessage(static_cast<uint16_t>(i)));
+            result->diagnosticsGeneration = compiler.GetDiagnosticsGeneration();
+            result->resolvedDataDirUtf8 = compiler.GetResolvedDataDirectoryUtf8();
+            result->assetIndex = compiler.GetAssetIndex();
+            result->assetGeneration = compiler.GetAssetGeneration();
+
+            if (render && req.previewWidth > 0 && req.previewHeight > 0)
+            {
+                if (cancel.IsCancelled()) return nullptr;
+                OBBOOK_TRACE_SCOPE("CompileService.Render");
+                result->previewWidth = req.previewWidth;
+                result->previewHeight = req.previewHeight;
+                result->previewDpi = req.previewDpi;
+                if (!render(compiler, req, *result, cancel)) result->previewBgra.clear();
+            }
+            if (cancel.IsCancelled()) return nullptr;
+            return result;
+        }
+
+        void WorkerLoop()
+        {
+            for (;;)
+            {
+                CompileRequest req;
+                uint64_t sequence = 0;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [this] { return stopping || pending.has_value(); });
+                    if (stopping) return;
+                    req = std::move(*pending);
+                    pending.reset();
+                    sequence = latestSequence;
+                    cancel.Reset();
+                }
+
+                auto result = Run(req, sequence);
+                if (!result) continue;
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (stopping || sequence != latestSequence) continue;
+                    latestResult = result;
+                }
+                // A newer Submit() can still land before the callback runs; receivers compare sequence numbers.
+                if (onCompleted) onCompleted(std::move(result));
+            }
+        }
+    };
+
+    CompileService::CompileService(CompletedFn onCompleted, RenderFn render)
+        : impl_(std::make_unique<Impl>())
+    {
+        impl_->onCompleted = std::move(onCompleted);
+        impl_->render = std::move(render);
+        impl_->worker = std::thread([impl = impl_.get()] { impl->WorkerLoop(); });
+    }
+
+    CompileService::~CompileService()
+    {
+        Stop();
+    }
+
+    uint64_t CompileService::Submit(CompileRequest request)
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        if (impl_->stopping) return 0;
+        impl_->pending = std::move(request);
+        impl_->cancel.Cancel();
+        impl_->wake.notify_one();
+        return ++impl_->latestSequence;
+    }
+
+    void CompileService::CancelPending()
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        impl_->pending.reset();
+        impl_->cancel.Cancel();
+        // Bumping the sequence keeps a result that slips past the cancellation check from being published.
+        ++impl_->latestSequence;
+    }
+
+    void CompileService::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(impl_->mutex);
+            impl_->stopping = true;
+            impl_->pending.reset();
+            impl_->cancel.Cancel();
+        }
+        impl_->wake.notify_one();
+        if (impl_->worker.joinable()) impl_->worker.join();
+    }
+
+    uint64_t CompileService::GetLatestSequence() const
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        return impl_->latestSequence;
+    }
+
+    std::shared_ptr<const CompileResult> CompileService::GetLatestResult() const
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        return impl_->latestResult;
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ObBookCore.h"
+
+namespace obbook
+{
+    struct CompileRequest
+    {
+        std::string sourceUtf8;
+        ProjectSettings settings{};
+        bool rescanAssets = false; // force asset discovery even if the Oblivion directory did not change
+        uint32_t previewWidth = 0; // 0 skips the render stage
+        uint32_t previewHeight = 0;
+        float previewDpi = 96.0f;
+    };
+
+    // Immutable snapshot of one finished compile; safe to hand to any thread.
+    struct CompileResult
+    {
+        uint64_t sequence{};
+        std::string sourceUtf8;
+        std::string normalizedUtf8;
+        SourceMap sourceMap;
+        std::vector<Diagnostic> diagnostics;
+        DiagnosticSummary summary{};
+        std::vector<std::string> messages; // indexed by Diagnostic::messageId
+        uint64_t diagnosticsGeneration{};  // the worker compiler's, see BookCompiler::GetDiagnosticsGeneration()
+        std::string resolvedDataDirUtf8;
+        std::shared_ptr<const AssetIndex> assetIndex; // shared with the compiler, never copied
+        uint64_t assetGeneration{};
+
+        uint32_t previewWidth{};
+        uint32_t previewHeight{};
+        float previewDpi = 96.0f;
+        std::vector<uint8_t> previewBgra; // empty when no preview was requested or rendering failed
+        std::string previewError;
+    };
+
+    // Runs compile (and an optional render stage) on a single worker thread.
+    // Submit() never blocks on compile or disk I/O: it replaces any queued request and cancels the running one,
+    // so only the latest snapshot is ever completed. Superseded and cancelled work is dropped without a callback.
+    class CompileService
+    {
+    public:
+        // Fills result.previewBgra from the finished compile. Runs on the worker thread; should poll cancel.
+        using RenderFn = std::function<bool(const BookCompiler& compiler, const CompileRequest& request,
+            CompileResult& result, const CancellationToken& cancel)>;
+        // Invoked on the worker thread for each published result.
+        using CompletedFn = std::function<void(std::shared_ptr<const CompileResult> result)>;
+
+        CompileService(CompletedFn onCompleted, RenderFn render = nullptr);
+        ~CompileService();
+
+        CompileService(const CompileService&) = delete;
+        CompileService& operator=(const CompileService&) = delete;
+
+        // Returns the sequence number assigned to the request (monotonic, starting at 1).
+        uint64_t Submit(CompileRequest request);
+
+        // Drops the queued request and cancels the running one.
+        void CancelPending();
+
+        // Cancels outstanding work and joins the worker. Submit() after Stop() is ignored and returns 0.
+        void Stop();
+
+        uint64_t GetLatestSequence() const;
+        std::shared_ptr<const CompileResult> GetLatestResult() const;
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl_;
+    };
+}
@@ -1,22 +1,18 @@
 #include "ObBookCore.h"
+#include "ObBookAssets.h"
+#include "ObBookCompileCache.h"
+#include "ObBookMarkup.h"
+#include "ObBookTrace.h"
 #include <algorithm>
-#include <array>
+#include <charconv>
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
-#include <fstream>
-#include <sstream>
 
 namespace fs = std::filesystem;
 
 namespace obbook
 {
-    static bool IsSmartQuote(uint32_t cp)
-    {
-        // Common Windows smart quote codepoints.
-        return (cp == 0x2018u || cp == 0x2019u || cp == 0x201Cu || cp == 0x201Du);
-    }
-
     static std::string ToLowerAscii(std::string s)
     {
         std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c)
@@ -27,29 +23,75 @@ namespace obbook
         return s;
     }
 
-    static std::string NormalizeVirtualPath(std::string path)
+    static void AppendLowerAscii(std::string& out, std::string_view s)
     {
-        for (auto& c : path) if (c == '\\') c = '/';
-        path = ToLowerAscii(path);
-        while (!path.empty() && path.front() == '/') path.erase(path.begin());
-        return path;
+        for (const char c : s) out.push_back(c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c);
     }
 
-    static bool IsBookTexturePath(const std::string& normalizedPath)
+    // Loose folders the scan needs: every texture, for IMG lint, and the fonts; nothing else is walked.
+    static constexpr std::string_view kLooseAssetRoots[] = { "textures/", "fonts/" };
+
+    // virtualDir ends with '/'. True on the way down to a root and anywhere below one.
+    static bool CanHoldAssets(std::string_view virtualDir)
     {
-        if (normalizedPath.rfind("textures/menus/book/", 0) != 0) return false;
-        const auto dot = normalizedPath.find_last_of('.');
-        if (dot == std::string::npos) return false;
-        const auto ext = normalizedPath.substr(dot);
-        return ext == ".dds" || ext == ".tga";
+        for (const std::string_view root : kLooseAssetRoots)
+        {
+            const size_t n = std::min(root.size(), virtualDir.size());
+            if (root.substr(0, n) == virtualDir.substr(0, n)) return true;
+        }
+        return false;
     }
 
-    static bool IsBookFontPath(const std::string& normalizedPath)
+    static bool IsUnderAssetRoot(std::string_view virtualDir)
     {
-        if (normalizedPath.rfind("fonts/", 0) == 0) return true;
-        return normalizedPath.rfind("textures/menus/book/fancy_font/", 0) == 0;
+        for (const std::string_view root : kLooseAssetRoots)
+            if (virtualDir.substr(0, root.size()) == root) return true;
+        return false;
     }
 
+    // Walks the Data folder's loose files, descending only into the asset roots, with names matched
+    // case-insensitively. The virtual path (lower-case, '/'-separated) is built on the way down and passed to fn
+    // for every file below a root. Unreadable folders are skipped; false if cancelled.
+    template <typename Fn>
+    static bool WalkLooseAssets(const fs::path& dataDir, const CancellationToken* cancel, Fn&& fn)
+    {
+        struct PendingDir
+        {
+            fs::path path;
+            std::string virtualDir;
+        };
+        std::vector<PendingDir> pending;
+        pending.push_back(PendingDir{ dataDir, std::string() });
+        std::string virtualPath;
+        size_t visited = 0;
+        while (!pending.empty())
+        {
+            const PendingDir dir = std::move(pending.back());
+            pending.pop_back();
+            const bool collect = IsUnderAssetRoot(dir.virtualDir);
+            std::error_code ec;
+            for (fs::directory_iterator it(dir.path, ec), end; !ec && it != end; it.increment(ec))
+            {
+                if ((++visited & 0x3FF) == 0 && cancel && cancel->IsCancelled()) return false;
+                const fs::directory_entry& entry = *it;
+                virtualPath.assign(dir.virtualDir);
+                AppendLowerAscii(virtualPath, entry.path().filename().string());
+                // The entry's cached type (d_type, or the find data on Windows) usually answers without a stat.
+                std::error_code typeEc;
+                if (entry.is_directory(typeEc))
+                {
+                    if (entry.is_symlink(typeEc)) continue; // not followed, as with recursive_directory_iterator
+                    virtualPath.push_back('/');
+                    if (CanHoldAssets(virtualPath)) pending.push_back(PendingDir{ entry.path(), virtualPath });
+                }
+                else if (collect && entry.is_regular_file(typeEc))
+                {
+                    fn(virtualPath);
+                }
+            }
+        }
+        return true;
+    }
 
     static std::string GetEnvironmentVariableUtf8(const char* name)
     {
@@ -70,234 +112,227 @@ namespace obbook
     #endif
     }
 
-    static std::string ReadBsaZString(std::ifstream& in)
+    BookCompiler::BookCompiler()
+        : assetIndex_(std::make_shared<AssetIndex>()), publishedAssetIndex_(assetIndex_)
     {
-        std::string out;
-        for (;;)
-        {
-            char c = 0;
-            if (!in.get(c)) break;
-            if (c == '\0') break;
-            out.push_back(c);
-        }
-        return out;
     }
 
-    struct BsaFolderRecord
+    void BookCompiler::SetSettings(const ProjectSettings& s) { settings_ = s; }
+    const ProjectSettings& BookCompiler::GetSettings() const { return settings_; }
+
+    void BookCompiler::SetSourceUtf8(const std::string& srcUtf8) { sourceUtf8_ = srcUtf8; }
+    const std::string& BookCompiler::GetSourceUtf8() const { return sourceUtf8_; }
+
+    void BookCompiler::SetOblivionDirectoryUtf8(const std::string& pathUtf8)
+    {
+        settings_.oblivionDirectoryUtf8 = pathUtf8;
+    }
+
+    const std::string& BookCompiler::GetResolvedDataDirectoryUtf8() const
     {
-        uint64_t hash{};
-        uint32_t fileCount{};
-        uint32_t offset{};
-    };
+        return resolvedDataDirUtf8_;
+    }
 
-    struct BsaFileRecord
+    std::shared_ptr<const AssetIndex> BookCompiler::GetAssetIndex() const
     {
-        uint64_t hash{};
-        uint32_t size{};
-        uint32_t offset{};
-    };
+        return publishedAssetIndex_.Load();
+    }
 
-    struct BsaHeader
+    const AssetPathSet& BookCompiler::GetTexturePaths() const
     {
-        uint32_t version{};
-        uint32_t dirOffset{};
-        uint32_t archiveFlags{};
-        uint32_t folderCount{};
-        uint32_t fileCount{};
-        uint32_t totalFolderNameLength{};
-        uint32_t totalFileNameLength{};
-        uint32_t fileFlags{};
+        return texturePaths_;
+    }
+
+    struct BuiltinDiagnostic
+    {
+        Diagnostic::Severity severity;
+        const char* message;
     };
 
-    static bool ReadExact(std::ifstream& in, void* dst, size_t size)
+    // Indexed by DiagnosticKind; the index doubles as the interned message id.
+    static const BuiltinDiagnostic kBuiltinDiagnostics[] =
     {
-        in.read(reinterpret_cast<char*>(dst), static_cast<std::streamsize>(size));
-        return static_cast<size_t>(in.gcount()) == size;
-    }
+        { Diagnostic::Severity::Warning, "Smart quote normalized to straight quote (\")" },
+        { Diagnostic::Severity::Warning, "Backslash normalized to forward slash in IMG src path" },
+        { Diagnostic::Severity::Error,   "IMG width exceeds safe maximum (default 490). Risk: crash on open." },
+        { Diagnostic::Severity::Info,    "Asset scan complete." },
+        { Diagnostic::Severity::Error,   "IMG texture not found in the Data folder or its archives." },
+        { Diagnostic::Severity::Warning, "IMG width/height distort the texture's aspect ratio." },
+    };
+    static_assert(sizeof(kBuiltinDiagnostics) / sizeof(kBuiltinDiagnostics[0]) == static_cast<size_t>(DiagnosticKind::Count));
 
-    static bool ReadBsaPaths(const fs::path& bsaPath, std::vector<std::string>& outPaths)
+    static const std::vector<std::string>& BuiltinMessageTable()
     {
-        enum : uint32_t
+        static const std::vector<std::string> table = []
         {
-            kArchiveFlagIncludeDirectoryNames = 0x1,
-            kArchiveFlagIncludeFileNames = 0x2,
-        };
-
-        std::ifstream in(bsaPath, std::ios::binary);
-        if (!in) return false;
+            std::vector<std::string> t;
+            for (const auto& b : kBuiltinDiagnostics) t.emplace_back(b.message);
+            return t;
+        }();
+        return table;
+    }
 
-        std::array<char, 4> magic{};
-        if (!ReadExact(in, magic.data(), magic.size())) return false;
-        if (std::memcmp(magic.data(), "BSA\0", 4) != 0) return false;
+    const std::string& GetBuiltinDiagnosticMessage(DiagnosticKind kind)
+    {
+        return BuiltinMessageTable()[static_cast<size_t>(kind)];
+    }
 
-        BsaHeader header{};
-        if (!ReadExact(in, &header, sizeof(header))) return false;
-        if (header.version != 103 && header.version != 104) return false;
-        if (header.folderCount == 0 || header.fileCount == 0) return true;
-        if (header.folderCount > 100000 || header.fileCount > 2000000) return false;
+    Diagnostic::Severity GetBuiltinDiagnosticSeverity(DiagnosticKind kind)
+    {
+        return kBuiltinDiagnostics[static_cast<size_t>(kind)].severity;
+    }
 
-        constexpr size_t kFolderRecordSize = sizeof(BsaFolderRecord);
-        constexpr size_t kFileRecordSize = sizeof(BsaFileRecord);
+    static void AppendDecimal(std::string& out, uint64_t value)
+    {
+        char digits[20];
+        const auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+        out.append(digits, static_cast<size_t>(end - digits));
+    }
 
-        std::vector<BsaFolderRecord> folders(header.folderCount);
-        in.seekg(static_cast<std::streamoff>(header.dirOffset), std::ios::beg);
-        for (auto& f : folders)
+    static uint64_t HashMessage(std::string_view text)
+    {
+        uint64_t h = 0xCBF29CE484222325ull;
+        for (const char c : text)
         {
-            if (!ReadExact(in, &f, sizeof(f))) return false;
-            if (f.fileCount > header.fileCount) return false;
+            h ^= static_cast<uint8_t>(c);
+            h *= 0x100000001B3ull;
         }
+        return h ^ (h >> 29);
+    }
 
-        std::vector<std::string> folderPrefixes;
-        folderPrefixes.reserve(header.fileCount);
-        uint64_t countedFiles = 0;
+    // Shared by every compiler, so a generation number never names two different results.
+    static uint64_t NextGeneration()
+    {
+        static std::atomic<uint64_t> next{ 1 };
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
 
-        if ((header.archiveFlags & kArchiveFlagIncludeDirectoryNames) == 0)
-            return false;
+    static TextRange MakeRange(size_t off, size_t len)
+    {
+        return { static_cast<uint32_t>(off), static_cast<uint32_t>(len) };
+    }
 
-        for (const auto& folder : folders)
-        {
-            uint8_t folderNameLen = 0;
-            if (!ReadExact(in, &folderNameLen, sizeof(folderNameLen))) return false;
+    void BookCompiler::ResetDiagnostics()
+    {
+        diags_.clear();
+        diagSummary_ = {};
+        dynamicMessageCount_ = 0;
+        std::fill(dynamicMessageSlots_.begin(), dynamicMessageSlots_.end(), 0u);
+    }
 
-            std::string folderName;
-            if (folderNameLen > 0)
-            {
-                folderName.resize(static_cast<size_t>(folderNameLen));
-                if (!ReadExact(in, folderName.data(), folderName.size())) return false;
+    void BookCompiler::PushDiag(DiagnosticKind kind, uint16_t messageId, TextRange source, TextRange normalized)
+    {
+        const auto k = static_cast<size_t>(kind);
+        const auto sev = kBuiltinDiagnostics[k].severity;
 
-                if (!folderName.empty() && folderName.back() == '\0')
-                    folderName.pop_back();
-            }
+        diagSummary_.total++;
+        diagSummary_.bySeverity[static_cast<size_t>(sev)]++;
+        diagSummary_.byKind[k]++;
 
-            const auto safeFolder = NormalizeVirtualPath(folderName);
-            for (uint32_t i = 0; i < folder.fileCount; ++i)
+        if (settings_.groupAdjacentDiagnostics && !diags_.empty())
+        {
+            auto& last = diags_.back();
+            // Adjacent means touching or overlapping the run in both texts; a gap starts a new record.
+            if (last.kind == kind && last.messageId == messageId && source.offset >= last.offset
+                && source.offset <= last.offset + last.length && normalized.offset >= last.normalizedOffset
+                && normalized.offset <= last.normalizedOffset + last.normalizedLength)
             {
-                BsaFileRecord fr{};
-                if (!ReadExact(in, &fr, sizeof(fr))) return false;
-                folderPrefixes.push_back(safeFolder);
+                last.length = std::max(last.offset + last.length, source.offset + source.length) - last.offset;
+                last.normalizedLength = std::max(last.normalizedOffset + last.normalizedLength, normalized.offset + normalized.length)
+                    - last.normalizedOffset;
+                last.count++;
+                return;
             }
-
-            countedFiles += folder.fileCount;
-            if (countedFiles > header.fileCount) return false;
         }
 
-        if (countedFiles != header.fileCount) return false;
-
-        if ((header.archiveFlags & kArchiveFlagIncludeFileNames) == 0)
-            return false;
-
-        const uint64_t namesOffset = static_cast<uint64_t>(header.dirOffset)
-            + static_cast<uint64_t>(header.folderCount) * static_cast<uint64_t>(kFolderRecordSize)
-            + static_cast<uint64_t>(header.totalFolderNameLength)
-            + static_cast<uint64_t>(header.fileCount) * static_cast<uint64_t>(kFileRecordSize);
-
-        in.seekg(static_cast<std::streamoff>(namesOffset), std::ios::beg);
-        if (!in) return false;
+        Diagnostic d{};
+        d.severity = sev;
+        d.kind = kind;
+        d.messageId = messageId;
+        d.offset = source.offset;
+        d.length = source.length;
+        d.normalizedOffset = normalized.offset;
+        d.normalizedLength = normalized.length;
+        diags_.push_back(d);
+    }
 
-        outPaths.reserve(outPaths.size() + folderPrefixes.size());
-        for (const auto& prefix : folderPrefixes)
-        {
-            std::string fileName = ReadBsaZString(in);
-            if (!in) return false;
-
-            auto fileNorm = NormalizeVirtualPath(fileName);
-            if (prefix.empty())
-                outPaths.push_back(std::move(fileNorm));
-            else
-                outPaths.push_back(prefix + "/" + fileNorm);
-        }
+    void BookCompiler::AddDiag(DiagnosticKind kind, size_t off, size_t len)
+    {
+        const TextRange normalized = MakeRange(off, len);
+        PushDiag(kind, static_cast<uint16_t>(kind), sourceMap_.ToSource(normalized), normalized);
+    }
 
-        return true;
+    // A full message table falls back to the kind's built-in text rather than let a 16-bit id wrap.
+    void BookCompiler::AddDiag(DiagnosticKind kind, size_t off, size_t len, std::string_view dynamicMessage)
+    {
+        const size_t slot = InternDynamicMessage(dynamicMessage);
+        const uint16_t messageId = slot == kNoDynamicMessage ? static_cast<uint16_t>(kind)
+            : static_cast<uint16_t>(static_cast<size_t>(DiagnosticKind::Count) + slot);
+        const TextRange normalized = MakeRange(off, len);
+        PushDiag(kind, messageId, sourceMap_.ToSource(normalized), normalized);
     }
 
-    // Minimal UTF-8 scan: returns codepoint and advances i.
-    static uint32_t NextUtf8(const std::string& s, size_t& i)
+    void BookCompiler::AddSourceDiag(DiagnosticKind kind, size_t sourceOff, size_t sourceLen)
     {
-        const unsigned char c = static_cast<unsigned char>(s[i]);
-        if (c < 0x80u) { i += 1; return c; }
-        if ((c >> 5) == 0x6 && i + 1 < s.size())
-        {
-            uint32_t cp = ((c & 0x1Fu) << 6) | (static_cast<unsigned char>(s[i+1]) & 0x3Fu);
-            i += 2; return cp;
-        }
-        if ((c >> 4) == 0xE && i + 2 < s.size())
-        {
-            uint32_t cp = ((c & 0x0Fu) << 12) |
-                          ((static_cast<unsigned char>(s[i+1]) & 0x3Fu) << 6) |
-                          ((static_cast<unsigned char>(s[i+2]) & 0x3Fu));
-            i += 3; return cp;
-        }
-        if ((c >> 3) == 0x1E && i + 3 < s.size())
-        {
-            uint32_t cp = ((c & 0x07u) << 18) |
-                          ((static_cast<unsigned char>(s[i+1]) & 0x3Fu) << 12) |
-                          ((static_cast<unsigned char>(s[i+2]) & 0x3Fu) << 6) |
-                          (static_cast<unsigned char>(s[i+3]) & 0x3Fu);
-            i += 4; return cp;
-        }
-        // Invalid; advance 1.
-        i += 1;
-        return 0xFFFDu;
+        const TextRange source = MakeRange(sourceOff, sourceLen);
+        PushDiag(kind, static_cast<uint16_t>(kind), source, sourceMap_.ToNormalized(source));
     }
 
-    static void AppendUtf8(std::string& out, uint32_t cp)
+    size_t BookCompiler::InternDynamicMessage(std::string_view text)
     {
-        if (cp < 0x80u) { out.push_back(static_cast<char>(cp)); return; }
-        if (cp < 0x800u)
-        {
-            out.push_back(static_cast<char>(0xC0u | (cp >> 6)));
-            out.push_back(static_cast<char>(0x80u | (cp & 0x3Fu)));
-            return;
-        }
-        if (cp < 0x10000u)
+        // Dynamic texts are interned per compile; identical texts share one id.
+        if ((dynamicMessageCount_ + 1) * 2 > dynamicMessageSlots_.size())
+            RehashDynamicMessages(dynamicMessageSlots_.empty() ? 16 : dynamicMessageSlots_.size() * 2);
+
+        const size_t mask = dynamicMessageSlots_.size() - 1;
+        for (size_t i = static_cast<size_t>(HashMessage(text)) & mask;; i = (i + 1) & mask)
         {
-            out.push_back(static_cast<char>(0xE0u | (cp >> 12)));
-            out.push_back(static_cast<char>(0x80u | ((cp >> 6) & 0x3Fu)));
-            out.push_back(static_cast<char>(0x80u | (cp & 0x3Fu)));
-            return;
+            const uint32_t slot = dynamicMessageSlots_[i];
+            if (slot != 0)
+            {
+                if (dynamicMessages_[slot - 1] == text) return slot - 1;
+                continue;
+            }
+            if (dynamicMessageCount_ == kMaxDynamicMessages) return kNoDynamicMessage;
+            if (dynamicMessageCount_ == dynamicMessages_.size()) dynamicMessages_.emplace_back();
+            dynamicMessages_[dynamicMessageCount_].assign(text);
+            dynamicMessageSlots_[i] = static_cast<uint32_t>(++dynamicMessageCount_);
+            return dynamicMessageCount_ - 1;
         }
-        out.push_back(static_cast<char>(0xF0u | (cp >> 18)));
-        out.push_back(static_cast<char>(0x80u | ((cp >> 12) & 0x3Fu)));
-        out.push_back(static_cast<char>(0x80u | ((cp >> 6) & 0x3Fu)));
-        out.push_back(static_cast<char>(0x80u | (cp & 0x3Fu)));
     }
 
-    BookCompiler::BookCompiler() = default;
-
-    void BookCompiler::SetSettings(const ProjectSettings& s) { settings_ = s; }
-    const ProjectSettings& BookCompiler::GetSettings() const { return settings_; }
-
-    void BookCompiler::SetSourceUtf8(const std::string& srcUtf8) { sourceUtf8_ = srcUtf8; }
-    const std::string& BookCompiler::GetSourceUtf8() const { return sourceUtf8_; }
-
-    void BookCompiler::SetOblivionDirectoryUtf8(const std::string& pathUtf8)
+    void BookCompiler::RehashDynamicMessages(size_t slotCount)
     {
-        settings_.oblivionDirectoryUtf8 = pathUtf8;
+        dynamicMessageSlots_.assign(slotCount, 0u);
+        const size_t mask = slotCount - 1;
+        for (size_t m = 0; m < dynamicMessageCount_; ++m)
+        {
+            size_t i = static_cast<size_t>(HashMessage(dynamicMessages_[m])) & mask;
+            while (dynamicMessageSlots_[i] != 0) i = (i + 1) & mask;
+            dynamicMessageSlots_[i] = static_cast<uint32_t>(m + 1);
+        }
     }
 
-    const std::string& BookCompiler::GetResolvedDataDirectoryUtf8() const
-    {
-        return resolvedDataDirUtf8_;
-    }
+    const DiagnosticSummary& BookCompiler::GetDiagnosticSummary() const { return diagSummary_; }
 
-    const std::vector<std::string>& BookCompiler::GetBookFontAssetsUtf8() const
+    const std::string& BookCompiler::GetDiagnosticMessage(const Diagnostic& d) const
     {
-        return bookFontAssetsUtf8_;
+        return GetDiagnosticMessage(d.messageId);
     }
 
-    const std::vector<std::string>& BookCompiler::GetBookTextureAssetsUtf8() const
+    const std::string& BookCompiler::GetDiagnosticMessage(uint16_t messageId) const
     {
-        return bookTextureAssetsUtf8_;
+        const auto& builtin = BuiltinMessageTable();
+        if (messageId < builtin.size()) return builtin[messageId];
+        const size_t slot = messageId - builtin.size();
+        if (slot < dynamicMessageCount_) return dynamicMessages_[slot];
+        static const std::string empty;
+        return empty;
     }
 
-    void BookCompiler::AddDiag(Diagnostic::Severity sev, size_t off, size_t len, const char* msg)
+    size_t BookCompiler::GetDiagnosticMessageCount() const
     {
-        Diagnostic d{};
-        d.severity = sev;
-        d.offset = off;
-        d.length = len;
-        d.message = msg ? msg : "";
-        diags_.push_back(std::move(d));
+        return BuiltinMessageTable().size() + dynamicMessageCount_;
     }
 
     static bool StartsWithNoCase(const std::string& s, size_t at, const char* lit)
@@ -317,9 +352,20 @@ namespace obbook
 
     void BookCompiler::DiscoverBookAssets()
     {
-        bookFontAssetsUtf8_.clear();
-        bookTextureAssetsUtf8_.clear();
+        DiscoverBookAssetsImpl(nullptr);
+        ReportMemory();
+    }
+
+    bool BookCompiler::DiscoverBookAssetsImpl(const CancellationToken* cancel)
+    {
+        OBBOOK_TRACE_SCOPE("DiscoverBookAssets");
+        // The current snapshot stays published until this scan completes; a cancelled scan leaves it in place.
+        texturePaths_.Clear();
+        textureSizes_.clear();
         resolvedDataDirUtf8_.clear();
+        assetFingerprint_ = 0;
+        assetsScanned_ = false;
+        auto cancelled = [cancel] { return cancel && cancel->IsCancelled(); };
 
         std::vector<fs::path> candidates;
         if (!settings_.oblivionDirectoryUtf8.empty())
@@ -338,187 +384,497 @@ namespace obbook
             break;
         }
 
-        if (resolvedDataDirUtf8_.empty()) return;
+        if (resolvedDataDirUtf8_.empty())
+        {
+            PublishAssetIndex(std::make_shared<const AssetIndex>());
+            assetsScanned_ = true;
+            scannedDirectoryUtf8_ = settings_.oblivionDirectoryUtf8;
+            return true;
+        }
 
         const fs::path dataDir = fs::path(resolvedDataDirUtf8_);
-        auto addVirtual = [&](const std::string& virtualPath, const std::string& source)
+        AssetIndexBuilder builder;
+        auto addVirtual = [&](const std::string& normalizedPath, AssetSourceId source)
         {
-            const auto p = NormalizeVirtualPath(virtualPath);
-            if (IsBookTexturePath(p))
-                bookTextureAssetsUtf8_.push_back(p + " [" + source + "]");
-            if (IsBookFontPath(p))
-                bookFontAssetsUtf8_.push_back(p + " [" + source + "]");
+            if (normalizedPath.rfind("textures/", 0) == 0) texturePaths_.Insert(normalizedPath);
+            if (IsBookTexturePath(normalizedPath) || IsBookFontPath(normalizedPath))
+                builder.Add(normalizedPath, source);
         };
 
-        for (auto root : { std::string("Textures"), std::string("Fonts") })
+        // Loose files override archive contents, so they get the highest-priority source id. Every loose texture
+        // goes into texturePaths_ for IMG lint, but only book textures and fonts into the index.
+        const AssetSourceId looseSource = builder.AddSource("loose");
         {
-            fs::path absRoot = dataDir / root;
-            if (!fs::exists(absRoot)) continue;
-            for (auto it = fs::recursive_directory_iterator(absRoot); it != fs::recursive_directory_iterator(); ++it)
-            {
-                if (!it->is_regular_file()) continue;
-                auto rel = fs::relative(it->path(), dataDir).string();
-                addVirtual(rel, "loose");
-            }
+            OBBOOK_TRACE_SCOPE("DiscoverBookAssets.LooseWalk");
+            if (!WalkLooseAssets(dataDir, cancel, [&](const std::string& p) { addVirtual(p, looseSource); })) return false;
         }
 
+        // Directory iteration order is unspecified; sort so source ids are stable between scans.
+        std::vector<fs::path> archives;
         for (const auto& entry : fs::directory_iterator(dataDir))
         {
             if (!entry.is_regular_file()) continue;
             auto ext = ToLowerAscii(entry.path().extension().string());
-            if (ext != ".bsa") continue;
+            if (ext == ".bsa") archives.push_back(entry.path());
+        }
+        std::sort(archives.begin(), archives.end());
 
-            std::vector<std::string> bsaPaths;
-            if (!ReadBsaPaths(entry.path(), bsaPaths)) continue;
-            const auto source = std::string("bsa:") + entry.path().filename().string();
-            for (const auto& p : bsaPaths) addVirtual(p, source);
+        std::vector<std::string> bsaPaths;
+        for (const auto& archive : archives)
+        {
+            if (cancelled()) return false;
+
+            const auto fileName = archive.filename().string();
+            OBBOOK_TRACE_SCOPE_DETAIL("DiscoverBookAssets.Bsa", fileName.c_str());
+            bsaPaths.clear();
+            if (!ReadBsaPaths(archive, bsaPaths)) continue;
+            const AssetSourceId source = builder.AddSource(std::string("bsa:") + fileName);
+            for (const auto& p : bsaPaths) addVirtual(NormalizeVirtualPath(p), source);
         }
 
-        auto dedupe = [](std::vector<std::string>& items)
+        PublishAssetIndex(std::make_shared<const AssetIndex>(builder.Build()));
+
+        // Everything the compile output depends on: the directory (it appears in the summary), the texture paths
+        // IMG references resolve against and the counts the summary reports.
+        Sha256 fingerprint;
+        fingerprint.Update(resolvedDataDirUtf8_);
+        const uint64_t scanShape[] = { texturePaths_.Fingerprint(), assetIndex_->EntryCount(), assetIndex_->NodeCount() };
+        fingerprint.Update(scanShape, sizeof(scanShape));
+        const Sha256::Digest digest = fingerprint.Finish();
+        std::memcpy(&assetFingerprint_, digest.data(), sizeof(assetFingerprint_));
+
+        assetsScanned_ = true;
+        scannedDirectoryUtf8_ = settings_.oblivionDirectoryUtf8;
+        return true;
+    }
+
+    // A rescan that found exactly what the last one did keeps the published snapshot, so holders can tell
+    // nothing changed by pointer (or generation) alone.
+    void BookCompiler::PublishAssetIndex(std::shared_ptr<const AssetIndex> index)
+    {
+        if (!DiffAssetIndexes(*assetIndex_, *index, nullptr)) return;
+        previousAssetIndex_ = std::move(assetIndex_);
+        assetIndex_ = std::move(index);
+        publishedAssetIndex_.Publish(assetIndex_);
+        previousAssetGeneration_ = assetGeneration_;
+        assetGeneration_ = NextGeneration();
+
+        // Counted once per snapshot for the scan summary: the .dds/.tga files IsBookTexturePath() accepts, so the
+        // fonts under fancy_font are not counted as textures too.
+        bookTextureCount_ = 0;
+        const AssetIndex& published = *assetIndex_;
+        const AssetNodeId book = published.NodeCount() == 0 ? kInvalidAssetNode : published.Find("textures/menus/book");
+        if (book == kInvalidAssetNode) return;
+        published.ForEachEntry(book, [&](AssetNodeId n)
         {
-            std::sort(items.begin(), items.end());
-            items.erase(std::unique(items.begin(), items.end()), items.end());
-        };
+            const std::string_view name = published.Segment(n);
+            const size_t dot = name.rfind('.');
+            if (dot != std::string_view::npos && (name.substr(dot) == ".dds" || name.substr(dot) == ".tga")) ++bookTextureCount_;
+        });
+    }
 
-        dedupe(bookFontAssetsUtf8_);
-        dedupe(bookTextureAssetsUtf8_);
+    void BookCompiler::InvalidateAssetScan()
+    {
+        assetsScanned_ = false;
+    }
+
+    void BookCompiler::SetCompileCache(CompileCache* cache)
+    {
+        compileCache_ = cache;
+    }
+
+    bool BookCompiler::LoadCachedResult(const Sha256::Digest& key)
+    {
+        CompileCacheEntry entry;
+        if (!compileCache_->Load(key, entry)) return false;
+
+        normalizedUtf8_.swap(entry.normalizedUtf8);
+        diags_.swap(entry.diagnostics);
+        for (const auto& e : entry.sourceMapEdits) sourceMap_.AddEdit(e.sourceOffset, e.sourceLength, e.normalizedOffset, e.normalizedLength);
+        diagSummary_ = entry.summary;
+        for (const auto& m : entry.dynamicMessages) InternDynamicMessage(m); // stored unique and in id order
+        return true;
+    }
+
+    void BookCompiler::StoreCachedResult(const Sha256::Digest& key) const
+    {
+        CompileCacheEntry entry;
+        entry.normalizedUtf8 = normalizedUtf8_;
+        entry.diagnostics = diags_;
+        entry.sourceMapEdits = sourceMap_.GetEdits();
+        entry.summary = diagSummary_;
+        entry.dynamicMessages.assign(dynamicMessages_.begin(), dynamicMessages_.begin() + static_cast<std::ptrdiff_t>(dynamicMessageCount_));
+        compileCache_->Store(key, entry);
     }
 
     void BookCompiler::Compile()
     {
-        diags_.clear();
-        normalizedUtf8_.clear();
+        CompileImpl(nullptr);
+        PublishDiagnostics();
+        ReportMemory();
+    }
+
+    bool BookCompiler::Compile(const CancellationToken& cancel)
+    {
+        const bool completed = CompileImpl(&cancel);
+        if (completed) PublishDiagnostics();
+        ReportMemory();
+        return completed;
+    }
+
+    uint64_t BookCompiler::GetDiagnosticsGeneration() const { return diagnosticsGeneration_; }
+    uint64_t BookCompiler::GetAssetGeneration() const { return assetGeneration_; }
 
-        // Normalize smart quotes to ASCII " and ' when requested.
-        // Also normalize backslashes to forward slashes inside IMG src=... attributes (v1 heuristic).
-        if (settings_.autoNormalizeSmartQuotes)
+    uint64_t BookCompiler::DiagnosticKey(const Diagnostic& d) const
+    {
+        uint64_t h = HashMessage(GetDiagnosticMessage(d));
+        const uint64_t fields[] =
         {
-            size_t i = 0;
-            size_t outOff = 0;
-            while (i < sourceUtf8_.size())
-            {
-                size_t inOff = i;
-                uint32_t cp = NextUtf8(sourceUtf8_, i);
-                if (IsSmartQuote(cp))
-                {
-                    // Convert curly quotes to straight quote.
-                    AppendUtf8(normalizedUtf8_, static_cast<uint32_t>('\"'));
-                    AddDiag(Diagnostic::Severity::Warning, inOff, i - inOff, "Smart quote normalized to straight quote (\")");
-                }
-                else
-                {
-                    AppendUtf8(normalizedUtf8_, cp);
-                }
-                (void)outOff;
-            }
+            static_cast<uint64_t>(d.kind) | (static_cast<uint64_t>(d.severity) << 8) | (static_cast<uint64_t>(d.count) << 32),
+            d.offset | (static_cast<uint64_t>(d.length) << 32),
+            d.normalizedOffset | (static_cast<uint64_t>(d.normalizedLength) << 32),
+        };
+        for (const uint64_t f : fields) h = (h ^ f) * 0x9E3779B97F4A7C15ull;
+        return h ^ (h >> 31);
+    }
+
+    // Digests the finished list and moves to a new generation only if it differs from the current one. Equal
+    // lists are compared in place and leave every buffer alone, so steady recompiles stay allocation-free. A
+    // 64-bit digest collision (odds 2^-64 per pair) would hide one change.
+    void BookCompiler::PublishDiagnostics()
+    {
+        bool same = diags_.size() == diagKeys_.size();
+        for (size_t i = 0; same && i < diags_.size(); ++i) same = DiagnosticKey(diags_[i]) == diagKeys_[i];
+        if (same) return;
+
+        previousDiagKeys_.swap(diagKeys_);
+        diagKeys_.clear();
+        for (const Diagnostic& d : diags_) diagKeys_.push_back(DiagnosticKey(d));
+        previousDiagnosticsGeneration_ = diagnosticsGeneration_;
+        diagnosticsGeneration_ = NextGeneration();
+    }
+
+    bool BookCompiler::GetDiagnosticsDelta(uint64_t sinceGeneration, DiagnosticsDelta& delta) const
+    {
+        delta.fromGeneration = sinceGeneration;
+        delta.toGeneration = diagnosticsGeneration_;
+        delta.reset = false;
+        delta.removed.clear();
+        delta.added.clear();
+        if (sinceGeneration == diagnosticsGeneration_) return false;
+        if (sinceGeneration != previousDiagnosticsGeneration_)
+        {
+            delta.reset = true;
+            for (uint32_t i = 0; i < diagKeys_.size(); ++i) delta.added.push_back(i);
+            return true;
         }
-        else
+
+        // Equal digests pair up in list order; the rest were removed or added.
+        using Keyed = std::pair<uint64_t, uint32_t>;
+        auto sorted = [](const std::vector<uint64_t>& keys)
+        {
+            std::vector<Keyed> out(keys.size());
+            for (uint32_t i = 0; i < keys.size(); ++i) out[i] = { keys[i], i };
+            std::sort(out.begin(), out.end());
+            return out;
+        };
+        const std::vector<Keyed> before = sorted(previousDiagKeys_);
+        const std::vector<Keyed> after = sorted(diagKeys_);
+        size_t i = 0, j = 0;
+        while (i < before.size() || j < after.size())
         {
-            normalizedUtf8_ = sourceUtf8_;
+            if (j == after.size() || (i < before.size() && before[i].first < after[j].first)) delta.removed.push_back(before[i++].second);
+            else if (i == before.size() || after[j].first < before[i].first) delta.added.push_back(after[j++].second);
+            else { ++i; ++j; }
         }
+        std::sort(delta.removed.begin(), delta.removed.end());
+        std::sort(delta.added.begin(), delta.added.end());
+        return true;
+    }
 
-        // Heuristic normalization for IMG src paths: replace '\\' with '/' inside src="...".
-        if (settings_.autoNormalizeSlashes)
+    bool BookCompiler::GetAssetDelta(uint64_t sinceGeneration, AssetDelta& delta) const
+    {
+        delta.fromGeneration = sinceGeneration;
+        delta.toGeneration = assetGeneration_;
+        delta.reset = false;
+        delta.entries = AssetIndexDiff{};
+        if (sinceGeneration == assetGeneration_) return false;
+        if (sinceGeneration == previousAssetGeneration_ && previousAssetIndex_)
         {
-            std::string out;
-            out.reserve(normalizedUtf8_.size());
-            bool inSrc = false;
-            bool inQuote = false;
+            DiffAssetIndexes(*previousAssetIndex_, *assetIndex_, &delta.entries);
+            return true;
+        }
+        delta.reset = true;
+        const AssetIndex& index = *assetIndex_;
+        if (index.NodeCount() != 0) index.ForEachEntry(AssetIndex::kRoot, [&](AssetNodeId n) { delta.entries.added.push_back(index.Path(n)); });
+        return true;
+    }
 
-            for (size_t i = 0; i < normalizedUtf8_.size(); i++)
-            {
-                if (!inSrc)
-                {
-                    if (StartsWithNoCase(normalizedUtf8_, i, "<img"))
-                    {
-                        inSrc = true;
-                        out.push_back(normalizedUtf8_[i]);
-                    }
-                    else
-                    {
-                        out.push_back(normalizedUtf8_[i]);
-                    }
-                    continue;
-                }
+    uint64_t BookCompiler::GetMemoryBytes(MemorySubsystem subsystem) const
+    {
+        if (subsystem == MemorySubsystem::AssetIndex) return assetMemory_.GetBytes();
+        if (subsystem == MemorySubsystem::CompileBuffers) return compileMemory_.GetBytes();
+        return 0;
+    }
 
-                // inside <IMG ... >
-                char c = normalizedUtf8_[i];
-                out.push_back(c);
+    // Capacities only, so this stays cheap and allocation-free on the compile path. The asset index snapshot
+    // counts here even when other threads hold it too; it is only freed once they let go of it as well.
+    void BookCompiler::ReportMemory()
+    {
+        size_t assets = assetIndex_->MemoryBytes() + (previousAssetIndex_ ? previousAssetIndex_->MemoryBytes() : 0) + texturePaths_.MemoryBytes() + HeapBytes(resolvedDataDirUtf8_)
+            + HeapBytes(scannedDirectoryUtf8_) + textureSizes_.bucket_count() * sizeof(void*);
+        // Per node: the key and value plus the next pointer and cached hash of a typical node-based map.
+        for (const auto& [path, size] : textureSizes_)
+            assets += sizeof(std::pair<const std::string, TextureSize>) + 2 * sizeof(void*) + HeapBytes(path);
+        assetMemory_.Report(assets);
+
+        compileMemory_.Report(HeapBytes(sourceUtf8_) + HeapBytes(normalizedUtf8_) + sourceMap_.GetRetainedBytes()
+            + HeapBytes(diags_) + HeapBytes(dynamicMessages_) + HeapBytes(dynamicMessageSlots_) + HeapBytes(slashFixOffsets_)
+            + HeapBytes(messageScratch_) + HeapBytes(pathScratch_) + HeapBytes(imgRefs_)
+            + HeapBytes(diagKeys_) + HeapBytes(previousDiagKeys_));
+    }
 
-                if (c == '>' ) { inSrc = false; inQuote = false; continue; }
+    // Same result as fixing quotes over the whole source and then slashes over that output, in one pass: the
+    // slash state machine is fed each byte as it is emitted. Bytes that cannot change any enabled fix's state
+    // (per kCharClasses) are copied in bulk. Edits that change the length go into sourceMap_ as they are made.
+    // Quote diagnostics are added as found; slash fixes are collected in normalized offsets for the caller to
+    // add after them.
+    template <bool kQuotes, bool kSlashes>
+    bool BookCompiler::NormalizeSource(const CancellationToken* cancel)
+    {
+        constexpr size_t kCancelPollBytes = 0x4000;
+        const std::string& src = sourceUtf8_;
+        std::string& out = normalizedUtf8_;
+        out.clear();
+        out.reserve(src.size());
+        sourceMap_.Clear();
+        slashFixOffsets_.clear();
+
+        bool inImg = false;   // inside an "<img" tag
+        bool inQuote = false; // inside a quoted value of that tag
+        auto feed = [&](size_t at)
+        {
+            const char c = out[at];
+            if (!inImg)
+            {
+                // "<img" is recognized on its last letter; 'i' and 'm' would have had no effect inside the tag.
+                inImg = (CharClassOf(c) & kCharTagLast) != 0 && at >= 3 && out[at - 3] == '<'
+                    && (out[at - 2] | 0x20) == 'i' && (out[at - 1] | 0x20) == 'm';
+                return;
+            }
+            if (c == '>')
+            {
+                inImg = false;
+                inQuote = false;
+            }
+            else if (c == '"')
+            {
+                inQuote = !inQuote;
+            }
+            else if (c == '\\' && inQuote)
+            {
+                out[at] = '/';
+                slashFixOffsets_.push_back(static_cast<uint32_t>(at));
+            }
+        };
 
-                // detect src=
-                if (StartsWithNoCase(normalizedUtf8_, i, "src="))
+        const char* p = src.data();
+        const size_t size = src.size();
+        size_t i = 0;
+        while (i < size)
+        {
+            if (cancel && cancel->IsCancelled()) return false;
+            const size_t chunkEnd = std::min(size, i + kCancelPollBytes);
+            while (i < chunkEnd)
+            {
+                const uint8_t stop = (kQuotes ? kCharNonAscii : 0)
+                    | (kSlashes ? (inImg ? kCharTagEnd | kCharQuote | kCharBackslash : kCharTagLast) : 0);
+                size_t run = i;
+                while (run < chunkEnd && (CharClassOf(p[run]) & stop) == 0) ++run;
+                out.append(p + i, run - i);
+                i = run;
+                if (i >= chunkEnd) break;
+
+                if (kQuotes && (CharClassOf(p[i]) & kCharNonAscii) != 0)
                 {
-                    // emit current char already; let normal flow continue
-                    continue;
+                    const size_t inOff = i;
+                    const uint32_t cp = DecodeUtf8(p, size, i);
+                    const size_t emitted = out.size();
+                    if (IsSmartQuote(cp))
+                        out.push_back('"');
+                    else
+                        AppendUtf8(out, cp); // re-encodes malformed sequences, as U+FFFD or as decoded
+                    sourceMap_.AddEdit(inOff, i - inOff, emitted, out.size() - emitted);
+                    if (IsSmartQuote(cp)) AddSourceDiag(DiagnosticKind::SmartQuoteNormalized, inOff, i - inOff);
+                    if constexpr (kSlashes)
+                        for (size_t k = emitted; k < out.size(); ++k) feed(k);
                 }
-
-                if (c == '\"') inQuote = !inQuote;
-
-                if (inQuote && c == '\\')
+                else
                 {
-                    out.back() = '/';
-                    AddDiag(Diagnostic::Severity::Warning, i, 1, "Backslash normalized to forward slash in IMG src path");
+                    out.push_back(p[i++]);
+                    feed(out.size() - 1);
                 }
             }
+        }
+        return true;
+    }
+
+    bool BookCompiler::CompileImpl(const CancellationToken* cancel)
+    {
+        OBBOOK_TRACE_SCOPE("Compile");
+        ResetDiagnostics();
+        normalizedUtf8_.clear();
+        sourceMap_.Clear();
+
+        // Polled every 16 KiB inside the passes and at every pass boundary.
+        constexpr size_t kCancelPollMask = 0x3FFF;
+        auto cancelled = [cancel] { return cancel && cancel->IsCancelled(); };
+        if (cancelled()) return false;
+
+        auto needsScan = [this] { return !assetsScanned_ || scannedDirectoryUtf8_ != settings_.oblivionDirectoryUtf8; };
 
-            normalizedUtf8_.swap(out);
+        // The asset scan is part of the cache key, so with a cache it runs before anything else.
+        Sha256::Digest cacheKey{};
+        if (compileCache_)
+        {
+            if (needsScan() && !DiscoverBookAssetsImpl(cancel)) return false;
+            cacheKey = CompileCache::MakeKey(sourceUtf8_, settings_, assetFingerprint_);
+            if (LoadCachedResult(cacheKey)) return true;
+            if (cancelled()) return false;
         }
 
-        // Validate IMG width cap (simple regex-ish scan).
-        const std::string& s = normalizedUtf8_;
-        for (size_t i = 0; i + 4 < s.size(); i++)
+        // Normalize smart quotes to ASCII " when requested, and backslashes to forward slashes inside quoted
+        // IMG attribute values (v1 heuristic). One pass, specialized for the enabled fixes.
         {
-            if (!StartsWithNoCase(s, i, "<img")) continue;
+            OBBOOK_TRACE_SCOPE("Compile.Normalize");
+            using Kernel = bool (BookCompiler::*)(const CancellationToken*);
+            static constexpr Kernel kKernels[4] =
+            {
+                &BookCompiler::NormalizeSource<false, false>,
+                &BookCompiler::NormalizeSource<false, true>,
+                &BookCompiler::NormalizeSource<true, false>,
+                &BookCompiler::NormalizeSource<true, true>,
+            };
+            const size_t kernel = (settings_.autoNormalizeSmartQuotes ? 2u : 0u) | (settings_.autoNormalizeSlashes ? 1u : 0u);
+            if (!(this->*kKernels[kernel])(cancel)) return false;
+            for (const uint32_t off : slashFixOffsets_) AddDiag(DiagnosticKind::BackslashNormalized, off, 1);
+        }
 
-            size_t j = i;
-            while (j < s.size() && s[j] != '>') j++;
-            if (j >= s.size()) break;
+        if (cancelled()) return false;
 
-            // scan for "width="
-            size_t k = i;
-            while (k < j)
+        // Validate IMG width cap (simple regex-ish scan) and record every tag for the reference lint.
+        const std::string& s = normalizedUtf8_;
+        imgRefs_.clear();
+        {
+            OBBOOK_TRACE_SCOPE("Compile.ValidateImgWidth");
+            for (size_t i = 0; i + 4 < s.size(); i++)
             {
-                if (StartsWithNoCase(s, k, "width="))
+                if ((i & kCancelPollMask) == 0 && cancelled()) return false;
+                if (!StartsWithNoCase(s, i, "<img")) continue;
+
+                size_t j = i;
+                while (j < s.size() && s[j] != '>') j++;
+                if (j >= s.size()) break;
+
+                const auto attrs = ScanImgTag(std::string_view(s).substr(i, j + 1 - i), [&](uint32_t val, size_t off, size_t len)
+                {
+                    if (val > settings_.maxImageWidth) AddDiag(DiagnosticKind::ImgWidthExceeded, i + off, len);
+                });
+
+                ImgRef ref{};
+                ref.tagOffset = static_cast<uint32_t>(i);
+                ref.tagLength = static_cast<uint32_t>(j + 1 - i);
+                ref.width = attrs.width;
+                ref.height = attrs.height;
+                if (attrs.srcLength != 0)
                 {
-                    k += 6;
-                    // optional quote
-                    bool q = false;
-                    if (k < j && s[k] == '\"') { q = true; k++; }
-
-                    int val = 0;
-                    size_t start = k;
-                    while (k < j && s[k] >= '0' && s[k] <= '9')
-                    {
-                        val = val * 10 + (s[k] - '0');
-                        k++;
-                    }
-                    if (q && k < j && s[k] == '\"') k++;
-
-                    if (val > static_cast<int>(settings_.maxImageWidth))
-                    {
-                        AddDiag(Diagnostic::Severity::Error, start, (k>start? (k-start):1), "IMG width exceeds safe maximum (default 490). Risk: crash on open.");
-                    }
+                    ref.srcOffset = static_cast<uint32_t>(i + attrs.srcOffset);
+                    ref.srcLength = static_cast<uint32_t>(attrs.srcLength);
                 }
-                k++;
+                imgRefs_.push_back(ref);
+                i = j;
             }
-
-            i = j;
         }
 
-        DiscoverBookAssets();
+        if (cancelled()) return false;
+
+        if (needsScan() && !DiscoverBookAssetsImpl(cancel)) return false;
+
+        if (settings_.lintImageReferences && !LintImageReferences(cancel)) return false;
+
         if (!resolvedDataDirUtf8_.empty())
         {
-            std::ostringstream oss;
-            oss << "Asset scan complete. Fonts=" << bookFontAssetsUtf8_.size()
-                << ", Textures=" << bookTextureAssetsUtf8_.size()
-                << ", DataDir=" << resolvedDataDirUtf8_;
-            AddDiag(Diagnostic::Severity::Info, 0, 0, oss.str().c_str());
+            const AssetIndex& index = *assetIndex_;
+            auto countUnder = [&index](std::string_view path)
+            {
+                const AssetNodeId node = index.Find(path);
+                return node == kInvalidAssetNode ? 0u : index.EntryCountUnder(node);
+            };
+            std::string& msg = messageScratch_;
+            msg.assign("Asset scan complete. Fonts=");
+            AppendDecimal(msg, countUnder("fonts") + countUnder("textures/menus/book/fancy_font"));
+            msg.append(", Textures=");
+            AppendDecimal(msg, bookTextureCount_);
+            msg.append(", DataDir=").append(resolvedDataDirUtf8_);
+            AddDiag(DiagnosticKind::AssetScanSummary, 0, 0, msg);
+        }
+
+        if (compileCache_) StoreCachedResult(cacheKey);
+        return true;
+    }
+
+    bool BookCompiler::LintImageReferences(const CancellationToken* cancel)
+    {
+        if (resolvedDataDirUtf8_.empty() || imgRefs_.empty()) return true;
+        OBBOOK_TRACE_SCOPE("Compile.LintImgRefs");
+
+        // One hashed lookup per tag; texture headers are read once per path and scan.
+        const std::string& s = normalizedUtf8_;
+        for (size_t r = 0; r < imgRefs_.size(); ++r)
+        {
+            if ((r & 0x3F) == 0 && cancel && cancel->IsCancelled()) return false;
+            const ImgRef& ref = imgRefs_[r];
+            if (ref.srcLength == 0) continue;
+
+            std::string& path = pathScratch_;
+            ToTextureVirtualPath(std::string_view(s).substr(ref.srcOffset, ref.srcLength), path);
+            std::string& msg = messageScratch_;
+            if (!texturePaths_.Contains(path))
+            {
+                msg.assign("IMG texture not found: ").append(path);
+                AddDiag(DiagnosticKind::ImgTextureMissing, ref.srcOffset, ref.srcLength, msg);
+                continue;
+            }
+            if (ref.width == 0 || ref.height == 0) continue;
+
+            auto [it, inserted] = textureSizes_.try_emplace(path);
+            if (inserted && !ReadTextureSize(resolvedDataDirUtf8_, path, it->second.width, it->second.height))
+                it->second = {};
+            const TextureSize t = it->second;
+            if (t.width == 0 || t.height == 0) continue;
+
+            // More than 2% apart: width/height cross-multiplied against the texture's own ratio.
+            const uint64_t declared = static_cast<uint64_t>(ref.width) * t.height;
+            const uint64_t actual = static_cast<uint64_t>(ref.height) * t.width;
+            if (declared * 50 > actual * 51 || actual * 50 > declared * 51)
+            {
+                msg.assign("IMG ");
+                AppendDecimal(msg, ref.width);
+                msg.push_back('x');
+                AppendDecimal(msg, ref.height);
+                msg.append(" distorts ").append(path).append(" (");
+                AppendDecimal(msg, t.width);
+                msg.push_back('x');
+                AppendDecimal(msg, t.height);
+                msg.push_back(')');
+                AddDiag(DiagnosticKind::ImgAspectMismatch, ref.tagOffset, ref.tagLength, msg);
+            }
         }
+        return true;
     }
 
     const std::string& BookCompiler::GetNormalizedSourceUtf8() const { return normalizedUtf8_; }
+    const SourceMap& BookCompiler::GetSourceMap() const { return sourceMap_; }
     const std::vector<Diagnostic>& BookCompiler::GetDiagnostics() const { return diags_; }
 
     std::string BookCompiler::ExportDescUtf8() const
@@ -1,20 +1,77 @@
 #pragma once
+#include <atomic>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include <cstdint>
 
+#include "ObBookAssetIndex.h"
+#include "ObBookMemory.h"
+#include "ObBookSha256.h"
+#include "ObBookSourceMap.h"
+
 namespace obbook
 {
+    class CompileCache;
+
+    enum class DiagnosticKind : uint8_t
+    {
+        SmartQuoteNormalized = 0,
+        BackslashNormalized = 1,
+        ImgWidthExceeded = 2,
+        AssetScanSummary = 3,
+        ImgTextureMissing = 4,
+        ImgAspectMismatch = 5,
+        Count
+    };
+
+    // Compact record; the text lives in the compiler's message table (BookCompiler::GetDiagnosticMessage).
     struct Diagnostic
     {
         enum class Severity : uint8_t { Info=0, Warning=1, Error=2 };
 
         Severity severity{};
-        size_t   offset{};
-        size_t   length{};
-        std::string message;
+        DiagnosticKind kind{};
+        uint16_t messageId{};        // the kind's built-in text once a compile has run out of dynamic message ids
+        uint32_t offset{};           // in the source text, i.e. editor coordinates
+        uint32_t length{};
+        uint32_t count = 1;          // >1 for a run of grouped same-kind diagnostics; the ranges then cover the run
+        uint32_t normalizedOffset{}; // the same range in the normalized text (see BookCompiler::GetSourceMap())
+        uint32_t normalizedLength{};
     };
 
+    struct DiagnosticSummary
+    {
+        uint32_t total{}; // individual findings, i.e. grouped runs count once per member
+        uint32_t bySeverity[3]{};
+        uint32_t byKind[static_cast<size_t>(DiagnosticKind::Count)]{};
+    };
+
+    // What changed in a compiler's diagnostics between two generations (BookCompiler::GetDiagnosticsDelta).
+    struct DiagnosticsDelta
+    {
+        uint64_t fromGeneration{};
+        uint64_t toGeneration{};
+        bool reset = false;            // fromGeneration is not known: drop what is shown; added lists everything
+        std::vector<uint32_t> removed; // indexes into the list of fromGeneration, ascending
+        std::vector<uint32_t> added;   // indexes into GetDiagnostics(), ascending
+    };
+
+    // What changed in a compiler's asset index between two generations (BookCompiler::GetAssetDelta).
+    struct AssetDelta
+    {
+        uint64_t fromGeneration{};
+        uint64_t toGeneration{};
+        bool reset = false; // fromGeneration is not known: entries.added lists every entry
+        AssetIndexDiff entries;
+    };
+
+    // Text and severity of a built-in diagnostic kind (the message for messageId == kind).
+    const std::string& GetBuiltinDiagnosticMessage(DiagnosticKind kind);
+    Diagnostic::Severity GetBuiltinDiagnosticSeverity(DiagnosticKind kind);
+
     struct ProjectSettings
     {
         // Export governance defaults
@@ -23,10 +80,30 @@ namespace obbook
         bool autoNormalizeSmartQuotes = true;
         bool autoNormalizeSlashes = true;
 
+        // Resolve every IMG src against the scanned Data folder: missing textures and width/height that
+        // distort the texture's aspect ratio are reported. Skipped when no Data folder was found.
+        bool lintImageReferences = true;
+
+        // Collapse consecutive diagnostics of the same kind whose ranges touch or overlap into one record with a
+        // count.
+        bool groupAdjacentDiagnostics = false;
+
         // Optional Oblivion installation path. Can point at either the game root or Data folder.
         std::string oblivionDirectoryUtf8;
     };
 
+    // Cooperative cancellation flag; Compile() polls it between passes and periodically inside them.
+    class CancellationToken
+    {
+    public:
+        void Cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+        void Reset() { cancelled_.store(false, std::memory_order_relaxed); }
+        bool IsCancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<bool> cancelled_{ false };
+    };
+
     // Minimal, stable "compiler" surface for v1.
     // Later: AST, style stack, page model, exporter variants.
     class BookCompiler
@@ -42,12 +119,27 @@ namespace obbook
         const std::string& GetSourceUtf8() const;
 
         // Returns the normalized source (auto-fixes applied) and diagnostics.
-        // v1: performs basic normalization and hazard detection (quotes, slashes, IMG width).
-        // Also refreshes book font/texture discovery from loose files and BSA archives.
+        // v1: performs basic normalization and hazard detection (quotes, slashes, IMG width and references).
+        // Book font/texture discovery runs on the first compile and whenever the Oblivion directory
+        // setting changes; call DiscoverBookAssets() to rescan now or InvalidateAssetScan() to rescan on the
+        // next compile (where it is cancellable).
+        // Buffers are retained between compiles: once a compile of similarly sized input has run, further ones
+        // make no heap allocations unless a compile cache is set, assets are rescanned or an IMG names a texture
+        // whose header has not been read yet.
         void Compile();
 
+        // As Compile(), but returns false as soon as cancellation is observed. Outputs are then incomplete.
+        bool Compile(const CancellationToken& cancel);
+
         const std::string& GetNormalizedSourceUtf8() const;
+        // Offsets between the last compiled source and its normalized text, e.g. to move the editor caret to a
+        // preview position and back without recompiling.
+        const SourceMap& GetSourceMap() const;
         const std::vector<Diagnostic>& GetDiagnostics() const;
+        const DiagnosticSummary& GetDiagnosticSummary() const;
+        const std::string& GetDiagnosticMessage(const Diagnostic& d) const;
+        const std::string& GetDiagnosticMessage(uint16_t messageId) const;
+        size_t GetDiagnosticMessageCount() const;
 
         // Export string suitable to paste into DESC. For v1 this is identical to normalized source.
         // Later: enforce CP1252 mapping and produce safe DESC bytes.
@@ -55,20 +147,120 @@ namespace obbook
 
         void SetOblivionDirectoryUtf8(const std::string& pathUtf8);
         const std::string& GetResolvedDataDirectoryUtf8() const;
-        const std::vector<std::string>& GetBookFontAssetsUtf8() const;
-        const std::vector<std::string>& GetBookTextureAssetsUtf8() const;
+        // Book textures (textures/menus/book/...) and fonts (fonts/..., book/fancy_font/...) found by the last
+        // scan. Source 0 is "loose"; archives follow as "bsa:<file>" in file-name order. Never null; the
+        // snapshot is immutable, so it can be shared with other threads. Unlike the rest of the compiler, this
+        // may be called from any thread, also while Compile() or DiscoverBookAssets() runs on the owning one:
+        // it returns the last published snapshot until the scan publishes the next.
+        std::shared_ptr<const AssetIndex> GetAssetIndex() const;
+        // Every texture (textures/...) found by the last scan, book or not; used to resolve IMG references.
+        const AssetPathSet& GetTexturePaths() const;
+
+        // Rescans the loose texture and font folders and the BSA archives under the resolved Data folder. The next
+        // index is built aside; GetAssetIndex() callers on other threads keep the previous snapshot until it is
+        // published.
+        void DiscoverBookAssets();
+        void InvalidateAssetScan();
+
+        // Optional persistent result cache (not owned; may be shared with other compilers). With one set, Compile()
+        // scans assets first, then reuses a stored result for the same source, settings and asset scan instead
+        // of compiling. The scan is fingerprinted by paths and counts, not file contents: after editing a
+        // texture in place, clear the cache directory or bump kCompilerVersion.
+        void SetCompileCache(CompileCache* cache);
+
+        // Generations name one diagnostics list and one asset index snapshot, so a host can skip marshalling and
+        // UI updates when they did not change. A completed compile or scan that produces what the last one did
+        // keeps its generation (and, for assets, the very same snapshot); a cancelled one leaves it alone. Numbers
+        // come from one process-wide counter, so they never repeat across compilers; 0 is the empty state before
+        // anything was found.
+        uint64_t GetDiagnosticsGeneration() const;
+        uint64_t GetAssetGeneration() const;
+        // Changes since sinceGeneration. One step back is kept: the current generation gives an empty delta and
+        // the one before it a real one; anything else (older, or another compiler's) is a reset that lists
+        // everything. False when nothing changed. Diagnostics are matched on kind, ranges, count and message
+        // text, so an edit shifts every diagnostic after it into removed and added.
+        bool GetDiagnosticsDelta(uint64_t sinceGeneration, DiagnosticsDelta& delta) const;
+        bool GetAssetDelta(uint64_t sinceGeneration, AssetDelta& delta) const;
+
+        // Bytes this compiler retains for a subsystem (AssetIndex or CompileBuffers; 0 for the others) as of
+        // the last Compile() or DiscoverBookAssets(). The same bytes are in the process-wide GetMemoryStats().
+        uint64_t GetMemoryBytes(MemorySubsystem subsystem) const;
 
     private:
         ProjectSettings settings_{};
         std::string sourceUtf8_;
         std::string normalizedUtf8_;
+        SourceMap sourceMap_;
         std::vector<Diagnostic> diags_;
+        DiagnosticSummary diagSummary_{};
+        // Per-compile texts, ids start after the built-in kinds. The strings are pooled: only the first
+        // dynamicMessageCount_ are live, the rest keep their capacity for the next compile.
+        std::vector<std::string> dynamicMessages_;
+        size_t dynamicMessageCount_ = 0;
+        std::vector<uint32_t> dynamicMessageSlots_; // open-addressed text -> index + 1 (0 = empty), at most half full
+
+        // Retained between compiles so a steady stream of similar inputs does not touch the heap.
+        std::vector<uint32_t> slashFixOffsets_; // backslashes fixed by the last normalization (normalized offsets)
+        std::string messageScratch_;   // dynamic message being formatted
+        std::string pathScratch_;      // IMG src resolved to a texture path
+
+        // IMG tags of the last compile, in source order (offsets into the normalized source).
+        struct ImgRef
+        {
+            uint32_t tagOffset{};
+            uint32_t tagLength{};
+            uint32_t srcOffset{};
+            uint32_t srcLength{};
+            uint32_t width{};  // 0 when absent
+            uint32_t height{};
+        };
+        std::vector<ImgRef> imgRefs_;
+
+        // One 64-bit digest per diagnostic, for the generation check and deltas; the two buffers swap.
+        uint64_t diagnosticsGeneration_ = 0;
+        uint64_t previousDiagnosticsGeneration_ = 0;
+        std::vector<uint64_t> diagKeys_;
+        std::vector<uint64_t> previousDiagKeys_;
 
         std::string resolvedDataDirUtf8_;
-        std::vector<std::string> bookFontAssetsUtf8_;
-        std::vector<std::string> bookTextureAssetsUtf8_;
+        std::shared_ptr<const AssetIndex> assetIndex_; // the owning thread's reference; compiles read it without atomics
+        AssetIndexPublisher publishedAssetIndex_;       // the same snapshot, for GetAssetIndex() on any thread
+        std::shared_ptr<const AssetIndex> previousAssetIndex_; // the snapshot of previousAssetGeneration_
+        uint64_t assetGeneration_ = 0;
+        uint64_t previousAssetGeneration_ = 0;
+        uint32_t bookTextureCount_ = 0; // textures/menus/book/ .dds and .tga entries of assetIndex_
+        AssetPathSet texturePaths_;
+        struct TextureSize { uint32_t width{}; uint32_t height{}; }; // 0 x 0 when the header was unreadable
+        std::unordered_map<std::string, TextureSize> textureSizes_; // IMG targets read since the last scan
+        bool assetsScanned_ = false;
+        std::string scannedDirectoryUtf8_; // settings_.oblivionDirectoryUtf8 at the last completed scan
+        uint64_t assetFingerprint_{};      // digest of the last scan; part of the compile cache key
+        CompileCache* compileCache_ = nullptr;
 
-        void AddDiag(Diagnostic::Severity sev, size_t off, size_t len, const char* msg);
-        void DiscoverBookAssets();
+        MemoryAccount assetMemory_{ MemorySubsystem::AssetIndex };
+        MemoryAccount compileMemory_{ MemorySubsystem::CompileBuffers };
+
+        bool CompileImpl(const CancellationToken* cancel);
+        template <bool kQuotes, bool kSlashes>
+        bool NormalizeSource(const CancellationToken* cancel);
+        bool LoadCachedResult(const Sha256::Digest& key);
+        void StoreCachedResult(const Sha256::Digest& key) const;
+        bool DiscoverBookAssetsImpl(const CancellationToken* cancel);
+        void PublishAssetIndex(std::shared_ptr<const AssetIndex> index);
+        void PublishDiagnostics();
+        uint64_t DiagnosticKey(const Diagnostic& d) const;
+        bool LintImageReferences(const CancellationToken* cancel);
+        void ResetDiagnostics();
+        void PushDiag(DiagnosticKind kind, uint16_t messageId, TextRange source, TextRange normalized);
+        // off/len are in the normalized text unless noted; the other range comes from sourceMap_.
+        void AddDiag(DiagnosticKind kind, size_t off, size_t len);
+        void AddDiag(DiagnosticKind kind, size_t off, size_t len, std::string_view dynamicMessage);
+        void AddSourceDiag(DiagnosticKind kind, size_t sourceOff, size_t sourceLen);
+        // Ids are 16-bit, so at most kMaxDynamicMessages distinct texts per compile; kNoDynamicMessage once full.
+        static constexpr size_t kMaxDynamicMessages = 0x10000 - static_cast<size_t>(DiagnosticKind::Count);
+        static constexpr size_t kNoDynamicMessage = static_cast<size_t>(-1);
+        size_t InternDynamicMessage(std::string_view text);
+        void RehashDynamicMessages(size_t slotCount);
+        void ReportMemory();
     };
 }
@@ -0,0 +1,193 @@
+#include "ObBookGolden.h"
+#include "ObBookPng.h"
+#include "ObBookTrace.h"
+#include "ObBookWorkers.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+
+namespace fs = std::filesystem;
+
+namespace obbook
+{
+    static constexpr const char* kTimingsFile = "timings.tsv";
+
+    static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static std::string PageFileName(uint32_t page, const char* suffix)
+    {
+        char name[48];
+        std::snprintf(name, sizeof(name), "page_%04u%s.png", page + 1, suffix);
+        return name;
+    }
+
+    static std::map<std::string, double> ReadTimings(const fs::path& file)
+    {
+        std::map<std::string, double> timings;
+        std::ifstream in(file);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            const size_t tab = line.find('\t');
+            if (tab == std::string::npos || tab == 0) continue;
+            timings[line.substr(0, tab)] = std::strtod(line.c_str() + tab + 1, nullptr);
+        }
+        return timings;
+    }
+
+    static bool WriteTimings(const fs::path& file, const std::map<std::string, double>& timings)
+    {
+        std::ofstream out(file, std::ios::trunc);
+        char value[32];
+        for (const auto& [name, ms] : timings)
+        {
+            std::snprintf(value, sizeof(value), "\t%.3f\n", ms);
+            out << name << value;
+        }
+        return static_cast<bool>(out);
+    }
+
+    // Golden pages are numbered from 1 without gaps.
+    static uint32_t CountGoldenPages(const fs::path& directory)
+    {
+        std::error_code ec;
+        uint32_t pages = 0;
+        while (fs::is_regular_file(directory / PageFileName(pages, ""), ec)) ++pages;
+        return pages;
+    }
+
+    static bool WritePng(const fs::path& file, PngEncoder& encoder, const uint8_t* bgra, uint32_t width, uint32_t height,
+        std::vector<uint8_t>& png)
+    {
+        if (!encoder.Encode(bgra, width, height, static_cast<size_t>(width) * 4, PngOptions{}, png)) return false;
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        return out && out.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+    }
+
+    void RunGoldenPages(const std::vector<GoldenCase>& cases, const GlyphAtlas& atlas, const GoldenOptions& options,
+        GoldenReport& report)
+    {
+        OBBOOK_TRACE_SCOPE("Golden.Run");
+        const auto start = std::chrono::steady_clock::now();
+        report = GoldenReport{};
+        report.cases.resize(cases.size());
+
+        const fs::path goldenDir(options.goldenDirUtf8);
+        const fs::path outputDir(options.outputDirUtf8);
+        const fs::path timingsFile = goldenDir / kTimingsFile;
+        std::map<std::string, double> timings = ReadTimings(timingsFile);
+        std::mutex timingsMutex;
+        const uint32_t width = options.request.geometry.width;
+        const uint32_t height = options.request.geometry.height;
+
+        auto runCase = [&](const GoldenCase& c, GoldenCaseResult& result, PngEncoder& encoder, std::vector<uint8_t>& png,
+            std::vector<uint8_t>& golden, std::vector<uint8_t>& heatmap)
+        {
+            OBBOOK_TRACE_SCOPE_DETAIL("Golden.Case", c.name.c_str());
+            result.name = c.name;
+
+            // One thread per case keeps the time comparable between runs whatever the core count.
+            BookPagesRequest request = options.request;
+            request.firstPage = 0;
+            request.pageCount = kAllPages;
+            request.workerCount = 1;
+            BookPagesResult rendered;
+            double best = 0;
+            for (uint32_t r = 0; r < std::max(1u, options.renderRepeats); ++r)
+            {
+                RenderBookPages(c.sourceUtf8, atlas, request, rendered);
+                best = r == 0 ? rendered.wallMilliseconds : std::min(best, rendered.wallMilliseconds);
+            }
+            result.renderMilliseconds = best;
+            result.pages = static_cast<uint32_t>(rendered.pages.size());
+
+            const fs::path caseGolden = goldenDir / c.name;
+            std::error_code ec;
+            if (options.update)
+            {
+                fs::create_directories(caseGolden, ec);
+                for (uint32_t stale = CountGoldenPages(caseGolden); stale-- > result.pages;) fs::remove(caseGolden / PageFileName(stale, ""), ec);
+                result.passed = true;
+                for (const auto& page : rendered.pages)
+                {
+                    if (WritePng(caseGolden / PageFileName(page.page, ""), encoder, page.bgra.data(), width, height, png)) continue;
+                    result.failures.push_back(GoldenPageFailure{ page.page, true, {}, {}, {} });
+                    result.passed = false;
+                }
+                result.goldenPages = result.pages;
+                std::lock_guard<std::mutex> lock(timingsMutex);
+                timings[c.name] = best;
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(timingsMutex);
+                const auto it = timings.find(c.name);
+                if (it != timings.end()) result.baselineMilliseconds = it->second;
+            }
+            result.goldenPages = CountGoldenPages(caseGolden);
+
+            const fs::path caseOutput = outputDir / c.name;
+            for (const auto& page : rendered.pages)
+            {
+                GoldenPageFailure failure{};
+                failure.page = page.page;
+                uint32_t gw = 0, gh = 0;
+                if (!ReadPngFile((caseGolden / PageFileName(page.page, "")).string(), gw, gh, golden) || gw != width || gh != height)
+                {
+                    failure.missing = true;
+                }
+                else
+                {
+                    DiffBgra(golden.data(), static_cast<size_t>(width) * 4, page.bgra.data(), static_cast<size_t>(width) * 4,
+                        width, height, options.tolerance, failure.diff);
+                    if (failure.diff.differingPixels <= options.maxDifferingPixels) continue;
+                }
+
+                fs::create_directories(caseOutput, ec);
+                const fs::path actualFile = caseOutput / PageFileName(page.page, ".actual");
+                if (WritePng(actualFile, encoder, page.bgra.data(), width, height, png)) failure.actualUtf8 = actualFile.string();
+                if (!failure.missing)
+                {
+                    DiffHeatmapBgra(golden.data(), static_cast<size_t>(width) * 4, page.bgra.data(), static_cast<size_t>(width) * 4,
+                        width, height, options.tolerance, heatmap);
+                    const fs::path heatmapFile = caseOutput / PageFileName(page.page, ".diff");
+                    if (WritePng(heatmapFile, encoder, heatmap.data(), width, height, png)) failure.heatmapUtf8 = heatmapFile.string();
+                }
+                result.failures.push_back(std::move(failure));
+            }
+
+            const double baseline = result.baselineMilliseconds;
+            result.slower = baseline > 0 && best > baseline * (1.0 + options.maxSlowdown) && best - baseline > options.minSlowdownMs;
+            result.passed = result.failures.empty() && result.pages == result.goldenPages && !result.slower;
+        };
+
+        const uint32_t workers = WorkerCount(options.workerCount, cases.size());
+        report.workers = workers;
+
+        WorkCursor cursor(cases.size());
+        RunOnWorkers(workers, [&](uint32_t)
+        {
+            PngEncoder encoder;
+            std::vector<uint8_t> png, golden, heatmap;
+            for (size_t i = 0; cursor.Next(i);)
+                runCase(cases[i], report.cases[i], encoder, png, golden, heatmap);
+        });
+
+        if (options.update)
+        {
+            std::error_code ec;
+            fs::create_directories(goldenDir, ec);
+            WriteTimings(timingsFile, timings);
+        }
+        for (const auto& result : report.cases) report.failedCases += result.passed ? 0 : 1;
+        report.wallMilliseconds = MillisecondsSince(start);
+    }
+}
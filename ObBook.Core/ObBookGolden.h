@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ObBookImageDiff.h"
+#include "ObBookPages.h"
+
+namespace obbook
+{
+    // One book of the regression corpus. name is also its folder under the golden directory.
+    struct GoldenCase
+    {
+        std::string name;
+        std::string sourceUtf8; // as rendered, i.e. already normalized
+    };
+
+    struct GoldenOptions
+    {
+        // <goldenDir>/<case>/page_0001.png ... hold the expected pages and <goldenDir>/timings.tsv one
+        // "<case>\t<milliseconds>" line per case.
+        std::string goldenDirUtf8;
+        // Failed pages are written to <outputDir>/<case>/page_NNNN.actual.png and page_NNNN.diff.png.
+        std::string outputDirUtf8;
+        BookPagesRequest request{};     // geometry and data directory; pages and workers are chosen per case
+        uint8_t tolerance = 0;          // per channel
+        uint64_t maxDifferingPixels = 0; // per page
+        uint32_t renderRepeats = 3;     // the fastest of these renders is the case's time
+        double maxSlowdown = 0.25;      // fail when a case renders this fraction slower than its baseline...
+        double minSlowdownMs = 2.0;     // ...and at least this much slower, so tiny books do not fail on noise
+        uint32_t workerCount = 0;       // cases run in parallel, each on one thread; 0 uses every core
+        bool update = false;            // write the rendered pages and times as the new goldens instead
+    };
+
+    struct GoldenPageFailure
+    {
+        uint32_t page{};
+        bool missing{};         // rendered, but there is no golden for it (or it could not be read)
+        ImageDiffStats diff{};
+        std::string actualUtf8; // empty if it could not be written
+        std::string heatmapUtf8;
+    };
+
+    struct GoldenCaseResult
+    {
+        std::string name;
+        uint32_t pages{};
+        uint32_t goldenPages{};
+        double renderMilliseconds{};
+        double baselineMilliseconds{}; // 0 when the case has no recorded time
+        bool slower{};
+        bool passed{};
+        std::vector<GoldenPageFailure> failures;
+    };
+
+    struct GoldenReport
+    {
+        uint32_t workers{};
+        uint32_t failedCases{};
+        double wallMilliseconds{};
+        std::vector<GoldenCaseResult> cases; // in the order given
+
+        bool Passed() const { return failedCases == 0; }
+    };
+
+    // Renders every case headlessly, then compares each page with its golden image (DiffBgra) and the case's
+    // render time with its baseline. A case fails on a page over maxDifferingPixels, a page count that differs
+    // from the goldens, or a time regression. With options.update it records the pages and times instead,
+    // and every case passes.
+    void RunGoldenPages(const std::vector<GoldenCase>& cases, const GlyphAtlas& atlas, const GoldenOptions& options,
+        GoldenReport& report);
+}
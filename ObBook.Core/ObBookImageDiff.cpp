@@ -0,0 +1,104 @@
+#include "ObBookImageDiff.h"
+#include "ObBookTrace.h"
+#include <algorithm>
+#include <bit>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define OBBOOK_DIFF_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace obbook
+{
+    static inline uint32_t ChannelDelta(uint8_t a, uint8_t b)
+    {
+        return a > b ? a - b : b - a;
+    }
+
+    // Pixels [from, width) of one row, one at a time.
+    static void DiffRowScalar(const uint8_t* e, const uint8_t* a, uint32_t from, uint32_t width, uint32_t tolerance,
+        uint64_t& differing, uint32_t& maxDelta)
+    {
+        for (uint32_t x = from; x < width; ++x)
+        {
+            uint32_t worst = 0;
+            for (uint32_t c = 0; c < 4; ++c) worst = std::max(worst, ChannelDelta(e[x * 4 + c], a[x * 4 + c]));
+            maxDelta = std::max(maxDelta, worst);
+            differing += worst > tolerance ? 1 : 0;
+        }
+    }
+
+    void DiffBgra(const uint8_t* expected, size_t expectedStride, const uint8_t* actual, size_t actualStride,
+        uint32_t width, uint32_t height, uint8_t tolerance, ImageDiffStats& stats)
+    {
+        OBBOOK_TRACE_SCOPE("ImageDiff.Diff");
+        uint64_t differing = 0;
+        uint32_t maxDelta = 0;
+#if OBBOOK_DIFF_SSE2
+        const __m128i tol = _mm_set1_epi8(static_cast<char>(tolerance));
+        const __m128i zero = _mm_setzero_si128();
+        __m128i maxBytes = zero;
+#endif
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const uint8_t* e = expected + y * expectedStride;
+            const uint8_t* a = actual + y * actualStride;
+            uint32_t x = 0;
+#if OBBOOK_DIFF_SSE2
+            // Four pixels per step: |e - a| per channel from two saturating subtractions, then a pixel differs
+            // when any of its bytes is still nonzero after subtracting the tolerance.
+            for (; x + 4 <= width; x += 4)
+            {
+                const __m128i ev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(e + x * 4));
+                const __m128i av = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x * 4));
+                const __m128i delta = _mm_or_si128(_mm_subs_epu8(ev, av), _mm_subs_epu8(av, ev));
+                maxBytes = _mm_max_epu8(maxBytes, delta);
+                const __m128i within = _mm_cmpeq_epi8(_mm_subs_epu8(delta, tol), zero);
+                const __m128i pixelWithin = _mm_cmpeq_epi32(within, _mm_set1_epi32(-1));
+                const uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(pixelWithin)));
+                differing += static_cast<uint32_t>(std::popcount(mask ^ 0xFu));
+            }
+#endif
+            DiffRowScalar(e, a, x, width, tolerance, differing, maxDelta);
+        }
+#if OBBOOK_DIFF_SSE2
+        alignas(16) uint8_t lanes[16];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), maxBytes);
+        for (const uint8_t lane : lanes) maxDelta = std::max<uint32_t>(maxDelta, lane);
+#endif
+        stats.differingPixels = differing;
+        stats.maxChannelDelta = maxDelta;
+    }
+
+    void DiffHeatmapBgra(const uint8_t* expected, size_t expectedStride, const uint8_t* actual, size_t actualStride,
+        uint32_t width, uint32_t height, uint8_t tolerance, std::vector<uint8_t>& heatmap)
+    {
+        OBBOOK_TRACE_SCOPE("ImageDiff.Heatmap");
+        heatmap.resize(static_cast<size_t>(width) * height * 4);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const uint8_t* e = expected + y * expectedStride;
+            const uint8_t* a = actual + y * actualStride;
+            uint8_t* out = heatmap.data() + static_cast<size_t>(y) * width * 4;
+            for (uint32_t x = 0; x < width; ++x, e += 4, a += 4, out += 4)
+            {
+                uint32_t worst = 0;
+                for (uint32_t c = 0; c < 4; ++c) worst = std::max(worst, ChannelDelta(e[c], a[c]));
+                if (worst > tolerance)
+                {
+                    out[0] = 0;
+                    out[1] = static_cast<uint8_t>(255 - worst);
+                    out[2] = 255;
+                }
+                else
+                {
+                    // Luma faded towards white, so the page stays legible under the marks.
+                    const uint32_t luma = (e[0] * 29u + e[1] * 150u + e[2] * 77u) >> 8;
+                    const uint8_t grey = static_cast<uint8_t>(160 + luma * 95 / 255);
+                    out[0] = out[1] = out[2] = grey;
+                }
+                out[3] = 255;
+            }
+        }
+    }
+}
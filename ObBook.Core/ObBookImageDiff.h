@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace obbook
+{
+    struct ImageDiffStats
+    {
+        uint64_t differingPixels{};
+        uint32_t maxChannelDelta{}; // over every pixel, within tolerance or not
+    };
+
+    // Compares two width x height BGRA8 images channel by channel: a pixel differs when any of its four channels
+    // is more than tolerance apart. SSE2 on x64 (16 channels per step), scalar elsewhere; both count the same.
+    void DiffBgra(const uint8_t* expected, size_t expectedStride, const uint8_t* actual, size_t actualStride,
+        uint32_t width, uint32_t height, uint8_t tolerance, ImageDiffStats& stats);
+
+    // Visual diff for a failed comparison, width x height BGRA8 tightly packed: the expected image faded to grey,
+    // with every differing pixel painted from yellow (just over tolerance) to red (255 apart).
+    void DiffHeatmapBgra(const uint8_t* expected, size_t expectedStride, const uint8_t* actual, size_t actualStride,
+        uint32_t width, uint32_t height, uint8_t tolerance, std::vector<uint8_t>& heatmap);
+}
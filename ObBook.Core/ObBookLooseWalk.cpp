@@ -0,0 +1,277 @@
+#include "ObBookLooseWalk.h"
+#include "ObBookCore.h"
+#include "ObBookTrace.h"
+#include "ObBookWorkers.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace obbook
+{
+    namespace
+    {
+        struct Folder;
+
+        struct FolderEntry
+        {
+            std::string name;         // lower-case
+            Folder* folder = nullptr; // null for files
+        };
+
+        struct Folder
+        {
+            fs::path path;
+            std::string virtualDir;           // lower-case, ends with '/'; empty for the Data folder
+            std::vector<FolderEntry> entries; // sorted once read
+        };
+
+        // Folders still to be read by one worker. The owner works from the back, thieves take from the front,
+        // so a thief gets the shallowest folder: the one most likely to hold a large subtree.
+        struct WorkQueue
+        {
+            std::mutex mutex;
+            std::deque<Folder*> folders;
+        };
+
+        void AppendLowerAscii(std::string& out, const char* s, size_t n)
+        {
+            for (size_t i = 0; i < n; ++i) out.push_back(s[i] >= 'A' && s[i] <= 'Z' ? static_cast<char>(s[i] - 'A' + 'a') : s[i]);
+        }
+
+        // Both end with '/' (or are empty): true when one is a prefix of the other.
+        bool CanLeadTo(std::string_view virtualDir, std::string_view prefix)
+        {
+            const size_t n = std::min(virtualDir.size(), prefix.size());
+            return virtualDir.substr(0, n) == prefix.substr(0, n);
+        }
+
+        // Calls onEntry(nativeName, name, nameLength, isFolder) for every file and every folder that is not a
+        // link. False if the folder could not be opened.
+        template <typename Fn>
+        bool ListFolder(const fs::path& path, Fn&& onEntry)
+        {
+#if defined(_WIN32)
+            // The basic info level skips the short names; large fetch asks for bigger batches per call.
+            WIN32_FIND_DATAW fd{};
+            const std::wstring pattern = path.native() + L"\\*";
+            HANDLE find = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &fd, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+            if (find == INVALID_HANDLE_VALUE) return false;
+            char name[MAX_PATH * 3];
+            do
+            {
+                const wchar_t* w = fd.cFileName;
+                if (w[0] == L'.' && (w[1] == 0 || (w[1] == L'.' && w[2] == 0))) continue;
+                const bool isFolder = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+                if (isFolder && (fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0) continue;
+                if (!isFolder && (fd.dwFileAttributes & FILE_ATTRIBUTE_DEVICE) != 0) continue;
+                // The active code page, as fs::path::string() converts.
+                const int n = WideCharToMultiByte(CP_ACP, 0, w, -1, name, static_cast<int>(sizeof(name)), nullptr, nullptr);
+                if (n <= 1) continue;
+                onEntry(w, name, static_cast<size_t>(n - 1), isFolder);
+            } while (FindNextFileW(find, &fd));
+            FindClose(find);
+            return true;
+#else
+            DIR* dir = opendir(path.c_str());
+            if (!dir) return false;
+            while (const dirent* e = readdir(dir))
+            {
+                const char* name = e->d_name;
+                if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) continue;
+                unsigned char type = e->d_type;
+                struct stat st{};
+                // Only when the listing does not say, or for a link: links to files count, links to folders
+                // are not followed.
+                if (type == DT_UNKNOWN)
+                {
+                    if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                    type = S_ISLNK(st.st_mode) ? DT_LNK : S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+                }
+                if (type == DT_LNK) type = fstatat(dirfd(dir), name, &st, 0) == 0 && S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+                if (type == DT_DIR || type == DT_REG) onEntry(name, name, std::strlen(name), type == DT_DIR);
+            }
+            closedir(dir);
+            return true;
+#endif
+        }
+    }
+
+    bool WalkLooseFiles(const std::string& dataDirUtf8, std::string_view virtualPrefix, uint32_t workerCount,
+        LooseInventory& inventory, const CancellationToken* cancel)
+    {
+        OBBOOK_TRACE_SCOPE("LooseWalk");
+        const auto start = std::chrono::steady_clock::now();
+        inventory.paths.clear();
+        inventory.directories = 0;
+        inventory.workers = 0;
+        inventory.milliseconds = 0;
+
+        std::error_code ec;
+        const fs::path dataDir(dataDirUtf8);
+        if (!fs::is_directory(dataDir, ec)) return false;
+
+        const uint32_t workers = WorkerCount(workerCount);
+        inventory.workers = workers;
+
+        // Folders live in their finder's deque (stable addresses) until the walk is assembled.
+        std::vector<WorkQueue> queues(workers);
+        std::vector<std::deque<Folder>> found(workers);
+        found[0].push_back(Folder{ dataDir, std::string(), {} });
+        Folder* const root = &found[0].back();
+        queues[0].folders.push_back(root);
+
+        // Folders queued or being read. A folder's subfolders are queued before it is counted off, so this only
+        // reaches 0 once the whole tree is read.
+        std::atomic<size_t> outstanding{ 1 };
+        std::atomic<bool> stopped{ false };
+        std::atomic<uint32_t> directories{ 0 };
+        std::atomic<size_t> files{ 0 };
+
+        auto work = [&](uint32_t self)
+        {
+            OBBOOK_TRACE_SCOPE("LooseWalk.Worker");
+            WorkQueue& own = queues[self];
+            std::deque<Folder>& mine = found[self];
+            uint32_t myDirectories = 0;
+            size_t myFiles = 0;
+            for (;;)
+            {
+                Folder* folder = nullptr;
+                {
+                    std::lock_guard<std::mutex> lock(own.mutex);
+                    if (!own.folders.empty())
+                    {
+                        folder = own.folders.back();
+                        own.folders.pop_back();
+                    }
+                }
+                for (uint32_t k = 1; !folder && k < workers; ++k)
+                {
+                    WorkQueue& victim = queues[(self + k) % workers];
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    if (!victim.folders.empty())
+                    {
+                        folder = victim.folders.front();
+                        victim.folders.pop_front();
+                    }
+                }
+                if (!folder)
+                {
+                    if (outstanding.load(std::memory_order_acquire) == 0) break;
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                if (cancel && cancel->IsCancelled()) stopped.store(true, std::memory_order_relaxed);
+                // Once stopped, queued folders are only counted off.
+                if (!stopped.load(std::memory_order_relaxed))
+                {
+                    const bool collect = folder->virtualDir.compare(0, virtualPrefix.size(), virtualPrefix) == 0;
+                    ListFolder(folder->path, [&](const fs::path::value_type* nativeName, const char* name, size_t length, bool isFolder)
+                    {
+                        if (!isFolder && !collect) return;
+                        FolderEntry entry;
+                        AppendLowerAscii(entry.name, name, length);
+                        if (isFolder)
+                        {
+                            std::string virtualDir = folder->virtualDir + entry.name + '/';
+                            if (!CanLeadTo(virtualDir, virtualPrefix)) return;
+                            mine.push_back(Folder{ folder->path / nativeName, std::move(virtualDir), {} });
+                            entry.folder = &mine.back();
+                            outstanding.fetch_add(1, std::memory_order_relaxed);
+                            std::lock_guard<std::mutex> lock(own.mutex);
+                            own.folders.push_back(entry.folder);
+                        }
+                        else
+                        {
+                            ++myFiles;
+                        }
+                        folder->entries.push_back(std::move(entry));
+                    });
+                    // Equal lower-case names only occur on case-sensitive file systems; files go first, then
+                    // folders in native-name order, so the result does not depend on the listing order.
+                    std::sort(folder->entries.begin(), folder->entries.end(), [](const FolderEntry& a, const FolderEntry& b)
+                    {
+                        const int c = a.name.compare(b.name);
+                        if (c != 0) return c < 0;
+                        if (!a.folder || !b.folder) return !a.folder && b.folder;
+                        return a.folder->path.native() < b.folder->path.native();
+                    });
+                    ++myDirectories;
+                }
+                outstanding.fetch_sub(1, std::memory_order_acq_rel);
+            }
+            directories.fetch_add(myDirectories, std::memory_order_relaxed);
+            files.fetch_add(myFiles, std::memory_order_relaxed);
+        };
+
+        // Any worker can finish the walk by stealing, so one that failed to start only costs parallelism.
+        RunOnWorkers(workers, work);
+
+        inventory.directories = directories.load(std::memory_order_relaxed);
+        if (stopped.load(std::memory_order_relaxed))
+        {
+            inventory.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            return false;
+        }
+
+        // Depth-first over the sorted folders, extending one path buffer.
+        {
+            OBBOOK_TRACE_SCOPE("LooseWalk.Assemble");
+            struct Frame
+            {
+                const Folder* folder;
+                size_t next;
+                size_t pathLength;
+            };
+            inventory.paths.reserve(files.load(std::memory_order_relaxed));
+            std::vector<Frame> stack{ Frame{ root, 0, 0 } };
+            std::string path;
+            while (!stack.empty())
+            {
+                Frame& top = stack.back();
+                if (top.next == top.folder->entries.size())
+                {
+                    stack.pop_back();
+                    continue;
+                }
+                const FolderEntry& entry = top.folder->entries[top.next++];
+                path.resize(top.pathLength);
+                path += entry.name;
+                if (entry.folder)
+                {
+                    path.push_back('/');
+                    stack.push_back(Frame{ entry.folder, 0, path.size() });
+                }
+                else
+                {
+                    inventory.paths.push_back(path);
+                }
+            }
+        }
+
+        inventory.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace obbook
+{
+    class CancellationToken;
+
+    struct LooseInventory
+    {
+        // Normalized virtual paths ("textures/armor/a.dds") of every regular file found, sorted segment by
+        // segment (the order AssetIndex lists children in), so equal trees give equal lists whatever the
+        // worker count or scheduling.
+        std::vector<std::string> paths;
+        uint32_t directories{}; // folders read, the Data folder included
+        uint32_t workers{};
+        double milliseconds{};
+    };
+
+    // Full inventory of the loose files under a Data folder, e.g. for a texture browser that lists everything
+    // rather than just book assets. Folders are read in parallel: each worker keeps its own deque of folders
+    // still to read, takes the newest from it and, when it runs dry, steals the oldest from another worker's.
+    // Entry types come from the directory listing itself (d_type, or the find data on Windows), so files are
+    // not stat'ed one by one. Names are matched and returned lower-case. virtualPrefix ("textures/", empty for
+    // everything, otherwise ending in '/') limits the walk to folders on the way to it or below it. Symbolic
+    // links to folders are not followed; unreadable folders are skipped. workerCount 0 uses the hardware
+    // concurrency and the calling thread is one of the workers. False if cancelled (the inventory is then
+    // incomplete) or if dataDirUtf8 is not a readable folder.
+    bool WalkLooseFiles(const std::string& dataDirUtf8, std::string_view virtualPrefix, uint32_t workerCount,
+        LooseInventory& inventory, const CancellationToken* cancel = nullptr);
+}
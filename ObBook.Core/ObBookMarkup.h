@@ -0,0 +1,245 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Shared pieces for scanning book markup: the lenient UTF-8 decoder the auto-fixes use, compile-time byte class
+// and tag-name tables, and the IMG attribute scan.
+
+namespace obbook
+{
+    // Common Windows smart quote codepoints.
+    inline bool IsSmartQuote(uint32_t cp)
+    {
+        return cp == 0x2018u || cp == 0x2019u || cp == 0x201Cu || cp == 0x201Du;
+    }
+
+    // Bytes DecodeUtf8 consumes for a sequence starting with lead, when that many are available.
+    inline size_t Utf8SequenceLength(uint8_t lead)
+    {
+        if ((lead >> 5) == 0x6) return 2;
+        if ((lead >> 4) == 0xE) return 3;
+        if ((lead >> 3) == 0x1E) return 4;
+        return 1;
+    }
+
+    // Minimal UTF-8 scan: returns the codepoint at s[i] and advances i. Continuation bytes are not validated;
+    // a stray byte, or a sequence cut off by the end of the buffer, decodes as U+FFFD and advances by one.
+    inline uint32_t DecodeUtf8(const char* s, size_t size, size_t& i)
+    {
+        const auto c = static_cast<uint8_t>(s[i]);
+        if (c < 0x80u) { i += 1; return c; }
+        const size_t n = Utf8SequenceLength(c);
+        if (n == 1 || i + n > size)
+        {
+            i += 1;
+            return 0xFFFDu;
+        }
+        auto cont = [s, i](size_t k) { return static_cast<uint32_t>(static_cast<uint8_t>(s[i + k]) & 0x3Fu); };
+        uint32_t cp;
+        if (n == 2) cp = ((c & 0x1Fu) << 6) | cont(1);
+        else if (n == 3) cp = ((c & 0x0Fu) << 12) | (cont(1) << 6) | cont(2);
+        else cp = ((c & 0x07u) << 18) | (cont(1) << 12) | (cont(2) << 6) | cont(3);
+        i += n;
+        return cp;
+    }
+
+    // Writes cp as 1-4 bytes; returns the count.
+    inline size_t EncodeUtf8(uint32_t cp, char out[4])
+    {
+        if (cp < 0x80u)
+        {
+            out[0] = static_cast<char>(cp);
+            return 1;
+        }
+        if (cp < 0x800u)
+        {
+            out[0] = static_cast<char>(0xC0u | (cp >> 6));
+            out[1] = static_cast<char>(0x80u | (cp & 0x3Fu));
+            return 2;
+        }
+        if (cp < 0x10000u)
+        {
+            out[0] = static_cast<char>(0xE0u | (cp >> 12));
+            out[1] = static_cast<char>(0x80u | ((cp >> 6) & 0x3Fu));
+            out[2] = static_cast<char>(0x80u | (cp & 0x3Fu));
+            return 3;
+        }
+        out[0] = static_cast<char>(0xF0u | (cp >> 18));
+        out[1] = static_cast<char>(0x80u | ((cp >> 12) & 0x3Fu));
+        out[2] = static_cast<char>(0x80u | ((cp >> 6) & 0x3Fu));
+        out[3] = static_cast<char>(0x80u | (cp & 0x3Fu));
+        return 4;
+    }
+
+    inline void AppendUtf8(std::string& out, uint32_t cp)
+    {
+        char bytes[4];
+        out.append(bytes, EncodeUtf8(cp, bytes));
+    }
+
+    // Byte classes; a byte can be in several. Bytes in none of the classes a scan cares about are copied in bulk.
+    enum CharClass : uint8_t
+    {
+        kCharNonAscii  = 1 << 0, // UTF-8 lead or continuation byte
+        kCharTagEnd    = 1 << 1, // '>'
+        kCharQuote     = 1 << 2, // '"'
+        kCharBackslash = 1 << 3, // '\\'
+        kCharTagLast   = 1 << 4, // 'g' / 'G', the last letter of "<img"
+    };
+
+    inline constexpr std::array<uint8_t, 256> kCharClasses = []
+    {
+        std::array<uint8_t, 256> t{};
+        for (size_t c = 0x80; c < 0x100; ++c) t[c] |= kCharNonAscii;
+        t['>'] |= kCharTagEnd;
+        t['"'] |= kCharQuote;
+        t['\\'] |= kCharBackslash;
+        t['g'] |= kCharTagLast;
+        t['G'] |= kCharTagLast;
+        return t;
+    }();
+
+    inline constexpr uint8_t CharClassOf(char c) { return kCharClasses[static_cast<uint8_t>(c)]; }
+
+    enum class BookTag : uint8_t { Unknown = 0, Br, Div, Font, Img, P, Count };
+
+    namespace detail
+    {
+        inline constexpr std::string_view kBookTagNames[] = { "", "br", "div", "font", "img", "p" };
+        static_assert(std::size(kBookTagNames) == static_cast<size_t>(BookTag::Count));
+
+        inline constexpr size_t kTagSlotBits = 4;
+        inline constexpr size_t kMaxTagName = 4;
+
+        constexpr char ToLowerAscii(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; }
+
+        // Case-insensitive; the top kTagSlotBits bits pick the slot.
+        constexpr uint32_t TagHash(std::string_view name, uint32_t seed)
+        {
+            uint32_t h = seed ^ static_cast<uint32_t>(name.size());
+            for (const char c : name) h = (h ^ static_cast<uint8_t>(ToLowerAscii(c))) * 0x01000193u;
+            return h >> (32 - kTagSlotBits);
+        }
+
+        // First seed under which every known name gets its own slot; 0 if none (caught below).
+        constexpr uint32_t FindTagSeed()
+        {
+            for (uint32_t seed = 1; seed < 100000; ++seed)
+            {
+                bool used[size_t{ 1 } << kTagSlotBits]{};
+                bool collision = false;
+                for (size_t t = 1; t < std::size(kBookTagNames) && !collision; ++t)
+                {
+                    const uint32_t slot = TagHash(kBookTagNames[t], seed);
+                    collision = used[slot];
+                    used[slot] = true;
+                }
+                if (!collision) return seed;
+            }
+            return 0;
+        }
+
+        inline constexpr uint32_t kTagSeed = FindTagSeed();
+        static_assert(kTagSeed != 0, "no collision-free seed for the book tag names");
+
+        inline constexpr std::array<BookTag, size_t{ 1 } << kTagSlotBits> kTagSlots = []
+        {
+            std::array<BookTag, size_t{ 1 } << kTagSlotBits> slots{};
+            for (size_t t = 1; t < std::size(kBookTagNames); ++t)
+                slots[TagHash(kBookTagNames[t], kTagSeed)] = static_cast<BookTag>(t);
+            return slots;
+        }();
+    }
+
+    // Tag name (without '<', '/' or attributes), any case. One hash and one comparison.
+    constexpr BookTag LookupBookTag(std::string_view name)
+    {
+        if (name.empty() || name.size() > detail::kMaxTagName) return BookTag::Unknown;
+        const BookTag tag = detail::kTagSlots[detail::TagHash(name, detail::kTagSeed)];
+        const std::string_view known = detail::kBookTagNames[static_cast<size_t>(tag)];
+        if (known.size() != name.size()) return BookTag::Unknown;
+        for (size_t i = 0; i < name.size(); ++i)
+            if (detail::ToLowerAscii(name[i]) != known[i]) return BookTag::Unknown;
+        return tag;
+    }
+
+    static_assert(LookupBookTag("IMG") == BookTag::Img && LookupBookTag("Font") == BookTag::Font);
+    static_assert(LookupBookTag("br") == BookTag::Br && LookupBookTag("image") == BookTag::Unknown);
+
+    // Attributes of one IMG tag; offsets are relative to the tag.
+    struct ImgTagAttributes
+    {
+        uint32_t width{};  // first non-zero width=, 0 when absent
+        uint32_t height{};
+        size_t srcOffset{};
+        size_t srcLength{};
+    };
+
+    // Scans tag, which runs from "<img" to its closing '>' inclusive. onWidth(value, offset, length) is called
+    // for every width= attribute, not just the first, with the value's position relative to the tag.
+    template <typename OnWidth>
+    ImgTagAttributes ScanImgTag(std::string_view tag, OnWidth&& onWidth)
+    {
+        auto startsWith = [tag](size_t at, std::string_view lit)
+        {
+            if (at + lit.size() > tag.size()) return false;
+            for (size_t i = 0; i < lit.size(); ++i)
+                if (detail::ToLowerAscii(tag[at + i]) != lit[i]) return false;
+            return true;
+        };
+        const size_t end = tag.empty() ? 0 : tag.size() - 1;
+        auto readNumber = [tag, end](size_t& k)
+        {
+            // optional quote
+            bool q = false;
+            if (k < end && tag[k] == '\"') { q = true; k++; }
+
+            uint32_t val = 0;
+            while (k < end && tag[k] >= '0' && tag[k] <= '9')
+            {
+                if (val < 100000000u) val = val * 10 + static_cast<uint32_t>(tag[k] - '0');
+                k++;
+            }
+            if (q && k < end && tag[k] == '\"') k++;
+            return val;
+        };
+
+        ImgTagAttributes a{};
+        bool haveSrc = false;
+        size_t k = 0;
+        while (k < end)
+        {
+            if (startsWith(k, "width="))
+            {
+                k += 6;
+                const size_t start = k;
+                const uint32_t val = readNumber(k);
+                if (a.width == 0) a.width = val;
+                onWidth(val, start, k > start ? k - start : 1);
+            }
+            else if (startsWith(k, "height="))
+            {
+                k += 7;
+                const uint32_t val = readNumber(k);
+                if (a.height == 0) a.height = val;
+            }
+            else if (!haveSrc && startsWith(k, "src="))
+            {
+                // Same value rules as ExtractFirstImgSrc: quoted, or up to the next blank.
+                haveSrc = true;
+                k += 4;
+                const bool quoted = k < end && tag[k] == '\"';
+                if (quoted) k++;
+                const size_t start = k;
+                while (k < end && (quoted ? tag[k] != '\"' : (tag[k] != ' ' && tag[k] != '\t'))) k++;
+                a.srcOffset = start;
+                a.srcLength = k - start;
+            }
+            k++;
+        }
+        return a;
+    }
+}
@@ -0,0 +1,136 @@
+#include "ObBookMemory.h"
+#include <atomic>
+#include <iterator>
+#include <utility>
+
+namespace obbook
+{
+    namespace
+    {
+        struct SubsystemCounters
+        {
+            std::atomic<int64_t> bytes{ 0 };
+            std::atomic<uint64_t> peakBytes{ 0 };
+            std::atomic<uint32_t> accounts{ 0 };
+            std::atomic<uint64_t> budgetBytes{ 0 };
+        };
+
+        // Constant-initialized, so accounts in other translation units' statics and thread_locals can use it.
+        SubsystemCounters g_counters[static_cast<size_t>(MemorySubsystem::Count)];
+
+        SubsystemCounters& CountersOf(MemorySubsystem s)
+        {
+            return g_counters[static_cast<size_t>(s)];
+        }
+
+        void Add(MemorySubsystem s, int64_t delta)
+        {
+            if (delta == 0) return;
+            SubsystemCounters& c = CountersOf(s);
+            const int64_t now = c.bytes.fetch_add(delta, std::memory_order_relaxed) + delta;
+            if (delta < 0 || now <= 0) return;
+            uint64_t peak = c.peakBytes.load(std::memory_order_relaxed);
+            while (static_cast<uint64_t>(now) > peak
+                && !c.peakBytes.compare_exchange_weak(peak, static_cast<uint64_t>(now), std::memory_order_relaxed))
+            {
+            }
+        }
+    }
+
+    const char* GetMemorySubsystemName(MemorySubsystem subsystem)
+    {
+        static const char* const kNames[] = { "asset_index", "compile_buffers", "texture_cache", "render_buffers" };
+        const size_t i = static_cast<size_t>(subsystem);
+        return i < std::size(kNames) ? kNames[i] : "unknown";
+    }
+
+    uint64_t MemoryStats::TotalBytes() const
+    {
+        uint64_t total = 0;
+        for (const auto& s : subsystems) total += s.bytes;
+        return total;
+    }
+
+    MemoryStats GetMemoryStats()
+    {
+        MemoryStats stats;
+        for (size_t i = 0; i < static_cast<size_t>(MemorySubsystem::Count); ++i)
+        {
+            const SubsystemCounters& c = g_counters[i];
+            const int64_t bytes = c.bytes.load(std::memory_order_relaxed);
+            MemoryUsage& u = stats.subsystems[i];
+            u.bytes = bytes > 0 ? static_cast<uint64_t>(bytes) : 0;
+            u.peakBytes = c.peakBytes.load(std::memory_order_relaxed);
+            u.accounts = c.accounts.load(std::memory_order_relaxed);
+            u.budgetBytes = c.budgetBytes.load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+
+    void ResetMemoryPeaks()
+    {
+        for (auto& c : g_counters)
+        {
+            const int64_t bytes = c.bytes.load(std::memory_order_relaxed);
+            c.peakBytes.store(bytes > 0 ? static_cast<uint64_t>(bytes) : 0, std::memory_order_relaxed);
+        }
+    }
+
+    void SetMemoryBudget(MemorySubsystem subsystem, uint64_t bytes)
+    {
+        CountersOf(subsystem).budgetBytes.store(bytes, std::memory_order_relaxed);
+    }
+
+    MemoryAccount::MemoryAccount(MemorySubsystem subsystem)
+        : subsystem_(subsystem)
+    {
+        CountersOf(subsystem_).accounts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    MemoryAccount::~MemoryAccount()
+    {
+        Add(subsystem_, -static_cast<int64_t>(bytes_));
+        CountersOf(subsystem_).accounts.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    MemoryAccount::MemoryAccount(const MemoryAccount& other)
+        : MemoryAccount(other.subsystem_)
+    {
+        Report(other.bytes_);
+    }
+
+    MemoryAccount::MemoryAccount(MemoryAccount&& other) noexcept
+        : MemoryAccount(other.subsystem_)
+    {
+        // Same subsystem, so the total does not change; only who reports it.
+        bytes_ = std::exchange(other.bytes_, 0);
+    }
+
+    MemoryAccount& MemoryAccount::operator=(const MemoryAccount& other)
+    {
+        if (this != &other) Report(other.bytes_);
+        return *this;
+    }
+
+    MemoryAccount& MemoryAccount::operator=(MemoryAccount&& other) noexcept
+    {
+        if (this == &other) return *this;
+        if (other.subsystem_ == subsystem_)
+        {
+            Add(subsystem_, -static_cast<int64_t>(bytes_));
+            bytes_ = std::exchange(other.bytes_, 0);
+        }
+        else
+        {
+            Report(other.bytes_);
+            other.Report(0);
+        }
+        return *this;
+    }
+
+    void MemoryAccount::Report(size_t bytes)
+    {
+        Add(subsystem_, static_cast<int64_t>(bytes) - static_cast<int64_t>(bytes_));
+        bytes_ = bytes;
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Process-wide accounting of the memory the engine retains, by subsystem. Owners of long-lived buffers hold a
+// MemoryAccount and report their retained bytes (capacity, not size) after a call that may have grown or shrunk
+// them; the difference is added to the subsystem's counters with one relaxed atomic add, so reporting never
+// allocates. Memory nobody reports (transient locals, the allocator's own overhead) is not counted: the
+// numbers are for budgets and for spotting growth across a long session, not a heap profiler.
+
+namespace obbook
+{
+    enum class MemorySubsystem : uint8_t
+    {
+        AssetIndex = 0,     // asset index snapshots, the texture path set and texture headers read by compilers
+        CompileBuffers = 1, // compiler sources, normalized text, diagnostics, source maps and scratch
+        TextureCache = 2,   // thumbnail cache records and mapping, decoded textures of books being laid out
+        RenderBuffers = 3,  // preview render targets, text masks and glyph atlases
+        Count
+    };
+
+    const char* GetMemorySubsystemName(MemorySubsystem subsystem);
+
+    struct MemoryUsage
+    {
+        uint64_t bytes{};
+        uint64_t peakBytes{};   // since the start or the last ResetMemoryPeaks()
+        uint32_t accounts{};    // live MemoryAccounts; a count that keeps growing points at a leaked owner
+        uint64_t budgetBytes{}; // 0 = none
+
+        bool IsOverBudget() const { return budgetBytes != 0 && bytes > budgetBytes; }
+    };
+
+    struct MemoryStats
+    {
+        MemoryUsage subsystems[static_cast<size_t>(MemorySubsystem::Count)]{};
+
+        const MemoryUsage& operator[](MemorySubsystem s) const { return subsystems[static_cast<size_t>(s)]; }
+        uint64_t TotalBytes() const;
+    };
+
+    MemoryStats GetMemoryStats();
+    void ResetMemoryPeaks();
+    // Budgets are reported (MemoryUsage::IsOverBudget), not enforced; what to drop is up to the caller.
+    void SetMemoryBudget(MemorySubsystem subsystem, uint64_t bytes);
+
+    // One owner's share of a subsystem. Copies report what the original reported (the owner's buffers were
+    // copied too); moves take it over. Not synchronized: report from one thread at a time, like the owner's
+    // own buffers are used.
+    class MemoryAccount
+    {
+    public:
+        explicit MemoryAccount(MemorySubsystem subsystem);
+        ~MemoryAccount();
+        MemoryAccount(const MemoryAccount& other);
+        MemoryAccount(MemoryAccount&& other) noexcept;
+        MemoryAccount& operator=(const MemoryAccount& other);
+        MemoryAccount& operator=(MemoryAccount&& other) noexcept;
+
+        void Report(size_t bytes);
+        size_t GetBytes() const { return bytes_; }
+        MemorySubsystem GetSubsystem() const { return subsystem_; }
+
+    private:
+        MemorySubsystem subsystem_;
+        size_t bytes_ = 0;
+    };
+
+    // Heap bytes behind a container, for reporting.
+    template <typename T>
+    size_t HeapBytes(const std::vector<T>& v)
+    {
+        return v.capacity() * sizeof(T);
+    }
+
+    inline size_t HeapBytes(const std::string& s)
+    {
+        // Short strings live inside the object; an empty string has exactly that capacity.
+        return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0;
+    }
+
+    inline size_t HeapBytes(const std::vector<std::string>& v)
+    {
+        size_t bytes = v.capacity() * sizeof(std::string);
+        for (const auto& s : v) bytes += HeapBytes(s);
+        return bytes;
+    }
+}
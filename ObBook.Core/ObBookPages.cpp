@@ -0,0 +1,431 @@
+#include "ObBookPages.h"
+#include "ObBookAssets.h"
+#include "ObBookMarkup.h"
+#include "ObBookMemory.h"
+#include "ObBookTrace.h"
+#include "ObBookWorkers.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace obbook
+{
+    namespace
+    {
+        // Same palette as the single-page preview.
+        struct Bgr { uint8_t b, g, r; };
+        constexpr Bgr kPagePaper{ 0xF5, 0xF0, 0xE7 };
+        constexpr Bgr kPageBorder{ 0x80, 0x80, 0x80 };
+        constexpr Bgr kPageInk{ 36, 36, 36 };
+    }
+
+    static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Name of the tag whose name starts at nameAt: up to a blank, '/' or the end of the tag.
+    static BookTag TagAt(const std::string& s, size_t nameAt, size_t tagEnd)
+    {
+        size_t end = nameAt;
+        while (end < tagEnd && s[end] != ' ' && s[end] != '\t' && s[end] != '/' && s[end] != '\r' && s[end] != '\n') ++end;
+        return LookupBookTag(std::string_view(s).substr(nameAt, end - nameAt));
+    }
+
+    static inline uint8_t Lerp255(uint8_t a, uint8_t b, uint32_t t)
+    {
+        return static_cast<uint8_t>((a * (255u - t) + b * t + 127u) / 255u);
+    }
+
+    static void FillSpan(uint8_t* px, uint32_t count, Bgr c)
+    {
+        for (uint32_t x = 0; x < count; ++x, px += 4)
+        {
+            px[0] = c.b;
+            px[1] = c.g;
+            px[2] = c.r;
+            px[3] = 0xFF;
+        }
+    }
+
+    void ParseBookMarkup(const std::string& src, BookLayout& layout)
+    {
+        OBBOOK_TRACE_SCOPE("Pages.Parse");
+        layout.text.clear();
+        layout.text.reserve(src.size());
+        layout.imageSources.clear();
+        layout.anchors.clear();
+
+        std::unordered_map<std::string, uint32_t> imageIds;
+        for (size_t i = 0; i < src.size(); ++i)
+        {
+            const char c = src[i];
+            if (c == '\r') continue;
+            if (c != '<')
+            {
+                layout.text.push_back(c);
+                continue;
+            }
+
+            size_t end = src.find('>', i);
+            if (end == std::string::npos) end = src.size();
+            const size_t nameAt = i + 1 < end && src[i + 1] == '/' ? i + 2 : i + 1;
+            const BookTag tag = TagAt(src, nameAt, end);
+            if (tag == BookTag::Br)
+            {
+                layout.text.push_back('\n');
+            }
+            else if (tag == BookTag::Img)
+            {
+                const auto imgSrc = ExtractFirstImgSrc(src.substr(i, end + 1 - i));
+                if (!imgSrc.empty())
+                {
+                    auto [it, inserted] = imageIds.emplace(ToTextureVirtualPath(imgSrc), static_cast<uint32_t>(layout.imageSources.size()));
+                    if (inserted) layout.imageSources.push_back(it->first);
+                    layout.anchors.push_back({ static_cast<uint32_t>(layout.text.size()), it->second });
+                }
+            }
+            i = end;
+        }
+    }
+
+    void LoadBookImages(const BookLayout& layout, const std::string& dataDirUtf8, std::vector<DecodedImage>& images)
+    {
+        OBBOOK_TRACE_SCOPE("Pages.LoadImages");
+        images.assign(layout.imageSources.size(), DecodedImage{});
+        if (dataDirUtf8.empty()) return;
+
+        std::vector<uint8_t> bytes;
+        for (size_t i = 0; i < images.size(); ++i)
+        {
+            if (!ReadAssetBytes(dataDirUtf8, layout.imageSources[i], bytes)) continue;
+            DecodedImage& img = images[i];
+            if (!DecodeTextureToBgra(bytes, 0, img.bgra, img.width, img.height) || img.width == 0 || img.height == 0)
+                img = DecodedImage{};
+        }
+    }
+
+    void LayoutBookPages(BookLayout& layout, const GlyphAtlas& atlas, const PageGeometry& g, const std::vector<DecodedImage>& images)
+    {
+        OBBOOK_TRACE_SCOPE("Pages.Layout");
+        layout.lines.clear();
+        layout.images.clear();
+        layout.pageLines.assign(1, 0);
+        layout.pageImages.assign(1, 0);
+
+        const uint32_t textW = g.width > 2 * g.marginX ? g.width - 2 * g.marginX : 0;
+        const uint32_t textH = g.height > 2 * g.marginY ? g.height - 2 * g.marginY : 0;
+        const uint32_t lineHeight = std::max<uint32_t>(atlas.lineHeight, 1);
+        if (textW == 0 || textH < lineHeight)
+        {
+            layout.pageLines.push_back(0);
+            layout.pageImages.push_back(0);
+            return;
+        }
+
+        const std::string& text = layout.text;
+        uint32_t y = 0;
+        auto newPage = [&]
+        {
+            layout.pageLines.push_back(static_cast<uint32_t>(layout.lines.size()));
+            layout.pageImages.push_back(static_cast<uint32_t>(layout.images.size()));
+            y = 0;
+        };
+        auto emitLine = [&](size_t begin, size_t end)
+        {
+            if (y + lineHeight > textH) newPage();
+            layout.lines.push_back({ static_cast<uint32_t>(begin), static_cast<uint32_t>(end), y });
+            y += lineHeight;
+        };
+        auto advanceOf = [&](size_t i) { return static_cast<uint32_t>(atlas.advance[static_cast<uint8_t>(text[i])]); };
+
+        // Greedy word wrap of text[begin, end), which holds no '\n'. Breaks at the last space that fits and
+        // splits words wider than the text block.
+        auto wrap = [&](size_t begin, size_t end)
+        {
+            size_t start = begin;
+            size_t lastSpace = std::string::npos;
+            uint32_t width = 0;
+            for (size_t i = begin; i < end;)
+            {
+                const uint32_t adv = advanceOf(i);
+                if (width + adv > textW && i > start)
+                {
+                    if (lastSpace != std::string::npos && lastSpace > start)
+                    {
+                        emitLine(start, lastSpace);
+                        start = lastSpace + 1;
+                    }
+                    else
+                    {
+                        emitLine(start, i);
+                        start = i;
+                    }
+                    lastSpace = std::string::npos;
+                    width = 0;
+                    for (size_t k = start; k < i; ++k) width += advanceOf(k);
+                    continue;
+                }
+                if (text[i] == ' ') lastSpace = i;
+                width += adv;
+                ++i;
+            }
+            emitLine(start, end);
+        };
+
+        auto placeImage = [&](uint32_t id)
+        {
+            if (id >= images.size() || images[id].bgra.empty()) return;
+            const DecodedImage& img = images[id];
+            const double scale = std::min({ 1.0, static_cast<double>(textW) / img.width, static_cast<double>(textH) / img.height });
+            const uint32_t w = std::max<uint32_t>(1, static_cast<uint32_t>(img.width * scale));
+            const uint32_t h = std::max<uint32_t>(1, static_cast<uint32_t>(img.height * scale));
+            if (y > 0 && y + h > textH) newPage();
+            layout.images.push_back({ id, (textW - w) / 2, y, w, h });
+            y += h;
+        };
+
+        // Text runs between anchors; an anchor sits at a line boundary of the run it interrupts.
+        size_t anchor = 0;
+        size_t pos = 0;
+        for (;;)
+        {
+            const size_t runEnd = anchor < layout.anchors.size() ? layout.anchors[anchor].offset : text.size();
+            while (pos < runEnd)
+            {
+                size_t lineEnd = text.find('\n', pos);
+                if (lineEnd == std::string::npos || lineEnd > runEnd) lineEnd = runEnd;
+                wrap(pos, lineEnd);
+                pos = lineEnd < runEnd ? lineEnd + 1 : lineEnd;
+            }
+            if (anchor >= layout.anchors.size()) break;
+            placeImage(layout.anchors[anchor++].image);
+        }
+
+        layout.pageLines.push_back(static_cast<uint32_t>(layout.lines.size()));
+        layout.pageImages.push_back(static_cast<uint32_t>(layout.images.size()));
+    }
+
+    void ComposeBookPage(const BookLayout& layout, uint32_t page, const GlyphAtlas& atlas, const std::vector<DecodedImage>& images,
+        const PageGeometry& g, uint8_t* pixels, size_t stride)
+    {
+        OBBOOK_TRACE_SCOPE("Pages.Compose");
+        const uint32_t w = g.width;
+        const uint32_t h = g.height;
+        for (uint32_t y = 0; y < h; ++y)
+        {
+            uint8_t* row = pixels + y * stride;
+            if (y < g.border || y + g.border >= h || w <= 2 * g.border)
+            {
+                FillSpan(row, w, kPageBorder);
+                continue;
+            }
+            FillSpan(row, g.border, kPageBorder);
+            FillSpan(row + static_cast<size_t>(g.border) * 4, w - 2 * g.border, kPagePaper);
+            FillSpan(row + static_cast<size_t>(w - g.border) * 4, g.border, kPageBorder);
+        }
+        if (page >= layout.PageCount() || w <= 2 * g.border || h <= 2 * g.border) return;
+
+        // Everything drawn below is clipped to the paper.
+        const uint32_t clipX0 = g.border, clipX1 = w - g.border;
+        const uint32_t clipY0 = g.border, clipY1 = h - g.border;
+
+        for (uint32_t i = layout.pageImages[page]; i < layout.pageImages[page + 1]; ++i)
+        {
+            const BookLayout::Image& placed = layout.images[i];
+            const DecodedImage& img = images[placed.image];
+            const uint32_t ox = g.marginX + placed.x;
+            const uint32_t oy = g.marginY + placed.y;
+            for (uint32_t y = 0; y < placed.height && oy + y < clipY1; ++y)
+            {
+                const uint32_t sy = static_cast<uint32_t>((static_cast<uint64_t>(y) * img.height) / placed.height);
+                uint8_t* dp = pixels + static_cast<size_t>(oy + y) * stride + static_cast<size_t>(ox) * 4;
+                for (uint32_t x = 0; x < placed.width && ox + x < clipX1; ++x, dp += 4)
+                {
+                    const uint32_t sx = static_cast<uint32_t>((static_cast<uint64_t>(x) * img.width) / placed.width);
+                    const uint8_t* sp = &img.bgra[(static_cast<size_t>(sy) * img.width + sx) * 4];
+                    dp[0] = Lerp255(dp[0], sp[0], sp[3]);
+                    dp[1] = Lerp255(dp[1], sp[1], sp[3]);
+                    dp[2] = Lerp255(dp[2], sp[2], sp[3]);
+                }
+            }
+        }
+
+        for (uint32_t i = layout.pageLines[page]; i < layout.pageLines[page + 1]; ++i)
+        {
+            const BookLayout::Line& line = layout.lines[i];
+            const uint32_t top = g.marginY + line.y;
+            uint32_t penX = g.marginX;
+            for (uint32_t t = line.begin; t < line.end; ++t)
+            {
+                const uint8_t c = static_cast<uint8_t>(layout.text[t]);
+                const uint32_t cellX = penX > atlas.originX ? penX - atlas.originX : 0;
+                penX += atlas.advance[c];
+                if (c == ' ') continue;
+
+                const uint8_t* cell = atlas.Cell(c);
+                for (uint32_t y = 0; y < atlas.cellHeight && top + y < clipY1; ++y)
+                {
+                    if (top + y < clipY0) continue;
+                    const uint8_t* m = cell + static_cast<size_t>(y) * atlas.cellWidth;
+                    uint8_t* px = pixels + static_cast<size_t>(top + y) * stride + static_cast<size_t>(cellX) * 4;
+                    for (uint32_t x = 0; x < atlas.cellWidth && cellX + x < clipX1; ++x, px += 4)
+                    {
+                        const uint32_t coverage = m[x];
+                        if (coverage == 0 || cellX + x < clipX0) continue;
+                        px[0] = Lerp255(px[0], kPageInk.b, coverage);
+                        px[1] = Lerp255(px[1], kPageInk.g, coverage);
+                        px[2] = Lerp255(px[2], kPageInk.r, coverage);
+                    }
+                }
+            }
+        }
+    }
+
+    // The decoded textures are reported to imageMemory for as long as the caller keeps images.
+    static void LayOutBook(const std::string& sourceUtf8, const GlyphAtlas& atlas, const BookPagesRequest& request,
+        BookLayout& layout, std::vector<DecodedImage>& images, MemoryAccount& imageMemory)
+    {
+        ParseBookMarkup(sourceUtf8, layout);
+        LoadBookImages(layout, request.dataDirUtf8, images);
+        size_t imageBytes = HeapBytes(images);
+        for (const auto& img : images) imageBytes += HeapBytes(img.bgra);
+        imageMemory.Report(imageBytes);
+        LayoutBookPages(layout, atlas, request.geometry, images);
+    }
+
+    void RenderBookPages(const std::string& sourceUtf8, const GlyphAtlas& atlas, const BookPagesRequest& request, BookPagesResult& result)
+    {
+        OBBOOK_TRACE_SCOPE("Pages.Render");
+        const auto start = std::chrono::steady_clock::now();
+        const PageGeometry& g = request.geometry;
+
+        BookLayout layout;
+        std::vector<DecodedImage> images;
+        MemoryAccount imageMemory(MemorySubsystem::TextureCache);
+        LayOutBook(sourceUtf8, atlas, request, layout, images, imageMemory);
+        result.layoutMilliseconds = MillisecondsSince(start);
+
+        result.totalPages = layout.PageCount();
+        const uint32_t first = std::min(request.firstPage, result.totalPages);
+        const uint32_t count = std::min(request.pageCount, result.totalPages - first);
+        result.pages.resize(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            result.pages[i].page = first + i;
+            result.pages[i].bgra.resize(static_cast<size_t>(g.width) * g.height * 4);
+        }
+
+        const uint32_t workers = WorkerCount(request.workerCount, count);
+        result.workers = workers;
+
+        WorkCursor cursor(count);
+        RunOnWorkers(workers, [&](uint32_t)
+        {
+            for (size_t i = 0; cursor.Next(i);)
+            {
+                BookPageImage& out = result.pages[i];
+                const auto pageStart = std::chrono::steady_clock::now();
+                ComposeBookPage(layout, out.page, atlas, images, g, out.bgra.data(), static_cast<size_t>(g.width) * 4);
+                out.milliseconds = MillisecondsSince(pageStart);
+            }
+        });
+
+        result.wallMilliseconds = MillisecondsSince(start);
+    }
+
+    void ExportBookPages(const std::string& sourceUtf8, const GlyphAtlas& atlas, const BookPagesRequest& request,
+        const BookPagesExport& output, BookPagesExportResult& result)
+    {
+        OBBOOK_TRACE_SCOPE("Pages.Export");
+        const auto start = std::chrono::steady_clock::now();
+        const PageGeometry& g = request.geometry;
+        result = BookPagesExportResult{};
+
+        BookLayout layout;
+        std::vector<DecodedImage> images;
+        MemoryAccount imageMemory(MemorySubsystem::TextureCache);
+        LayOutBook(sourceUtf8, atlas, request, layout, images, imageMemory);
+        result.layoutMilliseconds = MillisecondsSince(start);
+
+        result.totalPages = layout.PageCount();
+        const uint32_t first = std::min(request.firstPage, result.totalPages);
+        const uint32_t count = std::min(request.pageCount, result.totalPages - first);
+        result.filesUtf8.resize(count);
+        if (count == 0)
+        {
+            result.wallMilliseconds = MillisecondsSince(start);
+            return;
+        }
+
+        const fs::path directory(output.directoryUtf8);
+        std::error_code ec;
+        fs::create_directories(directory, ec);
+
+        const uint32_t workers = WorkerCount(request.workerCount, count);
+        result.workers = workers;
+
+        // Per-worker totals, merged once at the end.
+        WorkCursor cursor(count);
+        std::atomic<uint32_t> failed{ 0 };
+        std::atomic<uint64_t> pngBytes{ 0 };
+        std::atomic<int64_t> composeNs{ 0 };
+        std::atomic<int64_t> encodeNs{ 0 };
+        RunOnWorkers(workers, [&](uint32_t)
+        {
+            OBBOOK_TRACE_SCOPE("Pages.ExportWorker");
+            const size_t stride = static_cast<size_t>(g.width) * 4;
+            std::vector<uint8_t> frame(stride * g.height);
+            std::vector<uint8_t> png;
+            PngEncoder encoder;
+            uint32_t workerFailed = 0;
+            uint64_t workerBytes = 0;
+            std::chrono::steady_clock::duration compose{}, encode{};
+            for (size_t i = 0; cursor.Next(i);)
+            {
+                const uint32_t page = first + static_cast<uint32_t>(i);
+                const auto pageStart = std::chrono::steady_clock::now();
+                ComposeBookPage(layout, page, atlas, images, g, frame.data(), stride);
+                const auto composed = std::chrono::steady_clock::now();
+
+                char name[32];
+                std::snprintf(name, sizeof(name), "_%04u.png", page + 1);
+                const fs::path file = directory / (output.fileStem + name);
+                bool ok = encoder.Encode(frame.data(), g.width, g.height, stride, output.png, png);
+                if (ok)
+                {
+                    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+                    ok = out && out.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+                }
+                if (ok)
+                {
+                    result.filesUtf8[i] = file.string();
+                    workerBytes += png.size();
+                }
+                else
+                {
+                    ++workerFailed;
+                }
+                compose += composed - pageStart;
+                encode += std::chrono::steady_clock::now() - composed;
+            }
+            failed.fetch_add(workerFailed, std::memory_order_relaxed);
+            pngBytes.fetch_add(workerBytes, std::memory_order_relaxed);
+            composeNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(compose).count(), std::memory_order_relaxed);
+            encodeNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(encode).count(), std::memory_order_relaxed);
+        });
+
+        result.failed = failed.load();
+        result.pngBytes = pngBytes.load();
+        result.composeMilliseconds = static_cast<double>(composeNs.load()) / 1e6;
+        result.encodeMilliseconds = static_cast<double>(encodeNs.load()) / 1e6;
+        result.wallMilliseconds = MillisecondsSince(start);
+    }
+}
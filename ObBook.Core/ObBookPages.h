@@ -0,0 +1,134 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ObBookPng.h"
+
+namespace obbook
+{
+    // Rasterized glyphs for the 256 byte values book text can contain. Built once per font by the platform
+    // renderer and only read while pages are composed, so one atlas is shared by every page worker.
+    // Cell c holds the coverage (0 = paper, 255 = ink) of byte c drawn with its pen at (originX, 0).
+    struct GlyphAtlas
+    {
+        uint32_t cellWidth{};
+        uint32_t cellHeight{};
+        uint32_t originX{};
+        uint32_t lineHeight{};
+        std::array<uint16_t, 256> advance{};
+        std::vector<uint8_t> coverage; // 256 cells of cellWidth * cellHeight
+
+        const uint8_t* Cell(uint8_t c) const { return coverage.data() + static_cast<size_t>(c) * cellWidth * cellHeight; }
+    };
+
+    struct DecodedImage
+    {
+        uint32_t width{};
+        uint32_t height{};
+        std::vector<uint8_t> bgra; // empty when the texture could not be read or decoded
+    };
+
+    // Page size and text block, in pixels. The defaults match the single-page preview.
+    struct PageGeometry
+    {
+        uint32_t width = 1000;
+        uint32_t height = 700;
+        uint32_t marginX = 48;
+        uint32_t marginY = 42;
+        uint32_t border = 2;
+    };
+
+    // Book text broken into lines and pages for one geometry and atlas.
+    struct BookLayout
+    {
+        struct Anchor { uint32_t offset; uint32_t image; }; // an IMG tag before text[offset]
+        struct Line { uint32_t begin; uint32_t end; uint32_t y; }; // text[begin, end), y within the text block
+        struct Image { uint32_t image; uint32_t x; uint32_t y; uint32_t width; uint32_t height; };
+
+        std::string text;                      // markup stripped; '\n' is a hard break
+        std::vector<std::string> imageSources; // distinct texture virtual paths in first-use order
+        std::vector<Anchor> anchors;
+        std::vector<Line> lines;
+        std::vector<Image> images;             // image indexes imageSources
+        std::vector<uint32_t> pageLines;       // page p owns lines [pageLines[p], pageLines[p + 1])
+        std::vector<uint32_t> pageImages;      // and images [pageImages[p], pageImages[p + 1])
+
+        uint32_t PageCount() const { return pageLines.empty() ? 0 : static_cast<uint32_t>(pageLines.size() - 1); }
+    };
+
+    // Strips markup (BR breaks the line, IMG anchors its texture) and collects the texture paths.
+    void ParseBookMarkup(const std::string& sourceUtf8, BookLayout& layout);
+
+    // Reads and decodes every layout.imageSources entry once; images[i] matches imageSources[i].
+    void LoadBookImages(const BookLayout& layout, const std::string& dataDirUtf8, std::vector<DecodedImage>& images);
+
+    // Word-wraps the parsed text and images into pages. Images are scaled down to fit the text block and start a
+    // new page when they do not fit below the current line; undecoded images take no space.
+    void LayoutBookPages(BookLayout& layout, const GlyphAtlas& atlas, const PageGeometry& geometry,
+        const std::vector<DecodedImage>& images);
+
+    // Composes one laid-out page into caller memory (geometry.width x geometry.height BGRA8, rows strideBytes apart).
+    void ComposeBookPage(const BookLayout& layout, uint32_t page, const GlyphAtlas& atlas,
+        const std::vector<DecodedImage>& images, const PageGeometry& geometry, uint8_t* pixels, size_t strideBytes);
+
+    constexpr uint32_t kAllPages = 0xFFFFFFFFu;
+
+    struct BookPagesRequest
+    {
+        PageGeometry geometry{};
+        uint32_t firstPage = 0;
+        uint32_t pageCount = kAllPages; // clipped to the pages the book has
+        uint32_t workerCount = 0;       // 0 uses the hardware concurrency
+        std::string dataDirUtf8;        // empty skips IMG textures
+    };
+
+    struct BookPageImage
+    {
+        uint32_t page{};
+        std::vector<uint8_t> bgra; // geometry.width * geometry.height * 4, tightly packed
+        double milliseconds{};     // compose time of this page on its worker
+    };
+
+    struct BookPagesResult
+    {
+        uint32_t totalPages{};
+        uint32_t workers{};
+        double layoutMilliseconds{}; // parse, texture decode and pagination
+        double wallMilliseconds{};   // the whole call
+        std::vector<BookPageImage> pages;
+    };
+
+    // Lays the book out once, then composes the requested pages concurrently. Workers pull pages from a shared
+    // counter and write only their own output buffers; the layout, atlas and decoded textures are read-only.
+    void RenderBookPages(const std::string& sourceUtf8, const GlyphAtlas& atlas, const BookPagesRequest& request,
+        BookPagesResult& result);
+
+    struct BookPagesExport
+    {
+        std::string directoryUtf8;     // created if missing
+        std::string fileStem = "page"; // page p is written to <fileStem>_<p + 1, at least 4 digits>.png
+        PngOptions png{};
+    };
+
+    struct BookPagesExportResult
+    {
+        uint32_t totalPages{};
+        uint32_t workers{};
+        uint32_t failed{};                  // pages whose file could not be written
+        uint64_t pngBytes{};
+        double layoutMilliseconds{};
+        double composeMilliseconds{};       // summed over the workers
+        double encodeMilliseconds{};        // summed over the workers, file writes included
+        double wallMilliseconds{};
+        std::vector<std::string> filesUtf8; // one per requested page; empty where the write failed
+    };
+
+    // Headless export for CI artifacts: lays the book out once, then each worker composes a page into its own
+    // frame, encodes it to PNG and writes the file before pulling the next, so memory stays at one frame and
+    // encoder per worker however many pages are written.
+    void ExportBookPages(const std::string& sourceUtf8, const GlyphAtlas& atlas, const BookPagesRequest& request,
+        const BookPagesExport& output, BookPagesExportResult& result);
+}
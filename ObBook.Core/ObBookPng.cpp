@@ -0,0 +1,1004 @@
+#include "ObBookPng.h"
+#include "ObBookTrace.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace obbook
+{
+    static constexpr uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    static constexpr size_t kFilterCount = 5;
+
+    // Deflate (RFC 1951) limits and the match finder's shape.
+    static constexpr uint32_t kWindowSize = 32768;
+    static constexpr uint32_t kMinMatch = 4; // deflate allows 3; 4 hashes one load and loses almost nothing here
+    static constexpr uint32_t kMaxMatch = 258;
+    static constexpr uint32_t kHashBits = 15;
+    static constexpr uint32_t kMaxInsertLength = 32; // below level 4 longer matches are not indexed inside
+    static constexpr size_t kBlockSymbols = 1u << 16;
+    static constexpr size_t kMaxStoredBlock = 65535;
+    static constexpr uint32_t kMaxCodeLength = 15;
+    static constexpr uint32_t kMaxCodeLengthCodeLength = 7;
+    static constexpr uint32_t kLitLenCodes = 286;
+    static constexpr uint32_t kDistCodes = 30;
+    static constexpr uint32_t kCodeLengthCodes = 19;
+    static constexpr uint8_t kCodeLengthOrder[kCodeLengthCodes] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    static constexpr uint32_t kMatchFlag = 0x80000000u;
+
+    struct DeflateTables
+    {
+        std::array<uint16_t, 29> lengthBase{};
+        std::array<uint8_t, 29> lengthExtra{};
+        std::array<uint16_t, 30> distBase{};
+        std::array<uint8_t, 30> distExtra{};
+        std::array<uint8_t, kMaxMatch + 1> lengthCode{}; // by match length
+        std::array<uint8_t, 512> distCode{};             // by distance - 1 below 256, else 256 + ((distance - 1) >> 7)
+        std::array<std::array<uint32_t, 256>, 8> crc{}; // crc[k][v]: v followed by k zero bytes
+    };
+
+    static constexpr DeflateTables MakeDeflateTables()
+    {
+        DeflateTables t{};
+        uint32_t length = 3;
+        for (uint32_t code = 0; code < 28; ++code)
+        {
+            t.lengthExtra[code] = static_cast<uint8_t>(code < 8 ? 0 : (code - 4) / 4);
+            t.lengthBase[code] = static_cast<uint16_t>(length);
+            for (uint32_t i = 0; i < (1u << t.lengthExtra[code]) && length < kMaxMatch; ++i) t.lengthCode[length++] = static_cast<uint8_t>(code);
+        }
+        // 258 has its own code; code 27 stops one short of its 5 extra bits at 257.
+        t.lengthBase[28] = 258;
+        t.lengthExtra[28] = 0;
+        t.lengthCode[258] = 28;
+
+        uint32_t distance = 1;
+        for (uint32_t code = 0; code < kDistCodes; ++code)
+        {
+            t.distExtra[code] = static_cast<uint8_t>(code < 4 ? 0 : (code - 2) / 2);
+            t.distBase[code] = static_cast<uint16_t>(distance);
+            for (uint32_t i = 0; i < (1u << t.distExtra[code]); ++i, ++distance)
+            {
+                if (distance <= 256) t.distCode[distance - 1] = static_cast<uint8_t>(code);
+                else t.distCode[256 + ((distance - 1) >> 7)] = static_cast<uint8_t>(code);
+            }
+        }
+
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t.crc[0][n] = c;
+        }
+        for (uint32_t n = 0; n < 256; ++n)
+            for (uint32_t k = 1; k < 8; ++k) t.crc[k][n] = t.crc[0][t.crc[k - 1][n] & 0xFF] ^ (t.crc[k - 1][n] >> 8);
+        return t;
+    }
+
+    static constexpr DeflateTables kTables = MakeDeflateTables();
+
+    static inline uint32_t DistCode(uint32_t distance)
+    {
+        return distance <= 256 ? kTables.distCode[distance - 1] : kTables.distCode[256 + ((distance - 1) >> 7)];
+    }
+
+    static uint32_t Crc32(uint32_t crc, const uint8_t* p, size_t n)
+    {
+        // Slicing by 8: one lookup per byte, but eight independent ones per step.
+        const auto& t = kTables.crc;
+        crc = ~crc;
+        for (; n >= 8; p += 8, n -= 8)
+        {
+            const uint32_t lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24);
+            crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+                ^ t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+        }
+        for (; n > 0; ++p, --n) crc = t[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    static uint32_t Adler32(const uint8_t* p, size_t n)
+    {
+        // Eight bytes per step: a gains their sum and b gains 8a plus each byte weighted by its distance from the
+        // end of the step, which keeps the dependency chain to one add per step instead of two per byte. 5552 bytes
+        // between modulos keep both sums in 32 bits.
+        uint32_t a = 1, b = 0;
+        while (n > 0)
+        {
+            const size_t chunk = std::min<size_t>(n, 5552);
+            n -= chunk;
+            size_t i = 0;
+            for (; i + 8 <= chunk; i += 8)
+            {
+                const uint8_t* q = p + i;
+                b += 8 * a + 8u * q[0] + 7u * q[1] + 6u * q[2] + 5u * q[3] + 4u * q[4] + 3u * q[5] + 2u * q[6] + q[7];
+                a += static_cast<uint32_t>(q[0]) + q[1] + q[2] + q[3] + q[4] + q[5] + q[6] + q[7];
+            }
+            for (; i < chunk; ++i)
+            {
+                a += p[i];
+                b += a;
+            }
+            p += chunk;
+            a %= 65521;
+            b %= 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    static inline void PutBe32(uint8_t* p, uint32_t v)
+    {
+        p[0] = static_cast<uint8_t>(v >> 24);
+        p[1] = static_cast<uint8_t>(v >> 16);
+        p[2] = static_cast<uint8_t>(v >> 8);
+        p[3] = static_cast<uint8_t>(v);
+    }
+
+    static inline uint32_t GetBe32(const uint8_t* p)
+    {
+        return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+    }
+
+    static inline uint32_t Load32(const uint8_t* p)
+    {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static inline uint32_t Hash4(const uint8_t* p)
+    {
+        return (Load32(p) * 2654435761u) >> (32 - kHashBits);
+    }
+
+    // Length of the common prefix of a and b, at most limit bytes.
+    static inline uint32_t MatchLength(const uint8_t* a, const uint8_t* b, uint32_t limit)
+    {
+        uint32_t n = 0;
+        while (n + 8 <= limit)
+        {
+            uint64_t x, y;
+            std::memcpy(&x, a + n, 8);
+            std::memcpy(&y, b + n, 8);
+            const uint64_t diff = x ^ y;
+            if (diff) return n + static_cast<uint32_t>(std::countr_zero(diff) >> 3); // little-endian (x64 only)
+            n += 8;
+        }
+        while (n < limit && a[n] == b[n]) ++n;
+        return n;
+    }
+
+    // Branch-free (pa = |p - a| = |b - c| and so on), so the filter loops vectorize.
+    static inline uint8_t Paeth(uint8_t a, uint8_t b, uint8_t c)
+    {
+        const int pa = std::abs(b - c);
+        const int pb = std::abs(a - c);
+        const int pc = std::abs(a + b - 2 * c);
+        const int bc = pb <= pc ? b : c;
+        return static_cast<uint8_t>(pa <= pb && pa <= pc ? a : bc);
+    }
+
+    static inline uint32_t Magnitude(uint8_t v)
+    {
+        return v < 128 ? v : 256u - v;
+    }
+
+    // Adaptive's cost of each filter for one row, without writing any: the filtered bytes read as signed and
+    // summed by magnitude. One pass, so the row is read once instead of five times.
+    static void RowCosts(const uint8_t* cur, const uint8_t* prev, size_t n, size_t bpp, uint32_t* costs)
+    {
+        uint32_t none = 0, sub = 0, up = 0, average = 0, paeth = 0;
+        for (size_t i = 0; i < bpp; ++i)
+        {
+            none += Magnitude(cur[i]);
+            sub += Magnitude(cur[i]);
+            up += Magnitude(static_cast<uint8_t>(cur[i] - prev[i]));
+            average += Magnitude(static_cast<uint8_t>(cur[i] - (prev[i] >> 1)));
+            paeth += Magnitude(static_cast<uint8_t>(cur[i] - prev[i]));
+        }
+        for (size_t i = bpp; i < n; ++i)
+        {
+            const uint8_t x = cur[i];
+            const uint8_t a = cur[i - bpp];
+            const uint8_t b = prev[i];
+            const uint8_t c = prev[i - bpp];
+            none += Magnitude(x);
+            sub += Magnitude(static_cast<uint8_t>(x - a));
+            up += Magnitude(static_cast<uint8_t>(x - b));
+            average += Magnitude(static_cast<uint8_t>(x - ((a + b) >> 1)));
+            paeth += Magnitude(static_cast<uint8_t>(x - Paeth(a, b, c)));
+        }
+        costs[0] = none;
+        costs[1] = sub;
+        costs[2] = up;
+        costs[3] = average;
+        costs[4] = paeth;
+    }
+
+    // Filters cur (prev is the row above, zeros for the first) with one filter into out.
+    static void FilterRow(uint32_t filter, const uint8_t* cur, const uint8_t* prev, size_t n, size_t bpp, uint8_t* out)
+    {
+        switch (filter)
+        {
+        case 0:
+            std::memcpy(out, cur, n);
+            break;
+        case 1:
+            for (size_t i = 0; i < bpp; ++i) out[i] = cur[i];
+            for (size_t i = bpp; i < n; ++i) out[i] = static_cast<uint8_t>(cur[i] - cur[i - bpp]);
+            break;
+        case 2:
+            for (size_t i = 0; i < n; ++i) out[i] = static_cast<uint8_t>(cur[i] - prev[i]);
+            break;
+        case 3:
+            for (size_t i = 0; i < bpp; ++i) out[i] = static_cast<uint8_t>(cur[i] - (prev[i] >> 1));
+            for (size_t i = bpp; i < n; ++i) out[i] = static_cast<uint8_t>(cur[i] - ((cur[i - bpp] + prev[i]) >> 1));
+            break;
+        default:
+            for (size_t i = 0; i < bpp; ++i) out[i] = static_cast<uint8_t>(cur[i] - prev[i]);
+            for (size_t i = bpp; i < n; ++i) out[i] = static_cast<uint8_t>(cur[i] - Paeth(cur[i - bpp], prev[i], prev[i - bpp]));
+            break;
+        }
+    }
+
+    // Huffman code lengths for freq[0, n), none longer than limit: a two-queue Huffman build over the used
+    // symbols, with the frequencies halved and rebuilt until the deepest leaf fits. A lone used symbol gets a
+    // partner so that every decoder accepts the code.
+    static void BuildCodeLengths(const uint32_t* freq, uint32_t n, uint32_t limit, uint8_t* lengths)
+    {
+        struct Leaf { uint32_t freq; uint16_t symbol; };
+        std::array<Leaf, kLitLenCodes> leaves;
+        std::array<uint32_t, 2 * kLitLenCodes> weight;
+        std::array<uint16_t, 2 * kLitLenCodes> parent;
+        std::array<uint8_t, 2 * kLitLenCodes> depth;
+
+        std::fill(lengths, lengths + n, static_cast<uint8_t>(0));
+        uint32_t m = 0;
+        for (uint32_t s = 0; s < n; ++s)
+            if (freq[s]) leaves[m++] = { freq[s], static_cast<uint16_t>(s) };
+        if (m == 0) return;
+        if (m == 1)
+        {
+            lengths[leaves[0].symbol] = 1;
+            lengths[leaves[0].symbol == 0 ? 1 : 0] = 1;
+            return;
+        }
+        std::sort(leaves.begin(), leaves.begin() + m,
+            [](const Leaf& a, const Leaf& b) { return a.freq != b.freq ? a.freq < b.freq : a.symbol < b.symbol; });
+
+        for (uint32_t shift = 0;; ++shift)
+        {
+            for (uint32_t i = 0; i < m; ++i) weight[i] = std::max(1u, leaves[i].freq >> shift);
+            // Halving can break the order only between equal-after-shift neighbours, which does not matter.
+            uint32_t leaf = 0, inner = m, next = m;
+            auto take = [&]() -> uint32_t
+            {
+                if (leaf < m && (inner >= next || weight[leaf] <= weight[inner])) return leaf++;
+                return inner++;
+            };
+            for (; next < 2 * m - 1; ++next)
+            {
+                const uint32_t a = take();
+                const uint32_t b = take();
+                weight[next] = weight[a] + weight[b];
+                parent[a] = parent[b] = static_cast<uint16_t>(next);
+            }
+
+            uint32_t deepest = 0;
+            depth[2 * m - 2] = 0;
+            for (uint32_t i = 2 * m - 2; i-- > 0;)
+            {
+                depth[i] = static_cast<uint8_t>(depth[parent[i]] + 1);
+                if (i < m) deepest = std::max<uint32_t>(deepest, depth[i]);
+            }
+            if (deepest <= limit)
+            {
+                for (uint32_t i = 0; i < m; ++i) lengths[leaves[i].symbol] = depth[i];
+                return;
+            }
+        }
+    }
+
+    // Canonical codes (RFC 1951 3.2.2), bit-reversed for the LSB-first writer.
+    static void BuildCodes(const uint8_t* lengths, uint32_t n, uint16_t* codes)
+    {
+        uint32_t count[kMaxCodeLength + 1] = {};
+        for (uint32_t s = 0; s < n; ++s) ++count[lengths[s]];
+        count[0] = 0;
+        uint32_t next[kMaxCodeLength + 1] = {};
+        uint32_t code = 0;
+        for (uint32_t bits = 1; bits <= kMaxCodeLength; ++bits)
+        {
+            code = (code + count[bits - 1]) << 1;
+            next[bits] = code;
+        }
+        for (uint32_t s = 0; s < n; ++s)
+        {
+            const uint32_t len = lengths[s];
+            if (!len) continue;
+            const uint32_t c = next[len]++;
+            uint32_t reversed = 0;
+            for (uint32_t b = 0; b < len; ++b) reversed |= ((c >> b) & 1u) << (len - 1 - b);
+            codes[s] = static_cast<uint16_t>(reversed);
+        }
+    }
+
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(uint8_t* p) : p_(p) {}
+
+        // count <= 32.
+        void Put(uint32_t bits, uint32_t count)
+        {
+            acc_ |= static_cast<uint64_t>(bits) << count_;
+            count_ += count;
+            if (count_ >= 32)
+            {
+                p_[0] = static_cast<uint8_t>(acc_);
+                p_[1] = static_cast<uint8_t>(acc_ >> 8);
+                p_[2] = static_cast<uint8_t>(acc_ >> 16);
+                p_[3] = static_cast<uint8_t>(acc_ >> 24);
+                p_ += 4;
+                acc_ >>= 32;
+                count_ -= 32;
+            }
+        }
+
+        // Pads to a byte boundary and returns where the next byte goes.
+        uint8_t* Flush()
+        {
+            while (count_ > 0)
+            {
+                *p_++ = static_cast<uint8_t>(acc_);
+                acc_ >>= 8;
+                count_ = count_ > 8 ? count_ - 8 : 0;
+            }
+            return p_;
+        }
+
+        void Reset(uint8_t* p) { p_ = p; }
+
+    private:
+        uint8_t* p_;
+        uint64_t acc_ = 0;
+        uint32_t count_ = 0;
+    };
+
+    static void PutStored(BitWriter& bw, const uint8_t* data, size_t size, bool final)
+    {
+        do
+        {
+            const size_t n = std::min(size, kMaxStoredBlock);
+            size -= n;
+            bw.Put(final && size == 0 ? 1u : 0u, 3);
+            uint8_t* p = bw.Flush();
+            p[0] = static_cast<uint8_t>(n);
+            p[1] = static_cast<uint8_t>(n >> 8);
+            p[2] = static_cast<uint8_t>(~n);
+            p[3] = static_cast<uint8_t>(~n >> 8);
+            std::memcpy(p + 4, data, n);
+            data += n;
+            bw.Reset(p + 4 + n);
+        } while (size > 0);
+    }
+
+    static size_t StoredBits(size_t size)
+    {
+        const size_t blocks = std::max<size_t>(1, (size + kMaxStoredBlock - 1) / kMaxStoredBlock);
+        return (size + blocks * 5) * 8 + 8;
+    }
+
+    // Writes one block of symbols with its own Huffman codes, or stored when that is smaller (noise, photos).
+    static void PutBlock(BitWriter& bw, const uint32_t* symbols, size_t symbolCount, const uint8_t* raw, size_t rawSize, bool final)
+    {
+        uint32_t litFreq[kLitLenCodes] = {};
+        uint32_t distFreq[kDistCodes] = {};
+        for (size_t i = 0; i < symbolCount; ++i)
+        {
+            const uint32_t s = symbols[i];
+            if (s & kMatchFlag)
+            {
+                ++litFreq[257 + kTables.lengthCode[((s >> 16) & 0xFF) + 3]];
+                ++distFreq[DistCode(s & 0xFFFF)];
+            }
+            else
+            {
+                ++litFreq[s];
+            }
+        }
+        litFreq[256] = 1;
+
+        uint8_t litLen[kLitLenCodes], distLen[kDistCodes];
+        BuildCodeLengths(litFreq, kLitLenCodes, kMaxCodeLength, litLen);
+        BuildCodeLengths(distFreq, kDistCodes, kMaxCodeLength, distLen);
+        if (std::all_of(distLen, distLen + kDistCodes, [](uint8_t l) { return l == 0; })) distLen[0] = distLen[1] = 1;
+
+        uint32_t hlit = kLitLenCodes;
+        while (hlit > 257 && litLen[hlit - 1] == 0) --hlit;
+        uint32_t hdist = kDistCodes;
+        while (hdist > 1 && distLen[hdist - 1] == 0) --hdist;
+
+        // Run-length code the two length tables as one sequence: 16 repeats the previous length 3-6 times, 17 and
+        // 18 repeat zero 3-10 and 11-138 times. Each entry is symbol | extra << 8.
+        uint8_t all[kLitLenCodes + kDistCodes];
+        std::memcpy(all, litLen, hlit);
+        std::memcpy(all + hlit, distLen, hdist);
+        const uint32_t total = hlit + hdist;
+        uint16_t rle[kLitLenCodes + kDistCodes];
+        uint32_t rleCount = 0;
+        uint32_t clFreq[kCodeLengthCodes] = {};
+        for (uint32_t i = 0; i < total;)
+        {
+            const uint8_t len = all[i];
+            uint32_t run = 1;
+            while (i + run < total && all[i + run] == len) ++run;
+            i += run;
+            if (len == 0)
+            {
+                while (run >= 11) { const uint32_t r = std::min(run, 138u); rle[rleCount++] = static_cast<uint16_t>(18 | (r - 11) << 8); ++clFreq[18]; run -= r; }
+                if (run >= 3) { rle[rleCount++] = static_cast<uint16_t>(17 | (run - 3) << 8); ++clFreq[17]; run = 0; }
+            }
+            else
+            {
+                rle[rleCount++] = len;
+                ++clFreq[len];
+                --run;
+                while (run >= 3) { const uint32_t r = std::min(run, 6u); rle[rleCount++] = static_cast<uint16_t>(16 | (r - 3) << 8); ++clFreq[16]; run -= r; }
+            }
+            for (; run > 0; --run) { rle[rleCount++] = len; ++clFreq[len]; }
+        }
+
+        uint8_t clLen[kCodeLengthCodes];
+        BuildCodeLengths(clFreq, kCodeLengthCodes, kMaxCodeLengthCodeLength, clLen);
+        uint32_t hclen = kCodeLengthCodes;
+        while (hclen > 4 && clLen[kCodeLengthOrder[hclen - 1]] == 0) --hclen;
+
+        size_t bits = 3 + 5 + 5 + 4 + 3 * hclen;
+        for (uint32_t i = 0; i < rleCount; ++i)
+        {
+            const uint32_t sym = rle[i] & 0xFF;
+            bits += clLen[sym] + (sym == 16 ? 2 : sym == 17 ? 3 : sym == 18 ? 7 : 0);
+        }
+        for (uint32_t s = 0; s < kLitLenCodes; ++s)
+            bits += static_cast<size_t>(litFreq[s]) * (litLen[s] + (s > 256 ? kTables.lengthExtra[s - 257] : 0));
+        for (uint32_t s = 0; s < kDistCodes; ++s)
+            bits += static_cast<size_t>(distFreq[s]) * (distLen[s] + kTables.distExtra[s]);
+        if (bits >= StoredBits(rawSize))
+        {
+            PutStored(bw, raw, rawSize, final);
+            return;
+        }
+
+        uint16_t litCode[kLitLenCodes] = {}, distCode[kDistCodes] = {}, clCode[kCodeLengthCodes] = {};
+        BuildCodes(litLen, kLitLenCodes, litCode);
+        BuildCodes(distLen, kDistCodes, distCode);
+        BuildCodes(clLen, kCodeLengthCodes, clCode);
+
+        bw.Put(final ? 5u : 4u, 3); // BFINAL, BTYPE 10
+        bw.Put(hlit - 257, 5);
+        bw.Put(hdist - 1, 5);
+        bw.Put(hclen - 4, 4);
+        for (uint32_t i = 0; i < hclen; ++i) bw.Put(clLen[kCodeLengthOrder[i]], 3);
+        for (uint32_t i = 0; i < rleCount; ++i)
+        {
+            const uint32_t sym = rle[i] & 0xFF;
+            bw.Put(clCode[sym], clLen[sym]);
+            if (sym == 16) bw.Put(rle[i] >> 8, 2);
+            else if (sym == 17) bw.Put(rle[i] >> 8, 3);
+            else if (sym == 18) bw.Put(rle[i] >> 8, 7);
+        }
+
+        for (size_t i = 0; i < symbolCount; ++i)
+        {
+            const uint32_t s = symbols[i];
+            if (s & kMatchFlag)
+            {
+                const uint32_t length = ((s >> 16) & 0xFF) + 3;
+                const uint32_t distance = s & 0xFFFF;
+                const uint32_t lc = kTables.lengthCode[length];
+                const uint32_t dc = DistCode(distance);
+                bw.Put(litCode[257 + lc] | ((length - kTables.lengthBase[lc]) << litLen[257 + lc]),
+                    litLen[257 + lc] + kTables.lengthExtra[lc]);
+                bw.Put(distCode[dc] | ((distance - kTables.distBase[dc]) << distLen[dc]), distLen[dc] + kTables.distExtra[dc]);
+            }
+            else
+            {
+                bw.Put(litCode[s], litLen[s]);
+            }
+        }
+        bw.Put(litCode[256], litLen[256]);
+    }
+
+    void PngEncoder::FilterRows(const uint8_t* bgra, uint32_t width, uint32_t height, size_t strideBytes, const PngOptions& options)
+    {
+        OBBOOK_TRACE_SCOPE("Png.Filter");
+        const size_t bpp = options.keepAlpha ? 4 : 3;
+        const size_t rowBytes = static_cast<size_t>(width) * bpp;
+        raw_.assign(rowBytes * 2, 0);
+        filtered_.resize((rowBytes + 1) * height);
+
+        uint8_t* prev = raw_.data();
+        uint8_t* cur = raw_.data() + rowBytes;
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const uint8_t* src = bgra + y * strideBytes;
+            if (options.keepAlpha)
+            {
+                for (uint32_t x = 0; x < width; ++x, src += 4)
+                {
+                    cur[x * 4 + 0] = src[2];
+                    cur[x * 4 + 1] = src[1];
+                    cur[x * 4 + 2] = src[0];
+                    cur[x * 4 + 3] = src[3];
+                }
+            }
+            else
+            {
+                for (uint32_t x = 0; x < width; ++x, src += 4)
+                {
+                    cur[x * 3 + 0] = src[2];
+                    cur[x * 3 + 1] = src[1];
+                    cur[x * 3 + 2] = src[0];
+                }
+            }
+
+            uint8_t* out = filtered_.data() + y * (rowBytes + 1);
+            uint32_t filter = static_cast<uint32_t>(options.filter);
+            if (options.filter == PngFilter::Adaptive)
+            {
+                uint32_t costs[kFilterCount];
+                RowCosts(cur, prev, rowBytes, bpp, costs);
+                filter = static_cast<uint32_t>(std::min_element(costs, costs + kFilterCount) - costs);
+            }
+            FilterRow(filter, cur, prev, rowBytes, bpp, out + 1);
+            out[0] = static_cast<uint8_t>(filter);
+            std::swap(prev, cur);
+        }
+    }
+
+    // Writes the zlib stream (RFC 1950) of filtered_ to out, which must hold the stored-size bound, and returns
+    // its end.
+    uint8_t* PngEncoder::Deflate(uint32_t level, uint8_t* out)
+    {
+        OBBOOK_TRACE_SCOPE("Png.Deflate");
+        const uint8_t* data = filtered_.data();
+        const size_t size = filtered_.size();
+        out[0] = 0x78;
+        out[1] = level <= 1 ? 0x01 : 0x9C; // FLEVEL is advisory; both keep the header a multiple of 31
+        BitWriter bw(out + 2);
+
+        if (level == 0)
+        {
+            PutStored(bw, data, size, true);
+        }
+        else
+        {
+            const uint32_t maxChain = 1u << (std::min(level, 9u) - 1);
+            const bool chained = maxChain > 1;
+            head_.assign(size_t{ 1 } << kHashBits, -1);
+            if (chained) chain_.resize(kWindowSize);
+            symbols_.resize(kBlockSymbols);
+            uint32_t* symbols = symbols_.data();
+            size_t symbolCount = 0;
+            size_t blockStart = 0;
+
+            auto insert = [&](size_t at)
+            {
+                const uint32_t h = Hash4(data + at);
+                if (chained) chain_[at & (kWindowSize - 1)] = head_[h];
+                head_[h] = static_cast<int32_t>(at);
+            };
+
+            size_t pos = 0;
+            while (pos < size)
+            {
+                uint32_t bestLength = 0, bestDistance = 0;
+                if (pos + kMinMatch <= size)
+                {
+                    const uint32_t limit = static_cast<uint32_t>(std::min<size_t>(kMaxMatch, size - pos));
+                    const uint32_t h = Hash4(data + pos);
+                    int32_t candidate = head_[h];
+                    if (chained) chain_[pos & (kWindowSize - 1)] = candidate;
+                    head_[h] = static_cast<int32_t>(pos);
+                    for (uint32_t probes = maxChain; candidate >= 0 && probes > 0; --probes)
+                    {
+                        const size_t distance = pos - static_cast<size_t>(candidate);
+                        if (distance > kWindowSize) break;
+                        const uint8_t* c = data + candidate;
+                        if (c[bestLength] == data[pos + bestLength] || bestLength == 0)
+                        {
+                            const uint32_t length = MatchLength(c, data + pos, limit);
+                            if (length > bestLength)
+                            {
+                                bestLength = length;
+                                bestDistance = static_cast<uint32_t>(distance);
+                                if (length == limit) break;
+                            }
+                        }
+                        if (!chained) break;
+                        const int32_t older = chain_[static_cast<size_t>(candidate) & (kWindowSize - 1)];
+                        if (older >= candidate) break; // the slot was reused by a newer position
+                        candidate = older;
+                    }
+                }
+
+                if (bestLength >= kMinMatch)
+                {
+                    symbols[symbolCount++] = kMatchFlag | (bestLength - 3) << 16 | bestDistance;
+                    const size_t end = pos + bestLength;
+                    if (bestLength <= kMaxInsertLength || level >= 4)
+                    {
+                        for (size_t at = pos + 1; at < end && at + kMinMatch <= size; ++at) insert(at);
+                    }
+                    else if (end + kMinMatch <= size)
+                    {
+                        insert(end - 1);
+                    }
+                    pos = end;
+                }
+                else
+                {
+                    symbols[symbolCount++] = data[pos++];
+                }
+
+                if (symbolCount == kBlockSymbols)
+                {
+                    PutBlock(bw, symbols, symbolCount, data + blockStart, pos - blockStart, pos == size);
+                    symbolCount = 0;
+                    blockStart = pos;
+                }
+            }
+            if (symbolCount > 0 || blockStart == 0)
+                PutBlock(bw, symbols, symbolCount, data + blockStart, size - blockStart, true);
+        }
+
+        uint8_t* end = bw.Flush();
+        PutBe32(end, Adler32(data, size));
+        return end + 4;
+    }
+
+    bool PngEncoder::Encode(const uint8_t* bgra, uint32_t width, uint32_t height, size_t strideBytes, const PngOptions& options,
+        std::vector<uint8_t>& png)
+    {
+        OBBOOK_TRACE_SCOPE("Png.Encode");
+        const size_t bpp = options.keepAlpha ? 4 : 3;
+        if (!bgra || width == 0 || height == 0 || strideBytes < static_cast<size_t>(width) * 4) return false;
+        // Match positions are 31-bit and IDAT lengths 32-bit.
+        if ((static_cast<uint64_t>(width) * bpp + 1) * height >= 0x7FFF0000u) return false;
+
+        FilterRows(bgra, width, height, strideBytes, options);
+
+        // No block is written larger than storing its bytes, so size the output once for that and write in place.
+        // Every symbol block stores in its own 64 KiB pieces, so a block of kBlockSymbols bytes splits into two;
+        // each piece costs 4 length bytes plus up to 2 of header bits and padding, and each block may pad once more.
+        const size_t payload = filtered_.size();
+        const size_t blocks = payload / kBlockSymbols + 1;
+        const size_t pieces = payload / kMaxStoredBlock + blocks;
+        const size_t zlibBound = 2 + payload + 6 * pieces + blocks + 1 + 4;
+        png.resize(sizeof(kSignature) + 25 + 8 + zlibBound + 4 + 12);
+        uint8_t* p = png.data();
+        std::memcpy(p, kSignature, sizeof(kSignature));
+        p += sizeof(kSignature);
+
+        PutBe32(p, 13);
+        std::memcpy(p + 4, "IHDR", 4);
+        PutBe32(p + 8, width);
+        PutBe32(p + 12, height);
+        p[16] = 8;                          // bit depth
+        p[17] = options.keepAlpha ? 6 : 2;  // RGBA or RGB
+        p[18] = 0;                          // deflate
+        p[19] = 0;                          // adaptive filtering
+        p[20] = 0;                          // not interlaced
+        PutBe32(p + 21, Crc32(0, p + 4, 17));
+        p += 25;
+
+        std::memcpy(p + 4, "IDAT", 4);
+        uint8_t* const zlibBegin = p + 8;
+        const size_t zlibBytes = static_cast<size_t>(Deflate(options.level, zlibBegin) - zlibBegin);
+        PutBe32(p, static_cast<uint32_t>(zlibBytes));
+        PutBe32(zlibBegin + zlibBytes, Crc32(0, p + 4, 4 + zlibBytes));
+
+        p = zlibBegin + zlibBytes + 4;
+        PutBe32(p, 0);
+        std::memcpy(p + 4, "IEND", 4);
+        PutBe32(p + 8, Crc32(0, p + 4, 4));
+        png.resize(static_cast<size_t>(p + 12 - png.data()));
+        return true;
+    }
+
+    bool EncodePng(const uint8_t* bgra, uint32_t width, uint32_t height, size_t strideBytes, const PngOptions& options,
+        std::vector<uint8_t>& png)
+    {
+        thread_local PngEncoder encoder;
+        return encoder.Encode(bgra, width, height, strideBytes, options, png);
+    }
+
+    bool WritePngFile(const std::string& pathUtf8, const uint8_t* bgra, uint32_t width, uint32_t height, size_t strideBytes,
+        const PngOptions& options)
+    {
+        thread_local std::vector<uint8_t> png;
+        if (!EncodePng(bgra, width, height, strideBytes, options, png)) return false;
+        OBBOOK_TRACE_SCOPE("Png.Write");
+        std::ofstream out(fs::path(pathUtf8), std::ios::binary | std::ios::trunc);
+        return out && out.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+    }
+
+    // Inflate (RFC 1951) for DecodePng. Codes are looked up in one table indexed by the next maxBits input bits.
+    class Inflater
+    {
+    public:
+        Inflater(const uint8_t* p, size_t n) : p_(p), end_(p + n) {}
+
+        bool Run(std::vector<uint8_t>& out)
+        {
+            bool final = false;
+            while (!final)
+            {
+                final = Bits(1) != 0;
+                const uint32_t type = Bits(2);
+                bool ok = false;
+                if (type == 0) ok = Stored(out);
+                else if (type == 1) ok = Fixed() && Codes(out);
+                else if (type == 2) ok = Dynamic() && Codes(out);
+                if (!ok || overrun_) return false;
+            }
+            // Whole bytes still in the accumulator belong to the zlib trailer.
+            p_ -= count_ / 8;
+            return true;
+        }
+
+        const uint8_t* Position() const { return p_; }
+
+    private:
+        struct Table
+        {
+            std::vector<uint16_t> entries; // symbol << 4 | length; 0 marks a code the table does not have
+            uint32_t maxBits = 0;
+        };
+
+        void Need(uint32_t n)
+        {
+            while (count_ < n)
+            {
+                if (p_ < end_) acc_ |= static_cast<uint64_t>(*p_++) << count_;
+                else overrun_ = true;
+                count_ += 8;
+            }
+        }
+
+        uint32_t Bits(uint32_t n)
+        {
+            if (n == 0) return 0;
+            Need(n);
+            const uint32_t v = static_cast<uint32_t>(acc_ & ((uint64_t{ 1 } << n) - 1));
+            acc_ >>= n;
+            count_ -= n;
+            return v;
+        }
+
+        static bool Build(const uint8_t* lengths, uint32_t n, Table& t)
+        {
+            uint16_t codes[kLitLenCodes + kDistCodes] = {};
+            uint32_t count[kMaxCodeLength + 1] = {};
+            t.maxBits = 0;
+            for (uint32_t s = 0; s < n; ++s)
+            {
+                ++count[lengths[s]];
+                t.maxBits = std::max<uint32_t>(t.maxBits, lengths[s]);
+            }
+            count[0] = 0;
+            int left = 1;
+            for (uint32_t bits = 1; bits <= kMaxCodeLength; ++bits)
+            {
+                left = (left << 1) - static_cast<int>(count[bits]);
+                if (left < 0) return false; // over-subscribed
+            }
+            BuildCodes(lengths, n, codes);
+            t.entries.assign(size_t{ 1 } << t.maxBits, 0);
+            for (uint32_t s = 0; s < n; ++s)
+            {
+                const uint32_t len = lengths[s];
+                if (!len) continue;
+                for (uint32_t i = codes[s]; i < t.entries.size(); i += 1u << len)
+                    t.entries[i] = static_cast<uint16_t>(s << 4 | len);
+            }
+            return true;
+        }
+
+        bool Decode(const Table& t, uint32_t& symbol)
+        {
+            if (t.maxBits == 0) return false;
+            Need(t.maxBits);
+            const uint16_t e = t.entries[acc_ & ((uint64_t{ 1 } << t.maxBits) - 1)];
+            if (e == 0) return false;
+            acc_ >>= e & 0xF;
+            count_ -= e & 0xF;
+            symbol = e >> 4;
+            return true;
+        }
+
+        bool Stored(std::vector<uint8_t>& out)
+        {
+            Bits(count_ % 8);
+            const uint32_t len = Bits(16);
+            if ((Bits(16) ^ 0xFFFF) != len) return false;
+            for (uint32_t i = 0; i < len; ++i) out.push_back(static_cast<uint8_t>(Bits(8)));
+            return true;
+        }
+
+        bool Fixed()
+        {
+            uint8_t lengths[288 + kDistCodes];
+            std::fill(lengths, lengths + 144, static_cast<uint8_t>(8));
+            std::fill(lengths + 144, lengths + 256, static_cast<uint8_t>(9));
+            std::fill(lengths + 256, lengths + 280, static_cast<uint8_t>(7));
+            std::fill(lengths + 280, lengths + 288, static_cast<uint8_t>(8));
+            std::fill(lengths + 288, lengths + 288 + kDistCodes, static_cast<uint8_t>(5));
+            return Build(lengths, kLitLenCodes, lit_) && Build(lengths + 288, kDistCodes, dist_);
+        }
+
+        bool Dynamic()
+        {
+            const uint32_t hlit = Bits(5) + 257;
+            const uint32_t hdist = Bits(5) + 1;
+            const uint32_t hclen = Bits(4) + 4;
+            if (hlit > kLitLenCodes || hdist > kDistCodes) return false;
+            uint8_t clLen[kCodeLengthCodes] = {};
+            for (uint32_t i = 0; i < hclen; ++i) clLen[kCodeLengthOrder[i]] = static_cast<uint8_t>(Bits(3));
+            Table cl;
+            if (!Build(clLen, kCodeLengthCodes, cl)) return false;
+
+            uint8_t lengths[kLitLenCodes + kDistCodes] = {};
+            for (uint32_t i = 0; i < hlit + hdist;)
+            {
+                uint32_t sym;
+                if (!Decode(cl, sym)) return false;
+                if (sym < 16) { lengths[i++] = static_cast<uint8_t>(sym); continue; }
+                uint32_t repeat;
+                uint8_t value = 0;
+                if (sym == 16)
+                {
+                    if (i == 0) return false;
+                    value = lengths[i - 1];
+                    repeat = 3 + Bits(2);
+                }
+                else
+                {
+                    repeat = sym == 17 ? 3 + Bits(3) : 11 + Bits(7);
+                }
+                if (i + repeat > hlit + hdist) return false;
+                while (repeat--) lengths[i++] = value;
+            }
+            if (lengths[256] == 0) return false;
+            uint8_t distLengths[kDistCodes] = {};
+            std::memcpy(distLengths, lengths + hlit, hdist);
+            std::fill(lengths + hlit, lengths + kLitLenCodes, static_cast<uint8_t>(0));
+            return Build(lengths, kLitLenCodes, lit_) && Build(distLengths, kDistCodes, dist_);
+        }
+
+        bool Codes(std::vector<uint8_t>& out)
+        {
+            for (;;)
+            {
+                uint32_t sym;
+                if (!Decode(lit_, sym) || overrun_) return false;
+                if (sym < 256) { out.push_back(static_cast<uint8_t>(sym)); continue; }
+                if (sym == 256) return true;
+                sym -= 257;
+                if (sym >= 29) return false;
+                const uint32_t length = kTables.lengthBase[sym] + Bits(kTables.lengthExtra[sym]);
+                uint32_t dc;
+                if (!Decode(dist_, dc) || dc >= kDistCodes) return false;
+                const uint32_t distance = kTables.distBase[dc] + Bits(kTables.distExtra[dc]);
+                if (distance > out.size()) return false;
+                const size_t from = out.size() - distance;
+                for (uint32_t i = 0; i < length; ++i) out.push_back(out[from + i]);
+            }
+        }
+
+        const uint8_t* p_;
+        const uint8_t* end_;
+        uint64_t acc_ = 0;
+        uint32_t count_ = 0;
+        bool overrun_ = false;
+        Table lit_, dist_;
+    };
+
+    bool DecodePng(const uint8_t* data, size_t size, uint32_t& width, uint32_t& height, std::vector<uint8_t>& bgra)
+    {
+        OBBOOK_TRACE_SCOPE("Png.Decode");
+        width = height = 0;
+        bgra.clear();
+        if (size < sizeof(kSignature) || std::memcmp(data, kSignature, sizeof(kSignature)) != 0) return false;
+
+        uint32_t w = 0, h = 0;
+        size_t bpp = 0;
+        std::vector<uint8_t> zlib;
+        bool ended = false;
+        for (size_t at = sizeof(kSignature); !ended;)
+        {
+            if (size - at < 12) return false;
+            const uint32_t length = GetBe32(data + at);
+            if (length > size - at - 12) return false;
+            const uint8_t* type = data + at + 4;
+            const uint8_t* body = data + at + 8;
+            if (GetBe32(body + length) != Crc32(0, type, 4 + static_cast<size_t>(length))) return false;
+            if (std::memcmp(type, "IHDR", 4) == 0)
+            {
+                if (length != 13) return false;
+                w = GetBe32(body);
+                h = GetBe32(body + 4);
+                if (body[8] != 8 || (body[9] != 2 && body[9] != 6) || body[10] != 0 || body[11] != 0 || body[12] != 0) return false;
+                bpp = body[9] == 6 ? 4 : 3;
+            }
+            else if (std::memcmp(type, "IDAT", 4) == 0)
+            {
+                zlib.insert(zlib.end(), body, body + length);
+            }
+            else if (std::memcmp(type, "IEND", 4) == 0)
+            {
+                ended = true;
+            }
+            at += 12 + static_cast<size_t>(length);
+        }
+        if (w == 0 || h == 0 || bpp == 0 || zlib.size() < 6) return false;
+        if ((zlib[0] & 0x0F) != 8 || ((zlib[0] << 8) | zlib[1]) % 31 != 0 || (zlib[1] & 0x20)) return false;
+
+        const size_t rowBytes = static_cast<size_t>(w) * bpp;
+        std::vector<uint8_t> rows;
+        rows.reserve((rowBytes + 1) * h);
+        Inflater inflater(zlib.data() + 2, zlib.size() - 2);
+        if (!inflater.Run(rows) || rows.size() != (rowBytes + 1) * h) return false;
+        const uint8_t* trailer = inflater.Position();
+        if (trailer + 4 > zlib.data() + zlib.size() || GetBe32(trailer) != Adler32(rows.data(), rows.size())) return false;
+
+        // Unfilter in place; the row above is already reconstructed.
+        bgra.resize(static_cast<size_t>(w) * h * 4);
+        const std::vector<uint8_t> zero(rowBytes, 0);
+        for (uint32_t y = 0; y < h; ++y)
+        {
+            uint8_t* cur = rows.data() + y * (rowBytes + 1);
+            const uint8_t filter = *cur++;
+            const uint8_t* prev = y ? rows.data() + (y - 1) * (rowBytes + 1) + 1 : zero.data();
+            for (size_t i = 0; i < rowBytes; ++i)
+            {
+                const uint8_t a = i >= bpp ? cur[i - bpp] : 0;
+                const uint8_t c = i >= bpp ? prev[i - bpp] : 0;
+                switch (filter)
+                {
+                case 0: break;
+                case 1: cur[i] = static_cast<uint8_t>(cur[i] + a); break;
+                case 2: cur[i] = static_cast<uint8_t>(cur[i] + prev[i]); break;
+                case 3: cur[i] = static_cast<uint8_t>(cur[i] + ((a + prev[i]) >> 1)); break;
+                case 4: cur[i] = static_cast<uint8_t>(cur[i] + Paeth(a, prev[i], c)); break;
+                default: return false;
+                }
+            }
+            uint8_t* dst = bgra.data() + static_cast<size_t>(y) * w * 4;
+            for (uint32_t x = 0; x < w; ++x, dst += 4, cur += bpp)
+            {
+                dst[0] = cur[2];
+                dst[1] = cur[1];
+                dst[2] = cur[0];
+                dst[3] = bpp == 4 ? cur[3] : 0xFF;
+            }
+        }
+        width = w;
+        height = h;
+        return true;
+    }
+
+    bool ReadPngFile(const std::string& pathUtf8, uint32_t& width, uint32_t& height, std::vector<uint8_t>& bgra)
+    {
+        std::ifstream in(fs::path(pathUtf8), std::ios::binary);
+        if (!in) return false;
+        const std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return DecodePng(data.data(), data.size(), width, height, bgra);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace obbook
+{
+    // PNG row filter. Adaptive picks, per row, the filter with the smallest sum of absolute filtered bytes (the
+    // usual heuristic); it costs several times more than a fixed filter and rarely pays off on rendered pages,
+    // which are mostly flat paper and ink. Sub is the default: as cheap as any, and it helps on page textures.
+    enum class PngFilter : uint8_t
+    {
+        None,
+        Sub,
+        Up,
+        Average,
+        Paeth,
+        Adaptive,
+    };
+
+    struct PngOptions
+    {
+        PngFilter filter = PngFilter::Sub;
+        // 0 stores the rows uncompressed; 1 is a greedy single-probe match finder, each level above doubles how
+        // far back it searches (up to 9). Every level writes dynamic Huffman blocks.
+        uint32_t level = 1;
+        bool keepAlpha = false; // false writes 8-bit RGB and drops alpha
+    };
+
+    // Dependency-free PNG writer for BGRA8 frames. Scratch buffers (filtered rows, match finder tables, symbol
+    // buffer) are kept between calls, so encoding pages of one size does not allocate after the first; give
+    // each thread its own encoder.
+    class PngEncoder
+    {
+    public:
+        // Encodes width x height BGRA8 pixels, rows strideBytes apart, into png (resized; keeps its capacity).
+        // False only for an empty or oversized image.
+        bool Encode(const uint8_t* bgra, uint32_t width, uint32_t height, size_t strideBytes, const PngOptions& options,
+            std::vector<uint8_t>& png);
+
+    private:
+        void FilterRows(const uint8_t* bgra, uint32_t width, uint32_t height, size_t strideBytes, const PngOptions& options);
+        uint8_t* Deflate(uint32_t level, uint8_t* out);
+
+        std::vector<uint8_t> raw_;      // current and previous unfiltered row
+        std::vector<uint8_t> filtered_; // filter byte + filtered row, for every row: the zlib payload
+        std::vector<int32_t> head_;     // match finder: last position per hash
+        std::vector<int32_t> chain_;    // previous position with the same hash, per window slot
+        std::vector<uint32_t> symbols_; // one block of literals and (length, distance) pairs
+    };
+
+    // One-shot helpers around a thread-local encoder.
+    bool EncodePng(const uint8_t* bgra, uint32_t width, uint32_t height, size_t strideBytes, const PngOptions& options,
+        std::vector<uint8_t>& png);
+    bool WritePngFile(const std::string& pathUtf8, const uint8_t* bgra, uint32_t width, uint32_t height, size_t strideBytes,
+        const PngOptions& options);
+
+    // Reads back 8-bit, non-interlaced RGB or RGBA PNGs (what PngEncoder writes) as tightly packed BGRA8, e.g. to
+    // compare exported pages with stored ones. False for anything else or on a checksum mismatch.
+    bool DecodePng(const uint8_t* data, size_t size, uint32_t& width, uint32_t& height, std::vector<uint8_t>& bgra);
+    bool ReadPngFile(const std::string& pathUtf8, uint32_t& width, uint32_t& height, std::vector<uint8_t>& bgra);
+}
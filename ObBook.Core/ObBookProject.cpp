@@ -0,0 +1,158 @@
+#include "ObBookProject.h"
+#include "ObBookTrace.h"
+#include <chrono>
+#include <cstring>
+
+namespace obbook
+{
+    // 64-bit hash that consumes 8 bytes per step; not cryptographic, only a change detector.
+    static uint64_t Mix64(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+    {
+        const auto* p = static_cast<const uint8_t*>(data);
+        uint64_t h = seed ^ (size * 0x9E3779B97F4A7C15ull);
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t v;
+            std::memcpy(&v, p + i, sizeof(v));
+            h = (h ^ Mix64(v)) * 0x9E3779B97F4A7C15ull;
+            h = (h << 31) | (h >> 33);
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, p + i, size - i);
+        return Mix64(h ^ Mix64(tail ^ (size - i)));
+    }
+
+    static uint64_t HashSettings(const ProjectSettings& s)
+    {
+        uint64_t h = 0x0B0B5E771165ull;
+        const uint32_t numbers[] = { s.codepage, s.maxImageWidth };
+        const uint8_t flags[] = { s.autoNormalizeSmartQuotes, s.autoNormalizeSlashes, s.groupAdjacentDiagnostics, s.lintImageReferences };
+        h = HashBytes(numbers, sizeof(numbers), h);
+        h = HashBytes(flags, sizeof(flags), h);
+        return HashBytes(s.oblivionDirectoryUtf8.data(), s.oblivionDirectoryUtf8.size(), h);
+    }
+
+    BookProject::BookProject()
+        : settingsHash_(HashSettings(settings_))
+    {
+    }
+
+    void BookProject::SetSettings(const ProjectSettings& settings)
+    {
+        settings_ = settings;
+        settingsHash_ = HashSettings(settings);
+    }
+
+    size_t BookProject::SetBook(const std::string& id, std::string sourceUtf8)
+    {
+        auto [it, inserted] = indexById_.try_emplace(id, books_.size());
+        if (inserted)
+        {
+            books_.emplace_back();
+            books_.back().id = id;
+        }
+        Book& book = books_[it->second];
+        book.sourceHash = HashBytes(sourceUtf8.data(), sourceUtf8.size(), 0);
+        book.sourceUtf8 = std::move(sourceUtf8);
+        return it->second;
+    }
+
+    bool BookProject::RemoveBook(const std::string& id)
+    {
+        auto it = indexById_.find(id);
+        if (it == indexById_.end()) return false;
+        const size_t index = it->second;
+        indexById_.erase(it);
+        books_.erase(books_.begin() + static_cast<std::ptrdiff_t>(index));
+        for (auto& entry : indexById_)
+            if (entry.second > index) --entry.second;
+        return true;
+    }
+
+    size_t BookProject::FindBook(const std::string& id) const
+    {
+        auto it = indexById_.find(id);
+        return it == indexById_.end() ? npos : it->second;
+    }
+
+    uint64_t BookProject::CombinedHash(const Book& book) const
+    {
+        const uint64_t h = Mix64(book.sourceHash ^ Mix64(settingsHash_ + assetEpoch_));
+        return h ? h : 1; // 0 means "never built"
+    }
+
+    bool BookProject::IsStale(size_t index) const
+    {
+        return books_[index].output.contentHash != CombinedHash(books_[index]);
+    }
+
+    void BookProject::InvalidateAssets()
+    {
+        ++assetEpoch_;
+        compiler_.InvalidateAssetScan();
+    }
+
+    void BookProject::InvalidateOutputs()
+    {
+        for (auto& book : books_) book.output.contentHash = 0;
+    }
+
+    BookProject::RebuildStats BookProject::Rebuild(const CancellationToken* cancel)
+    {
+        OBBOOK_TRACE_SCOPE("Project.Rebuild");
+        const auto start = std::chrono::steady_clock::now();
+        RebuildStats stats{};
+
+        compiler_.SetSettings(settings_);
+        for (auto& book : books_)
+        {
+            const uint64_t hash = CombinedHash(book);
+            if (book.output.contentHash == hash)
+            {
+                ++stats.reused;
+                continue;
+            }
+            if (cancel && cancel->IsCancelled())
+            {
+                stats.cancelled = true;
+                break;
+            }
+
+            OBBOOK_TRACE_SCOPE_DETAIL("Project.CompileBook", book.id.c_str());
+            compiler_.SetSourceUtf8(book.sourceUtf8);
+            bool completed = true;
+            if (cancel) completed = compiler_.Compile(*cancel);
+            else compiler_.Compile();
+            if (!completed)
+            {
+                stats.cancelled = true;
+                break;
+            }
+
+            BookOutput& out = book.output;
+            out.normalizedUtf8 = compiler_.GetNormalizedSourceUtf8();
+            out.diagnostics = compiler_.GetDiagnostics();
+            out.summary = compiler_.GetDiagnosticSummary();
+            const size_t messageCount = compiler_.GetDiagnosticMessageCount();
+            out.messages.resize(messageCount);
+            for (size_t i = 0; i < messageCount; ++i)
+                out.messages[i] = compiler_.GetDiagnosticMessage(static_cast<uint16_t>(i));
+            out.contentHash = hash;
+            ++stats.compiled;
+        }
+
+        stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+}
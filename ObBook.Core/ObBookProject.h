@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ObBookCore.h"
+
+namespace obbook
+{
+    // Compiled output of one book, kept until its source or the project settings change.
+    struct BookOutput
+    {
+        uint64_t contentHash{}; // source + settings + asset scan the output was built from
+        std::string normalizedUtf8;
+        std::vector<Diagnostic> diagnostics;
+        DiagnosticSummary summary{};
+        std::vector<std::string> messages; // indexed by Diagnostic::messageId
+    };
+
+    // Many books sharing one ProjectSettings. Each book's source hash is computed when the source is set;
+    // Rebuild() combines it with the settings hash and recompiles only books whose combined hash changed, so
+    // an unchanged rebuild is one comparison per book. A single BookCompiler does the work, so the Data folder
+    // is scanned once per project rather than once per book.
+    class BookProject
+    {
+    public:
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        struct RebuildStats
+        {
+            size_t compiled{};
+            size_t reused{};
+            double milliseconds{};
+            bool cancelled{};
+        };
+
+        BookProject();
+
+        void SetSettings(const ProjectSettings& settings);
+        const ProjectSettings& GetSettings() const { return settings_; }
+
+        // Adds the book, or replaces its source; returns its index. Indexes stay stable until RemoveBook().
+        size_t SetBook(const std::string& id, std::string sourceUtf8);
+        bool RemoveBook(const std::string& id);
+        size_t FindBook(const std::string& id) const;
+
+        size_t BookCount() const { return books_.size(); }
+        const std::string& GetBookId(size_t index) const { return books_[index].id; }
+        const std::string& GetBookSourceUtf8(size_t index) const { return books_[index].sourceUtf8; }
+
+        // Recompiles stale books in index order. A cancelled rebuild keeps what it finished; the rest stay stale.
+        RebuildStats Rebuild(const CancellationToken* cancel = nullptr);
+
+        // Last successful output; contentHash is 0 if the book has never been built.
+        const BookOutput& GetOutput(size_t index) const { return books_[index].output; }
+        bool IsStale(size_t index) const;
+
+        // Rescans the Data folder on the next rebuild; every book is recompiled against the new scan.
+        void InvalidateAssets();
+        // Drops every cached output (the next rebuild compiles everything).
+        void InvalidateOutputs();
+
+        // Persistent cache consulted for stale books before compiling them (not owned; nullptr to detach), so a
+        // fresh process, e.g. a CI run, skips books whose source, settings and asset scan are unchanged.
+        void SetCompileCache(CompileCache* cache) { compiler_.SetCompileCache(cache); }
+
+    private:
+        struct Book
+        {
+            std::string id;
+            std::string sourceUtf8;
+            uint64_t sourceHash{};
+            BookOutput output;
+        };
+
+        ProjectSettings settings_{};
+        uint64_t settingsHash_{};
+        uint64_t assetEpoch_{};
+        std::vector<Book> books_;
+        std::unordered_map<std::string, size_t> indexById_;
+        BookCompiler compiler_;
+
+        uint64_t CombinedHash(const Book& book) const;
+    };
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace obbook
+{
+    // FIPS 180-4 SHA-256, for content-addressed cache keys. Incremental: Update() any number of times, then
+    // Finish() once.
+    class Sha256
+    {
+    public:
+        using Digest = std::array<uint8_t, 32>;
+
+        Sha256();
+
+        void Update(const void* data, size_t size);
+        void Update(std::string_view s) { Update(s.data(), s.size()); }
+        Digest Finish();
+
+        static Digest Hash(std::string_view s);
+        static std::string ToHex(const Digest& digest);
+
+    private:
+        uint32_t state_[8];
+        uint64_t length_ = 0; // bytes consumed so far
+        uint8_t block_[64];
+        size_t blockSize_ = 0;
+
+        void Transform(const uint8_t* block);
+    };
+}
@@ -0,0 +1,87 @@
+#include "ObBookSourceMap.h"
+#include <algorithm>
+
+namespace obbook
+{
+    // One side of the map: where an edit starts and how long it is in the text being translated from or to.
+    struct EditSide
+    {
+        uint32_t SourceMap::Edit::* offset;
+        uint32_t SourceMap::Edit::* length;
+    };
+
+    static constexpr EditSide kSourceSide{ &SourceMap::Edit::sourceOffset, &SourceMap::Edit::sourceLength };
+    static constexpr EditSide kNormalizedSide{ &SourceMap::Edit::normalizedOffset, &SourceMap::Edit::normalizedLength };
+
+    // The last edit starting at or before offset (or, with strict, before it); null if there is none.
+    static const SourceMap::Edit* FindEdit(const std::vector<SourceMap::Edit>& edits, EditSide from, uint32_t offset, bool strict)
+    {
+        auto it = strict
+            ? std::lower_bound(edits.begin(), edits.end(), offset, [from](const SourceMap::Edit& e, uint32_t v) { return e.*from.offset < v; })
+            : std::upper_bound(edits.begin(), edits.end(), offset, [from](uint32_t v, const SourceMap::Edit& e) { return v < e.*from.offset; });
+        return it == edits.begin() ? nullptr : &*(it - 1);
+    }
+
+    // Start of a range: inside an edit it snaps to the start of the counterpart.
+    static uint32_t MapStart(const std::vector<SourceMap::Edit>& edits, EditSide from, EditSide to, uint32_t offset)
+    {
+        const SourceMap::Edit* e = FindEdit(edits, from, offset, false);
+        if (!e) return offset;
+        const uint32_t fromEnd = e->*from.offset + e->*from.length;
+        if (offset < fromEnd) return e->*to.offset;
+        return offset - fromEnd + e->*to.offset + e->*to.length;
+    }
+
+    // End of a range (exclusive): inside an edit it snaps to the end of the counterpart.
+    static uint32_t MapEnd(const std::vector<SourceMap::Edit>& edits, EditSide from, EditSide to, uint32_t offset)
+    {
+        const SourceMap::Edit* e = FindEdit(edits, from, offset, true);
+        if (!e) return offset;
+        const uint32_t fromEnd = e->*from.offset + e->*from.length;
+        if (offset <= fromEnd) return e->*to.offset + e->*to.length;
+        return offset - fromEnd + e->*to.offset + e->*to.length;
+    }
+
+    static TextRange MapRange(const std::vector<SourceMap::Edit>& edits, EditSide from, EditSide to, TextRange range)
+    {
+        const uint32_t start = MapStart(edits, from, to, range.offset);
+        if (range.length == 0) return { start, 0 };
+        return { start, MapEnd(edits, from, to, range.offset + range.length) - start };
+    }
+
+    void SourceMap::AddEdit(size_t sourceOffset, size_t sourceLength, size_t normalizedOffset, size_t normalizedLength)
+    {
+        if (sourceLength == normalizedLength) return;
+        Edit e{};
+        e.sourceOffset = static_cast<uint32_t>(sourceOffset);
+        e.normalizedOffset = static_cast<uint32_t>(normalizedOffset);
+        e.sourceLength = static_cast<uint32_t>(sourceLength);
+        e.normalizedLength = static_cast<uint32_t>(normalizedLength);
+        edits_.push_back(e);
+    }
+
+    void SourceMap::KeepLastEdit()
+    {
+        if (edits_.size() > 1) edits_.erase(edits_.begin(), edits_.end() - 1);
+    }
+
+    uint32_t SourceMap::ToNormalized(uint32_t sourceOffset) const
+    {
+        return MapStart(edits_, kSourceSide, kNormalizedSide, sourceOffset);
+    }
+
+    uint32_t SourceMap::ToSource(uint32_t normalizedOffset) const
+    {
+        return MapStart(edits_, kNormalizedSide, kSourceSide, normalizedOffset);
+    }
+
+    TextRange SourceMap::ToNormalized(TextRange source) const
+    {
+        return MapRange(edits_, kSourceSide, kNormalizedSide, source);
+    }
+
+    TextRange SourceMap::ToSource(TextRange normalized) const
+    {
+        return MapRange(edits_, kNormalizedSide, kSourceSide, normalized);
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace obbook
+{
+    struct TextRange
+    {
+        uint32_t offset{};
+        uint32_t length{};
+    };
+
+    // Piecewise offset map between a source and its normalized text. Only edits that change length are stored
+    // (a 3-byte smart quote that became '"', a stray byte that became U+FFFD); between them both texts advance
+    // in step, so a translation is one binary search. An offset inside an edit snaps to the start of the other
+    // side; ranges widen to cover the whole counterpart of every edit they touch.
+    class SourceMap
+    {
+    public:
+        struct Edit
+        {
+            uint32_t sourceOffset{};
+            uint32_t normalizedOffset{};
+            uint32_t sourceLength{};
+            uint32_t normalizedLength{};
+        };
+
+        // Keeps the capacity, so rebuilding the map for a similar text does not allocate.
+        void Clear() { edits_.clear(); }
+        // Edits are added in text order and must not overlap; one that keeps the length is not stored.
+        void AddEdit(size_t sourceOffset, size_t sourceLength, size_t normalizedOffset, size_t normalizedLength);
+        // Drops every edit but the last; offsets from its start on still translate. Bounds a map kept for a stream.
+        void KeepLastEdit();
+
+        uint32_t ToNormalized(uint32_t sourceOffset) const;
+        uint32_t ToSource(uint32_t normalizedOffset) const;
+        TextRange ToNormalized(TextRange source) const;
+        TextRange ToSource(TextRange normalized) const;
+
+        const std::vector<Edit>& GetEdits() const { return edits_; }
+        size_t GetEditCount() const { return edits_.size(); }
+        size_t GetRetainedBytes() const { return edits_.capacity() * sizeof(Edit); }
+
+    private:
+        std::vector<Edit> edits_;
+    };
+}
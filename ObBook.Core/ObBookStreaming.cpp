@@ -0,0 +1,243 @@
+#include "ObBookStreaming.h"
+#include "ObBookMarkup.h"
+#include "ObBookTrace.h"
+#include <algorithm>
+#include <cstring>
+
+namespace obbook
+{
+    StreamingCompiler::StreamingCompiler(const ProjectSettings& settings, NormalizedFn onNormalized, DiagnosticFn onDiagnostic)
+        : settings_(settings)
+        , onNormalized_(std::move(onNormalized))
+        , onDiagnostic_(std::move(onDiagnostic))
+    {
+    }
+
+    void StreamingCompiler::Reset()
+    {
+        sourceBytes_ = 0;
+        normalizedBytes_ = 0;
+        out_.clear();
+        carrySize_ = 0;
+        std::memset(recent_, 0, sizeof(recent_));
+        inImg_ = false;
+        inQuote_ = false;
+        tagTooLong_ = false;
+        tag_.clear();
+        sourceMap_.Clear();
+        hasPending_ = false;
+        summary_ = {};
+    }
+
+    void StreamingCompiler::Feed(std::string_view chunk)
+    {
+        OBBOOK_TRACE_SCOPE("Streaming.Feed");
+        if (carrySize_ > 0)
+        {
+            const size_t need = Utf8SequenceLength(static_cast<uint8_t>(carry_[0]));
+            const size_t take = std::min(need - carrySize_, chunk.size());
+            std::memcpy(carry_ + carrySize_, chunk.data(), take);
+            carrySize_ += take;
+            chunk.remove_prefix(take);
+            if (carrySize_ < need) return;
+            Process(carry_, carrySize_, true);
+            carrySize_ = 0;
+        }
+
+        const size_t used = Process(chunk.data(), chunk.size(), false);
+        carrySize_ = chunk.size() - used;
+        std::memcpy(carry_, chunk.data() + used, carrySize_);
+        FlushOutput();
+    }
+
+    void StreamingCompiler::Finish()
+    {
+        OBBOOK_TRACE_SCOPE("Streaming.Finish");
+        // A cut-off sequence at the very end decodes byte by byte, as it does at the end of a whole source.
+        Process(carry_, carrySize_, true);
+        carrySize_ = 0;
+
+        // An unterminated IMG tag ends the width checks, as in a whole-source compile.
+        inImg_ = false;
+        inQuote_ = false;
+        tag_.clear();
+
+        FlushPending();
+        FlushOutput();
+    }
+
+    // Returns the bytes consumed; unless atEnd, stops before a UTF-8 sequence the chunk does not complete.
+    // Runs of bytes that cannot change the tag state are emitted in bulk, as in BookCompiler::NormalizeSource.
+    size_t StreamingCompiler::Process(const char* p, size_t size, bool atEnd)
+    {
+        const bool quotes = settings_.autoNormalizeSmartQuotes;
+        size_t i = 0;
+        while (i < size)
+        {
+            const uint8_t stop = (quotes ? kCharNonAscii : 0)
+                | (inImg_ ? kCharTagEnd | kCharQuote | kCharBackslash : kCharTagLast);
+            size_t run = i;
+            while (run < size && (CharClassOf(p[run]) & stop) == 0) ++run;
+            EmitRun(p + i, run - i);
+            sourceBytes_ += run - i;
+            i = run;
+            if (i >= size) break;
+
+            if (quotes && (CharClassOf(p[i]) & kCharNonAscii) != 0)
+            {
+                if (!atEnd && i + Utf8SequenceLength(static_cast<uint8_t>(p[i])) > size) break;
+                const size_t start = i;
+                const uint32_t cp = DecodeUtf8(p, size, i);
+                char bytes[4];
+                const size_t count = IsSmartQuote(cp) ? 1 : EncodeUtf8(cp, bytes);
+                sourceMap_.AddEdit(sourceBytes_, i - start, normalizedBytes_, count);
+                if (!inImg_) sourceMap_.KeepLastEdit(); // outside a tag only the last edit is needed
+                if (IsSmartQuote(cp))
+                {
+                    Report(DiagnosticKind::SmartQuoteNormalized,
+                        { static_cast<uint32_t>(sourceBytes_), static_cast<uint32_t>(i - start) },
+                        { static_cast<uint32_t>(normalizedBytes_), 1 });
+                    Emit('"');
+                }
+                else
+                {
+                    for (size_t k = 0; k < count; ++k) Emit(bytes[k]);
+                }
+                sourceBytes_ += i - start;
+            }
+            else
+            {
+                Emit(p[i++]);
+                ++sourceBytes_;
+            }
+        }
+        return i;
+    }
+
+    void StreamingCompiler::EmitRun(const char* p, size_t size)
+    {
+        if (size == 0) return;
+        out_.append(p, size);
+        normalizedBytes_ += size;
+        if (inImg_ && !tagTooLong_)
+        {
+            if (tag_.size() + size > kMaxImgTagBytes)
+            {
+                tagTooLong_ = true;
+                tag_.clear();
+            }
+            else
+            {
+                tag_.append(p, size);
+            }
+        }
+
+        const size_t keep = std::min<size_t>(size, sizeof(recent_));
+        std::memmove(recent_, recent_ + keep, sizeof(recent_) - keep);
+        std::memcpy(recent_ + sizeof(recent_) - keep, p + size - keep, keep);
+    }
+
+    void StreamingCompiler::Emit(char c)
+    {
+        const uint64_t at = normalizedBytes_;
+        bool closes = false;
+        if (!inImg_)
+        {
+            // "<img" is recognized on its last letter, like the whole-source kernel.
+            if ((CharClassOf(c) & kCharTagLast) != 0 && recent_[0] == '<' && (recent_[1] | 0x20) == 'i' && (recent_[2] | 0x20) == 'm')
+            {
+                inImg_ = true;
+                inQuote_ = false;
+                tagTooLong_ = false;
+                tagOffset_ = at - 3;
+                tag_.assign(recent_, sizeof(recent_));
+            }
+        }
+        else if (c == '>')
+        {
+            closes = true;
+        }
+        else if (c == '"')
+        {
+            inQuote_ = !inQuote_;
+        }
+        else if (c == '\\' && inQuote_ && settings_.autoNormalizeSlashes)
+        {
+            c = '/';
+            ReportNormalized(DiagnosticKind::BackslashNormalized, at, 1);
+        }
+
+        EmitRun(&c, 1);
+        if (!closes) return;
+
+        if (!tagTooLong_)
+        {
+            ScanImgTag(tag_, [this](uint32_t val, size_t off, size_t len)
+            {
+                if (val > settings_.maxImageWidth) ReportNormalized(DiagnosticKind::ImgWidthExceeded, tagOffset_ + off, len);
+            });
+        }
+        inImg_ = false;
+        inQuote_ = false;
+        tag_.clear();
+        sourceMap_.KeepLastEdit();
+    }
+
+    void StreamingCompiler::Report(DiagnosticKind kind, TextRange source, TextRange normalized)
+    {
+        const auto k = static_cast<size_t>(kind);
+        const auto sev = GetBuiltinDiagnosticSeverity(kind);
+        summary_.total++;
+        summary_.bySeverity[static_cast<size_t>(sev)]++;
+        summary_.byKind[k]++;
+
+        Diagnostic d{};
+        d.severity = sev;
+        d.kind = kind;
+        d.messageId = static_cast<uint16_t>(k);
+        d.offset = source.offset;
+        d.length = source.length;
+        d.normalizedOffset = normalized.offset;
+        d.normalizedLength = normalized.length;
+
+        if (!settings_.groupAdjacentDiagnostics)
+        {
+            if (onDiagnostic_) onDiagnostic_(d);
+            return;
+        }
+        // Same rule as BookCompiler::PushDiag, applied in stream order.
+        if (hasPending_ && pending_.kind == kind && d.offset >= pending_.offset && d.offset <= pending_.offset + pending_.length
+            && d.normalizedOffset >= pending_.normalizedOffset && d.normalizedOffset <= pending_.normalizedOffset + pending_.normalizedLength)
+        {
+            pending_.length = std::max(pending_.offset + pending_.length, d.offset + d.length) - pending_.offset;
+            pending_.normalizedLength = std::max(pending_.normalizedOffset + pending_.normalizedLength, d.normalizedOffset + d.normalizedLength)
+                - pending_.normalizedOffset;
+            pending_.count++;
+            return;
+        }
+        FlushPending();
+        pending_ = d;
+        hasPending_ = true;
+    }
+
+    // For diagnostics found in the normalized text; only ever at or after the open tag, which sourceMap_ covers.
+    void StreamingCompiler::ReportNormalized(DiagnosticKind kind, uint64_t offset, uint64_t length)
+    {
+        const TextRange normalized{ static_cast<uint32_t>(offset), static_cast<uint32_t>(length) };
+        Report(kind, sourceMap_.ToSource(normalized), normalized);
+    }
+
+    void StreamingCompiler::FlushPending()
+    {
+        if (!hasPending_) return;
+        hasPending_ = false;
+        if (onDiagnostic_) onDiagnostic_(pending_);
+    }
+
+    void StreamingCompiler::FlushOutput()
+    {
+        if (out_.empty()) return;
+        if (onNormalized_) onNormalized_(out_);
+        out_.clear();
+    }
+}
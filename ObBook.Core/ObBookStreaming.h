@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "ObBookCore.h"
+#include "ObBookSourceMap.h"
+
+namespace obbook
+{
+    // Compiles a document fed in chunks of any size, e.g. a multi-gigabyte concatenated lore dump, in memory
+    // bounded by the chunk size: normalized text and diagnostics go to callbacks as they become final, and
+    // between calls only a partial UTF-8 sequence and the open IMG tag are held. UTF-8 sequences and tags may
+    // straddle chunk boundaries.
+    //
+    // Applies the same fixes and checks as BookCompiler::Compile(), except asset discovery and the IMG
+    // reference lint, which need a Data folder and work per book. Differences from compiling the whole text:
+    //  - diagnostics arrive in stream order rather than pass by pass, so grouping may merge differently;
+    //  - offsets are 32-bit like Diagnostic's and wrap past 4 GiB (use GetSourceBytes() to place a chunk);
+    //  - an IMG tag longer than kMaxImgTagBytes is passed through without the width check.
+    class StreamingCompiler
+    {
+    public:
+        static constexpr size_t kMaxImgTagBytes = 64 * 1024;
+
+        // Called once per Feed()/Finish() that produced output; the view is valid during the call only.
+        using NormalizedFn = std::function<void(std::string_view normalizedUtf8)>;
+        // Diagnostics only use built-in kinds; see GetBuiltinDiagnosticMessage() for the text. They may point
+        // into normalized text that is delivered at the end of the same call.
+        using DiagnosticFn = std::function<void(const Diagnostic& diagnostic)>;
+
+        StreamingCompiler(const ProjectSettings& settings, NormalizedFn onNormalized, DiagnosticFn onDiagnostic);
+
+        void Feed(std::string_view chunkUtf8);
+        // Flushes what was held for the next chunk. Call Reset() before feeding another document.
+        void Finish();
+        void Reset();
+
+        uint64_t GetSourceBytes() const { return sourceBytes_; }
+        uint64_t GetNormalizedBytes() const { return normalizedBytes_; }
+        const DiagnosticSummary& GetDiagnosticSummary() const { return summary_; }
+        // Heap held between calls: the output buffer (about the largest chunk), the longest IMG tag seen and the
+        // source map edits inside it.
+        size_t GetRetainedBytes() const { return out_.capacity() + tag_.capacity() + sourceMap_.GetRetainedBytes(); }
+
+    private:
+        ProjectSettings settings_;
+        NormalizedFn onNormalized_;
+        DiagnosticFn onDiagnostic_;
+
+        uint64_t sourceBytes_{};     // consumed, i.e. not counting carry_
+        uint64_t normalizedBytes_{}; // emitted
+        std::string out_;            // normalized bytes of the current call
+        char carry_[4]{};            // UTF-8 sequence cut off by the end of a chunk
+        size_t carrySize_{};
+        char recent_[3]{};           // last three emitted bytes, so "<img" is found across chunks
+
+        bool inImg_ = false;         // between "<img" and '>'
+        bool inQuote_ = false;       // inside a quoted value of that tag
+        bool tagTooLong_ = false;
+        uint64_t tagOffset_{};
+        std::string tag_;            // the open IMG tag, normalized
+        SourceMap sourceMap_;        // the last edit before the open IMG tag and those inside it
+
+        Diagnostic pending_{};       // held back while later diagnostics may still be grouped into it
+        bool hasPending_ = false;
+        DiagnosticSummary summary_{};
+
+        size_t Process(const char* p, size_t size, bool atEnd);
+        void EmitRun(const char* p, size_t size);
+        void Emit(char c);
+        void Report(DiagnosticKind kind, TextRange source, TextRange normalized);
+        void ReportNormalized(DiagnosticKind kind, uint64_t offset, uint64_t length);
+        void FlushPending();
+        void FlushOutput();
+    };
+}
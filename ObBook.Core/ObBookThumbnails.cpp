@@ -0,0 +1,460 @@
+#include "ObBookThumbnails.h"
+#include "ObBookAssets.h"
+#include "ObBookMemory.h"
+#include "ObBookSha256.h"
+#include "ObBookTrace.h"
+#include "ObBookWorkers.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace obbook
+{
+    // Cache file layout; integers are little-endian (x64 only, so written as-is):
+    //   header   "OBTH", u32 format, u32 maxEdge, u32 reserved
+    //   records  key[32], u32 width, u32 height, pixels[width * height * 4]   (0 x 0 remembers a failure)
+    // Records are only ever appended; a torn last one (a crash mid-append) is cut off when the file is opened.
+    static constexpr char kMagic[4] = { 'O', 'B', 'T', 'H' };
+    static constexpr uint32_t kFormatVersion = 1;
+    static constexpr size_t kHeaderBytes = 16;
+    static constexpr size_t kKeyBytes = 32;
+    static constexpr size_t kRecordHeaderBytes = kKeyBytes + 8;
+
+    // Read-only mapping of a whole file; an empty file maps to nothing.
+    class MappedFile
+    {
+    public:
+        static std::shared_ptr<const MappedFile> Open(const fs::path& path)
+        {
+            auto file = std::shared_ptr<MappedFile>(new MappedFile());
+#if defined(_WIN32)
+            const HANDLE handle = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (handle == INVALID_HANDLE_VALUE) return nullptr;
+            LARGE_INTEGER size{};
+            bool ok = ::GetFileSizeEx(handle, &size) != 0;
+            if (ok && size.QuadPart > 0)
+            {
+                const HANDLE mapping = ::CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                ok = mapping != nullptr;
+                if (ok)
+                {
+                    // The view keeps the file and the mapping object alive on its own.
+                    file->data_ = static_cast<const uint8_t*>(::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                    file->size_ = static_cast<size_t>(size.QuadPart);
+                    ok = file->data_ != nullptr;
+                    ::CloseHandle(mapping);
+                }
+            }
+            ::CloseHandle(handle);
+#else
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) return nullptr;
+            struct stat st{};
+            bool ok = ::fstat(fd, &st) == 0;
+            if (ok && st.st_size > 0)
+            {
+                void* data = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+                ok = data != MAP_FAILED;
+                if (ok)
+                {
+                    file->data_ = static_cast<const uint8_t*>(data);
+                    file->size_ = static_cast<size_t>(st.st_size);
+                }
+            }
+            ::close(fd);
+#endif
+            if (!ok) return nullptr;
+            return file;
+        }
+
+        ~MappedFile()
+        {
+            if (!data_) return;
+#if defined(_WIN32)
+            ::UnmapViewOfFile(data_);
+#else
+            ::munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const uint8_t* Data() const { return data_; }
+        size_t Size() const { return size_; }
+
+    private:
+        MappedFile() = default;
+
+        const uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    template <typename T>
+    static void Put(std::string& out, T value)
+    {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        out.append(bytes, sizeof(T));
+    }
+
+    template <typename T>
+    static T Get(const uint8_t* p)
+    {
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        return value;
+    }
+
+    // Everything that identifies the bytes of the texture, plus what shapes the thumbnail.
+    static std::string MakeKey(uint32_t maxEdge, const std::string& virtualPath, const AssetLocation& l)
+    {
+        Sha256 h;
+        const uint64_t numbers[] = { kFormatVersion, maxEdge, l.inArchive ? 1u : 0u, l.offset, l.size, l.containerSize,
+            static_cast<uint64_t>(l.containerWriteTime), virtualPath.size(), l.containerUtf8.size() };
+        h.Update(numbers, sizeof(numbers));
+        h.Update(virtualPath);
+        h.Update(l.containerUtf8);
+        const auto digest = h.Finish();
+        return std::string(reinterpret_cast<const char*>(digest.data()), digest.size());
+    }
+
+    struct BuiltThumbnail
+    {
+        uint32_t width{};
+        uint32_t height{};
+        std::vector<uint8_t> bgra; // empty for a failure
+    };
+
+    // Box filter down to fit maxEdge x maxEdge with the aspect ratio kept; the decoded mip as-is when it fits.
+    static void FitThumbnail(std::vector<uint8_t>& src, uint32_t sw, uint32_t sh, uint32_t maxEdge, BuiltThumbnail& out)
+    {
+        const uint32_t longest = std::max(sw, sh);
+        if (longest <= maxEdge)
+        {
+            out.width = sw;
+            out.height = sh;
+            out.bgra.swap(src);
+            return;
+        }
+        const uint32_t w = std::max(1u, static_cast<uint32_t>(static_cast<uint64_t>(sw) * maxEdge / longest));
+        const uint32_t h = std::max(1u, static_cast<uint32_t>(static_cast<uint64_t>(sh) * maxEdge / longest));
+        out.width = w;
+        out.height = h;
+        out.bgra.resize(static_cast<size_t>(w) * h * 4);
+        for (uint32_t y = 0; y < h; ++y)
+        {
+            const uint32_t y0 = static_cast<uint32_t>(static_cast<uint64_t>(y) * sh / h);
+            const uint32_t y1 = std::max(y0 + 1, static_cast<uint32_t>(static_cast<uint64_t>(y + 1) * sh / h));
+            for (uint32_t x = 0; x < w; ++x)
+            {
+                const uint32_t x0 = static_cast<uint32_t>(static_cast<uint64_t>(x) * sw / w);
+                const uint32_t x1 = std::max(x0 + 1, static_cast<uint32_t>(static_cast<uint64_t>(x + 1) * sw / w));
+                uint32_t sum[4]{};
+                for (uint32_t sy = y0; sy < y1; ++sy)
+                {
+                    const uint8_t* p = &src[(static_cast<size_t>(sy) * sw + x0) * 4];
+                    for (uint32_t sx = x0; sx < x1; ++sx, p += 4)
+                        for (int c = 0; c < 4; ++c) sum[c] += p[c];
+                }
+                const uint32_t count = (y1 - y0) * (x1 - x0);
+                uint8_t* d = &out.bgra[(static_cast<size_t>(y) * w + x) * 4];
+                for (int c = 0; c < 4; ++c) d[c] = static_cast<uint8_t>((sum[c] + count / 2) / count);
+            }
+        }
+    }
+
+    struct ThumbnailCache::Impl
+    {
+        struct Record
+        {
+            uint64_t pixelOffset{}; // into the file
+            uint32_t width{};
+            uint32_t height{};
+        };
+
+        mutable std::mutex mutex;
+        fs::path file;
+        uint32_t maxEdge{};
+        bool open = false;
+        std::shared_ptr<const MappedFile> mapping; // the file as of the last open or append
+        std::unordered_map<std::string, Record> records; // by key; a later record for a key wins
+        uint64_t fileBytes{};
+        MemoryAccount memory{ MemorySubsystem::TextureCache };
+
+        // Callers hold the mutex (or own the cache alone). The mapped file counts in full, as if resident.
+        void ReportMemory()
+        {
+            size_t bytes = records.bucket_count() * sizeof(void*) + (mapping ? static_cast<size_t>(fileBytes) : 0);
+            for (const auto& [key, record] : records)
+                bytes += sizeof(std::pair<const std::string, Record>) + 2 * sizeof(void*) + HeapBytes(key);
+            memory.Report(bytes);
+        }
+
+        bool WriteEmptyFile()
+        {
+            std::string header(kMagic, sizeof(kMagic));
+            Put(header, kFormatVersion);
+            Put(header, maxEdge);
+            Put(header, uint32_t{ 0 });
+            std::ofstream out(file, std::ios::binary | std::ios::trunc);
+            return static_cast<bool>(out.write(header.data(), static_cast<std::streamsize>(header.size())));
+        }
+
+        // Maps the file and indexes its records; starts over when it is missing, foreign or made for another size.
+        bool Load()
+        {
+            std::error_code ec;
+            if (file.has_parent_path()) fs::create_directories(file.parent_path(), ec);
+            mapping = MappedFile::Open(file);
+            const bool usable = mapping && mapping->Size() >= kHeaderBytes
+                && std::memcmp(mapping->Data(), kMagic, sizeof(kMagic)) == 0
+                && Get<uint32_t>(mapping->Data() + 4) == kFormatVersion
+                && Get<uint32_t>(mapping->Data() + 8) == maxEdge;
+            if (!usable)
+            {
+                mapping.reset();
+                if (!WriteEmptyFile()) return false;
+                mapping = MappedFile::Open(file);
+                if (!mapping) return false;
+            }
+
+            const uint8_t* data = mapping->Data();
+            const size_t size = mapping->Size();
+            size_t pos = kHeaderBytes;
+            while (size - pos >= kRecordHeaderBytes)
+            {
+                const uint32_t w = Get<uint32_t>(data + pos + kKeyBytes);
+                const uint32_t h = Get<uint32_t>(data + pos + kKeyBytes + 4);
+                if (w > maxEdge || h > maxEdge) break;
+                const size_t pixels = static_cast<size_t>(w) * h * 4;
+                if (size - pos - kRecordHeaderBytes < pixels) break;
+                records[std::string(reinterpret_cast<const char*>(data + pos), kKeyBytes)] = { pos + kRecordHeaderBytes, w, h };
+                pos += kRecordHeaderBytes + pixels;
+            }
+            if (pos != size)
+            {
+                // Nothing else maps the file yet, so it can be cut back to its last whole record.
+                mapping.reset();
+                fs::resize_file(file, pos, ec);
+                if (ec) return false;
+                mapping = MappedFile::Open(file);
+                if (!mapping) return false;
+            }
+            fileBytes = pos;
+            return true;
+        }
+
+        // Callers hold the mutex. Views of the old mapping stay valid; new lookups use the new one.
+        bool Append(const std::string& bytes)
+        {
+            {
+                std::ofstream out(file, std::ios::binary | std::ios::app);
+                if (!out.write(bytes.data(), static_cast<std::streamsize>(bytes.size())) || !out.flush())
+                {
+                    out.close();
+                    std::error_code ec;
+                    fs::resize_file(file, fileBytes, ec);
+                    return false;
+                }
+            }
+            auto remapped = MappedFile::Open(file);
+            if (!remapped || remapped->Size() < fileBytes + bytes.size()) return false;
+            mapping = std::move(remapped);
+            fileBytes += bytes.size();
+            return true;
+        }
+
+        ThumbnailView View(const Record& r) const
+        {
+            ThumbnailView v{};
+            if (r.width == 0 || r.height == 0) return v;
+            v.width = r.width;
+            v.height = r.height;
+            v.bgra = mapping->Data() + r.pixelOffset;
+            v.storage = mapping;
+            return v;
+        }
+    };
+
+    ThumbnailCache::ThumbnailCache(const std::string& fileUtf8, uint32_t maxEdge)
+        : impl_(std::make_unique<Impl>())
+    {
+        OBBOOK_TRACE_SCOPE("Thumbnails.Open");
+        impl_->file = fs::path(fileUtf8);
+        impl_->maxEdge = std::max(1u, maxEdge);
+        impl_->open = impl_->Load();
+        if (!impl_->open)
+        {
+            impl_->mapping.reset();
+            impl_->records.clear();
+        }
+        impl_->ReportMemory();
+    }
+
+    ThumbnailCache::~ThumbnailCache() = default;
+
+    bool ThumbnailCache::IsOpen() const
+    {
+        return impl_->open;
+    }
+
+    uint32_t ThumbnailCache::GetMaxEdge() const
+    {
+        return impl_->maxEdge;
+    }
+
+    size_t ThumbnailCache::EntryCount() const
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        return impl_->records.size();
+    }
+
+    uint64_t ThumbnailCache::FileBytes() const
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        return impl_->fileBytes;
+    }
+
+    void ThumbnailCache::GetThumbnails(const std::string& dataDirUtf8, const std::vector<std::string>& virtualPaths,
+        uint32_t workerCount, std::vector<ThumbnailView>& thumbnails, ThumbnailStats* stats)
+    {
+        OBBOOK_TRACE_SCOPE("Thumbnails.Get");
+        const auto start = std::chrono::steady_clock::now();
+        Impl& impl = *impl_;
+        const size_t count = virtualPaths.size();
+        ThumbnailStats st{};
+        st.requested = static_cast<uint32_t>(count);
+        thumbnails.assign(count, ThumbnailView{});
+
+        std::vector<AssetLocation> locations;
+        LocateAssets(dataDirUtf8, virtualPaths, locations);
+
+        // Serve what the file has; queue one decode per distinct missing key.
+        std::vector<std::string> keys(count);
+        std::vector<size_t> jobs;                     // path index of each decode
+        std::vector<size_t> jobOf(count, SIZE_MAX);   // decode serving each path
+        {
+            std::lock_guard<std::mutex> lock(impl.mutex);
+            std::unordered_map<std::string, size_t> queued;
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (!locations[i].IsFound())
+                {
+                    ++st.failed;
+                    continue;
+                }
+                keys[i] = MakeKey(impl.maxEdge, virtualPaths[i], locations[i]);
+                const auto found = impl.records.find(keys[i]);
+                if (found != impl.records.end())
+                {
+                    thumbnails[i] = impl.View(found->second);
+                    ++st.cached;
+                    if (!thumbnails[i].IsValid()) ++st.failed;
+                    continue;
+                }
+                const auto [it, added] = queued.try_emplace(keys[i], jobs.size());
+                if (added) jobs.push_back(i);
+                jobOf[i] = it->second;
+            }
+        }
+
+        auto built = std::make_shared<std::vector<BuiltThumbnail>>(jobs.size());
+        if (!jobs.empty())
+        {
+            const uint32_t workers = WorkerCount(workerCount, jobs.size());
+            st.workers = workers;
+
+            WorkCursor cursor(jobs.size());
+            RunOnWorkers(workers, [&](uint32_t)
+            {
+                std::vector<uint8_t> bytes;
+                std::vector<uint8_t> full;
+                for (size_t j = 0; cursor.Next(j);)
+                {
+                    uint32_t w = 0, h = 0;
+                    if (ReadAssetBytes(locations[jobs[j]], bytes) && DecodeTextureToBgra(bytes, impl.maxEdge, full, w, h) && w != 0 && h != 0)
+                        FitThumbnail(full, w, h, impl.maxEdge, (*built)[j]);
+                }
+            });
+        }
+
+        for (const auto& b : *built)
+        {
+            if (b.bgra.empty()) ++st.failed;
+            else ++st.decoded;
+        }
+
+        if (!jobs.empty())
+        {
+            std::lock_guard<std::mutex> lock(impl.mutex);
+            bool persisted = false;
+            if (impl.open)
+            {
+                // One append and one remap for the whole batch.
+                std::string bytes;
+                std::vector<uint64_t> offsets(jobs.size());
+                for (size_t j = 0; j < jobs.size(); ++j)
+                {
+                    const BuiltThumbnail& b = (*built)[j];
+                    bytes.append(keys[jobs[j]]);
+                    Put(bytes, b.bgra.empty() ? 0u : b.width);
+                    Put(bytes, b.bgra.empty() ? 0u : b.height);
+                    offsets[j] = impl.fileBytes + bytes.size();
+                    bytes.append(reinterpret_cast<const char*>(b.bgra.data()), b.bgra.size());
+                }
+                persisted = impl.Append(bytes);
+                if (persisted)
+                {
+                    for (size_t j = 0; j < jobs.size(); ++j)
+                    {
+                        const BuiltThumbnail& b = (*built)[j];
+                        impl.records[keys[jobs[j]]] = { offsets[j], b.bgra.empty() ? 0u : b.width, b.bgra.empty() ? 0u : b.height };
+                    }
+                }
+            }
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (jobOf[i] == SIZE_MAX) continue;
+                if (persisted)
+                {
+                    thumbnails[i] = impl.View(impl.records[keys[i]]);
+                    continue;
+                }
+                const BuiltThumbnail& b = (*built)[jobOf[i]];
+                if (b.bgra.empty()) continue;
+                thumbnails[i].width = b.width;
+                thumbnails[i].height = b.height;
+                thumbnails[i].bgra = b.bgra.data();
+                thumbnails[i].storage = built;
+            }
+            impl.ReportMemory();
+        }
+
+        st.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (stats) *stats = st;
+    }
+}
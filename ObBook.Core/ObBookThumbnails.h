@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace obbook
+{
+    // One thumbnail, tightly packed BGRA8 (width * height * 4 bytes). The pixels live in a read-only mapping of
+    // the cache file (or on the heap when nothing could be persisted), which the view keeps alive: it stays valid
+    // after the cache appends more thumbnails or is destroyed.
+    struct ThumbnailView
+    {
+        uint32_t width{};
+        uint32_t height{};
+        const uint8_t* bgra = nullptr; // null when the texture is missing or could not be decoded
+        std::shared_ptr<const void> storage;
+
+        bool IsValid() const { return bgra != nullptr; }
+    };
+
+    struct ThumbnailStats
+    {
+        uint32_t requested{};
+        uint32_t cached{};   // served from the cache file, failures remembered there included
+        uint32_t decoded{};
+        uint32_t failed{};   // missing, compressed or not a decodable DDS or TGA
+        uint32_t workers{};
+        double milliseconds{};
+    };
+
+    // Book texture thumbnails for the asset browser, fitted into maxEdge x maxEdge. Missing ones are decoded
+    // in parallel from the largest mip that fits (box-filtered further when the file has no such mip) and
+    // appended to a single packed cache file, keyed by the texture's source identity (container, entry range,
+    // size and write time), so editing or overriding a texture yields a new thumbnail. Reopening serves
+    // everything from a memory mapping of that file without decoding. Thread-safe; one process should own a
+    // cache file at a time.
+    class ThumbnailCache
+    {
+    public:
+        static constexpr uint32_t kDefaultMaxEdge = 96;
+
+        ThumbnailCache(const std::string& fileUtf8, uint32_t maxEdge = kDefaultMaxEdge);
+        ~ThumbnailCache();
+
+        ThumbnailCache(const ThumbnailCache&) = delete;
+        ThumbnailCache& operator=(const ThumbnailCache&) = delete;
+
+        // False if the file could not be created or read; thumbnails are then built on every call and kept
+        // only by their views.
+        bool IsOpen() const;
+        uint32_t GetMaxEdge() const;
+
+        // thumbnails[i] is for virtualPaths[i], resolved under dataDirUtf8 like ReadAssetBytes. workerCount 0
+        // uses the hardware concurrency; the calling thread is one of the workers.
+        void GetThumbnails(const std::string& dataDirUtf8, const std::vector<std::string>& virtualPaths,
+            uint32_t workerCount, std::vector<ThumbnailView>& thumbnails, ThumbnailStats* stats = nullptr);
+
+        size_t EntryCount() const;
+        uint64_t FileBytes() const;
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl_;
+    };
+}
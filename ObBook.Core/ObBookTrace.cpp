@@ -0,0 +1,213 @@
+#include "ObBookTrace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace obbook::trace
+{
+    std::atomic<bool> g_enabled{ false };
+
+    namespace
+    {
+        constexpr size_t kRingCapacity = 8192; // spans kept per thread; older spans are overwritten
+        constexpr size_t kDetailSize = 48;
+
+        constexpr size_t kDetailWords = kDetailSize / sizeof(uint64_t);
+
+        // Every field is an atomic written with relaxed stores, bracketed by a sequence number (a seqlock): the
+        // export can then read a slot its thread is overwriting without a data race, and drops it instead.
+        struct SpanEvent
+        {
+            std::atomic<uint64_t> sequence{ 0 }; // 2 * (span number + 1) once written, odd while being written
+            std::atomic<const char*> name{ nullptr };
+            std::atomic<uint64_t> detail[kDetailWords]{};
+            std::atomic<uint64_t> beginNs{ 0 };
+            std::atomic<uint64_t> endNs{ 0 };
+        };
+
+        struct ThreadRing
+        {
+            uint32_t threadIndex{};
+            std::atomic<uint64_t> head{ 0 }; // total spans written; slot = head % kRingCapacity
+            SpanEvent events[kRingCapacity];
+        };
+
+        struct Registry
+        {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<ThreadRing>> rings;
+            std::vector<ThreadRing*> freeRings; // rings of threads that have exited
+        };
+
+        Registry& GetRegistry()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        const std::chrono::steady_clock::time_point g_epoch = std::chrono::steady_clock::now();
+
+        // Hands the thread's ring back when the thread exits. The next thread that traces reuses it, so short
+        // lived workers (one set per page render) do not add a ring each; its spans stay exportable until the
+        // new owner overwrites them, under the same tid.
+        struct RingOwner
+        {
+            ThreadRing* ring = nullptr;
+
+            ~RingOwner()
+            {
+                if (!ring) return;
+                auto& reg = GetRegistry();
+                std::lock_guard<std::mutex> lock(reg.mutex);
+                reg.freeRings.push_back(ring);
+            }
+        };
+
+        ThreadRing* GetThreadRing()
+        {
+            thread_local RingOwner owner;
+            if (!owner.ring)
+            {
+                auto& reg = GetRegistry();
+                std::lock_guard<std::mutex> lock(reg.mutex);
+                if (!reg.freeRings.empty())
+                {
+                    owner.ring = reg.freeRings.back();
+                    reg.freeRings.pop_back();
+                }
+                else
+                {
+                    reg.rings.push_back(std::make_unique<ThreadRing>());
+                    owner.ring = reg.rings.back().get();
+                    owner.ring->threadIndex = static_cast<uint32_t>(reg.rings.size());
+                }
+            }
+            return owner.ring;
+        }
+
+        void AppendJsonString(std::string& out, const char* s)
+        {
+            out.push_back('"');
+            for (; s && *s; ++s)
+            {
+                const char c = *s;
+                if (c == '"' || c == '\\') { out.push_back('\\'); out.push_back(c); }
+                else if (static_cast<unsigned char>(c) < 0x20) out.push_back(' ');
+                else out.push_back(c);
+            }
+            out.push_back('"');
+        }
+    }
+
+    void SetEnabled(bool enabled)
+    {
+        g_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    void Clear()
+    {
+        auto& reg = GetRegistry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (auto& r : reg.rings) r->head.store(0, std::memory_order_release);
+    }
+
+    uint64_t NowNs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - g_epoch).count());
+    }
+
+    void RecordSpan(const char* name, const char* detail, uint64_t beginNs, uint64_t endNs)
+    {
+        ThreadRing* ring = GetThreadRing();
+        const uint64_t h = ring->head.load(std::memory_order_relaxed);
+        SpanEvent& e = ring->events[h % kRingCapacity];
+        e.sequence.store(2 * h + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        e.name.store(name, std::memory_order_relaxed);
+        e.beginNs.store(beginNs, std::memory_order_relaxed);
+        e.endNs.store(endNs, std::memory_order_relaxed);
+        uint64_t words[kDetailWords]{};
+        if (detail)
+        {
+            // A cut inside a UTF-8 sequence drops the whole sequence, so the JSON stays valid UTF-8.
+            size_t n = std::strlen(detail);
+            if (n > kDetailSize - 1)
+            {
+                n = kDetailSize - 1;
+                while (n > 0 && (static_cast<uint8_t>(detail[n]) & 0xC0u) == 0x80u) --n;
+            }
+            std::memcpy(words, detail, n);
+        }
+        for (size_t i = 0; i < kDetailWords; ++i) e.detail[i].store(words[i], std::memory_order_relaxed);
+        e.sequence.store(2 * h + 2, std::memory_order_release);
+        ring->head.store(h + 1, std::memory_order_release);
+    }
+
+    std::string ExportChromeTraceJson()
+    {
+        std::string out;
+        out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+
+        auto& reg = GetRegistry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (const auto& r : reg.rings)
+        {
+            const uint64_t head = r->head.load(std::memory_order_acquire);
+            const uint64_t begin = head > kRingCapacity ? head - kRingCapacity : 0;
+            for (uint64_t i = begin; i < head; ++i)
+            {
+                // Copy the slot out, then keep it only if its thread did not start overwriting it meanwhile.
+                const SpanEvent& e = r->events[i % kRingCapacity];
+                const uint64_t sequence = e.sequence.load(std::memory_order_acquire);
+                const char* name = e.name.load(std::memory_order_relaxed);
+                const uint64_t beginNs = e.beginNs.load(std::memory_order_relaxed);
+                const uint64_t endNs = e.endNs.load(std::memory_order_relaxed);
+                uint64_t words[kDetailWords];
+                for (size_t w = 0; w < kDetailWords; ++w) words[w] = e.detail[w].load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence != 2 * i + 2 || e.sequence.load(std::memory_order_relaxed) != sequence) continue;
+                char detail[kDetailSize];
+                std::memcpy(detail, words, kDetailSize);
+
+                if (!first) out.push_back(',');
+                first = false;
+
+                char nums[160];
+                std::snprintf(nums, sizeof(nums), ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                    r->threadIndex, static_cast<double>(beginNs) / 1000.0,
+                    static_cast<double>(endNs - beginNs) / 1000.0);
+
+                out += "{\"name\":";
+                AppendJsonString(out, name);
+                out += ",\"cat\":\"obbook\"";
+                out += nums;
+                if (detail[0] != '\0')
+                {
+                    out += ",\"args\":{\"detail\":";
+                    AppendJsonString(out, detail);
+                    out += "}";
+                }
+                out += "}";
+            }
+        }
+
+        out += "]}\n";
+        return out;
+    }
+
+    bool WriteChromeTraceJson(const std::string& pathUtf8)
+    {
+        const std::string json = ExportChromeTraceJson();
+        std::ofstream out(pathUtf8, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(json.data(), static_cast<std::streamsize>(json.size()));
+        return static_cast<bool>(out);
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Scoped trace spans for the compile, asset and render hot paths.
+// Each thread records into its own fixed-size ring buffer (no locks on the record path); a thread's ring is
+// reused by a later thread once it exits. The buffers can be dumped as Chrome trace-event JSON (chrome://tracing,
+// Perfetto). When tracing is disabled a span costs one relaxed atomic load. Define OBBOOK_TRACE_DISABLED to
+// compile the spans out entirely.
+
+namespace obbook::trace
+{
+    extern std::atomic<bool> g_enabled;
+
+    inline bool IsEnabled() { return g_enabled.load(std::memory_order_relaxed); }
+    void SetEnabled(bool enabled);
+
+    // Drops every recorded span on every thread. Only call while no spans are being recorded.
+    void Clear();
+
+    uint64_t NowNs();
+
+    // name must have static storage duration; detail is copied (truncated) into the span.
+    void RecordSpan(const char* name, const char* detail, uint64_t beginNs, uint64_t endNs);
+
+    // Chrome trace-event JSON ("X" complete events, microsecond timestamps). Spans recorded while the export
+    // runs may or may not be included.
+    std::string ExportChromeTraceJson();
+    bool WriteChromeTraceJson(const std::string& pathUtf8);
+
+    class ScopedSpan
+    {
+    public:
+        explicit ScopedSpan(const char* name, const char* detail = nullptr)
+            : name_(IsEnabled() ? name : nullptr), detail_(detail), begin_(name_ ? NowNs() : 0)
+        {
+        }
+
+        ~ScopedSpan()
+        {
+            if (name_) RecordSpan(name_, detail_, begin_, NowNs());
+        }
+
+        ScopedSpan(const ScopedSpan&) = delete;
+        ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+    private:
+        const char* name_;
+        const char* detail_;
+        uint64_t begin_;
+    };
+}
+
+#define OBBOOK_TRACE_CONCAT_INNER(a, b) a##b
+#define OBBOOK_TRACE_CONCAT(a, b) OBBOOK_TRACE_CONCAT_INNER(a, b)
+
+#if defined(OBBOOK_TRACE_DISABLED)
+#define OBBOOK_TRACE_SCOPE(name) ((void)0)
+#define OBBOOK_TRACE_SCOPE_DETAIL(name, detail) ((void)0)
+#else
+#define OBBOOK_TRACE_SCOPE(name) ::obbook::trace::ScopedSpan OBBOOK_TRACE_CONCAT(obbookTraceSpan_, __LINE__)(name)
+#define OBBOOK_TRACE_SCOPE_DETAIL(name, detail) ::obbook::trace::ScopedSpan OBBOOK_TRACE_CONCAT(obbookTraceSpan_, __LINE__)(name, detail)
+#endif
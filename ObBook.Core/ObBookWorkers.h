@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Fan-out helpers for the parallel passes (pages, thumbnails, golden runs, the loose walk, batch export). Not
+// part of the public API: include from .cpp files only, since <thread> cannot be compiled as C++/CLI.
+
+namespace obbook
+{
+    // Threads to use for items jobs: requested, or one per hardware thread when 0; at least 1, at most items.
+    inline uint32_t WorkerCount(uint32_t requested, size_t items = SIZE_MAX)
+    {
+        const uint32_t workers = requested ? requested : std::max(1u, std::thread::hardware_concurrency());
+        return static_cast<uint32_t>(std::max<size_t>(1, std::min<size_t>(workers, items)));
+    }
+
+    // Hands out the indexes 0 to count - 1, each to exactly one of the workers that share it.
+    class WorkCursor
+    {
+    public:
+        explicit WorkCursor(size_t count) : count_(count) {}
+
+        bool Next(size_t& index)
+        {
+            index = next_.fetch_add(1, std::memory_order_relaxed);
+            return index < count_;
+        }
+
+    private:
+        std::atomic<size_t> next_{ 0 };
+        const size_t count_;
+    };
+
+    // Runs work(worker) for worker 0 to workerCount - 1, worker 0 on the calling thread, and returns when all are
+    // done. If a thread cannot be started, or worker 0 throws, the threads already running are joined before the
+    // exception leaves; work must then be able to finish without the missing workers.
+    template <typename Work>
+    void RunOnWorkers(uint32_t workerCount, Work&& work)
+    {
+        struct Joiner
+        {
+            std::vector<std::thread> threads;
+            ~Joiner()
+            {
+                for (auto& t : threads) t.join();
+            }
+        } joiner;
+        joiner.threads.reserve(workerCount > 0 ? workerCount - 1 : 0);
+        for (uint32_t t = 1; t < workerCount; ++t) joiner.threads.emplace_back([&work, t] { work(t); });
+        work(0u);
+    }
+}
@@ -0,0 +1,305 @@
+// ObBook.Export: headless batch export for CI artifacts. Each book source is compiled like the editor does it
+// (auto-fixes applied), paginated and rendered with the preview font, and every page is written as a PNG to
+// <out>/<book name>/page_0001.png and so on. Books are spread over the workers; when there are fewer books than
+// workers, the spare workers render pages of the same book. Uses GDI for the glyph atlas, so Windows only.
+//
+// With --golden the books are a regression corpus instead: every page is compared with the stored golden image
+// (see RunGoldenPages), failed pages leave page_NNNN.actual.png and a page_NNNN.diff.png heatmap under --out,
+// and a book that renders more than --max-slowdown percent slower than its recorded time fails too.
+// --update-golden records the current pages and times.
+//
+// Usage: ObBook.Export --out dir [--oblivion dir] [--width N] [--height N] [--first N] [--count N]
+//                      [--workers N] [--filter none|sub|up|average|paeth|adaptive] [--level 0-9] [--alpha]
+//                      [--golden dir [--update-golden] [--tolerance N] [--max-diff-pixels N]
+//                       [--max-slowdown percent] [--repeat N]]
+//                      book.txt|folder...
+// Folders contribute their *.txt files. Exits with 1 if any book could not be read, exported or matched.
+
+#include "../ObBook.Core/ObBookCore.h"
+#include "../ObBook.Core/ObBookGolden.h"
+#include "../ObBook.Core/ObBookPages.h"
+#include "../ObBook.Core/ObBookPng.h"
+#include "../ObBook.Core/ObBookWorkers.h"
+#include "../ObBook.RenderD2D/ObBookRenderD2D.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct Options
+    {
+        fs::path out;
+        std::string oblivionDir;
+        obbook::BookPagesRequest request{};
+        obbook::PngOptions png{};
+        std::vector<fs::path> inputs;
+        fs::path golden;
+        bool updateGolden = false;
+        uint32_t tolerance = 0;
+        uint32_t maxDiffPixels = 0;
+        uint32_t maxSlowdownPercent = 25;
+        uint32_t repeat = 3;
+    };
+
+    struct BookOutcome
+    {
+        fs::path source;
+        obbook::BookPagesExportResult result;
+        std::string error;
+    };
+
+    bool ParseFilter(const std::string& name, obbook::PngFilter& filter)
+    {
+        static const std::pair<const char*, obbook::PngFilter> kFilters[] = {
+            { "none", obbook::PngFilter::None }, { "sub", obbook::PngFilter::Sub }, { "up", obbook::PngFilter::Up },
+            { "average", obbook::PngFilter::Average }, { "paeth", obbook::PngFilter::Paeth },
+            { "adaptive", obbook::PngFilter::Adaptive },
+        };
+        for (const auto& [n, f] : kFilters)
+        {
+            if (name == n)
+            {
+                filter = f;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ParseArgs(int argc, char** argv, Options& o)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string a = argv[i];
+            auto next = [&](const char* flag) -> const char*
+            {
+                if (i + 1 >= argc) { std::fprintf(stderr, "%s requires a value\n", flag); return nullptr; }
+                return argv[++i];
+            };
+            auto number = [&](const char* flag, uint32_t& value) -> bool
+            {
+                auto v = next(flag);
+                if (!v) return false;
+                value = static_cast<uint32_t>(std::strtoul(v, nullptr, 10));
+                return true;
+            };
+
+            if (a == "--out") { auto v = next("--out"); if (!v) return false; o.out = v; }
+            else if (a == "--oblivion") { auto v = next("--oblivion"); if (!v) return false; o.oblivionDir = v; }
+            else if (a == "--width") { if (!number("--width", o.request.geometry.width)) return false; }
+            else if (a == "--height") { if (!number("--height", o.request.geometry.height)) return false; }
+            else if (a == "--first") { if (!number("--first", o.request.firstPage)) return false; }
+            else if (a == "--count") { if (!number("--count", o.request.pageCount)) return false; }
+            else if (a == "--workers") { if (!number("--workers", o.request.workerCount)) return false; }
+            else if (a == "--level") { if (!number("--level", o.png.level)) return false; }
+            else if (a == "--alpha") { o.png.keepAlpha = true; }
+            else if (a == "--golden") { auto v = next("--golden"); if (!v) return false; o.golden = v; }
+            else if (a == "--update-golden") { o.updateGolden = true; }
+            else if (a == "--tolerance") { if (!number("--tolerance", o.tolerance)) return false; }
+            else if (a == "--max-diff-pixels") { if (!number("--max-diff-pixels", o.maxDiffPixels)) return false; }
+            else if (a == "--max-slowdown") { if (!number("--max-slowdown", o.maxSlowdownPercent)) return false; }
+            else if (a == "--repeat") { if (!number("--repeat", o.repeat)) return false; }
+            else if (a == "--filter")
+            {
+                auto v = next("--filter");
+                if (!v) return false;
+                if (!ParseFilter(v, o.png.filter)) { std::fprintf(stderr, "Unknown filter: %s\n", v); return false; }
+            }
+            else if (a.size() > 1 && a[0] == '-' && a[1] == '-')
+            {
+                std::fprintf(stderr, "Unknown argument: %s\n", a.c_str());
+                return false;
+            }
+            else
+            {
+                o.inputs.emplace_back(a);
+            }
+        }
+        if (o.out.empty() || o.inputs.empty())
+        {
+            std::fprintf(stderr, "Usage: ObBook.Export --out dir [options] book.txt|folder...\n");
+            return false;
+        }
+        if (o.updateGolden && o.golden.empty())
+        {
+            std::fprintf(stderr, "--update-golden requires --golden\n");
+            return false;
+        }
+        if (o.request.pageCount == 0) o.request.pageCount = obbook::kAllPages;
+        return true;
+    }
+
+    std::vector<fs::path> CollectBooks(const std::vector<fs::path>& inputs)
+    {
+        std::vector<fs::path> books;
+        for (const auto& input : inputs)
+        {
+            std::error_code ec;
+            if (!fs::is_directory(input, ec))
+            {
+                books.push_back(input);
+                continue;
+            }
+            std::vector<fs::path> found;
+            for (auto it = fs::directory_iterator(input, ec); !ec && it != fs::directory_iterator(); it.increment(ec))
+            {
+                if (it->is_regular_file(ec) && it->path().extension() == ".txt") found.push_back(it->path());
+            }
+            std::sort(found.begin(), found.end());
+            books.insert(books.end(), found.begin(), found.end());
+        }
+        return books;
+    }
+
+    bool ReadSource(const fs::path& path, std::string& sourceUtf8)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+        sourceUtf8.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    void ExportBook(obbook::BookCompiler& compiler, const Options& o, uint32_t pageWorkers, BookOutcome& outcome)
+    {
+        std::string source;
+        if (!ReadSource(outcome.source, source))
+        {
+            outcome.error = "cannot read the file";
+            return;
+        }
+        compiler.SetSourceUtf8(source);
+        compiler.Compile();
+
+        obbook::BookPagesRequest request = o.request;
+        request.workerCount = pageWorkers;
+        request.dataDirUtf8 = compiler.GetResolvedDataDirectoryUtf8();
+
+        obbook::BookPagesExport output{};
+        output.directoryUtf8 = (o.out / outcome.source.stem()).string();
+        output.png = o.png;
+        obbook::ExportBookPagesPng(compiler.GetNormalizedSourceUtf8(), request, output, outcome.result, outcome.error);
+    }
+
+    // Compiles every book, then hands the corpus to the golden run, which spreads the books over the workers.
+    int RunGolden(const Options& o, const std::vector<fs::path>& books)
+    {
+        obbook::BookCompiler compiler;
+        if (!o.oblivionDir.empty()) compiler.SetOblivionDirectoryUtf8(o.oblivionDir);
+        std::vector<obbook::GoldenCase> cases;
+        int unreadable = 0;
+        for (const auto& path : books)
+        {
+            std::string source;
+            if (!ReadSource(path, source))
+            {
+                std::fprintf(stderr, "%s: cannot read the file\n", path.string().c_str());
+                ++unreadable;
+                continue;
+            }
+            compiler.SetSourceUtf8(source);
+            compiler.Compile();
+            cases.push_back(obbook::GoldenCase{ path.stem().string(), compiler.GetNormalizedSourceUtf8() });
+        }
+
+        obbook::GoldenOptions options{};
+        options.goldenDirUtf8 = o.golden.string();
+        options.outputDirUtf8 = o.out.string();
+        options.request = o.request;
+        options.request.dataDirUtf8 = compiler.GetResolvedDataDirectoryUtf8();
+        options.tolerance = static_cast<uint8_t>(std::min(o.tolerance, 255u));
+        options.maxDifferingPixels = o.maxDiffPixels;
+        options.maxSlowdown = o.maxSlowdownPercent / 100.0;
+        options.renderRepeats = o.repeat;
+        options.workerCount = o.request.workerCount;
+        options.update = o.updateGolden;
+
+        obbook::GoldenReport report;
+        std::string err;
+        if (!obbook::RunGoldenPagesWithPreviewFont(cases, options, report, err))
+        {
+            std::fprintf(stderr, "%s\n", err.c_str());
+            return 1;
+        }
+
+        for (const auto& c : report.cases)
+        {
+            std::printf("%s %s: %u pages (%u golden), %.2f ms", c.passed ? "ok  " : "FAIL", c.name.c_str(), c.pages,
+                c.goldenPages, c.renderMilliseconds);
+            if (c.baselineMilliseconds > 0) std::printf(" (baseline %.2f ms%s)", c.baselineMilliseconds, c.slower ? ", too slow" : "");
+            std::printf("\n");
+            for (const auto& f : c.failures)
+            {
+                if (f.missing) std::printf("    page %u: no golden image, actual %s\n", f.page + 1, f.actualUtf8.c_str());
+                else std::printf("    page %u: %llu pixels differ (max channel delta %u), heatmap %s\n", f.page + 1,
+                    static_cast<unsigned long long>(f.diff.differingPixels), f.diff.maxChannelDelta, f.heatmapUtf8.c_str());
+            }
+        }
+        std::printf("%zu books, %u failed, %.0f ms (%u workers)%s\n", report.cases.size(), report.failedCases,
+            report.wallMilliseconds, report.workers, o.updateGolden ? ", goldens updated" : "");
+        return report.Passed() && unreadable == 0 ? 0 : 1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    if (!ParseArgs(argc, argv, opts)) return 2;
+
+    const std::vector<fs::path> sources = CollectBooks(opts.inputs);
+    if (sources.empty())
+    {
+        std::fprintf(stderr, "No book sources found.\n");
+        return 1;
+    }
+    if (!opts.golden.empty()) return RunGolden(opts, sources);
+
+    std::vector<BookOutcome> books;
+    for (const auto& path : sources) books.push_back(BookOutcome{ path, {}, {} });
+
+    const auto start = std::chrono::steady_clock::now();
+    const uint32_t workers = obbook::WorkerCount(opts.request.workerCount);
+    const uint32_t bookWorkers = obbook::WorkerCount(workers, books.size());
+    const uint32_t pageWorkers = std::max(1u, workers / bookWorkers);
+
+    // Each book worker keeps its own compiler, so the asset scan is done once per worker rather than per book.
+    obbook::WorkCursor cursor(books.size());
+    obbook::RunOnWorkers(bookWorkers, [&](uint32_t)
+    {
+        obbook::BookCompiler compiler;
+        if (!opts.oblivionDir.empty()) compiler.SetOblivionDirectoryUtf8(opts.oblivionDir);
+        for (size_t i = 0; cursor.Next(i);)
+            ExportBook(compiler, opts, pageWorkers, books[i]);
+    });
+    const double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t pages = 0, bytes = 0;
+    int failures = 0;
+    for (const auto& book : books)
+    {
+        const auto& r = book.result;
+        const uint32_t written = static_cast<uint32_t>(r.filesUtf8.size()) - r.failed;
+        pages += written;
+        bytes += r.pngBytes;
+        if (!book.error.empty())
+        {
+            ++failures;
+            std::fprintf(stderr, "%s: %s\n", book.source.string().c_str(), book.error.c_str());
+            continue;
+        }
+        std::printf("%s: %u of %u pages, %.1f KB, compose %.1f ms, encode %.1f ms\n", book.source.string().c_str(),
+            written, r.totalPages, r.pngBytes / 1024.0, r.composeMilliseconds, r.encodeMilliseconds);
+    }
+    std::printf("%zu books, %llu pages, %.1f MB in %.0f ms (%.1f pages/s, %u workers)\n", books.size(),
+        static_cast<unsigned long long>(pages), bytes / (1024.0 * 1024.0), wallMs, wallMs > 0 ? pages * 1000.0 / wallMs : 0.0, workers);
+    return failures ? 1 : 0;
+}
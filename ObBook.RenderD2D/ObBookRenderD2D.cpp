@@ -1,22 +1,31 @@
 #include "ObBookRenderD2D.h"
+#include "../ObBook.Core/ObBookMemory.h"
+#include "../ObBook.Core/ObBookTrace.h"
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
-#include <d3d9.h>
 #include <algorithm>
 #include <cstring>
 #include <cctype>
 #include <string>
 #include <vector>
 
-#pragma comment(lib, "d3d9.lib")
-
 namespace
 {
-    static std::string StripMarkup(const std::string& s)
+    // Page margins of the text block, in pixels.
+    constexpr LONG kTextMarginX = 48;
+    constexpr LONG kTextMarginY = 42;
+    constexpr uint32_t kBorderPx = 2;
+
+    struct Bgr { uint8_t b, g, r; };
+    constexpr Bgr kPaper{ 0xF5, 0xF0, 0xE7 };
+    constexpr Bgr kBorder{ 0x80, 0x80, 0x80 };
+    constexpr Bgr kInk{ 36, 36, 36 };
+
+    // Strips tags (BR becomes a line break) and widens bytes to UTF-16 in one pass, reusing out's capacity.
+    static void StripMarkup(const std::string& s, std::wstring& out)
     {
-        std::string out;
-        out.reserve(s.size());
+        out.clear();
         bool inTag = false;
 
         for (size_t i = 0; i < s.size(); ++i)
@@ -28,7 +37,7 @@ namespace
                 {
                     char c1 = static_cast<char>(::tolower(static_cast<unsigned char>(s[i + 1])));
                     char c2 = static_cast<char>(::tolower(static_cast<unsigned char>(s[i + 2])));
-                    if (c1 == 'b' && c2 == 'r') out += "\r\n";
+                    if (c1 == 'b' && c2 == 'r') out += L"\r\n";
                 }
                 continue;
             }
@@ -37,149 +46,319 @@ namespace
                 inTag = false;
                 continue;
             }
-            if (!inTag) out.push_back(s[i]);
+            if (!inTag) out.push_back(static_cast<wchar_t>(static_cast<unsigned char>(s[i])));
         }
-        return out;
     }
 
-    static bool TryDirect3D9Background(uint32_t width, uint32_t height, std::vector<uint8_t>& outBgra)
+    // GDI can only draw into its own DIB, so text is rendered there as a grayscale coverage mask (black on
+    // white) and composited into the caller's buffer. The DC, DIB and font live as long as the thread and the
+    // DIB only grows, so steady-state renders make no GDI object or heap allocations.
+    struct TextMaskContext
+    {
+        HDC dc = nullptr;
+        HBITMAP dib = nullptr;
+        HGDIOBJ oldBitmap = nullptr;
+        HFONT font = nullptr;
+        HGDIOBJ oldFont = nullptr;
+        uint8_t* bits = nullptr;
+        uint32_t capacityW = 0;
+        uint32_t capacityH = 0;
+        std::wstring text;
+        obbook::MemoryAccount memory{ obbook::MemorySubsystem::RenderBuffers };
+
+        ~TextMaskContext()
+        {
+            if (!dc) return;
+            if (oldFont) SelectObject(dc, oldFont);
+            if (oldBitmap) SelectObject(dc, oldBitmap);
+            if (font) DeleteObject(font);
+            if (dib) DeleteObject(dib);
+            DeleteDC(dc);
+        }
+
+        bool Ensure(uint32_t w, uint32_t h)
+        {
+            if (!dc)
+            {
+                dc = CreateCompatibleDC(nullptr);
+                if (!dc) return false;
+                // Grayscale antialiasing keeps the mask single-channel; ClearType would tint the coverage.
+                font = CreateFontW(22, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
+                    DEFAULT_CHARSET, OUT_OUTLINE_PRECIS, CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY,
+                    FF_DONTCARE, L"Times New Roman");
+                if (font) oldFont = SelectObject(dc, font);
+                SetTextColor(dc, RGB(0, 0, 0));
+                SetBkMode(dc, TRANSPARENT);
+            }
+            if (w <= capacityW && h <= capacityH) return bits != nullptr;
+
+            const uint32_t newW = std::max(w, capacityW);
+            const uint32_t newH = std::max(h, capacityH);
+            BITMAPINFO bmi{};
+            bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+            bmi.bmiHeader.biWidth = static_cast<LONG>(newW);
+            bmi.bmiHeader.biHeight = -static_cast<LONG>(newH);
+            bmi.bmiHeader.biPlanes = 1;
+            bmi.bmiHeader.biBitCount = 32;
+            bmi.bmiHeader.biCompression = BI_RGB;
+
+            void* newBits = nullptr;
+            HBITMAP newDib = CreateDIBSection(dc, &bmi, DIB_RGB_COLORS, &newBits, nullptr, 0);
+            if (!newDib || !newBits) return false;
+
+            HGDIOBJ prev = SelectObject(dc, newDib);
+            if (dib) DeleteObject(dib);
+            else oldBitmap = prev;
+            dib = newDib;
+            bits = static_cast<uint8_t*>(newBits);
+            capacityW = newW;
+            capacityH = newH;
+            ReportMemory();
+            return true;
+        }
+
+        size_t Stride() const { return static_cast<size_t>(capacityW) * 4; }
+
+        void ReportMemory()
+        {
+            const size_t textBytes = text.capacity() > std::wstring().capacity() ? (text.capacity() + 1) * sizeof(wchar_t) : 0;
+            memory.Report(Stride() * capacityH + textBytes);
+        }
+    };
+
+    thread_local TextMaskContext t_textMask;
+    thread_local obbook::GlyphAtlas t_glyphAtlas;
+    thread_local obbook::MemoryAccount t_glyphAtlasMemory{ obbook::MemorySubsystem::RenderBuffers };
+
+    // Rasterizes bytes 0x20-0xFF (widened like the preview text) into a 16 x 16 grid in the mask DIB, then copies
+    // each cell's coverage out. Control bytes get no advance and no ink.
+    static bool BuildGlyphAtlas(TextMaskContext& ctx, obbook::GlyphAtlas& atlas)
     {
-        IDirect3D9* d3d = Direct3DCreate9(D3D_SDK_VERSION);
-        if (!d3d) return false;
+        OBBOOK_TRACE_SCOPE("RenderBookPages.GlyphAtlas");
+        if (!ctx.Ensure(1, 1)) return false;
 
-        HWND hwnd = GetDesktopWindow();
-        D3DPRESENT_PARAMETERS pp{};
-        pp.Windowed = TRUE;
-        pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
-        pp.hDeviceWindow = hwnd;
-        pp.BackBufferFormat = D3DFMT_A8R8G8B8;
-        pp.BackBufferWidth = width;
-        pp.BackBufferHeight = height;
+        TEXTMETRICW tm{};
+        ABC abc[256]{};
+        if (!GetTextMetricsW(ctx.dc, &tm) || !GetCharABCWidthsW(ctx.dc, 0, 255, abc)) return false;
 
-        IDirect3DDevice9* device = nullptr;
-        HRESULT hr = d3d->CreateDevice(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, hwnd,
-            D3DCREATE_SOFTWARE_VERTEXPROCESSING | D3DCREATE_DISABLE_DRIVER_MANAGEMENT,
-            &pp, &device);
-        if (FAILED(hr))
+        int overhangLeft = 0;
+        int widest = 0;
+        for (int c = 0x20; c < 256; ++c)
         {
-            d3d->Release();
-            return false;
+            overhangLeft = std::max(overhangLeft, -abc[c].abcA);
+            widest = std::max(widest, std::max(abc[c].abcA, 0) + static_cast<int>(abc[c].abcB) + std::max(abc[c].abcC, 0));
         }
 
-        IDirect3DSurface9* surface = nullptr;
-        hr = device->CreateOffscreenPlainSurface(width, height, D3DFMT_A8R8G8B8, D3DPOOL_SYSTEMMEM, &surface, nullptr);
-        if (FAILED(hr))
+        const uint32_t originX = static_cast<uint32_t>(overhangLeft + 1);
+        const uint32_t cellW = originX + static_cast<uint32_t>(widest) + 2;
+        const uint32_t cellH = static_cast<uint32_t>(tm.tmHeight);
+        if (!ctx.Ensure(cellW * 16, cellH * 16)) return false;
+
+        for (uint32_t y = 0; y < cellH * 16; ++y)
+            std::memset(ctx.bits + y * ctx.Stride(), 0xFF, static_cast<size_t>(cellW) * 16 * 4);
+        for (int c = 0x20; c < 256; ++c)
         {
-            device->Release();
-            d3d->Release();
-            return false;
+            const wchar_t ch = static_cast<wchar_t>(c);
+            TextOutW(ctx.dc, static_cast<int>((c % 16) * cellW + originX), static_cast<int>((c / 16) * cellH), &ch, 1);
         }
+        GdiFlush();
 
-        D3DLOCKED_RECT lr{};
-        hr = surface->LockRect(&lr, nullptr, 0);
-        if (SUCCEEDED(hr))
+        atlas.cellWidth = cellW;
+        atlas.cellHeight = cellH;
+        atlas.originX = originX;
+        atlas.lineHeight = static_cast<uint32_t>(tm.tmHeight + tm.tmExternalLeading);
+        atlas.coverage.assign(static_cast<size_t>(cellW) * cellH * 256, 0);
+        for (int c = 0; c < 256; ++c)
         {
-            for (uint32_t y = 0; y < height; ++y)
-            {
-                auto* row = reinterpret_cast<uint8_t*>(static_cast<uint8_t*>(lr.pBits) + y * lr.Pitch);
-                for (uint32_t x = 0; x < width; ++x)
-                {
-                    const bool border = (x < 2 || y < 2 || x + 2 >= width || y + 2 >= height);
-                    row[x * 4 + 0] = border ? 0x80 : 0xF5;
-                    row[x * 4 + 1] = border ? 0x80 : 0xF0;
-                    row[x * 4 + 2] = border ? 0x80 : 0xE7;
-                    row[x * 4 + 3] = 0xFF;
-                }
-            }
-            surface->UnlockRect();
+            atlas.advance[c] = c < 0x20 ? 0 : static_cast<uint16_t>(std::max(abc[c].abcA + static_cast<int>(abc[c].abcB) + abc[c].abcC, 0));
+            if (c < 0x20) continue;
 
-            outBgra.resize(static_cast<size_t>(width) * static_cast<size_t>(height) * 4);
-            hr = surface->LockRect(&lr, nullptr, D3DLOCK_READONLY);
-            if (SUCCEEDED(hr))
+            uint8_t* cell = atlas.coverage.data() + static_cast<size_t>(c) * cellW * cellH;
+            for (uint32_t y = 0; y < cellH; ++y)
             {
-                for (uint32_t y = 0; y < height; ++y)
-                {
-                    std::memcpy(&outBgra[static_cast<size_t>(y) * width * 4],
-                        static_cast<uint8_t*>(lr.pBits) + y * lr.Pitch,
-                        static_cast<size_t>(width) * 4);
-                }
-                surface->UnlockRect();
+                const uint8_t* m = ctx.bits + ((c / 16) * cellH + y) * ctx.Stride() + static_cast<size_t>((c % 16) * cellW) * 4;
+                for (uint32_t x = 0; x < cellW; ++x) cell[y * cellW + x] = static_cast<uint8_t>(255u - m[x * 4 + 1]);
             }
         }
+        t_glyphAtlasMemory.Report(obbook::HeapBytes(atlas.coverage)); // atlas is this thread's t_glyphAtlas
+        return true;
+    }
 
-        surface->Release();
-        device->Release();
-        d3d->Release();
-        return !outBgra.empty();
+    // Draws text into the top-left w x h region of the mask. Returns false if GDI is unavailable.
+    static bool DrawTextMask(TextMaskContext& ctx, uint32_t w, uint32_t h)
+    {
+        OBBOOK_TRACE_SCOPE("RenderPreviewBgra.DrawText");
+        if (!ctx.Ensure(w, h)) return false;
+
+        for (uint32_t y = 0; y < h; ++y)
+            std::memset(ctx.bits + y * ctx.Stride(), 0xFF, static_cast<size_t>(w) * 4);
+
+        RECT rc{ 0, 0, static_cast<LONG>(w), static_cast<LONG>(h) };
+        DrawTextW(ctx.dc, ctx.text.c_str(), static_cast<int>(ctx.text.size()), &rc, DT_WORDBREAK | DT_TOP | DT_LEFT);
+        GdiFlush();
+        return true;
     }
 
-    static void DrawTextSoftware(uint32_t width, uint32_t height, const std::string& text, std::vector<uint8_t>& bgra)
+    static inline uint8_t Lerp255(uint8_t a, uint8_t b, uint32_t t)
     {
-        BITMAPINFO bmi{};
-        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-        bmi.bmiHeader.biWidth = static_cast<LONG>(width);
-        bmi.bmiHeader.biHeight = -static_cast<LONG>(height);
-        bmi.bmiHeader.biPlanes = 1;
-        bmi.bmiHeader.biBitCount = 32;
-        bmi.bmiHeader.biCompression = BI_RGB;
+        return static_cast<uint8_t>((a * (255u - t) + b * t + 127u) / 255u);
+    }
 
-        void* dibBits = nullptr;
-        HDC hdc = CreateCompatibleDC(nullptr);
-        HBITMAP dib = CreateDIBSection(hdc, &bmi, DIB_RGB_COLORS, &dibBits, nullptr, 0);
-        HGDIOBJ oldBmp = SelectObject(hdc, dib);
+    static void FillSpan(uint8_t* px, uint32_t count, Bgr c)
+    {
+        for (uint32_t x = 0; x < count; ++x, px += 4)
+        {
+            px[0] = c.b;
+            px[1] = c.g;
+            px[2] = c.r;
+            px[3] = 0xFF;
+        }
+    }
+}
 
-        if (!bgra.empty() && dibBits)
-            std::memcpy(dibBits, bgra.data(), bgra.size());
+bool obbook::RenderPreviewBgra(const RenderParams& p, const std::string& sourceUtf8, uint8_t* pixels, size_t strideBytes, std::string& outError)
+{
+    OBBOOK_TRACE_SCOPE("RenderPreviewBgra");
+    outError.clear();
 
-        SetTextColor(hdc, RGB(36, 36, 36));
-        SetBkMode(hdc, TRANSPARENT);
-        HFONT font = CreateFontW(22, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
-            DEFAULT_CHARSET, OUT_OUTLINE_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY,
-            FF_DONTCARE, L"Times New Roman");
-        HGDIOBJ oldFont = SelectObject(hdc, font);
+    if (p.width == 0 || p.height == 0)
+    {
+        outError = "Invalid render target size.";
+        return false;
+    }
+    if (!pixels || strideBytes < static_cast<size_t>(p.width) * 4)
+    {
+        outError = "Invalid render target buffer.";
+        return false;
+    }
 
-        RECT rc{ 48, 42, static_cast<LONG>(width) - 48, static_cast<LONG>(height) - 42 };
-        std::wstring wtext(text.begin(), text.end());
-        DrawTextW(hdc, wtext.c_str(), -1, &rc, DT_WORDBREAK | DT_TOP | DT_LEFT);
+    const uint32_t w = p.width;
+    const uint32_t h = p.height;
 
-        if (dibBits && bgra.size() == static_cast<size_t>(width) * static_cast<size_t>(height) * 4)
-            std::memcpy(bgra.data(), dibBits, bgra.size());
+    // Text block in page coordinates; empty when the page is smaller than the margins.
+    const uint32_t textX = static_cast<uint32_t>(kTextMarginX);
+    const uint32_t textY = static_cast<uint32_t>(kTextMarginY);
+    const uint32_t textW = w > 2 * textX ? w - 2 * textX : 0;
+    const uint32_t textH = h > 2 * textY ? h - 2 * textY : 0;
 
-        SelectObject(hdc, oldFont);
-        DeleteObject(font);
-        SelectObject(hdc, oldBmp);
-        DeleteObject(dib);
-        DeleteDC(hdc);
+    auto& mask = t_textMask;
+    bool hasText = false;
+    if (textW > 0 && textH > 0)
+    {
+        StripMarkup(sourceUtf8, mask.text);
+        mask.ReportMemory();
+        hasText = !mask.text.empty() && DrawTextMask(mask, textW, textH);
     }
+
+    OBBOOK_TRACE_SCOPE("RenderPreviewBgra.Compose");
+    for (uint32_t y = 0; y < h; ++y)
+    {
+        uint8_t* row = pixels + y * strideBytes;
+        if (y < kBorderPx || y + kBorderPx >= h || w <= 2 * kBorderPx)
+        {
+            FillSpan(row, w, kBorder);
+            continue;
+        }
+
+        FillSpan(row, kBorderPx, kBorder);
+        FillSpan(row + kBorderPx * 4, w - 2 * kBorderPx, kPaper);
+        FillSpan(row + static_cast<size_t>(w - kBorderPx) * 4, kBorderPx, kBorder);
+
+        if (!hasText || y < textY || y >= textY + textH) continue;
+
+        // Coverage is 255 minus the mask's green channel (black ink on a white mask).
+        const uint8_t* m = mask.bits + (y - textY) * mask.Stride();
+        uint8_t* px = row + static_cast<size_t>(textX) * 4;
+        for (uint32_t x = 0; x < textW; ++x, m += 4, px += 4)
+        {
+            const uint32_t coverage = 255u - m[1];
+            if (coverage == 0) continue;
+            px[0] = Lerp255(px[0], kInk.b, coverage);
+            px[1] = Lerp255(px[1], kInk.g, coverage);
+            px[2] = Lerp255(px[2], kInk.r, coverage);
+        }
+    }
+    return true;
 }
 
 bool obbook::RenderPreviewBgra(const RenderParams& p, const std::string& sourceUtf8, std::vector<uint8_t>& outBgra, std::string& outError)
 {
+    const size_t stride = static_cast<size_t>(p.width) * 4;
+    outBgra.resize(stride * static_cast<size_t>(p.height));
+    if (outBgra.empty())
+    {
+        outError = "Invalid render target size.";
+        return false;
+    }
+    return RenderPreviewBgra(p, sourceUtf8, outBgra.data(), stride, outError);
+}
+
+bool obbook::RenderBookPagesBgra(const std::string& sourceUtf8, const BookPagesRequest& request, BookPagesResult& result, std::string& outError)
+{
+    OBBOOK_TRACE_SCOPE("RenderBookPagesBgra");
     outError.clear();
+    if (request.geometry.width == 0 || request.geometry.height == 0)
+    {
+        outError = "Invalid render target size.";
+        return false;
+    }
 
-    if (p.width == 0 || p.height == 0)
+    auto& atlas = t_glyphAtlas;
+    if (atlas.coverage.empty() && !BuildGlyphAtlas(t_textMask, atlas))
+    {
+        outError = "Could not rasterize the preview font.";
+        return false;
+    }
+
+    RenderBookPages(sourceUtf8, atlas, request, result);
+    return true;
+}
+
+bool obbook::ExportBookPagesPng(const std::string& sourceUtf8, const BookPagesRequest& request, const BookPagesExport& output,
+    BookPagesExportResult& result, std::string& outError)
+{
+    OBBOOK_TRACE_SCOPE("ExportBookPagesPng");
+    outError.clear();
+    if (request.geometry.width == 0 || request.geometry.height == 0)
     {
         outError = "Invalid render target size.";
         return false;
     }
 
-    if (!TryDirect3D9Background(p.width, p.height, outBgra))
+    auto& atlas = t_glyphAtlas;
+    if (atlas.coverage.empty() && !BuildGlyphAtlas(t_textMask, atlas))
     {
-        const size_t stride = static_cast<size_t>(p.width) * 4;
-        outBgra.assign(stride * static_cast<size_t>(p.height), 0xFF);
-        for (uint32_t y = 0; y < p.height; ++y)
-        {
-            for (uint32_t x = 0; x < p.width; ++x)
-            {
-                uint8_t* px = &outBgra[(static_cast<size_t>(y) * p.width + x) * 4];
-                px[0] = 0xF5;
-                px[1] = 0xF0;
-                px[2] = 0xE7;
-                px[3] = 0xFF;
-            }
-        }
+        outError = "Could not rasterize the preview font.";
+        return false;
+    }
+
+    ExportBookPages(sourceUtf8, atlas, request, output, result);
+    if (result.failed != 0)
+    {
+        outError = std::to_string(result.failed) + " page(s) could not be written to " + output.directoryUtf8 + ".";
+        return false;
+    }
+    return true;
+}
+
+bool obbook::RunGoldenPagesWithPreviewFont(const std::vector<GoldenCase>& cases, const GoldenOptions& options, GoldenReport& report,
+    std::string& outError)
+{
+    OBBOOK_TRACE_SCOPE("RunGoldenPagesWithPreviewFont");
+    outError.clear();
+    if (options.request.geometry.width == 0 || options.request.geometry.height == 0)
+    {
+        outError = "Invalid render target size.";
+        return false;
+    }
+
+    auto& atlas = t_glyphAtlas;
+    if (atlas.coverage.empty() && !BuildGlyphAtlas(t_textMask, atlas))
+    {
+        outError = "Could not rasterize the preview font.";
+        return false;
     }
 
-    DrawTextSoftware(p.width, p.height, StripMarkup(sourceUtf8), outBgra);
+    RunGoldenPages(cases, atlas, options, report);
     return true;
 }
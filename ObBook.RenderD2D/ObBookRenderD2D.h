@@ -1,8 +1,12 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 #include <string>
 
+#include "../ObBook.Core/ObBookGolden.h"
+#include "../ObBook.Core/ObBookPages.h"
+
 namespace obbook
 {
     struct RenderParams
@@ -13,6 +17,28 @@ namespace obbook
     };
 
     // Renders a preview BGRA8 buffer from compiled/normalized markup-like source.
-    // Attempts a Direct3D9 path first and falls back to software rendering.
+    // outBgra is resized to width*height*4 and keeps its capacity, so reusing it avoids reallocation.
     bool RenderPreviewBgra(const RenderParams& p, const std::string& sourceUtf8, std::vector<uint8_t>& outBgra, std::string& outError);
+
+    // Renders straight into caller memory (e.g. a locked WriteableBitmap back buffer): p.width x p.height BGRA8
+    // pixels, rows strideBytes apart (>= width*4). The whole target is overwritten and nothing is staged in an
+    // intermediate frame; GDI objects and scratch buffers are retained per thread, so steady-state renders do
+    // not allocate.
+    bool RenderPreviewBgra(const RenderParams& p, const std::string& sourceUtf8, uint8_t* pixels, size_t strideBytes, std::string& outError);
+
+    // Renders a range of book pages (or all of them) into separate buffers on a worker pool; see RenderBookPages.
+    // Glyphs are rasterized with the preview font into a per-thread atlas on first use and shared read-only by
+    // the workers, which compose pages without touching GDI.
+    bool RenderBookPagesBgra(const std::string& sourceUtf8, const BookPagesRequest& request, BookPagesResult& result, std::string& outError);
+
+    // Renders a range of book pages (or all of them) to PNG files on a worker pool; see ExportBookPages. False
+    // with outError set when the size is invalid, the font cannot be rasterized or any page failed to write
+    // (result still lists the pages that were written).
+    bool ExportBookPagesPng(const std::string& sourceUtf8, const BookPagesRequest& request, const BookPagesExport& output,
+        BookPagesExportResult& result, std::string& outError);
+
+    // Golden-image regression run with the preview font; see RunGoldenPages. False only when the size is invalid
+    // or the font cannot be rasterized; failed cases are reported in report.
+    bool RunGoldenPagesWithPreviewFont(const std::vector<GoldenCase>& cases, const GoldenOptions& options, GoldenReport& report,
+        std::string& outError);
 }